@@ -0,0 +1,809 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	CPU decoder for LDR ASTC blocks, for devices that can't sample ASTC.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "AstcDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	constexpr uint32_t MAX_WEIGHTS = 64;
+	constexpr uint32_t MAX_COLOUR_VALUES = 18;
+	constexpr uint32_t MAX_PARTITIONS = 4;
+
+	// Every range the integer sequence encoding can store, each value as an optional trit or quint above some plain bits.
+	struct IseRange
+	{
+		uint32_t levels;
+		bool trit;
+		bool quint;
+		uint32_t bits;
+	};
+
+	// Weights use the first twelve, indexed straight from the block mode. Colours use the highest that fits.
+	constexpr IseRange ISE_RANGES[] =
+	{
+		{ 2, false, false, 1 },		{ 3, true, false, 0 },		{ 4, false, false, 2 },		{ 5, false, true, 0 },
+		{ 6, true, false, 1 },		{ 8, false, false, 3 },		{ 10, false, true, 1 },		{ 12, true, false, 2 },
+		{ 16, false, false, 4 },	{ 20, false, true, 2 },		{ 24, true, false, 3 },		{ 32, false, false, 5 },
+		{ 40, false, true, 3 },		{ 48, true, false, 4 },		{ 64, false, false, 6 },	{ 80, false, true, 4 },
+		{ 96, true, false, 5 },		{ 128, false, false, 7 },	{ 160, false, true, 5 },	{ 192, true, false, 6 },
+		{ 256, false, false, 8 }
+	};
+	constexpr uint32_t ISE_RANGE_COUNT = static_cast<uint32_t>(sizeof(ISE_RANGES) / sizeof(ISE_RANGES[0]));
+	constexpr uint32_t LOWEST_COLOUR_RANGE = 4;	// Six levels. A block that can't fit that many is invalid.
+
+	// =============================================================================================================================================================
+	// Bits.
+
+	// Bits at or past end read as zero, the last trit or quint group of a sequence is allowed to be cut short.
+	uint32_t ReadBits(const uint8_t* pBits, uint32_t position, uint32_t count, uint32_t end)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < count && position + i < end; i++)
+		{
+			const uint32_t BIT = position + i;
+			value |= ((pBits[BIT >> 3] >> (BIT & 7)) & 1u) << i;
+		}
+		return value;
+	}
+
+	// Stretch an n bit value to more bits by repeating it, so all zeros and all ones map to the ends of the range.
+	uint32_t ReplicateBits(uint32_t value, uint32_t bits, uint32_t targetBits)
+	{
+		uint32_t result = 0;
+		int32_t shift = static_cast<int32_t>(targetBits);
+		while (shift > 0)
+		{
+			shift -= static_cast<int32_t>(bits);
+			result |= shift >= 0 ? value << shift : value >> -shift;
+		}
+		return result & ((1u << targetBits) - 1);
+	}
+
+	// =============================================================================================================================================================
+	// Integer sequence encoding. Five trits pack into 8 bits and three quints into 7, spread between the plain bits.
+
+	uint32_t IseBitCount(const IseRange& range, uint32_t count)
+	{
+		return range.bits * count + (range.trit ? (8 * count + 4) / 5 : 0) + (range.quint ? (7 * count + 2) / 3 : 0);
+	}
+
+	void UnpackTrits(uint32_t packed, uint32_t trits[5])
+	{
+		uint32_t c;
+		if (((packed >> 2) & 7) == 7)
+		{
+			c = (((packed >> 5) & 7) << 2) | (packed & 3);
+			trits[4] = 2;
+			trits[3] = 2;
+		}
+		else
+		{
+			c = packed & 0x1F;
+			if (((packed >> 5) & 3) == 3)
+			{
+				trits[4] = 2;
+				trits[3] = (packed >> 7) & 1;
+			}
+			else
+			{
+				trits[4] = (packed >> 7) & 1;
+				trits[3] = (packed >> 5) & 3;
+			}
+		}
+
+		if ((c & 3) == 3)
+		{
+			trits[2] = 2;
+			trits[1] = (c >> 4) & 1;
+			trits[0] = (((c >> 3) & 1) << 1) | ((c >> 2) & 1 & ~(c >> 3));
+		}
+		else if (((c >> 2) & 3) == 3)
+		{
+			trits[2] = 2;
+			trits[1] = 2;
+			trits[0] = c & 3;
+		}
+		else
+		{
+			trits[2] = (c >> 4) & 1;
+			trits[1] = (c >> 2) & 3;
+			trits[0] = (((c >> 1) & 1) << 1) | (c & 1 & ~(c >> 1));
+		}
+	}
+
+	void UnpackQuints(uint32_t packed, uint32_t quints[3])
+	{
+		if (((packed >> 1) & 3) == 3 && ((packed >> 5) & 3) == 0)
+		{
+			const uint32_t LOW = packed & 1;
+			quints[2] = (LOW << 2) | ((((packed >> 4) & 1) & ~LOW) << 1) | (((packed >> 3) & 1) & ~LOW);
+			quints[1] = 4;
+			quints[0] = 4;
+			return;
+		}
+
+		uint32_t c;
+		if (((packed >> 1) & 3) == 3)
+		{
+			quints[2] = 4;
+			c = (((packed >> 3) & 3) << 3) | ((~(packed >> 5) & 3) << 1) | (packed & 1);
+		}
+		else
+		{
+			quints[2] = (packed >> 5) & 3;
+			c = packed & 0x1F;
+		}
+
+		if ((c & 7) == 5)
+		{
+			quints[1] = 4;
+			quints[0] = (c >> 3) & 3;
+		}
+		else
+		{
+			quints[1] = (c >> 3) & 3;
+			quints[0] = c & 7;
+		}
+	}
+
+	void DecodeIse(const uint8_t* pBits, uint32_t start, const IseRange& range, uint32_t count, uint32_t* pOut)
+	{
+		const uint32_t END = start + IseBitCount(range, count);
+		const uint32_t BITS = range.bits;
+		uint32_t position = start;
+
+		auto read = [&](uint32_t bitCount)
+		{
+			const uint32_t VALUE = ReadBits(pBits, position, bitCount, END);
+			position += bitCount;
+			return VALUE;
+		};
+
+		if (range.trit)
+		{
+			// m0 T[1:0] m1 T[3:2] m2 T[4] m3 T[6:5] m4 T[7]
+			constexpr uint32_t PACKED_BITS[5] = { 2, 2, 1, 2, 1 };
+			for (uint32_t first = 0; first < count; first += 5)
+			{
+				uint32_t low[5];
+				uint32_t packed = 0;
+				uint32_t packedShift = 0;
+				for (uint32_t i = 0; i < 5; i++)
+				{
+					low[i] = read(BITS);
+					packed |= read(PACKED_BITS[i]) << packedShift;
+					packedShift += PACKED_BITS[i];
+				}
+
+				uint32_t trits[5];
+				UnpackTrits(packed, trits);
+				for (uint32_t i = 0; i < 5 && first + i < count; i++)
+				{
+					pOut[first + i] = (trits[i] << BITS) | low[i];
+				}
+			}
+		}
+		else if (range.quint)
+		{
+			// m0 Q[2:0] m1 Q[4:3] m2 Q[6:5]
+			constexpr uint32_t PACKED_BITS[3] = { 3, 2, 2 };
+			for (uint32_t first = 0; first < count; first += 3)
+			{
+				uint32_t low[3];
+				uint32_t packed = 0;
+				uint32_t packedShift = 0;
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					low[i] = read(BITS);
+					packed |= read(PACKED_BITS[i]) << packedShift;
+					packedShift += PACKED_BITS[i];
+				}
+
+				uint32_t quints[3];
+				UnpackQuints(packed, quints);
+				for (uint32_t i = 0; i < 3 && first + i < count; i++)
+				{
+					pOut[first + i] = (quints[i] << BITS) | low[i];
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				pOut[i] = read(BITS);
+			}
+		}
+	}
+
+	// =============================================================================================================================================================
+	// Unquantisation. Trit and quint ranges scale the trit or quint and scatter the plain bits over it, as the spec lays out.
+
+	// To 0-255.
+	uint32_t UnquantiseColour(uint32_t value, const IseRange& range)
+	{
+		if (!range.trit && !range.quint)
+		{
+			return ReplicateBits(value, range.bits, 8);
+		}
+
+		const uint32_t A = (value & 1) ? 0x1FF : 0;
+		const uint32_t B_BIT = (value >> 1) & 1;
+		const uint32_t C_BIT = (value >> 2) & 1;
+		const uint32_t D_BIT = (value >> 3) & 1;
+		const uint32_t E_BIT = (value >> 4) & 1;
+		const uint32_t F_BIT = (value >> 5) & 1;
+		const uint32_t D = value >> range.bits;
+
+		uint32_t b = 0;
+		uint32_t c = 0;
+		if (range.trit)
+		{
+			switch (range.bits)
+			{
+			case 1: c = 204; break;
+			case 2: c = 93; b = B_BIT * 0x116; break;
+			case 3: c = 44; b = C_BIT * 0x10A + B_BIT * 0x85; break;
+			case 4: c = 22; b = D_BIT * 0x104 + C_BIT * 0x82 + B_BIT * 0x41; break;
+			case 5: c = 11; b = E_BIT * 0x102 + D_BIT * 0x81 + C_BIT * 0x40 + B_BIT * 0x20; break;
+			case 6: c = 5; b = F_BIT * 0x101 + E_BIT * 0x80 + D_BIT * 0x40 + C_BIT * 0x20 + B_BIT * 0x10; break;
+			}
+		}
+		else
+		{
+			switch (range.bits)
+			{
+			case 1: c = 113; break;
+			case 2: c = 54; b = B_BIT * 0x10C; break;
+			case 3: c = 26; b = C_BIT * 0x105 + B_BIT * 0x82; break;
+			case 4: c = 13; b = D_BIT * 0x102 + C_BIT * 0x81 + B_BIT * 0x40; break;
+			case 5: c = 6; b = E_BIT * 0x101 + D_BIT * 0x80 + C_BIT * 0x40 + B_BIT * 0x20; break;
+			}
+		}
+
+		const uint32_t T = (D * c + b) ^ A;
+		return (A & 0x80) | (T >> 2);
+	}
+
+	// To 0-64.
+	uint32_t UnquantiseWeight(uint32_t value, const IseRange& range)
+	{
+		uint32_t weight;
+		if (!range.trit && !range.quint)
+		{
+			weight = ReplicateBits(value, range.bits, 6);
+		}
+		else if (range.bits == 0)
+		{
+			return value * (range.trit ? 32 : 16);
+		}
+		else
+		{
+			const uint32_t A = (value & 1) ? 0x7F : 0;
+			const uint32_t B_BIT = (value >> 1) & 1;
+			const uint32_t C_BIT = (value >> 2) & 1;
+			const uint32_t D = value >> range.bits;
+
+			uint32_t b = 0;
+			uint32_t c = 0;
+			if (range.trit)
+			{
+				switch (range.bits)
+				{
+				case 1: c = 50; break;
+				case 2: c = 23; b = B_BIT * 0x45; break;
+				case 3: c = 11; b = C_BIT * 0x42 + B_BIT * 0x21; break;
+				}
+			}
+			else
+			{
+				switch (range.bits)
+				{
+				case 1: c = 28; break;
+				case 2: c = 13; b = B_BIT * 0x42; break;
+				}
+			}
+
+			const uint32_t T = (D * c + b) ^ A;
+			weight = (A & 0x20) | (T >> 2);
+		}
+
+		return weight > 32 ? weight + 1 : weight;
+	}
+
+	// =============================================================================================================================================================
+	// Block layout.
+
+	struct BlockMode
+	{
+		uint32_t gridWidth = 0;
+		uint32_t gridHeight = 0;
+		uint32_t weightRange = 0;
+		bool dualPlane = false;
+	};
+
+	// The 11 bit block mode packs the weight grid size, weight range and dual plane flag a dozen different ways.
+	bool DecodeBlockMode(uint32_t mode, BlockMode& result)
+	{
+		uint32_t range = (mode >> 4) & 1;
+		uint32_t high = (mode >> 9) & 1;
+		uint32_t dual = (mode >> 10) & 1;
+		const uint32_t A = (mode >> 5) & 3;
+
+		if ((mode & 3) != 0)
+		{
+			range |= (mode & 3) << 1;
+			const uint32_t B = (mode >> 7) & 3;
+			switch ((mode >> 2) & 3)
+			{
+			case 0: result.gridWidth = B + 4; result.gridHeight = A + 2; break;
+			case 1: result.gridWidth = B + 8; result.gridHeight = A + 2; break;
+			case 2: result.gridWidth = A + 2; result.gridHeight = B + 8; break;
+			case 3:
+				if (mode & 0x100)
+				{
+					result.gridWidth = (B & 1) + 2;
+					result.gridHeight = A + 2;
+				}
+				else
+				{
+					result.gridWidth = A + 2;
+					result.gridHeight = (B & 1) + 6;
+				}
+				break;
+			}
+		}
+		else
+		{
+			range |= ((mode >> 2) & 3) << 1;
+			if (((mode >> 2) & 3) == 0)
+			{
+				return false;
+			}
+
+			const uint32_t B = (mode >> 9) & 3;
+			switch ((mode >> 7) & 3)
+			{
+			case 0: result.gridWidth = 12; result.gridHeight = A + 2; break;
+			case 1: result.gridWidth = A + 2; result.gridHeight = 12; break;
+			case 2:
+				// The high range and dual plane bits hold B here.
+				result.gridWidth = A + 6;
+				result.gridHeight = B + 6;
+				high = 0;
+				dual = 0;
+				break;
+			case 3:
+				if (A == 0)
+				{
+					result.gridWidth = 6;
+					result.gridHeight = 10;
+				}
+				else if (A == 1)
+				{
+					result.gridWidth = 10;
+					result.gridHeight = 6;
+				}
+				else
+				{
+					return false;
+				}
+				break;
+			}
+		}
+
+		result.weightRange = range - 2 + 6 * high;
+		result.dualPlane = dual != 0;
+		return true;
+	}
+
+	// The spec's hash from a partition pattern index and texel position to a partition.
+	uint32_t SelectPartition(uint32_t seed, uint32_t x, uint32_t y, uint32_t partitionCount, bool smallBlock)
+	{
+		if (smallBlock)
+		{
+			x <<= 1;
+			y <<= 1;
+		}
+
+		seed += (partitionCount - 1) * 1024;
+
+		uint32_t rnum = seed;
+		rnum ^= rnum >> 15;
+		rnum *= 0xEEDE0891;
+		rnum ^= rnum >> 5;
+		rnum += rnum << 16;
+		rnum ^= rnum >> 7;
+		rnum ^= rnum >> 3;
+		rnum ^= rnum << 6;
+		rnum ^= rnum >> 17;
+
+		uint32_t seeds[8];
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			const uint32_t NIBBLE = (rnum >> (i * 4)) & 0xF;
+			seeds[i] = NIBBLE * NIBBLE;
+		}
+
+		uint32_t shiftA;
+		uint32_t shiftB;
+		if (seed & 1)
+		{
+			shiftA = (seed & 2) ? 4 : 5;
+			shiftB = partitionCount == 3 ? 6 : 5;
+		}
+		else
+		{
+			shiftA = partitionCount == 3 ? 6 : 5;
+			shiftB = (seed & 2) ? 4 : 5;
+		}
+
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			seeds[i] >>= (i & 1) ? shiftB : shiftA;
+		}
+
+		// The z terms of the 3D form drop out, a 2D block is the z = 0 slice.
+		uint32_t a = (seeds[0] * x + seeds[1] * y + (rnum >> 14)) & 0x3F;
+		uint32_t b = (seeds[2] * x + seeds[3] * y + (rnum >> 10)) & 0x3F;
+		uint32_t c = (seeds[4] * x + seeds[5] * y + (rnum >> 6)) & 0x3F;
+		uint32_t d = (seeds[6] * x + seeds[7] * y + (rnum >> 2)) & 0x3F;
+
+		if (partitionCount < 4)
+		{
+			d = 0;
+		}
+		if (partitionCount < 3)
+		{
+			c = 0;
+		}
+
+		if (a >= b && a >= c && a >= d)
+		{
+			return 0;
+		}
+		if (b >= c && b >= d)
+		{
+			return 1;
+		}
+		return c >= d ? 2 : 3;
+	}
+
+	// =============================================================================================================================================================
+	// Endpoints.
+
+	bool IsHdrEndpointMode(uint32_t mode)
+	{
+		return mode == 2 || mode == 3 || mode == 7 || mode == 11 || mode == 14 || mode == 15;
+	}
+
+	// Moves the top bit of an offset into its base and sign extends what's left of the offset.
+	void BitTransferSigned(int32_t& offset, int32_t& base)
+	{
+		base >>= 1;
+		base |= offset & 0x80;
+		offset >>= 1;
+		offset &= 0x3F;
+		if (offset & 0x20)
+		{
+			offset -= 0x40;
+		}
+	}
+
+	void SetColour(int32_t colour[4], int32_t r, int32_t g, int32_t b, int32_t a)
+	{
+		colour[0] = std::min(std::max(r, 0), 255);
+		colour[1] = std::min(std::max(g, 0), 255);
+		colour[2] = std::min(std::max(b, 0), 255);
+		colour[3] = std::min(std::max(a, 0), 255);
+	}
+
+	// Red and green pulled towards blue, before clamping. Encoders use it, signalled by swapped endpoints, for more precision near grey.
+	void SetBlueContracted(int32_t colour[4], int32_t r, int32_t g, int32_t b, int32_t a)
+	{
+		SetColour(colour, (r + b) >> 1, (g + b) >> 1, b, a);
+	}
+
+	void DecodeEndpoints(uint32_t mode, const uint32_t* pValues, int32_t e0[4], int32_t e1[4])
+	{
+		int32_t v[8];
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			v[i] = i < ((mode >> 2) + 1) * 2 ? static_cast<int32_t>(pValues[i]) : 0;
+		}
+
+		switch (mode)
+		{
+		case 0: // Luminance.
+			SetColour(e0, v[0], v[0], v[0], 255);
+			SetColour(e1, v[1], v[1], v[1], 255);
+			break;
+
+		case 1: // Luminance, base and offset.
+		{
+			const int32_t L0 = (v[0] >> 2) | (v[1] & 0xC0);
+			const int32_t L1 = L0 + (v[1] & 0x3F);
+			SetColour(e0, L0, L0, L0, 255);
+			SetColour(e1, L1, L1, L1, 255);
+			break;
+		}
+
+		case 4: // Luminance and alpha.
+			SetColour(e0, v[0], v[0], v[0], v[2]);
+			SetColour(e1, v[1], v[1], v[1], v[3]);
+			break;
+
+		case 5: // Luminance and alpha, base and offset.
+			BitTransferSigned(v[1], v[0]);
+			BitTransferSigned(v[3], v[2]);
+			SetColour(e0, v[0], v[0], v[0], v[2]);
+			SetColour(e1, v[0] + v[1], v[0] + v[1], v[0] + v[1], v[2] + v[3]);
+			break;
+
+		case 6: // RGB and a scale for the first endpoint.
+			SetColour(e0, (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, 255);
+			SetColour(e1, v[0], v[1], v[2], 255);
+			break;
+
+		case 8: // RGB.
+		case 12: // RGBA.
+		{
+			const int32_t A0 = mode == 12 ? v[6] : 255;
+			const int32_t A1 = mode == 12 ? v[7] : 255;
+			if (v[1] + v[3] + v[5] >= v[0] + v[2] + v[4])
+			{
+				SetColour(e0, v[0], v[2], v[4], A0);
+				SetColour(e1, v[1], v[3], v[5], A1);
+			}
+			else
+			{
+				SetBlueContracted(e0, v[1], v[3], v[5], A1);
+				SetBlueContracted(e1, v[0], v[2], v[4], A0);
+			}
+			break;
+		}
+
+		case 9: // RGB, base and offset.
+		case 13: // RGBA, base and offset.
+		{
+			BitTransferSigned(v[1], v[0]);
+			BitTransferSigned(v[3], v[2]);
+			BitTransferSigned(v[5], v[4]);
+			if (mode == 13)
+			{
+				BitTransferSigned(v[7], v[6]);
+			}
+			else
+			{
+				v[6] = 255;
+				v[7] = 0;
+			}
+
+			if (v[1] + v[3] + v[5] >= 0)
+			{
+				SetColour(e0, v[0], v[2], v[4], v[6]);
+				SetColour(e1, v[0] + v[1], v[2] + v[3], v[4] + v[5], v[6] + v[7]);
+			}
+			else
+			{
+				SetBlueContracted(e0, v[0] + v[1], v[2] + v[3], v[4] + v[5], v[6] + v[7]);
+				SetBlueContracted(e1, v[0], v[2], v[4], v[6]);
+			}
+			break;
+		}
+
+		case 10: // RGB and a scale, plus two alphas.
+			SetColour(e0, (v[0] * v[3]) >> 8, (v[1] * v[3]) >> 8, (v[2] * v[3]) >> 8, v[4]);
+			SetColour(e1, v[0], v[1], v[2], v[5]);
+			break;
+		}
+	}
+
+	void FillErrorColour(uint32_t texelCount, uint8_t* pOutRgba)
+	{
+		for (uint32_t i = 0; i < texelCount; i++)
+		{
+			pOutRgba[i * 4 + 0] = 255;
+			pOutRgba[i * 4 + 1] = 0;
+			pOutRgba[i * 4 + 2] = 255;
+			pOutRgba[i * 4 + 3] = 255;
+		}
+	}
+}
+
+void DecodeAstcBlock(const uint8_t* pBlock, uint32_t blockWidth, uint32_t blockHeight, bool srgb, uint8_t* pOutRgba)
+{
+	constexpr uint32_t END = 128;
+	const uint32_t TEXEL_COUNT = blockWidth * blockHeight;
+	const uint32_t BLOCK_MODE = ReadBits(pBlock, 0, 11, END);
+
+	// Void extent, one colour for the whole block. The extent coordinates only help encoders, we don't need them.
+	if ((BLOCK_MODE & 0x1FF) == 0x1FC)
+	{
+		if ((BLOCK_MODE & 0x200) != 0 || ReadBits(pBlock, 10, 2, END) != 3)
+		{
+			FillErrorColour(TEXEL_COUNT, pOutRgba);
+			return;
+		}
+
+		uint8_t colour[4];
+		for (uint32_t ch = 0; ch < 4; ch++)
+		{
+			colour[ch] = static_cast<uint8_t>(ReadBits(pBlock, 64 + ch * 16, 16, END) >> 8);
+		}
+		for (uint32_t i = 0; i < TEXEL_COUNT; i++)
+		{
+			std::memcpy(&pOutRgba[i * 4], colour, 4);
+		}
+		return;
+	}
+
+	BlockMode mode;
+	if (!DecodeBlockMode(BLOCK_MODE, mode) || mode.gridWidth > blockWidth || mode.gridHeight > blockHeight)
+	{
+		FillErrorColour(TEXEL_COUNT, pOutRgba);
+		return;
+	}
+
+	const uint32_t PARTITION_COUNT = ReadBits(pBlock, 11, 2, END) + 1;
+	const uint32_t PLANE_COUNT = mode.dualPlane ? 2 : 1;
+	const uint32_t WEIGHT_COUNT = mode.gridWidth * mode.gridHeight * PLANE_COUNT;
+	const IseRange& WEIGHT_RANGE = ISE_RANGES[mode.weightRange];
+	const uint32_t WEIGHT_BITS = IseBitCount(WEIGHT_RANGE, WEIGHT_COUNT);
+
+	if (WEIGHT_COUNT > MAX_WEIGHTS || WEIGHT_BITS < 24 || WEIGHT_BITS > 96 || (mode.dualPlane && PARTITION_COUNT == MAX_PARTITIONS))
+	{
+		FillErrorColour(TEXEL_COUNT, pOutRgba);
+		return;
+	}
+
+	// Endpoint modes. With more than one partition they can differ, and then spill below the weights.
+	uint32_t endpointModes[MAX_PARTITIONS];
+	uint32_t partitionIndex = 0;
+	uint32_t extraModeBits = 0;
+	uint32_t colourStart = 17;
+	if (PARTITION_COUNT == 1)
+	{
+		endpointModes[0] = ReadBits(pBlock, 13, 4, END);
+	}
+	else
+	{
+		colourStart = 29;
+		partitionIndex = ReadBits(pBlock, 13, 10, END);
+
+		const uint32_t SELECTOR = ReadBits(pBlock, 23, 2, END);
+		if (SELECTOR == 0)
+		{
+			std::fill(endpointModes, endpointModes + PARTITION_COUNT, ReadBits(pBlock, 25, 4, END));
+		}
+		else
+		{
+			// One class bit per partition, then two mode bits each, relative to the smallest class.
+			extraModeBits = 3 * PARTITION_COUNT - 4;
+			const uint32_t ENCODED = ReadBits(pBlock, 25, 4, END) | (ReadBits(pBlock, END - WEIGHT_BITS - extraModeBits, extraModeBits, END) << 4);
+			const uint32_t BASE_CLASS = SELECTOR - 1;
+			for (uint32_t i = 0; i < PARTITION_COUNT; i++)
+			{
+				endpointModes[i] = ((((ENCODED >> i) & 1) + BASE_CLASS) << 2) | ((ENCODED >> (PARTITION_COUNT + 2 * i)) & 3);
+			}
+		}
+	}
+
+	// Which channel, if any, has its own plane of weights. Stored just below the weights and any extra mode bits.
+	const uint32_t BELOW_WEIGHTS = END - WEIGHT_BITS - extraModeBits;
+	const uint32_t SECOND_PLANE_CHANNEL = mode.dualPlane ? ReadBits(pBlock, BELOW_WEIGHTS - 2, 2, END) : 4;
+
+	uint32_t colourValueCount = 0;
+	for (uint32_t i = 0; i < PARTITION_COUNT; i++)
+	{
+		if (IsHdrEndpointMode(endpointModes[i]))
+		{
+			FillErrorColour(TEXEL_COUNT, pOutRgba);
+			return;
+		}
+		colourValueCount += ((endpointModes[i] >> 2) + 1) * 2;
+	}
+
+	const int32_t COLOUR_BITS = static_cast<int32_t>(BELOW_WEIGHTS) - static_cast<int32_t>(colourStart) - (mode.dualPlane ? 2 : 0);
+	if (colourValueCount > MAX_COLOUR_VALUES || COLOUR_BITS < 0)
+	{
+		FillErrorColour(TEXEL_COUNT, pOutRgba);
+		return;
+	}
+
+	// Endpoints take the finest range that fits whatever the weights and modes left.
+	uint32_t colourRange = ISE_RANGE_COUNT - 1;
+	while (colourRange > 0 && IseBitCount(ISE_RANGES[colourRange], colourValueCount) > static_cast<uint32_t>(COLOUR_BITS))
+	{
+		colourRange--;
+	}
+	if (colourRange < LOWEST_COLOUR_RANGE)
+	{
+		FillErrorColour(TEXEL_COUNT, pOutRgba);
+		return;
+	}
+
+	uint32_t colourValues[MAX_COLOUR_VALUES];
+	DecodeIse(pBlock, colourStart, ISE_RANGES[colourRange], colourValueCount, colourValues);
+	for (uint32_t i = 0; i < colourValueCount; i++)
+	{
+		colourValues[i] = UnquantiseColour(colourValues[i], ISE_RANGES[colourRange]);
+	}
+
+	int32_t endpoints[MAX_PARTITIONS][2][4];
+	const uint32_t* pValues = colourValues;
+	for (uint32_t i = 0; i < PARTITION_COUNT; i++)
+	{
+		DecodeEndpoints(endpointModes[i], pValues, endpoints[i][0], endpoints[i][1]);
+		pValues += ((endpointModes[i] >> 2) + 1) * 2;
+	}
+
+	// Weights are stored from the top of the block down, bit reversed, so read them from a reversed copy.
+	uint8_t reversed[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint8_t byte = pBlock[15 - i];
+		byte = static_cast<uint8_t>(((byte & 0xF0) >> 4) | ((byte & 0x0F) << 4));
+		byte = static_cast<uint8_t>(((byte & 0xCC) >> 2) | ((byte & 0x33) << 2));
+		byte = static_cast<uint8_t>(((byte & 0xAA) >> 1) | ((byte & 0x55) << 1));
+		reversed[i] = byte;
+	}
+
+	uint32_t weights[MAX_WEIGHTS];
+	DecodeIse(reversed, 0, WEIGHT_RANGE, WEIGHT_COUNT, weights);
+
+	// Split the planes, padded so the bilinear taps past the last row and column read a zero they then don't use.
+	uint32_t planeWeights[2][MAX_WEIGHTS + 16] = {};
+	for (uint32_t i = 0; i < WEIGHT_COUNT; i++)
+	{
+		planeWeights[i % PLANE_COUNT][i / PLANE_COUNT] = UnquantiseWeight(weights[i], WEIGHT_RANGE);
+	}
+
+	// The weight grid can be coarser than the block, each texel takes a bilinear blend of the four nearest weights.
+	const uint32_t SCALE_X = (1024 + blockWidth / 2) / (blockWidth - 1);
+	const uint32_t SCALE_Y = (1024 + blockHeight / 2) / (blockHeight - 1);
+	const bool SMALL_BLOCK = TEXEL_COUNT < 31;
+
+	for (uint32_t y = 0; y < blockHeight; y++)
+	{
+		for (uint32_t x = 0; x < blockWidth; x++)
+		{
+			const uint32_t GRID_X = (SCALE_X * x * (mode.gridWidth - 1) + 32) >> 6;
+			const uint32_t GRID_Y = (SCALE_Y * y * (mode.gridHeight - 1) + 32) >> 6;
+			const uint32_t FRAC_X = GRID_X & 0xF;
+			const uint32_t FRAC_Y = GRID_Y & 0xF;
+			const uint32_t BASE = (GRID_X >> 4) + (GRID_Y >> 4) * mode.gridWidth;
+
+			const uint32_t W11 = (FRAC_X * FRAC_Y + 8) >> 4;
+			const uint32_t W10 = FRAC_Y - W11;
+			const uint32_t W01 = FRAC_X - W11;
+			const uint32_t W00 = 16 - FRAC_X - FRAC_Y + W11;
+
+			uint32_t texelWeights[2];
+			for (uint32_t plane = 0; plane < PLANE_COUNT; plane++)
+			{
+				const uint32_t* pGrid = planeWeights[plane];
+				texelWeights[plane] = (pGrid[BASE] * W00 + pGrid[BASE + 1] * W01 + pGrid[BASE + mode.gridWidth] * W10 + pGrid[BASE + mode.gridWidth + 1] * W11 + 8) >> 4;
+			}
+
+			const uint32_t PARTITION = PARTITION_COUNT > 1 ? SelectPartition(partitionIndex, x, y, PARTITION_COUNT, SMALL_BLOCK) : 0;
+			const int32_t(&e)[2][4] = endpoints[PARTITION];
+
+			// Interpolated at 16 bits, as the spec does, and the top 8 kept.
+			uint8_t* pTexel = &pOutRgba[(y * blockWidth + x) * 4];
+			for (uint32_t ch = 0; ch < 4; ch++)
+			{
+				const uint32_t WEIGHT = texelWeights[ch == SECOND_PLANE_CHANNEL ? 1 : 0];
+				const uint32_t C0 = srgb ? (static_cast<uint32_t>(e[0][ch]) << 8) | 0x80 : static_cast<uint32_t>(e[0][ch]) * 257;
+				const uint32_t C1 = srgb ? (static_cast<uint32_t>(e[1][ch]) << 8) | 0x80 : static_cast<uint32_t>(e[1][ch]) * 257;
+				pTexel[ch] = static_cast<uint8_t>(((C0 * (64 - WEIGHT) + C1 * WEIGHT + 32) >> 6) >> 8);
+			}
+		}
+	}
+}
@@ -0,0 +1,16 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	CPU decoder for LDR ASTC blocks, for devices that can't sample ASTC.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <cstdint>
+
+/*
+	Decodes one 128 bit ASTC block of any 2D footprint to blockWidth * blockHeight tightly packed RGBA8 texels.
+	Only LDR content is supported, as the only formats we load are the UNORM and SRGB ones. Blocks that are invalid,
+	or use HDR endpoints, decode to the error colour the spec gives, opaque magenta, rather than failing the texture.
+*/
+void DecodeAstcBlock(const uint8_t* pBlock, uint32_t blockWidth, uint32_t blockHeight, bool srgb, uint8_t* pOutRgba);
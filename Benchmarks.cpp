@@ -0,0 +1,435 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	CPU benchmarks for the scene systems, run with --bench instead of opening a window.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "Benchmarks.h"
+#include "Bvh.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "Meshlets.h"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iomanip>
+#include <cstdint>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Fixed seed, so runs compare like with like.
+	constexpr uint32_t SEED = 1234;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Boxes of mixed sizes scattered through a cube whose volume grows with the count, so density stays about the same.
+	std::vector<Aabb> MakeScene(uint32_t count, std::mt19937& random)
+	{
+		const float SIDE = std::cbrt(static_cast<float>(count)) * 4.0f;
+		std::uniform_real_distribution<float> position(-SIDE * 0.5f, SIDE * 0.5f);
+		std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+		std::vector<Aabb> vBounds(count);
+		for (Aabb& box : vBounds)
+		{
+			const Float3 CENTER = { position(random), position(random), position(random) };
+			const Float3 HALF = { size(random), size(random), size(random) };
+			box = { CENTER - HALF, CENTER + HALF };
+		}
+
+		return vBounds;
+	}
+
+	// A perspective camera at the origin looking down -z, 60 degrees, yawed by angle.
+	Frustum MakeFrustum(float angle, float farPlane)
+	{
+		const float F = 1.0f / std::tan(0.5f * 1.0472f);
+		const float NEAR_PLANE = 0.1f;
+		Float4x4 projection{};
+		projection.m[0] = F;
+		projection.m[5] = -F;
+		projection.m[10] = farPlane / (NEAR_PLANE - farPlane);
+		projection.m[11] = -1.0f;
+		projection.m[14] = NEAR_PLANE * farPlane / (NEAR_PLANE - farPlane);
+
+		Float4x4 view = Float4x4::Identity();
+		view.m[0] = std::cos(angle);
+		view.m[2] = std::sin(angle);
+		view.m[8] = -std::sin(angle);
+		view.m[10] = std::cos(angle);
+
+		Float4x4 viewProjection;
+		Multiply(projection, view, viewProjection);
+		return Frustum::FromViewProjection(viewProjection);
+	}
+
+	bool Outside(const Frustum& frustum, const Aabb& box)
+	{
+		for (const Plane& PLANE : frustum.planes)
+		{
+			const Float3 CORNER = { PLANE.normal.x >= 0.0f ? box.max.x : box.min.x, PLANE.normal.y >= 0.0f ? box.max.y : box.min.y, PLANE.normal.z >= 0.0f ? box.max.z : box.min.z };
+			if (Dot(PLANE.normal, CORNER) + PLANE.distance < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	float LinearRaycast(const std::vector<Aabb>& vBounds, const Ray& ray, float maxDistance)
+	{
+		const Float3 INVERSE = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+		float closest = maxDistance;
+		for (const Aabb& BOX : vBounds)
+		{
+			const float X0 = (BOX.min.x - ray.origin.x) * INVERSE.x, X1 = (BOX.max.x - ray.origin.x) * INVERSE.x;
+			const float Y0 = (BOX.min.y - ray.origin.y) * INVERSE.y, Y1 = (BOX.max.y - ray.origin.y) * INVERSE.y;
+			const float Z0 = (BOX.min.z - ray.origin.z) * INVERSE.z, Z1 = (BOX.max.z - ray.origin.z) * INVERSE.z;
+			const float ENTER = std::fmax(std::fmax(std::fmin(X0, X1), std::fmin(Y0, Y1)), std::fmax(std::fmin(Z0, Z1), 0.0f));
+			const float EXIT = std::fmin(std::fmin(std::fmax(X0, X1), std::fmax(Y0, Y1)), std::fmin(std::fmax(Z0, Z1), closest));
+			if (ENTER <= EXIT)
+			{
+				closest = ENTER;
+			}
+		}
+
+		return closest;
+	}
+
+	// A UV sphere, triangles shuffled the way an exporter that doesn't care might leave them.
+	void MakeShuffledSphere(uint32_t rings, uint32_t segments, std::mt19937& random, std::vector<Float3>& vPositions, std::vector<uint32_t>& indices)
+	{
+		vPositions.clear();
+		for (uint32_t r = 0; r <= rings; r++)
+		{
+			const float THETA = 3.14159265f * r / rings;
+			for (uint32_t s = 0; s <= segments; s++)
+			{
+				const float PHI = 6.2831853f * s / segments;
+				vPositions.push_back({ std::sin(THETA) * std::cos(PHI), std::cos(THETA), std::sin(THETA) * std::sin(PHI) });
+			}
+		}
+
+		std::vector<uint32_t> vTriangles;
+		for (uint32_t r = 0; r < rings; r++)
+		{
+			for (uint32_t s = 0; s < segments; s++)
+			{
+				const uint32_t A = r * (segments + 1) + s;
+				const uint32_t B = A + segments + 1;
+				vTriangles.insert(vTriangles.end(), { A, B, A + 1, A + 1, B, B + 1 });
+			}
+		}
+
+		std::vector<uint32_t> vOrder(vTriangles.size() / 3);
+		for (uint32_t t = 0; t < vOrder.size(); t++)
+		{
+			vOrder[t] = t;
+		}
+		std::shuffle(vOrder.begin(), vOrder.end(), random);
+
+		indices.clear();
+		for (uint32_t t : vOrder)
+		{
+			indices.insert(indices.end(), vTriangles.begin() + t * 3, vTriangles.begin() + t * 3 + 3);
+		}
+	}
+}
+
+void RunBvhBenchmarks(std::ostream& out)
+{
+	constexpr uint32_t SCENE_SIZES[] = { 10000, 100000, 1000000 };
+	constexpr uint32_t FRUSTUM_QUERIES = 64;
+	constexpr uint32_t RAYS = 4096;
+	constexpr uint32_t LINEAR_RAYS = 64;		// The linear scan is slow enough that a sample says enough.
+
+	out << std::fixed << std::setprecision(3);
+	out << "BVH benchmarks (milliseconds, queries are per query)\n";
+
+	for (uint32_t count : SCENE_SIZES)
+	{
+		std::mt19937 random(SEED);
+		std::vector<Aabb> vBounds = MakeScene(count, random);
+		const float SIDE = std::cbrt(static_cast<float>(count)) * 4.0f;
+
+		Bvh bvh;
+		Clock::time_point start = Clock::now();
+		bvh.Build(vBounds.data(), count);
+		const double BUILD = MillisecondsSince(start);
+
+		// Everything drifts a little, as a frame of animation would.
+		std::uniform_real_distribution<float> drift(-0.25f, 0.25f);
+		for (Aabb& box : vBounds)
+		{
+			const Float3 OFFSET = { drift(random), drift(random), drift(random) };
+			box = { box.min + OFFSET, box.max + OFFSET };
+		}
+
+		start = Clock::now();
+		bvh.Refit(vBounds.data());
+		const double REFIT = MillisecondsSince(start);
+
+		// Frustum culling, the tree against testing every box.
+		std::vector<uint32_t> vVisible;
+		vVisible.reserve(count);
+		size_t treeVisible = 0;
+		start = Clock::now();
+		for (uint32_t q = 0; q < FRUSTUM_QUERIES; q++)
+		{
+			vVisible.clear();
+			bvh.QueryFrustum(MakeFrustum(q * 0.1f, SIDE * 0.5f), vVisible);
+			treeVisible += vVisible.size();
+		}
+		const double TREE_CULL = MillisecondsSince(start) / FRUSTUM_QUERIES;
+
+		size_t linearVisible = 0;
+		start = Clock::now();
+		for (uint32_t q = 0; q < FRUSTUM_QUERIES; q++)
+		{
+			const Frustum FRUSTUM = MakeFrustum(q * 0.1f, SIDE * 0.5f);
+			for (const Aabb& BOX : vBounds)
+			{
+				linearVisible += Outside(FRUSTUM, BOX) ? 0 : 1;
+			}
+		}
+		const double LINEAR_CULL = MillisecondsSince(start) / FRUSTUM_QUERIES;
+
+		// Picking rays from the middle of the scene in random directions.
+		std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+		std::vector<Ray> vRays(RAYS);
+		for (Ray& ray : vRays)
+		{
+			ray = { { 0.0f, 0.0f, 0.0f }, { direction(random), direction(random), direction(random) } };
+		}
+
+		uint32_t mismatches = 0;
+		start = Clock::now();
+		std::vector<float> vTreeHits(RAYS);
+		for (uint32_t r = 0; r < RAYS; r++)
+		{
+			vTreeHits[r] = bvh.Raycast(vRays[r], SIDE).distance;
+		}
+		const double TREE_RAY = MillisecondsSince(start) / RAYS;
+
+		start = Clock::now();
+		for (uint32_t r = 0; r < LINEAR_RAYS; r++)
+		{
+			mismatches += LinearRaycast(vBounds, vRays[r], SIDE) == vTreeHits[r] ? 0 : 1;
+		}
+		const double LINEAR_RAY = MillisecondsSince(start) / LINEAR_RAYS;
+
+		// A box query around the origin, as a proximity test would.
+		const float REACH = 8.0f;
+		vVisible.clear();
+		start = Clock::now();
+		bvh.QueryBox({ { -REACH, -REACH, -REACH }, { REACH, REACH, REACH } }, vVisible);
+		const double BOX_QUERY = MillisecondsSince(start);
+
+		out << count << " objects: " << bvh.NodeCount() << " nodes, depth " << bvh.Depth() << "\n"
+			<< "  build " << BUILD << ", refit " << REFIT << "\n"
+			<< "  frustum " << TREE_CULL << " (linear " << LINEAR_CULL << "), " << treeVisible / FRUSTUM_QUERIES << " visible"
+			<< (treeVisible == linearVisible ? "" : ", MISMATCH") << "\n"
+			<< "  ray " << TREE_RAY << " (linear " << LINEAR_RAY << ")" << (mismatches == 0 ? "" : ", MISMATCH") << "\n"
+			<< "  box " << BOX_QUERY << ", " << vVisible.size() << " found\n";
+	}
+}
+
+void RunMeshOptimizerBenchmarks(std::ostream& out)
+{
+	constexpr uint32_t SPHERE_RINGS[] = { 32, 128, 512 };
+	constexpr uint32_t CACHE_SIZES[] = { 16, 32 };
+
+	out << std::fixed << std::setprecision(3);
+	out << "Mesh optimizer benchmarks (ACMR and ATVR against FIFO caches, milliseconds)\n";
+
+	for (uint32_t rings : SPHERE_RINGS)
+	{
+		std::mt19937 random(SEED);
+		std::vector<Float3> vPositions;
+		std::vector<uint32_t> indices;
+		MakeShuffledSphere(rings, rings * 2, random, vPositions, indices);
+
+		const uint32_t VERTEX_COUNT = static_cast<uint32_t>(vPositions.size());
+		const MeshView MESH{ vPositions.data(), VERTEX_COUNT, sizeof(Float3) };
+		const std::vector<uint32_t> ORIGINAL = indices;
+
+		Clock::time_point start = Clock::now();
+		OptimizeVertexCache(indices, VERTEX_COUNT);
+		const double CACHE_TIME = MillisecondsSince(start);
+		const std::vector<uint32_t> CACHE_ONLY = indices;
+
+		start = Clock::now();
+		OptimizeOverdraw(indices, MESH, 1.05f);
+		const double OVERDRAW_TIME = MillisecondsSince(start);
+
+		std::vector<uint32_t> vRemap;
+		start = Clock::now();
+		const uint32_t USED = OptimizeVertexFetchRemap(indices, VERTEX_COUNT, vRemap);
+		RemapIndices(indices, vRemap);
+		const std::vector<uint8_t> VERTICES = RemapVertices(MESH, vRemap, USED);
+		const double FETCH_TIME = MillisecondsSince(start);
+
+		out << ORIGINAL.size() / 3 << " triangles, " << VERTEX_COUNT << " vertices\n"
+			<< "  vertex cache " << CACHE_TIME << ", overdraw " << OVERDRAW_TIME << ", fetch remap " << FETCH_TIME << "\n";
+
+		for (uint32_t cacheSize : CACHE_SIZES)
+		{
+			const VertexCacheStats BEFORE = AnalyzeVertexCache(ORIGINAL, VERTEX_COUNT, cacheSize);
+			const VertexCacheStats CACHED = AnalyzeVertexCache(CACHE_ONLY, VERTEX_COUNT, cacheSize);
+			const VertexCacheStats AFTER = AnalyzeVertexCache(indices, USED, cacheSize);
+			out << "  cache " << cacheSize << ": ACMR " << BEFORE.acmr << " -> " << CACHED.acmr << " -> " << AFTER.acmr
+				<< ", ATVR " << BEFORE.atvr << " -> " << CACHED.atvr << " -> " << AFTER.atvr << "\n";
+		}
+	}
+}
+
+void RunVertexFormatBenchmarks(std::ostream& out)
+{
+	constexpr uint32_t RINGS = 500;
+	constexpr uint32_t SEGMENTS = RINGS * 2;		// Not powers of two, so the uvs aren't all exact in half precision.
+	constexpr float RADIUS = 50.0f;		// Big enough that position precision matters.
+
+	// A sphere with everything a real mesh carries, uvs wrapping once around it.
+	std::vector<MeshVertex> vVertices;
+	vVertices.reserve(static_cast<size_t>(RINGS + 1) * (SEGMENTS + 1));
+	for (uint32_t r = 0; r <= RINGS; r++)
+	{
+		const float THETA = 3.14159265f * r / RINGS;
+		for (uint32_t s = 0; s <= SEGMENTS; s++)
+		{
+			const float PHI = 6.2831853f * s / SEGMENTS;
+			const Float3 NORMAL = { std::sin(THETA) * std::cos(PHI), std::cos(THETA), std::sin(THETA) * std::sin(PHI) };
+
+			MeshVertex vertex;
+			vertex.position = NORMAL * RADIUS;
+			vertex.normal = NORMAL;
+			vertex.tangent[0] = -std::sin(PHI);
+			vertex.tangent[1] = 0.0f;
+			vertex.tangent[2] = std::cos(PHI);
+			vertex.tangent[3] = s % 2 == 0 ? 1.0f : -1.0f;
+			vertex.uv[0] = static_cast<float>(s) / SEGMENTS;
+			vertex.uv[1] = static_cast<float>(r) / RINGS;
+			vVertices.push_back(vertex);
+		}
+	}
+
+	const uint32_t COUNT = static_cast<uint32_t>(vVertices.size());
+	Clock::time_point start = Clock::now();
+	const VertexQuantization QUANTIZATION = ComputeQuantization(vVertices.data(), COUNT);
+	const std::vector<QuantizedVertex> QUANTIZED = QuantizeVertices(vVertices.data(), COUNT, QUANTIZATION);
+	const double QUANTIZE_TIME = MillisecondsSince(start);
+
+	float positionError = 0.0f;
+	float normalError = 0.0f;
+	float tangentError = 0.0f;
+	float uvError = 0.0f;
+	uint32_t signErrors = 0;
+	for (uint32_t v = 0; v < COUNT; v++)
+	{
+		const MeshVertex& SOURCE = vVertices[v];
+		const MeshVertex DECODED = DequantizeVertex(QUANTIZED[v], QUANTIZATION);
+		const Float3 OFFSET = DECODED.position - SOURCE.position;
+		const Float3 TANGENT = { SOURCE.tangent[0], SOURCE.tangent[1], SOURCE.tangent[2] };
+		const Float3 DECODED_TANGENT = { DECODED.tangent[0], DECODED.tangent[1], DECODED.tangent[2] };
+
+		positionError = std::max(positionError, std::sqrt(Dot(OFFSET, OFFSET)));
+		normalError = std::max(normalError, std::acos(std::min(Dot(DECODED.normal, SOURCE.normal), 1.0f)));
+		tangentError = std::max(tangentError, std::acos(std::min(Dot(DECODED_TANGENT, TANGENT), 1.0f)));
+		uvError = std::max(uvError, std::max(std::fabs(DECODED.uv[0] - SOURCE.uv[0]), std::fabs(DECODED.uv[1] - SOURCE.uv[1])));
+		signErrors += DECODED.tangent[3] == SOURCE.tangent[3] ? 0 : 1;
+	}
+
+	const double FULL_MB = static_cast<double>(COUNT) * sizeof(MeshVertex) / (1024.0 * 1024.0);
+	const double QUANTIZED_MB = static_cast<double>(COUNT) * sizeof(QuantizedVertex) / (1024.0 * 1024.0);
+
+	out << std::fixed << std::setprecision(3);
+	out << "Vertex format benchmarks\n"
+		<< COUNT << " vertices: " << sizeof(MeshVertex) << " -> " << sizeof(QuantizedVertex) << " bytes each, "
+		<< FULL_MB << " -> " << QUANTIZED_MB << " MB, quantised in " << QUANTIZE_TIME << " ms\n"
+		<< std::setprecision(6)
+		<< "  max error: position " << positionError << " (of " << 2.0f * RADIUS << " across), normal " << normalError * 57.29578f
+		<< " deg, tangent " << tangentError * 57.29578f << " deg, uv " << uvError << (signErrors == 0 ? "" : ", SIGN MISMATCH") << "\n";
+}
+
+void RunMeshletBenchmarks(std::ostream& out)
+{
+	constexpr uint32_t SPHERE_RINGS[] = { 32, 128, 512 };
+	constexpr uint32_t VIEWPOINTS = 256;
+	constexpr float VIEW_DISTANCE = 3.0f;
+
+	out << std::fixed << std::setprecision(3);
+	out << "Meshlet benchmarks (milliseconds, cone culling from viewpoints around the mesh)\n";
+
+	for (uint32_t rings : SPHERE_RINGS)
+	{
+		std::mt19937 random(SEED);
+		std::vector<Float3> vPositions;
+		std::vector<uint32_t> indices;
+		MakeShuffledSphere(rings, rings * 2, random, vPositions, indices);
+
+		const uint32_t VERTEX_COUNT = static_cast<uint32_t>(vPositions.size());
+		const MeshView MESH{ vPositions.data(), VERTEX_COUNT, sizeof(Float3) };
+
+		// Shuffled order shows what the cache optimisation is worth to meshlets, not just to the post transform cache.
+		const MeshletSet SHUFFLED = BuildMeshlets(indices, VERTEX_COUNT);
+		OptimizeVertexCache(indices, VERTEX_COUNT);
+
+		Clock::time_point start = Clock::now();
+		const MeshletSet SET = BuildMeshlets(indices, VERTEX_COUNT);
+		const double BUILD_TIME = MillisecondsSince(start);
+
+		start = Clock::now();
+		std::vector<MeshletBounds> vBounds;
+		vBounds.reserve(SET.vMeshlets.size());
+		for (const Meshlet& MESHLET : SET.vMeshlets)
+		{
+			vBounds.push_back(ComputeMeshletBounds(SET, MESHLET, MESH));
+		}
+		const double BOUNDS_TIME = MillisecondsSince(start);
+
+		// Viewers spread evenly over a sphere around the mesh, as a golden angle spiral.
+		uint64_t culledMeshlets = 0;
+		uint64_t culledTriangles = 0;
+		for (uint32_t v = 0; v < VIEWPOINTS; v++)
+		{
+			const float Y = 1.0f - 2.0f * (v + 0.5f) / VIEWPOINTS;
+			const float RADIUS = std::sqrt(1.0f - Y * Y);
+			const float ANGLE = 2.3999632f * v;
+			const Float3 VIEWER = Float3{ RADIUS * std::cos(ANGLE), Y, RADIUS * std::sin(ANGLE) } * VIEW_DISTANCE;
+
+			for (size_t m = 0; m < vBounds.size(); m++)
+			{
+				const Float3 TO_APEX = vBounds[m].coneApex - VIEWER;
+				if (Dot(TO_APEX, vBounds[m].coneAxis) >= vBounds[m].coneCutoff * std::sqrt(Dot(TO_APEX, TO_APEX)))
+				{
+					culledMeshlets++;
+					culledTriangles += SET.vMeshlets[m].triangleCount;
+				}
+			}
+		}
+
+		const size_t TRIANGLES = indices.size() / 3;
+		const double SAMPLES = static_cast<double>(VIEWPOINTS);
+		out << TRIANGLES << " triangles: " << SET.vMeshlets.size() << " meshlets (" << SHUFFLED.vMeshlets.size() << " from shuffled order)"
+			<< ", " << static_cast<double>(SET.vVertices.size()) / SET.vMeshlets.size() << " vertices and "
+			<< static_cast<double>(TRIANGLES) / SET.vMeshlets.size() << " triangles each\n"
+			<< "  build " << BUILD_TIME << ", bounds " << BOUNDS_TIME << ", cone culled " << 100.0 * culledMeshlets / (SAMPLES * vBounds.size())
+			<< "% of meshlets, " << 100.0 * culledTriangles / (SAMPLES * TRIANGLES) << "% of triangles\n";
+	}
+}
+
+void RunBenchmarks(std::ostream& out)
+{
+	RunBvhBenchmarks(out);
+	RunMeshOptimizerBenchmarks(out);
+	RunVertexFormatBenchmarks(out);
+	RunMeshletBenchmarks(out);
+}
@@ -0,0 +1,24 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	CPU benchmarks for the scene systems, run with --bench instead of opening a window.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <ostream>
+
+// Build, refit and query times at a few scene sizes, against the linear scans the BVH replaces.
+void RunBvhBenchmarks(std::ostream& out);
+
+// Vertex cache miss ratios of shuffled meshes before and after the optimisation stage, and what each pass costs.
+void RunMeshOptimizerBenchmarks(std::ostream& out);
+
+// Bytes per vertex and the error the quantised layout introduces, against full precision vertices.
+void RunVertexFormatBenchmarks(std::ostream& out);
+
+// Meshlet counts and fill, build cost, and how much of a mesh the normal cones cull from viewpoints around it.
+void RunMeshletBenchmarks(std::ostream& out);
+
+// Every benchmark, in turn.
+void RunBenchmarks(std::ostream& out);
@@ -0,0 +1,372 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Bounding volume hierarchy over scene objects, for culling, picking and spatial queries.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "Bvh.h"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t BIN_COUNT = 16;
+
+	// A leaf costs one box test per object, visiting an interior node's children is roughly one more.
+	constexpr float TRAVERSAL_COST = 1.0f;
+
+	// Splits past this are forced even when the heuristic says otherwise, so a leaf never holds a pile of objects.
+	constexpr uint32_t MAX_LEAF_OBJECTS = 8;
+
+	// Leaves the traversal stacks room to spare.
+	constexpr uint32_t MAX_DEPTH = 60;
+
+	// Copied out of the caller's array so the build's passes walk memory in order, and partitioning moves the data with the ids.
+	struct BuildItem
+	{
+		Aabb bounds;
+		Float3 centroid;
+		uint32_t id;
+	};
+
+	struct Bin
+	{
+		Aabb bounds;
+		uint32_t count;
+	};
+
+	void SetBounds(BvhNode& node, const Aabb& box)
+	{
+		node.min = box.min;
+		node.max = box.max;
+	}
+
+	Aabb GetBounds(const BvhNode& node)
+	{
+		return { node.min, node.max };
+	}
+
+	// Bitmask of the planes the box still straddles. Returns false if it's entirely outside any of them.
+	bool TestPlanes(const Frustum& frustum, const Float3& min, const Float3& max, uint32_t& mask)
+	{
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			if ((mask & (1u << p)) == 0)
+			{
+				continue;
+			}
+
+			// The corner furthest along the normal. If that's outside, the whole box is.
+			const Plane& PLANE = frustum.planes[p];
+			const Float3 FAR_CORNER = { PLANE.normal.x >= 0.0f ? max.x : min.x, PLANE.normal.y >= 0.0f ? max.y : min.y, PLANE.normal.z >= 0.0f ? max.z : min.z };
+			if (Dot(PLANE.normal, FAR_CORNER) + PLANE.distance < 0.0f)
+			{
+				return false;
+			}
+
+			// And if the nearest corner is inside too, nothing below here needs this plane again.
+			const Float3 NEAR_CORNER = { PLANE.normal.x >= 0.0f ? min.x : max.x, PLANE.normal.y >= 0.0f ? min.y : max.y, PLANE.normal.z >= 0.0f ? min.z : max.z };
+			if (Dot(PLANE.normal, NEAR_CORNER) + PLANE.distance >= 0.0f)
+			{
+				mask &= ~(1u << p);
+			}
+		}
+
+		return true;
+	}
+}
+
+void Bvh::Build(const Aabb* pBounds, uint32_t count)
+{
+	m_vNodes.clear();
+	m_vItems.resize(count);
+	m_vLeafBounds.clear();
+	m_depth = 0;
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	std::vector<BuildItem> vItems(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		vItems[i] = { pBounds[i], pBounds[i].Center(), i };
+	}
+
+	// A tree of n leaves has 2n - 1 nodes, plus the pad after the root.
+	m_vNodes.reserve(2 * static_cast<size_t>(count));
+
+	// The root sits alone, index 1 is padding so every sibling pair after it starts on an even index.
+	BvhNode root{};
+	root.leftOrFirst = 0;
+	root.count = count;
+	m_vNodes.push_back(root);
+	m_vNodes.push_back(BvhNode{});
+
+	Subdivide(0, vItems.data(), 0);
+
+	m_vLeafBounds.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_vItems[i] = vItems[i].id;
+		m_vLeafBounds[i] = vItems[i].bounds;
+	}
+}
+
+void Bvh::Subdivide(uint32_t node, void* pBuildItems, uint32_t depth)
+{
+	m_depth = std::max(m_depth, depth);
+
+	const uint32_t FIRST = m_vNodes[node].leftOrFirst;
+	const uint32_t COUNT = m_vNodes[node].count;
+	BuildItem* pItems = static_cast<BuildItem*>(pBuildItems) + FIRST;
+
+	Aabb bounds = Aabb::Empty();
+	Aabb centroidBounds = Aabb::Empty();
+	for (uint32_t i = 0; i < COUNT; i++)
+	{
+		bounds.Grow(pItems[i].bounds);
+		centroidBounds.Grow(pItems[i].centroid);
+	}
+	SetBounds(m_vNodes[node], bounds);
+
+	if (COUNT <= 1 || depth >= MAX_DEPTH)
+	{
+		return;
+	}
+
+	// Bin the centroids along each axis and sweep for the cheapest split, in units of one object's box test.
+	float bestCost = FLT_MAX;
+	uint32_t bestAxis = 0;
+	uint32_t bestSplit = 0;
+
+	const float EXTENT[3] = { centroidBounds.max.x - centroidBounds.min.x, centroidBounds.max.y - centroidBounds.min.y, centroidBounds.max.z - centroidBounds.min.z };
+	const float LOWEST[3] = { centroidBounds.min.x, centroidBounds.min.y, centroidBounds.min.z };
+
+	// Small nodes get fewer bins, clearing and sweeping all of them would cost more than binning the items.
+	const uint32_t BINS = std::min(BIN_COUNT, std::max(COUNT, 2u));
+
+	// One pass drops each item into a bin on every axis, the items are read once rather than once per axis.
+	Bin bins[3][BIN_COUNT];
+	float scale[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		scale[axis] = EXTENT[axis] > 0.0f ? BINS / EXTENT[axis] : 0.0f;
+		for (uint32_t b = 0; b < BINS; b++)
+		{
+			bins[axis][b] = { Aabb::Empty(), 0 };
+		}
+	}
+
+	for (uint32_t i = 0; i < COUNT; i++)
+	{
+		const BuildItem& ITEM = pItems[i];
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			const float CENTROID = (&ITEM.centroid.x)[axis];
+			Bin& bin = bins[axis][std::min(BINS - 1, static_cast<uint32_t>((CENTROID - LOWEST[axis]) * scale[axis]))];
+			bin.bounds.Grow(ITEM.bounds);
+			bin.count++;
+		}
+	}
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		if (EXTENT[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		// Area times count to the left of each boundary, then sweep back from the right adding the other side.
+		float leftCost[BIN_COUNT - 1];
+		uint32_t leftCount[BIN_COUNT - 1];
+		Aabb sweep = Aabb::Empty();
+		uint32_t running = 0;
+		for (uint32_t b = 0; b < BINS - 1; b++)
+		{
+			sweep.Grow(bins[axis][b].bounds);
+			running += bins[axis][b].count;
+			leftCost[b] = running > 0 ? sweep.HalfArea() * running : 0.0f;
+			leftCount[b] = running;
+		}
+
+		sweep = Aabb::Empty();
+		running = 0;
+		for (uint32_t b = BINS - 1; b > 0; b--)
+		{
+			sweep.Grow(bins[axis][b].bounds);
+			running += bins[axis][b].count;
+
+			const uint32_t SPLIT = b - 1;
+			if (leftCount[SPLIT] == 0 || running == 0)
+			{
+				continue;
+			}
+
+			const float COST = leftCost[SPLIT] + sweep.HalfArea() * running;
+			if (COST < bestCost)
+			{
+				bestCost = COST;
+				bestAxis = axis;
+				bestSplit = SPLIT;
+			}
+		}
+	}
+
+	const float AREA = bounds.HalfArea();
+	const float SPLIT_COST = AREA > 0.0f ? TRAVERSAL_COST + bestCost / AREA : FLT_MAX;
+	const bool NO_SPLIT = bestCost == FLT_MAX;
+	if (COUNT <= MAX_LEAF_OBJECTS && (NO_SPLIT || SPLIT_COST >= static_cast<float>(COUNT)))
+	{
+		return;
+	}
+
+	uint32_t middle = FIRST;
+	if (NO_SPLIT)
+	{
+		// Every centroid in the same place, no plane separates them. Halve the list to keep leaves small.
+		middle = FIRST + COUNT / 2;
+	}
+	else
+	{
+		middle = FIRST + static_cast<uint32_t>(std::partition(pItems, pItems + COUNT, [&](const BuildItem& ITEM)
+		{
+			const float CENTROID = (&ITEM.centroid.x)[bestAxis];
+			return std::min(BINS - 1, static_cast<uint32_t>((CENTROID - LOWEST[bestAxis]) * scale[bestAxis])) <= bestSplit;
+		}) - pItems);
+	}
+
+	const uint32_t LEFT = static_cast<uint32_t>(m_vNodes.size());
+	BvhNode left{};
+	left.leftOrFirst = FIRST;
+	left.count = middle - FIRST;
+	BvhNode right{};
+	right.leftOrFirst = middle;
+	right.count = FIRST + COUNT - middle;
+	m_vNodes.push_back(left);
+	m_vNodes.push_back(right);
+
+	m_vNodes[node].leftOrFirst = LEFT;
+	m_vNodes[node].count = 0;
+
+	Subdivide(LEFT, pBuildItems, depth + 1);
+	Subdivide(LEFT + 1, pBuildItems, depth + 1);
+}
+
+void Bvh::Refit(const Aabb* pBounds)
+{
+	for (uint32_t i = 0; i < m_vItems.size(); i++)
+	{
+		m_vLeafBounds[i] = pBounds[m_vItems[i]];
+	}
+
+	// Children always come after their parent, so walking backwards finishes every child before its parent.
+	for (size_t n = m_vNodes.size(); n-- > 0;)
+	{
+		BvhNode& node = m_vNodes[n];
+		if (n == 1)
+		{
+			continue;
+		}
+
+		Aabb box = Aabb::Empty();
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				box.Grow(m_vLeafBounds[i]);
+			}
+		}
+		else
+		{
+			box = GetBounds(m_vNodes[node.leftOrFirst]);
+			box.Grow(GetBounds(m_vNodes[node.leftOrFirst + 1]));
+		}
+
+		SetBounds(node, box);
+	}
+}
+
+void Bvh::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& vResults) const
+{
+	if (m_vNodes.empty())
+	{
+		return;
+	}
+
+	// Each entry carries the planes its node still straddles. Once a node is inside all six, its subtree is just collected.
+	struct Entry
+	{
+		uint32_t node;
+		uint32_t mask;
+	};
+
+	Entry stack[STACK_SIZE];
+	uint32_t top = 0;
+	stack[top++] = { 0, 0x3F };
+
+	while (top > 0)
+	{
+		const Entry ENTRY = stack[--top];
+		const BvhNode& NODE = m_vNodes[ENTRY.node];
+
+		uint32_t mask = ENTRY.mask;
+		if (mask != 0 && !TestPlanes(frustum, NODE.min, NODE.max, mask))
+		{
+			continue;
+		}
+
+		if (!NODE.IsLeaf())
+		{
+			stack[top++] = { NODE.leftOrFirst + 1, mask };
+			stack[top++] = { NODE.leftOrFirst, mask };
+			continue;
+		}
+
+		for (uint32_t i = NODE.leftOrFirst; i < NODE.leftOrFirst + NODE.count; i++)
+		{
+			uint32_t objectMask = mask;
+			if (objectMask == 0 || TestPlanes(frustum, m_vLeafBounds[i].min, m_vLeafBounds[i].max, objectMask))
+			{
+				vResults.push_back(m_vItems[i]);
+			}
+		}
+	}
+}
+
+void Bvh::QueryBox(const Aabb& box, std::vector<uint32_t>& vResults) const
+{
+	if (m_vNodes.empty())
+	{
+		return;
+	}
+
+	uint32_t stack[STACK_SIZE];
+	uint32_t top = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const BvhNode& NODE = m_vNodes[stack[--top]];
+		if (!box.Overlaps(GetBounds(NODE)))
+		{
+			continue;
+		}
+
+		if (!NODE.IsLeaf())
+		{
+			stack[top++] = NODE.leftOrFirst + 1;
+			stack[top++] = NODE.leftOrFirst;
+			continue;
+		}
+
+		for (uint32_t i = NODE.leftOrFirst; i < NODE.leftOrFirst + NODE.count; i++)
+		{
+			if (box.Overlaps(m_vLeafBounds[i]))
+			{
+				vResults.push_back(m_vItems[i]);
+			}
+		}
+	}
+}
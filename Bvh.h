@@ -0,0 +1,166 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Bounding volume hierarchy over scene objects, for culling, picking and spatial queries.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MathTypes.h"
+
+#include <vector>
+#include <cstdint>
+
+// Two to a cache line. Siblings are allocated as a pair at an even index, so visiting one brings in the other.
+struct alignas(32) BvhNode
+{
+	Float3 min;
+	uint32_t leftOrFirst;		// Interior: index of the left child, the right is next to it. Leaf: first item.
+	Float3 max;
+	uint32_t count;				// Items in a leaf, zero for an interior node.
+
+	bool IsLeaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BVH nodes are meant to pack two to a cache line!");
+
+struct BvhHit
+{
+	uint32_t object;
+	float distance;
+};
+
+/*
+	Built top down with a binned surface area heuristic: at each node the object centroids are dropped into a few
+	bins along each axis and the cheapest split between bins is taken. Only a leaf when no split is worth its cost.
+
+	Objects are identified by their index in the bounds array passed to Build. When objects move but the scene
+	doesn't change, Refit updates the boxes bottom up and keeps the tree, which gets less tight the further things
+	move from where they were built. Rebuild when that starts to show in the query times.
+*/
+class Bvh
+{
+public:
+
+	static constexpr uint32_t NO_HIT = UINT32_MAX;
+
+	Bvh() :
+		m_depth(0)
+	{}
+
+	void Build(const Aabb* pBounds, uint32_t count);
+
+	// Same objects, new bounds.
+	void Refit(const Aabb* pBounds);
+
+	// Appends every object whose box is at least partly inside.
+	void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& vResults) const;
+	void QueryBox(const Aabb& box, std::vector<uint32_t>& vResults) const;
+
+	// Closest object whose box the ray enters within maxDistance.
+	_NODISCARD BvhHit Raycast(const Ray& ray, float maxDistance) const
+	{
+		return Raycast(ray, maxDistance, [](uint32_t, float boxDistance) { return boxDistance; });
+	}
+
+	/*
+		As above with an exact test per object, intersect(object, boxDistance) returns the hit distance or a negative
+		value for a miss. Children are visited nearest first, so most of the tree is skipped once something is hit.
+	*/
+	template<typename F>
+	_NODISCARD BvhHit Raycast(const Ray& ray, float maxDistance, F&& intersect) const
+	{
+		BvhHit hit{ NO_HIT, maxDistance };
+		if (m_vNodes.empty())
+		{
+			return hit;
+		}
+
+		const Float3 INVERSE = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+		uint32_t stack[STACK_SIZE];
+		uint32_t top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const BvhNode& NODE = m_vNodes[stack[--top]];
+			float entry = 0.0f;
+			if (!RayHitsBox(ray.origin, INVERSE, NODE.min, NODE.max, hit.distance, entry))
+			{
+				continue;
+			}
+
+			if (NODE.IsLeaf())
+			{
+				for (uint32_t i = NODE.leftOrFirst; i < NODE.leftOrFirst + NODE.count; i++)
+				{
+					const Aabb& BOX = m_vLeafBounds[i];
+					float boxDistance = 0.0f;
+					if (!RayHitsBox(ray.origin, INVERSE, BOX.min, BOX.max, hit.distance, boxDistance))
+					{
+						continue;
+					}
+
+					const float DISTANCE = intersect(m_vItems[i], boxDistance);
+					if (DISTANCE >= 0.0f && DISTANCE < hit.distance)
+					{
+						hit = { m_vItems[i], DISTANCE };
+					}
+				}
+				continue;
+			}
+
+			// Push the far child first so the near one is popped next.
+			const uint32_t LEFT = NODE.leftOrFirst;
+			float leftEntry = 0.0f;
+			float rightEntry = 0.0f;
+			const bool HIT_LEFT = RayHitsBox(ray.origin, INVERSE, m_vNodes[LEFT].min, m_vNodes[LEFT].max, hit.distance, leftEntry);
+			const bool HIT_RIGHT = RayHitsBox(ray.origin, INVERSE, m_vNodes[LEFT + 1].min, m_vNodes[LEFT + 1].max, hit.distance, rightEntry);
+
+			if (HIT_LEFT && HIT_RIGHT)
+			{
+				const bool LEFT_NEAR = leftEntry <= rightEntry;
+				stack[top++] = LEFT_NEAR ? LEFT + 1 : LEFT;
+				stack[top++] = LEFT_NEAR ? LEFT : LEFT + 1;
+			}
+			else if (HIT_LEFT || HIT_RIGHT)
+			{
+				stack[top++] = HIT_LEFT ? LEFT : LEFT + 1;
+			}
+		}
+
+		return hit;
+	}
+
+	_NODISCARD uint32_t NodeCount() const { return static_cast<uint32_t>(m_vNodes.size()); }
+	_NODISCARD uint32_t ObjectCount() const { return static_cast<uint32_t>(m_vItems.size()); }
+	_NODISCARD uint32_t Depth() const { return m_depth; }
+
+private:
+
+	// Traversal pushes at most one more than the depth, and the build stops splitting before this.
+	static constexpr uint32_t STACK_SIZE = 64;
+
+	static bool RayHitsBox(const Float3& origin, const Float3& inverse, const Float3& min, const Float3& max, float maxDistance, float& entry)
+	{
+		const float X0 = (min.x - origin.x) * inverse.x, X1 = (max.x - origin.x) * inverse.x;
+		const float Y0 = (min.y - origin.y) * inverse.y, Y1 = (max.y - origin.y) * inverse.y;
+		const float Z0 = (min.z - origin.z) * inverse.z, Z1 = (max.z - origin.z) * inverse.z;
+
+		// fmin and fmax drop a NaN, which a ray starting exactly on a slab of a flat box can produce.
+		const float ENTER = std::fmax(std::fmax(std::fmin(X0, X1), std::fmin(Y0, Y1)), std::fmax(std::fmin(Z0, Z1), 0.0f));
+		const float EXIT = std::fmin(std::fmin(std::fmax(X0, X1), std::fmax(Y0, Y1)), std::fmin(std::fmax(Z0, Z1), maxDistance));
+
+		entry = ENTER;
+		return ENTER <= EXIT;
+	}
+
+	// Build items are private to Bvh.cpp.
+	void Subdivide(uint32_t node, void* pBuildItems, uint32_t depth);
+
+	std::vector<BvhNode> m_vNodes;
+	std::vector<uint32_t> m_vItems;			// Object ids, in leaf order.
+	std::vector<Aabb> m_vLeafBounds;		// Each item's box in leaf order, so queries read leaves straight through.
+	uint32_t m_depth;
+};
@@ -0,0 +1,258 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Bins point and spot lights into screen space clusters on the GPU for forward shading.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "ClusteredLights.h"
+#include "VulkanUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Must match light_cull.comp.
+	constexpr uint32_t BIN_GROUP_SIZE = 64;
+
+	constexpr uint32_t CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+	constexpr VkDeviceSize CLUSTER_BYTES = static_cast<VkDeviceSize>(CLUSTER_COUNT) * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t);
+
+	// Ahead of the lights in each frame's buffer, matches the start of Lights in clustered_lights.glsl.
+	struct LightsHeader
+	{
+		Float4x4 worldFromClip;
+		float screenSize[2];
+		uint32_t lightCount;
+		uint32_t pad;
+		GpuSun sun;
+	};
+
+	static_assert(sizeof(GpuLight) == 64 && sizeof(LightsHeader) == 384, "Light buffer layouts changed, update clustered_lights.glsl!");
+
+	enum Binding : uint32_t
+	{
+		BINDING_LIGHTS = 0,
+		BINDING_CLUSTERS,
+		BINDING_SHADOW_MAP,
+		BINDING_COUNT,
+		BUFFER_BINDING_COUNT = BINDING_SHADOW_MAP
+	};
+}
+
+void ClusteredLights::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxLights)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_maxLights = maxLights;
+	m_vFrames.resize(framesInFlight);
+
+	// Written by binning, read by shading. Only shading reads the shadow map.
+	VkDescriptorSetLayoutBinding bindings[BINDING_COUNT]{};
+	for (uint32_t i = 0; i < BINDING_COUNT; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+	bindings[BINDING_SHADOW_MAP].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[BINDING_SHADOW_MAP].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = BINDING_COUNT;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create light descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create light binning pipeline layout!");
+	}
+
+	VkShaderModule shaderModule = LoadShaderModule(m_device, "shaders/light_cull.spv");
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create light binning pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, shaderModule, GetAllocationCallbacks());
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = framesInFlight * BUFFER_BINDING_COUNT;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = framesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = framesInFlight;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create light descriptor pool!");
+	}
+
+	const std::vector<VkDescriptorSetLayout> LAYOUTS(framesInFlight, m_descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = framesInFlight;
+	allocInfo.pSetLayouts = LAYOUTS.data();
+
+	m_vDescriptorSets.resize(framesInFlight);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_vDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate light descriptor sets!");
+	}
+
+	// Only ever touched by the GPU, and fully rewritten each frame before it's read.
+	CreateBuffer(m_physicalDevice, m_device, CLUSTER_BYTES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_clusterBuffer, m_clusterMemory);
+
+	// Lights change every frame and are read once, so they stay in host memory like the instance buffers.
+	const VkDeviceSize LIGHT_BYTES = sizeof(LightsHeader) + static_cast<VkDeviceSize>(std::max(maxLights, 1u)) * sizeof(GpuLight);
+	for (uint32_t i = 0; i < framesInFlight; i++)
+	{
+		FrameLights& frame = m_vFrames[i];
+		CreateBuffer(m_physicalDevice, m_device, LIGHT_BYTES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.buffer, frame.memory);
+		vkMapMemory(m_device, frame.memory, 0, VK_WHOLE_SIZE, 0, &frame.pMapped);
+
+		// Nothing to shade with until the first update.
+		std::memset(frame.pMapped, 0, sizeof(LightsHeader));
+
+		VkDescriptorBufferInfo bufferInfos[BUFFER_BINDING_COUNT] =
+		{
+			{ frame.buffer, 0, VK_WHOLE_SIZE },
+			{ m_clusterBuffer, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet writes[BUFFER_BINDING_COUNT]{};
+		for (uint32_t b = 0; b < BUFFER_BINDING_COUNT; b++)
+		{
+			writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[b].dstSet = m_vDescriptorSets[i];
+			writes[b].dstBinding = b;
+			writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[b].descriptorCount = 1;
+			writes[b].pBufferInfo = &bufferInfos[b];
+		}
+
+		vkUpdateDescriptorSets(m_device, BUFFER_BINDING_COUNT, writes, 0, nullptr);
+	}
+}
+
+void ClusteredLights::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Unmapping happens implicitly when the memory is freed.
+	for (FrameLights& frame : m_vFrames)
+	{
+		vkDestroyBuffer(m_device, frame.buffer, GetAllocationCallbacks());
+		vkFreeMemory(m_device, frame.memory, GetAllocationCallbacks());
+	}
+	m_vFrames.clear();
+
+	vkDestroyBuffer(m_device, m_clusterBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_clusterMemory, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_pipeline, GetAllocationCallbacks());
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the sets.
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+
+	m_vDescriptorSets.clear();
+}
+
+void ClusteredLights::Update(uint32_t frame, const std::vector<GpuLight>& vLights, const GpuSun& sun, const Float4x4& viewProjection, VkExtent2D extent)
+{
+	FrameLights& lights = m_vFrames[frame];
+	lights.count = std::min(static_cast<uint32_t>(vLights.size()), m_maxLights);
+
+	// Built on the stack, the mapping is write combined. A singular view projection sees nothing, identity just keeps the maths finite.
+	LightsHeader header;
+	if (!Inverse(viewProjection, header.worldFromClip))
+	{
+		header.worldFromClip = Float4x4::Identity();
+	}
+	header.screenSize[0] = static_cast<float>(extent.width);
+	header.screenSize[1] = static_cast<float>(extent.height);
+	header.lightCount = lights.count;
+	header.pad = 0;
+	header.sun = sun;
+
+	uint8_t* pData = static_cast<uint8_t*>(lights.pMapped);
+	std::memcpy(pData, &header, sizeof(header));
+	std::memcpy(pData + sizeof(header), vLights.data(), lights.count * sizeof(GpuLight));
+}
+
+void ClusteredLights::BindShadowMap(VkImageView view, VkSampler sampler)
+{
+	const VkDescriptorImageInfo IMAGE_INFO{ sampler, view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+	// The same map for every frame, it's only ever rewritten in order with the frames that read it.
+	std::vector<VkWriteDescriptorSet> vWrites(m_vDescriptorSets.size());
+	for (size_t i = 0; i < vWrites.size(); i++)
+	{
+		vWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		vWrites[i].dstSet = m_vDescriptorSets[i];
+		vWrites[i].dstBinding = BINDING_SHADOW_MAP;
+		vWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		vWrites[i].descriptorCount = 1;
+		vWrites[i].pImageInfo = &IMAGE_INFO;
+	}
+
+	vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(vWrites.size()), vWrites.data(), 0, nullptr);
+}
+
+void ClusteredLights::Record(VkCommandBuffer commandBuffer, uint32_t frame) const
+{
+	// The last frame's shading has to be done with the lists before they're rewritten.
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_vDescriptorSets[frame], 0, nullptr);
+	vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + BIN_GROUP_SIZE - 1) / BIN_GROUP_SIZE, 1, 1);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = m_clusterBuffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void ClusteredLights::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, uint32_t frame) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &m_vDescriptorSets[frame], 0, nullptr);
+}
@@ -0,0 +1,111 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Bins point and spot lights into screen space clusters on the GPU for forward shading.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MathTypes.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+
+// Must match clustered_lights.glsl.
+constexpr uint32_t LIGHT_CLUSTERS_X = 16;
+constexpr uint32_t LIGHT_CLUSTERS_Y = 9;
+constexpr uint32_t LIGHT_CLUSTERS_Z = 24;
+constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+constexpr uint32_t MAX_SHADOW_CASCADES = 4;
+
+// One light in world space, as the shaders read it. Matches Light in clustered_lights.glsl.
+struct GpuLight
+{
+	float position[3];
+	float range;
+	float color[3];
+	uint32_t type;			// A LightType.
+	float direction[3];
+	float spotCosOuter;
+	float spotCosInner;
+	float pad[3];
+};
+
+// The directional light, shadowed through cascades filled by ShadowCascades. Matches the sun in clustered_lights.glsl.
+struct GpuSun
+{
+	Float4x4 shadowFromWorld[MAX_SHADOW_CASCADES];	// To each cascade's clip space.
+	float cascadeEnds[MAX_SHADOW_CASCADES];			// Clip space depth of the view each cascade reaches.
+	float direction[3];								// The way the light travels, normalised.
+	uint32_t cascadeCount;
+	float color[3];									// Linear, premultiplied by intensity. Zero for no sun.
+	float pad;
+};
+
+/*
+	Each frame the lights are written to that frame's buffer, then a compute pass gives every cluster the list of
+	lights whose bounds touch it. The lists are shared by every frame, the binning waits for the last frame's
+	fragments to finish reading them. Shading reads the same set, at whatever set index its pipeline layout puts it.
+*/
+class ClusteredLights
+{
+public:
+
+	ClusteredLights() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_maxLights(0),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_pipeline(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_clusterBuffer(VK_NULL_HANDLE),
+		m_clusterMemory(VK_NULL_HANDLE)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxLights);
+	void Destroy();
+
+	/*
+		Writes the frame's lights, the first maxLights of them, and the sun, with what's needed to place fragments and clusters in
+		the world. The frame's last submission must have finished.
+	*/
+	void Update(uint32_t frame, const std::vector<GpuLight>& vLights, const GpuSun& sun, const Float4x4& viewProjection, VkExtent2D extent);
+
+	// The sun's shadow cascades, an array sampled with depth comparison. Must be bound before anything is shaded.
+	void BindShadowMap(VkImageView view, VkSampler sampler);
+
+	// Outside any render pass, after Update and before anything shaded with the frame's set.
+	void Record(VkCommandBuffer commandBuffer, uint32_t frame) const;
+
+	// For a graphics pipeline layout that has SetLayout at this index.
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, uint32_t frame) const;
+
+	_NODISCARD VkDescriptorSetLayout SetLayout() const { return m_descriptorSetLayout; }
+
+private:
+
+	struct FrameLights
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* pMapped = nullptr;	// Persistently mapped.
+		uint32_t count = 0;
+	};
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	uint32_t m_maxLights;
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_vDescriptorSets;		// One per frame in flight.
+
+	std::vector<FrameLights> m_vFrames;
+	VkBuffer m_clusterBuffer;
+	VkDeviceMemory m_clusterMemory;
+};
@@ -12,7 +12,157 @@ namespace Render_constants
 	constexpr inline uint32_t g_windowWidth = 800;
 	constexpr inline uint32_t g_windowHeight = 600;
 
-	constexpr uint32_t g_maxFramesInFlight = 2;
+	// Sync objects and per frame resources are made for this many frames, the present policy decides how many are used.
+	constexpr uint32_t g_maxFramesInFlight = 3;
+
+	// Key commands from the GLFW thread the render thread can fall behind by, any more are dropped. Must be a power of two.
+	constexpr size_t g_windowEventCapacity = 256;
+
+	// How often the render thread checks for a restore while minimised.
+	constexpr uint32_t g_minimizedSleepMilliseconds = 10;
+
+	// Use dynamic rendering when the device has it. Set false to force the render pass path.
+	constexpr bool g_preferDynamicRendering = true;
+
+	// Draw culled meshlets with mesh shaders when the device has VK_EXT_mesh_shader, otherwise through indirect indexed draws.
+	constexpr bool g_preferMeshShaders = true;
+
+	// Shade in a second subpass from a G-buffer instead of per fragment drawn. Replaces dynamic rendering, subpasses need a render pass.
+	constexpr bool g_preferDeferredShading = false;
+}
+
+namespace Resolution_constants
+{
+	// Scale the render resolution to hold the GPU frame time. Otherwise it stays at the largest scale.
+	constexpr bool g_dynamicResolution = true;
+
+	// GPU time per frame to hold, a little under a 60 Hz refresh, and how far either side of it is left alone.
+	constexpr double g_targetGpuMilliseconds = 14.0;
+	constexpr double g_targetTolerance = 0.1;
+
+	// Bounds of the render resolution as a fraction of the window's, along each axis.
+	constexpr float g_minRenderScale = 0.5f;
+	constexpr float g_maxRenderScale = 1.0f;
+}
+
+namespace Post_constants
+{
+	// Tonemap and grade the HDR scene. Otherwise the upscale reads it as is, and anything past 1 clips.
+	constexpr bool g_postProcess = true;
+
+	// One dispatch for every effect, or one per effect. F switches between them, and both are timed.
+	constexpr bool g_fusedPostProcess = true;
+
+	constexpr float g_exposure = 1.0f;
+	constexpr float g_contrast = 1.1f;
+	constexpr float g_saturation = 1.05f;
+	constexpr float g_tint[3] = { 1.0f, 0.98f, 0.95f };	// A little warm.
+	constexpr float g_vignette = 0.25f;
+	constexpr float g_filmGrain = 0.02f;
+	constexpr float g_sharpen = 0.3f;
+}
+
+namespace Texture_constants
+{
+	// Bytes of texture data uploaded per frame, per upload slot. Must hold at least one row of blocks of the widest mip.
+	constexpr VkDeviceSize g_streamingBudgetPerFrame = 4 * 1024 * 1024;
+
+	// Compute mip generations that can be recorded before their descriptor sets and counters must be recycled.
+	constexpr uint32_t g_maxMipGenerationsInFlight = 256;
+
+	// Drawn behind the scene through the streamer when there's no virtual texture to draw it from.
+	constexpr const char* g_backdropTexture = "backdrop.ktx2";
+}
+
+namespace VirtualTexture_constants
+{
+	// Page cache is a square grid of slots. 28 slots of 128 texel pages plus borders stays within the guaranteed 4096 image size.
+	constexpr uint32_t g_cacheSlotsPerSide = 28;
+
+	// Pages copied into the cache per frame.
+	constexpr uint32_t g_pagesUploadedPerFrame = 16;
+
+	// Drawn behind the scene when it exists, see PageFile::Build for making one.
+	constexpr const char* g_backdropPageFile = "backdrop.vtex";
+}
+
+namespace Scene_constants
+{
+	// World matrices per instance buffer, there's one buffer per frame in flight.
+	constexpr uint32_t g_maxInstances = 64 * 1024;
+
+	// Loaded at start up when it exists, otherwise the scene is just the triangle.
+	constexpr const char* g_sceneFile = "scene.vscene";
+
+	// A level of detail is used while its error stays under this many pixels. It only gets coarser once
+	// under the threshold less the hysteresis fraction, so objects near the boundary don't flicker between levels.
+	constexpr float g_lodErrorPixels = 1.0f;
+	constexpr float g_lodHysteresis = 0.25f;
+}
+
+namespace Lighting_constants
+{
+	// Lights shaded per frame, any more are dropped. Each frame in flight has its own buffer of this many.
+	constexpr uint32_t g_maxLights = 4096;
+
+	// Point and spot lights scattered through a loaded scene's bounds, until scene files can carry their own.
+	constexpr uint32_t g_testLightCount = 1024;
+
+	// The way sunlight travels, normalised on use, and its colour premultiplied by intensity. A black sun is skipped.
+	constexpr float g_sunDirection[3] = { 0.3f, 1.0f, 0.4f };
+	constexpr float g_sunColor[3] = { 1.0f, 0.95f, 0.85f };
+}
+
+namespace Shadow_constants
+{
+	// Cascades of the sun's shadow map and the texels across each. At most MAX_SHADOW_CASCADES.
+	constexpr uint32_t g_cascadeCount = 4;
+	constexpr uint32_t g_shadowMapSize = 2048;
+
+	// The clip space depth each cascade reaches. With no camera clip depth is the view distance, so these are linear.
+	constexpr float g_cascadeEnds[4] = { 0.1f, 0.25f, 0.5f, 1.0f };
+
+	// Frames between each cascade's refreshes. Far cascades have coarser texels, so their dynamic shadows can lag more.
+	constexpr uint32_t g_cascadeRefreshIntervals[4] = { 1, 2, 4, 8 };
+
+	// How far towards the sun beyond a cascade's slice casters are still drawn, in world units.
+	constexpr float g_casterReach = 50.0f;
+}
+
+namespace Job_constants
+{
+	// Worker threads in the job system. Zero means one per core, less the main and render threads.
+	constexpr uint32_t g_workerThreads = 0;
+}
+
+namespace Startup_constants
+{
+	// Per device query results, keyed on device and driver version. Delete it to force a full requery.
+	constexpr const char* g_deviceCacheFile = "device_cache.bin";
+}
+
+namespace Memory_constants
+{
+	// Route driver host allocations through HostAllocator. Off means the driver's own allocator, and no stats.
+	constexpr bool g_trackHostAllocations = true;
+
+	// Bytes per pool chunk, carved into blocks of a single size class.
+	constexpr size_t g_hostPoolChunkSize = 64 * 1024;
+}
+
+namespace Logging_constants
+{
+	// Validation messages and status lines go here as JSON lines, one object per message.
+	constexpr const char* g_logFile = "vulkan_log.jsonl";
+
+	// Messages the ring can hold before new ones are dropped. Must be a power of two.
+	constexpr size_t g_logCapacity = 1024;
+
+	// Beyond this, repeats of the same message ID are only counted.
+	constexpr uint32_t g_maxMessagesPerIdPerSecond = 5;
+
+	// Performance warnings we already know about. Written on the first run, delete it to take a new baseline.
+	constexpr const char* g_perfWarningBaselineFile = "perf_warning_baseline.txt";
 }
 
 namespace Validation_constants
@@ -0,0 +1,292 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	G-buffer and lighting subpass for deferred shading inside the main render pass.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "DeferredLighting.h"
+#include "VulkanUtils.h"
+
+#include <stdexcept>
+
+namespace
+{
+	// Must match deferred_light.frag.
+	enum Binding : uint32_t
+	{
+		BINDING_ALBEDO = 0,
+		BINDING_NORMAL,
+		BINDING_DEPTH,
+		BINDING_COUNT
+	};
+}
+
+void DeferredLighting::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout lightSetLayout)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		m_lazyMemory = m_lazyMemory || (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+	}
+
+	VkDescriptorSetLayoutBinding bindings[BINDING_COUNT]{};
+	for (uint32_t i = 0; i < BINDING_COUNT; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = BINDING_COUNT;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create G-buffer descriptor set layout!");
+	}
+
+	const VkDescriptorSetLayout SET_LAYOUTS[] = { m_descriptorSetLayout, lightSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = SET_LAYOUTS;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create deferred lighting pipeline layout!");
+	}
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	poolSize.descriptorCount = BINDING_COUNT;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create G-buffer descriptor pool!");
+	}
+
+	// One set, like the targets it points at. Frames are ordered around them by the render pass's dependencies.
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate G-buffer descriptor set!");
+	}
+}
+
+void DeferredLighting::Destroy()
+{
+	// Never initialised, shading is forward.
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	ReleasePipeline();
+	ReleaseTargets();
+
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the set.
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+}
+
+void DeferredLighting::CreateTargets(VkExtent2D extent, VkImageView depthView)
+{
+	ReleaseTargets();
+
+	CreateTarget(ALBEDO_FORMAT, extent, m_albedo);
+	CreateTarget(NORMAL_FORMAT, extent, m_normal);
+
+	const VkDescriptorImageInfo IMAGE_INFOS[BINDING_COUNT] =
+	{
+		{ VK_NULL_HANDLE, m_albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ VK_NULL_HANDLE, m_normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ VK_NULL_HANDLE, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL }
+	};
+
+	VkWriteDescriptorSet writes[BINDING_COUNT]{};
+	for (uint32_t i = 0; i < BINDING_COUNT; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = m_descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		writes[i].descriptorCount = 1;
+		writes[i].pImageInfo = &IMAGE_INFOS[i];
+	}
+
+	vkUpdateDescriptorSets(m_device, BINDING_COUNT, writes, 0, nullptr);
+}
+
+void DeferredLighting::ReleaseTargets()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	ReleaseTarget(m_albedo);
+	ReleaseTarget(m_normal);
+}
+
+void DeferredLighting::CreatePipeline(VkRenderPass renderPass)
+{
+	ReleasePipeline();
+
+	VkShaderModule vertShaderModule = LoadShaderModule(m_device, "shaders/fullscreen_vert.spv");
+	VkShaderModule fragShaderModule = LoadShaderModule(m_device, "shaders/deferred_light_frag.spv");
+
+	VkPipelineShaderStageCreateInfo shaderStages[2]{};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main";
+
+	// One triangle over the whole screen, its corners made in the shader.
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// Whatever the pass set, the render scale changes from frame to frame.
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	const VkDynamicState DYNAMIC_STATES[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = DYNAMIC_STATES;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Every lit pixel is written once, opaque.
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	// The subpass has no depth attachment, depth is one of its inputs.
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_pipelineLayout;
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = 1;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create deferred lighting pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, fragShaderModule, GetAllocationCallbacks());
+	vkDestroyShaderModule(m_device, vertShaderModule, GetAllocationCallbacks());
+}
+
+void DeferredLighting::ReleasePipeline()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyPipeline(m_device, m_pipeline, GetAllocationCallbacks());
+	m_pipeline = VK_NULL_HANDLE;
+}
+
+void DeferredLighting::Record(VkCommandBuffer commandBuffer) const
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void DeferredLighting::CreateTarget(VkFormat format, VkExtent2D extent, Target& target)
+{
+	// Only ever an attachment, written and read within the pass.
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { extent.width, extent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	const VkMemoryPropertyFlags PROPERTIES = m_lazyMemory
+		? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+		: VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, PROPERTIES, target.image, target.memory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = target.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &target.view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create G-buffer view!");
+	}
+}
+
+void DeferredLighting::ReleaseTarget(Target& target)
+{
+	vkDestroyImageView(m_device, target.view, GetAllocationCallbacks());
+	vkDestroyImage(m_device, target.image, GetAllocationCallbacks());
+	vkFreeMemory(m_device, target.memory, GetAllocationCallbacks());
+	target = Target();
+}
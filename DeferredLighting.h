@@ -0,0 +1,83 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	G-buffer and lighting subpass for deferred shading inside the main render pass.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+
+/*
+	The main render pass's first subpass writes the G-buffer, and the second reads it back through input attachments
+	and lights it from the clustered light lists. The G-buffer only lives for the pass, so it's transient and, on
+	tiled GPUs, lazily allocated and never written out. Lighting costs one shade per pixel however much overdraw
+	the geometry had. Targets follow the scene targets' size, the pipeline its render pass.
+*/
+class DeferredLighting
+{
+public:
+
+	// Attachments 2 and 3 of the main render pass, after the swap chain image and depth.
+	static constexpr VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;			// rgb albedo, a whether anything was drawn.
+	static constexpr VkFormat NORMAL_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;	// xyz world normal, w whether it's lit.
+
+	DeferredLighting() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_lazyMemory(false),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_descriptorSet(VK_NULL_HANDLE),
+		m_pipeline(VK_NULL_HANDLE),
+		m_albedo(),
+		m_normal()
+	{}
+
+	// Lights are set 1 of the lighting pipeline's layout, the G-buffer set 0.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout lightSetLayout);
+	void Destroy();
+
+	// The G-buffer for this size, read back alongside the depth buffer. Replaces any previous targets.
+	void CreateTargets(VkExtent2D extent, VkImageView depthView);
+	void ReleaseTargets();
+
+	// Built for subpass 1 of renderPass. Viewport and scissor are dynamic, left as the pass set them.
+	void CreatePipeline(VkRenderPass renderPass);
+	void ReleasePipeline();
+
+	// Inside subpass 1, with the lights bound at set 1 of PipelineLayout and the viewport set.
+	void Record(VkCommandBuffer commandBuffer) const;
+
+	_NODISCARD VkPipelineLayout PipelineLayout() const { return m_pipelineLayout; }
+	_NODISCARD VkImageView AlbedoView() const { return m_albedo.view; }
+	_NODISCARD VkImageView NormalView() const { return m_normal.view; }
+
+private:
+
+	struct Target
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+	};
+
+	void CreateTarget(VkFormat format, VkExtent2D extent, Target& target);
+	void ReleaseTarget(Target& target);
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	bool m_lazyMemory;		// The device has lazily allocated memory, so transient targets need never be backed.
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkDescriptorPool m_descriptorPool;
+	VkDescriptorSet m_descriptorSet;		// Rewritten whenever the targets are recreated.
+	VkPipeline m_pipeline;
+
+	Target m_albedo;
+	Target m_normal;
+};
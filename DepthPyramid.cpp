@@ -0,0 +1,330 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Hierarchical depth for occlusion culling, rebuilt from the depth buffer in a single dispatch.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "DepthPyramid.h"
+#include "VulkanUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Must match depth_pyramid.comp and spd.glsl.
+	constexpr uint32_t MAX_MIPS = 12;
+	constexpr uint32_t TILE_SIZE = 64;
+
+	// The largest grid one dispatch can reduce, see MipGenerator. Only depth buffers 8192 or more across are read coarser for it.
+	constexpr uint32_t MAX_GRID_SIZE = TILE_SIZE * TILE_SIZE;
+
+	struct PyramidPushConstants
+	{
+		int32_t gridWidth;
+		int32_t gridHeight;
+		uint32_t mipCount;
+		uint32_t workgroupCount;
+	};
+
+	// At least two, so there's always a mip 0.
+	uint32_t GridSize(uint32_t size)
+	{
+		uint32_t grid = 2;
+		while (grid * 2 <= std::min(size, MAX_GRID_SIZE))
+		{
+			grid *= 2;
+		}
+		return grid;
+	}
+}
+
+void DepthPyramid::Init(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+
+	// Depth buffer, destination mips, completion counter.
+	VkDescriptorSetLayoutBinding bindings[3]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = MAX_MIPS;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[2].binding = 2;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount = 1;
+	bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 3;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PyramidPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+	}
+
+	VkShaderModule shaderModule = LoadShaderModule(m_device, "shaders/depth_pyramid.spv");
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, shaderModule, GetAllocationCallbacks());
+
+	VkDescriptorPoolSize poolSizes[3]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = MAX_MIPS;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+	}
+
+	// One set, rewritten whenever the pyramid is recreated.
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor set!");
+	}
+
+	// Only ever read with texelFetch, so filtering doesn't matter. Used for the depth buffer and the pyramid.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+	}
+
+	CreateBuffer
+	(
+		m_physicalDevice, m_device, sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_counterBuffer, m_counterMemory
+	);
+
+	void* pData;
+	vkMapMemory(m_device, m_counterMemory, 0, sizeof(uint32_t), 0, &pData);
+	std::memset(pData, 0, sizeof(uint32_t));
+	vkUnmapMemory(m_device, m_counterMemory);
+}
+
+void DepthPyramid::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Release();
+
+	vkDestroyBuffer(m_device, m_counterBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_counterMemory, GetAllocationCallbacks());
+	vkDestroySampler(m_device, m_sampler, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_pipeline, GetAllocationCallbacks());
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the set.
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+}
+
+void DepthPyramid::Create(VkExtent2D depthExtent, VkImageView depthView)
+{
+	Release();
+
+	m_gridExtent = { GridSize(depthExtent.width), GridSize(depthExtent.height) };
+
+	// Down to a single texel, which is one fewer level than the grid would have as a mip chain of its own.
+	uint32_t largest = std::max(m_gridExtent.width, m_gridExtent.height);
+	while (largest > 1)
+	{
+		largest >>= 1;
+		m_mipCount++;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;	// Storage support is required for it, and depth of any format fits.
+	imageInfo.extent = { m_gridExtent.width / 2, m_gridExtent.height / 2, 1 };
+	imageInfo.mipLevels = m_mipCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipCount, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid view!");
+	}
+
+	m_vMipViews.resize(m_mipCount);
+	for (uint32_t i = 0; i < m_mipCount; i++)
+	{
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+		if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_vMipViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid mip view!");
+		}
+	}
+
+	// Every array element must be valid, so unused slots repeat the last mip. The shader never writes them.
+	VkDescriptorImageInfo depthInfo{ m_sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo mipInfos[MAX_MIPS];
+	for (uint32_t i = 0; i < MAX_MIPS; i++)
+	{
+		mipInfos[i] = { VK_NULL_HANDLE, m_vMipViews[std::min(i, m_mipCount - 1)], VK_IMAGE_LAYOUT_GENERAL };
+	}
+	VkDescriptorBufferInfo counterInfo{ m_counterBuffer, 0, VK_WHOLE_SIZE };
+
+	VkWriteDescriptorSet writes[3]{};
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = m_descriptorSet;
+		writes[i].dstBinding = i;
+	}
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[0].descriptorCount = 1;
+	writes[0].pImageInfo = &depthInfo;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writes[1].descriptorCount = MAX_MIPS;
+	writes[1].pImageInfo = mipInfos;
+	writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes[2].descriptorCount = 1;
+	writes[2].pBufferInfo = &counterInfo;
+
+	vkUpdateDescriptorSets(m_device, 3, writes, 0, nullptr);
+}
+
+void DepthPyramid::Release()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (VkImageView view : m_vMipViews)
+	{
+		vkDestroyImageView(m_device, view, GetAllocationCallbacks());
+	}
+	vkDestroyImageView(m_device, m_view, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_image, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_imageMemory, GetAllocationCallbacks());
+
+	m_vMipViews.clear();
+	m_view = VK_NULL_HANDLE;
+	m_image = VK_NULL_HANDLE;
+	m_imageMemory = VK_NULL_HANDLE;
+	m_gridExtent = { 0, 0 };
+	m_mipCount = 0;
+}
+
+void DepthPyramid::Record(VkCommandBuffer commandBuffer) const
+{
+	// Last frame's pyramid is rebuilt from scratch, once the culling that read it and the last build's counter reset are done.
+	VkMemoryBarrier counterBarrier{};
+	counterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	counterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_image;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipCount, 0, 1 };
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &counterBarrier, 0, nullptr, 1, &barrier);
+
+	const uint32_t GROUPS_X = (m_gridExtent.width + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t GROUPS_Y = (m_gridExtent.height + TILE_SIZE - 1) / TILE_SIZE;
+
+	PyramidPushConstants constants{};
+	constants.gridWidth = static_cast<int32_t>(m_gridExtent.width);
+	constants.gridHeight = static_cast<int32_t>(m_gridExtent.height);
+	constants.mipCount = m_mipCount;
+	constants.workgroupCount = GROUPS_X * GROUPS_Y;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, GROUPS_X, GROUPS_Y, 1);
+
+	// Stays in GENERAL, culling reads it straight after.
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
@@ -0,0 +1,81 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Hierarchical depth for occlusion culling, rebuilt from the depth buffer in a single dispatch.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+
+/*
+	Every texel is the farthest depth under it, so a bound whose nearest depth is behind that everywhere it covers
+	is hidden. Mip 0 is half the largest power of two grid that fits in the depth buffer, so each level exactly halves
+	the last and a texel at any level lines up with the ones below it. Sized with the swap chain, like the depth buffer.
+*/
+class DepthPyramid
+{
+public:
+
+	DepthPyramid() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_pipeline(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_descriptorSet(VK_NULL_HANDLE),
+		m_sampler(VK_NULL_HANDLE),
+		m_counterBuffer(VK_NULL_HANDLE),
+		m_counterMemory(VK_NULL_HANDLE),
+		m_image(VK_NULL_HANDLE),
+		m_imageMemory(VK_NULL_HANDLE),
+		m_view(VK_NULL_HANDLE),
+		m_gridExtent({ 0, 0 }),
+		m_mipCount(0)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device);
+	void Destroy();
+
+	// For a depth buffer of this size, sampled in DEPTH_STENCIL_READ_ONLY_OPTIMAL. Replaces any previous pyramid.
+	void Create(VkExtent2D depthExtent, VkImageView depthView);
+	void Release();
+
+	/*
+		Outside any render pass, with the depth buffer already in DEPTH_STENCIL_READ_ONLY_OPTIMAL and its writes
+		made visible to compute. Leaves the pyramid ready for compute shaders to read.
+	*/
+	void Record(VkCommandBuffer commandBuffer) const;
+
+	// Every mip, in GENERAL layout, to be read with texelFetch through Sampler.
+	_NODISCARD VkImageView View() const { return m_view; }
+	_NODISCARD VkSampler Sampler() const { return m_sampler; }
+	_NODISCARD uint32_t MipCount() const { return m_mipCount; }
+
+private:
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	VkDescriptorSet m_descriptorSet;
+	VkSampler m_sampler;
+
+	// Workgroup completion counter. Builds never overlap, each waits on the reads of the last.
+	VkBuffer m_counterBuffer;
+	VkDeviceMemory m_counterMemory;
+
+	VkImage m_image;
+	VkDeviceMemory m_imageMemory;
+	VkImageView m_view;
+	std::vector<VkImageView> m_vMipViews;	// One per mip, for the shader's storage image array.
+	VkExtent2D m_gridExtent;				// Twice mip 0.
+	uint32_t m_mipCount;
+};
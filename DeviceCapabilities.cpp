@@ -0,0 +1,337 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Everything we need to know about a physical device, queried once rather than on every use.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "DeviceCapabilities.h"
+#include "Constants.h"
+
+#include <fstream>
+#include <set>
+
+#define V_EXTENS					Extension_constants::g_vDeviceExtensions
+
+namespace
+{
+	constexpr uint32_t CACHE_MAGIC = 0x50414344; // 'DCAP'
+	constexpr uint32_t CACHE_VERSION = 3;	// Old records predate the mesh shader bit.
+
+	constexpr uint32_t CACHED_DYNAMIC_RENDERING = 1 << 0;
+	constexpr uint32_t CACHED_DYNAMIC_RENDERING_CORE = 1 << 1;
+	constexpr uint32_t CACHED_MESH_SHADER = 1 << 2;
+
+	// Anything that changes with the driver invalidates the record, so it's keyed on the driver version as well as the device.
+	struct CachedDeviceRecord
+	{
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint32_t apiVersion;
+		uint32_t instanceApiVersion;		// What we can use depends on the instance version too.
+		uint32_t queueFamilyCount;
+		uint32_t graphicsFamily;
+		uint32_t presentFamily;
+		uint32_t extensionsSupported;
+		uint32_t optionalFeatures;			// CACHED_ bits.
+	};
+
+	std::vector<CachedDeviceRecord> ReadCache(const std::string& filename)
+	{
+		std::vector<CachedDeviceRecord> records;
+
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			return records;
+		}
+
+		const uint64_t FILE_SIZE = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+
+		uint32_t header[3] = {};
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!file || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION)
+		{
+			return records;
+		}
+
+		// The count is only believed if the file is exactly that many records long, anything else is a miss.
+		if (FILE_SIZE != sizeof(header) + static_cast<uint64_t>(header[2]) * sizeof(CachedDeviceRecord))
+		{
+			return records;
+		}
+
+		records.resize(header[2]);
+		file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(CachedDeviceRecord));
+		if (!file)
+		{
+			records.clear();
+		}
+
+		return records;
+	}
+
+	void WriteCache(const std::string& filename, const std::vector<CachedDeviceRecord>& records)
+	{
+		// A cache that can't be written just means a slower start next time, so failure is ignored.
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			return;
+		}
+
+		const uint32_t HEADER[3] = { CACHE_MAGIC, CACHE_VERSION, static_cast<uint32_t>(records.size()) };
+		file.write(reinterpret_cast<const char*>(HEADER), sizeof(HEADER));
+		file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CachedDeviceRecord));
+	}
+
+	bool Matches(const CachedDeviceRecord& record, const DeviceCapabilities& capabilities, uint32_t instanceApiVersion)
+	{
+		return record.vendorID == capabilities.properties.vendorID
+			&& record.deviceID == capabilities.properties.deviceID
+			&& record.driverVersion == capabilities.properties.driverVersion
+			&& record.apiVersion == capabilities.properties.apiVersion
+			&& record.instanceApiVersion == instanceApiVersion
+			&& record.queueFamilyCount == capabilities.vQueueFamilies.size();
+	}
+
+	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, const std::vector<VkQueueFamilyProperties>& queueFamilies)
+	{
+		QueueFamilyIndices indices{};
+
+		for (uint32_t i = 0; i < queueFamilies.size(); i++)
+		{
+			VkBool32 presentSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+
+			if (presentSupport)
+			{
+				indices.presentFamily = i;
+			}
+
+			// Require at least one queue family that supports GFX bit.
+			if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			{
+				indices.graphicsFamily = i;
+			}
+
+			// Break if we have at least one of each required family.
+			if (indices.IsComplete())
+			{
+				break;
+			}
+		}
+
+		return indices;
+	}
+
+	std::set<std::string> GetDeviceExtensions(VkPhysicalDevice physicalDevice)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		std::set<std::string> names;
+		for (const auto& extension : availableExtensions)
+		{
+			names.insert(extension.extensionName);
+		}
+
+		return names;
+	}
+
+	bool DeviceExtensionSupport(const std::set<std::string>& availableExtensions)
+	{
+		// Tick off required extensions against those that are avilable.
+		for (const char* extension : V_EXTENS)
+		{
+			if (availableExtensions.count(extension) == 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void FindDynamicRendering(DeviceCapabilities& capabilities, const std::set<std::string>& availableExtensions, uint32_t instanceApiVersion)
+	{
+		if (instanceApiVersion < VK_MAKE_API_VERSION(0, 1, 1, 0) || capabilities.properties.apiVersion < VK_MAKE_API_VERSION(0, 1, 1, 0))
+		{
+			return;
+		}
+
+		// The extension's dependencies (create_renderpass2, depth_stencil_resolve) are only looked for on 1.1, where their own dependencies are core.
+		const bool CORE = instanceApiVersion >= VK_MAKE_API_VERSION(0, 1, 3, 0) && capabilities.properties.apiVersion >= VK_MAKE_API_VERSION(0, 1, 3, 0);
+		const bool EXTENSION = availableExtensions.count(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) != 0
+			&& availableExtensions.count(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) != 0
+			&& availableExtensions.count(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) != 0;
+
+		if (!CORE && !EXTENSION)
+		{
+			return;
+		}
+
+		// The KHR feature struct has the same layout and sType as the 1.3 one, so it works for both.
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+		dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &dynamicRenderingFeatures;
+		vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features2);
+
+		capabilities.dynamicRendering = dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+		capabilities.dynamicRenderingIsCore = capabilities.dynamicRendering && CORE;
+	}
+
+	void FindMeshShader(DeviceCapabilities& capabilities, const std::set<std::string>& availableExtensions, uint32_t instanceApiVersion)
+	{
+#ifdef VK_EXT_mesh_shader
+		if (instanceApiVersion < VK_MAKE_API_VERSION(0, 1, 2, 0) || capabilities.properties.apiVersion < VK_MAKE_API_VERSION(0, 1, 2, 0)
+			|| availableExtensions.count(VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0)
+		{
+			return;
+		}
+
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+		meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &meshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(capabilities.physicalDevice, &features2);
+
+		capabilities.meshShader = meshShaderFeatures.meshShader == VK_TRUE;
+#else
+		// Headers older than the extension, the path isn't compiled in.
+		(void)capabilities;
+		(void)availableExtensions;
+		(void)instanceApiVersion;
+#endif
+	}
+}
+
+DeviceCapabilities QueryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t instanceApiVersion, const std::string& cacheFilename)
+{
+	DeviceCapabilities capabilities;
+	capabilities.physicalDevice = physicalDevice;
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &capabilities.properties);
+	vkGetPhysicalDeviceFeatures(physicalDevice, &capabilities.features);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &capabilities.memoryProperties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	capabilities.vQueueFamilies.resize(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, capabilities.vQueueFamilies.data());
+
+	std::vector<CachedDeviceRecord> records;
+	bool fromCache = false;
+
+	if (!cacheFilename.empty())
+	{
+		records = ReadCache(cacheFilename);
+
+		for (const auto& RECORD : records)
+		{
+			if (!Matches(RECORD, capabilities, instanceApiVersion))
+			{
+				continue;
+			}
+
+			// Presentation support belongs to the surface rather than the device, so the cached family is still checked. One call instead of one per family.
+			VkBool32 presentSupport = false;
+			if (RECORD.presentFamily != UINT32_MAX)
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, RECORD.presentFamily, surface, &presentSupport);
+			}
+
+			if (presentSupport)
+			{
+				capabilities.queueFamilies.presentFamily = RECORD.presentFamily;
+				if (RECORD.graphicsFamily != UINT32_MAX)
+				{
+					capabilities.queueFamilies.graphicsFamily = RECORD.graphicsFamily;
+				}
+				capabilities.extensionsSupported = RECORD.extensionsSupported != 0;
+				capabilities.dynamicRendering = (RECORD.optionalFeatures & CACHED_DYNAMIC_RENDERING) != 0;
+				capabilities.dynamicRenderingIsCore = (RECORD.optionalFeatures & CACHED_DYNAMIC_RENDERING_CORE) != 0;
+				capabilities.meshShader = (RECORD.optionalFeatures & CACHED_MESH_SHADER) != 0;
+				fromCache = true;
+			}
+			break;
+		}
+	}
+
+	if (!fromCache)
+	{
+		capabilities.queueFamilies = FindQueueFamilies(physicalDevice, surface, capabilities.vQueueFamilies);
+
+		const std::set<std::string> EXTENSIONS = GetDeviceExtensions(physicalDevice);
+		capabilities.extensionsSupported = DeviceExtensionSupport(EXTENSIONS);
+		FindDynamicRendering(capabilities, EXTENSIONS, instanceApiVersion);
+		FindMeshShader(capabilities, EXTENSIONS, instanceApiVersion);
+	}
+
+	// Only query swap chain support if the swap chain extension is actually there.
+	if (capabilities.extensionsSupported)
+	{
+		RefreshSurfaceCapabilities(capabilities, surface);
+
+		uint32_t formatCount;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, nullptr);
+		capabilities.swapChainSupport.formats.resize(formatCount);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, capabilities.swapChainSupport.formats.data());
+
+		uint32_t presentModeCount;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+		capabilities.swapChainSupport.presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, capabilities.swapChainSupport.presentModes.data());
+	}
+
+	if (!cacheFilename.empty() && !fromCache)
+	{
+		CachedDeviceRecord record{};
+		record.vendorID = capabilities.properties.vendorID;
+		record.deviceID = capabilities.properties.deviceID;
+		record.driverVersion = capabilities.properties.driverVersion;
+		record.apiVersion = capabilities.properties.apiVersion;
+		record.instanceApiVersion = instanceApiVersion;
+		record.queueFamilyCount = queueFamilyCount;
+		record.graphicsFamily = capabilities.queueFamilies.graphicsFamily.value_or(UINT32_MAX);
+		record.presentFamily = capabilities.queueFamilies.presentFamily.value_or(UINT32_MAX);
+		record.extensionsSupported = capabilities.extensionsSupported ? 1 : 0;
+		record.optionalFeatures = (capabilities.dynamicRendering ? CACHED_DYNAMIC_RENDERING : 0) | (capabilities.dynamicRenderingIsCore ? CACHED_DYNAMIC_RENDERING_CORE : 0)
+			| (capabilities.meshShader ? CACHED_MESH_SHADER : 0);
+
+		// Replace any stale record for this device, from an older driver say.
+		bool replaced = false;
+		for (auto& existing : records)
+		{
+			if (existing.vendorID == record.vendorID && existing.deviceID == record.deviceID)
+			{
+				existing = record;
+				replaced = true;
+				break;
+			}
+		}
+
+		if (!replaced)
+		{
+			records.push_back(record);
+		}
+
+		WriteCache(cacheFilename, records);
+	}
+
+	return capabilities;
+}
+
+void RefreshSurfaceCapabilities(DeviceCapabilities& capabilities, VkSurfaceKHR surface)
+{
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(capabilities.physicalDevice, surface, &capabilities.swapChainSupport.capabilities);
+}
@@ -0,0 +1,49 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Everything we need to know about a physical device, queried once rather than on every use.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "VulkanUtils.h"
+
+#include <vector>
+#include <string>
+
+struct DeviceCapabilities
+{
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties{};
+	VkPhysicalDeviceFeatures features{};
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	std::vector<VkQueueFamilyProperties> vQueueFamilies;
+	QueueFamilyIndices queueFamilies;
+	bool extensionsSupported = false;
+
+	// Rendering straight to image views, without render pass or framebuffer objects. Core in 1.3, otherwise VK_KHR_dynamic_rendering.
+	bool dynamicRendering = false;
+	bool dynamicRenderingIsCore = false;
+
+	// VK_EXT_mesh_shader with its meshShader feature. Only looked for on 1.2 devices, where the SPIR-V 1.4 it needs is core.
+	bool meshShader = false;
+
+	// Formats and present modes are fixed for the surface, the capabilities change with the window so are refreshed on resize.
+	SwapChainSupportDetails swapChainSupport;
+
+	_NODISCARD bool Suitable() const
+	{
+		return queueFamilies.IsComplete() && extensionsSupported && !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+	}
+};
+
+/*
+	Runs every query for the device against the surface. Optional features are only looked for when the instance is 1.1 or newer,
+	since querying them needs vkGetPhysicalDeviceFeatures2. If a cache file is given and holds a record for the same device
+	and driver version, the queue family choice and extension check are taken from it instead of being redone.
+	The record is (re)written whenever it was missing or stale.
+*/
+DeviceCapabilities QueryDeviceCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t instanceApiVersion, const std::string& cacheFilename = "");
+
+// Only the surface capabilities, current extent and so on, which is all that changes when the window is resized.
+void RefreshSurfaceCapabilities(DeviceCapabilities& capabilities, VkSurfaceKHR surface);
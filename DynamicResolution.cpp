@@ -0,0 +1,424 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Render resolution steered by GPU frame time, and the upscale from it to the swap chain.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "DynamicResolution.h"
+#include "VulkanUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+	// How much of each cheaper measurement is taken, dearer ones are taken whole.
+	constexpr double COST_SMOOTHING = 0.1;
+
+	// How much of the way to the ideal scale each frame moves when it's higher than the current one.
+	constexpr float SCALE_GROWTH = 0.05f;
+
+	// Must match upscale.frag.
+	struct UpscalePushConstants
+	{
+		float renderSize[2];		// Texels of the target drawn this frame.
+		float targetTexel[2];		// One over the target's full size.
+		float renderPerOutput[2];	// Render texels per swap chain pixel.
+	};
+}
+
+void DynamicResolution::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, const DynamicResolutionSettings& settings)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_settings = settings;
+	m_settings.minScale = std::max(std::min(settings.minScale, settings.maxScale), 0.0625f);
+	m_scale = m_settings.maxScale;
+	m_vFrameScales.assign(framesInFlight, m_scale);
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(UpscalePushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale pipeline layout!");
+	}
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale descriptor pool!");
+	}
+
+	// One set, like the target. Frames are ordered around it by the scene pass's and the upscale pass's dependencies.
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate upscale descriptor set!");
+	}
+
+	// Bilinear taps, the shader weights them into the bicubic. Taps are kept inside the drawn corner, so the edge mode never comes into it.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale sampler!");
+	}
+}
+
+void DynamicResolution::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	ReleaseOutput();
+	ReleaseTargets();
+
+	vkDestroySampler(m_device, m_sampler, GetAllocationCallbacks());
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the set.
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+}
+
+void DynamicResolution::CreateTargets(VkExtent2D displayExtent, VkFormat colorFormat)
+{
+	ReleaseTargets();
+
+	m_displayExtent = displayExtent;
+	m_colorFormat = colorFormat;
+	m_targetExtent.width = std::max(static_cast<uint32_t>(std::ceil(displayExtent.width * m_settings.maxScale)), 1u);
+	m_targetExtent.height = std::max(static_cast<uint32_t>(std::ceil(displayExtent.height * m_settings.maxScale)), 1u);
+	UpdateRenderExtent();
+
+	// Drawn to by the scene, read by the upscale.
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = m_colorFormat;
+	imageInfo.extent = { m_targetExtent.width, m_targetExtent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_colorImage, m_colorMemory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_colorImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = m_colorFormat;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_colorView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create scene colour view!");
+	}
+
+	SetSource(m_colorView);
+}
+
+void DynamicResolution::SetSource(VkImageView view)
+{
+	const VkDescriptorImageInfo IMAGE_INFO = { m_sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_descriptorSet;
+	write.dstBinding = 0;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo = &IMAGE_INFO;
+
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+void DynamicResolution::ReleaseTargets()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyImageView(m_device, m_colorView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_colorImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_colorMemory, GetAllocationCallbacks());
+	m_colorView = VK_NULL_HANDLE;
+	m_colorImage = VK_NULL_HANDLE;
+	m_colorMemory = VK_NULL_HANDLE;
+}
+
+void DynamicResolution::CreateOutput(VkFormat swapChainFormat, const std::vector<VkImageView>& vSwapChainViews)
+{
+	ReleaseOutput();
+
+	// Every pixel is written, so what was in the image doesn't matter.
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = swapChainFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	// Waits for the acquire, which signals at colour output. The source was made readable by whatever wrote it.
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	if (vkCreateRenderPass(m_device, &renderPassInfo, GetAllocationCallbacks(), &m_renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale render pass!");
+	}
+
+	m_vFramebuffers.resize(vSwapChainViews.size());
+	for (size_t i = 0; i < vSwapChainViews.size(); i++)
+	{
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = m_renderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &vSwapChainViews[i];
+		framebufferInfo.width = m_displayExtent.width;
+		framebufferInfo.height = m_displayExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(m_device, &framebufferInfo, GetAllocationCallbacks(), &m_vFramebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upscale framebuffer!");
+		}
+	}
+
+	VkShaderModule vertShaderModule = LoadShaderModule(m_device, "shaders/fullscreen_vert.spv");
+	VkShaderModule fragShaderModule = LoadShaderModule(m_device, "shaders/upscale_frag.spv");
+
+	VkPipelineShaderStageCreateInfo shaderStages[2]{};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// The output is always the whole swap chain image, only the input varies.
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(m_displayExtent.width);
+	viewport.height = static_cast<float>(m_displayExtent.height);
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.extent = m_displayExtent;
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.layout = m_pipelineLayout;
+	pipelineInfo.renderPass = m_renderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, fragShaderModule, GetAllocationCallbacks());
+	vkDestroyShaderModule(m_device, vertShaderModule, GetAllocationCallbacks());
+}
+
+void DynamicResolution::ReleaseOutput()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (VkFramebuffer framebuffer : m_vFramebuffers)
+	{
+		vkDestroyFramebuffer(m_device, framebuffer, GetAllocationCallbacks());
+	}
+	m_vFramebuffers.clear();
+
+	vkDestroyPipeline(m_device, m_pipeline, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_renderPass, GetAllocationCallbacks());
+	m_pipeline = VK_NULL_HANDLE;
+	m_renderPass = VK_NULL_HANDLE;
+}
+
+void DynamicResolution::Update(uint32_t frame, double gpuMilliseconds)
+{
+	// The scale this frame is drawn at is the one its timing will be read against, whatever happens below.
+	const float MEASURED_SCALE = m_vFrameScales[frame];
+
+	if (m_settings.enabled && gpuMilliseconds > 0.0)
+	{
+		/*
+			In terms of a full scale frame, so frames drawn at different scales compare, and a measurement that's
+			frames old by the time it's read still says the right thing about the current scale.
+		*/
+		const double COST = gpuMilliseconds / (static_cast<double>(MEASURED_SCALE) * MEASURED_SCALE);
+		m_smoothedCost = (m_smoothedCost == 0.0 || COST > m_smoothedCost) ? COST : m_smoothedCost + (COST - m_smoothedCost) * COST_SMOOTHING;
+
+		const double PREDICTED = m_smoothedCost * m_scale * m_scale;
+		if (std::fabs(PREDICTED - m_settings.targetMilliseconds) > m_settings.targetMilliseconds * m_settings.tolerance)
+		{
+			// Down to the ideal in one go, up a little at a time. What isn't per pixel makes the ideal optimistic either way.
+			const float IDEAL = static_cast<float>(std::sqrt(m_settings.targetMilliseconds / m_smoothedCost));
+			const float NEXT = IDEAL < m_scale ? IDEAL : m_scale + (IDEAL - m_scale) * SCALE_GROWTH;
+			m_scale = std::clamp(NEXT, m_settings.minScale, m_settings.maxScale);
+			UpdateRenderExtent();
+		}
+	}
+
+	m_vFrameScales[frame] = m_scale;
+}
+
+void DynamicResolution::Record(VkCommandBuffer commandBuffer, uint32_t imageIndex) const
+{
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_renderPass;
+	renderPassInfo.framebuffer = m_vFramebuffers[imageIndex];
+	renderPassInfo.renderArea.extent = m_displayExtent;
+
+	UpscalePushConstants constants{};
+	constants.renderSize[0] = static_cast<float>(m_renderExtent.width);
+	constants.renderSize[1] = static_cast<float>(m_renderExtent.height);
+	constants.targetTexel[0] = 1.0f / static_cast<float>(m_targetExtent.width);
+	constants.targetTexel[1] = 1.0f / static_cast<float>(m_targetExtent.height);
+	constants.renderPerOutput[0] = static_cast<float>(m_renderExtent.width) / static_cast<float>(m_displayExtent.width);
+	constants.renderPerOutput[1] = static_cast<float>(m_renderExtent.height) / static_cast<float>(m_displayExtent.height);
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void DynamicResolution::UpdateRenderExtent()
+{
+	// Rounded to whole pixels, never past the target.
+	m_renderExtent.width = std::clamp(static_cast<uint32_t>(std::lround(m_displayExtent.width * m_scale)), 1u, std::max(m_targetExtent.width, 1u));
+	m_renderExtent.height = std::clamp(static_cast<uint32_t>(std::lround(m_displayExtent.height * m_scale)), 1u, std::max(m_targetExtent.height, 1u));
+}
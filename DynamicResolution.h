@@ -0,0 +1,124 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Render resolution steered by GPU frame time, and the upscale from it to the swap chain.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+
+struct DynamicResolutionSettings
+{
+	bool enabled;				// Otherwise the scale stays at maxScale.
+	double targetMilliseconds;	// GPU time per frame the scale is steered towards.
+	double tolerance;			// Fraction of the target either side of it that's left alone.
+	float minScale;				// Bounds of the scale along each axis.
+	float maxScale;
+};
+
+/*
+	The scene is drawn into a colour target sized for the largest scale, and each frame only uses its top left
+	corner, so changing scale costs nothing: no reallocation and no pipelines rebuilt, just a smaller viewport.
+	The upscale pass resamples that corner onto the swap chain image with a Catmull-Rom filter, which stays sharp
+	where bilinear would blur, and never reads past the corner into what bigger frames left behind.
+
+	GPU cost follows pixel count, the square of the scale. Going over budget brings the scale down straight away,
+	coming back up is gradual, so a spike costs a frame or two of resolution instead of frame rate.
+*/
+class DynamicResolution
+{
+public:
+
+	DynamicResolution() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_settings(),
+		m_scale(1.0f),
+		m_smoothedCost(0.0),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_descriptorSet(VK_NULL_HANDLE),
+		m_sampler(VK_NULL_HANDLE),
+		m_colorFormat(VK_FORMAT_UNDEFINED),
+		m_colorImage(VK_NULL_HANDLE),
+		m_colorMemory(VK_NULL_HANDLE),
+		m_colorView(VK_NULL_HANDLE),
+		m_displayExtent({ 0, 0 }),
+		m_targetExtent({ 0, 0 }),
+		m_renderExtent({ 0, 0 }),
+		m_renderPass(VK_NULL_HANDLE),
+		m_pipeline(VK_NULL_HANDLE)
+	{}
+
+	// Frame slots are the frames in flight, the scale each was last drawn at is kept to make sense of its timing.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, const DynamicResolutionSettings& settings);
+	void Destroy();
+
+	// The scene's colour target for this display size, to be sampled in SHADER_READ_ONLY_OPTIMAL. Replaces any previous target.
+	void CreateTargets(VkExtent2D displayExtent, VkFormat colorFormat);
+	void ReleaseTargets();
+
+	// What the upscale samples instead of the scene's colour, the same size and in the same layout. Until the targets are recreated.
+	void SetSource(VkImageView view);
+
+	// The upscale pass into every swap chain image. Its render pass is its own, with or without dynamic rendering.
+	void CreateOutput(VkFormat swapChainFormat, const std::vector<VkImageView>& vSwapChainViews);
+	void ReleaseOutput();
+
+	/*
+		Once a frame, before anything is recorded at RenderExtent. gpuMilliseconds is what the frame slot took the
+		last time it was used, negative when it wasn't measured.
+	*/
+	void Update(uint32_t frame, double gpuMilliseconds);
+
+	/*
+		Outside any render pass, after whatever wrote the source has left it ready to sample. Leaves the swap chain
+		image ready to present.
+	*/
+	void Record(VkCommandBuffer commandBuffer, uint32_t imageIndex) const;
+
+	// The corner of every scene target this frame draws into, viewport and render area alike.
+	_NODISCARD VkExtent2D RenderExtent() const { return m_renderExtent; }
+
+	// Every scene target's size, depth and G-buffer included.
+	_NODISCARD VkExtent2D TargetExtent() const { return m_targetExtent; }
+
+	_NODISCARD float Scale() const { return m_scale; }
+	_NODISCARD VkFormat ColorFormat() const { return m_colorFormat; }
+	_NODISCARD VkImage ColorImage() const { return m_colorImage; }
+	_NODISCARD VkImageView ColorView() const { return m_colorView; }
+
+private:
+
+	void UpdateRenderExtent();
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	DynamicResolutionSettings m_settings;
+	float m_scale;
+	double m_smoothedCost;				// Milliseconds a frame would take at a scale of 1, zero until the first measurement.
+	std::vector<float> m_vFrameScales;	// The scale each frame slot was last drawn at.
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkDescriptorPool m_descriptorPool;
+	VkDescriptorSet m_descriptorSet;	// Rewritten whenever the target is recreated.
+	VkSampler m_sampler;
+
+	VkFormat m_colorFormat;
+	VkImage m_colorImage;
+	VkDeviceMemory m_colorMemory;
+	VkImageView m_colorView;
+	VkExtent2D m_displayExtent;
+	VkExtent2D m_targetExtent;			// The display at the largest scale.
+	VkExtent2D m_renderExtent;			// The display at the current scale.
+
+	VkRenderPass m_renderPass;
+	VkPipeline m_pipeline;
+	std::vector<VkFramebuffer> m_vFramebuffers;		// One per swap chain image.
+};
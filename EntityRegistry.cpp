@@ -0,0 +1,189 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Archetype entity component store. Components live in structure of arrays chunks.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "EntityRegistry.h"
+
+#include <atomic>
+#include <stdexcept>
+
+uint32_t EntityDetail::NextComponentType()
+{
+	static std::atomic<uint32_t> s_next{ 0 };
+
+	const uint32_t ID = s_next.fetch_add(1, std::memory_order_relaxed);
+	if (ID >= EntityRegistry::MAX_COMPONENT_TYPES)
+	{
+		throw std::runtime_error("Too many component types, the archetype signature only has 64 bits!");
+	}
+
+	return ID;
+}
+
+EntityRegistry::EntityRegistry() :
+	m_aliveCount(0),
+	m_typeSizes{},
+	m_typeAlignments{}
+{
+	// Entities made with no components start here.
+	GetArchetype(0);
+}
+
+uint32_t EntityRegistry::GetArchetype(uint64_t signature)
+{
+	const auto FOUND = m_archetypeLookup.find(signature);
+	if (FOUND != m_archetypeLookup.end())
+	{
+		return FOUND->second;
+	}
+
+	Archetype archetype{};
+	archetype.signature = signature;
+
+	size_t bytesPerEntity = sizeof(Entity);
+	for (uint32_t type = 0; type < MAX_COMPONENT_TYPES; type++)
+	{
+		if (signature & (1ull << type))
+		{
+			archetype.vTypes.push_back(type);
+			bytesPerEntity += m_typeSizes[type];
+		}
+	}
+
+	// Lay the arrays out back to back, then shrink the capacity until the alignment padding fits too.
+	uint32_t capacity = static_cast<uint32_t>(CHUNK_SIZE / bytesPerEntity);
+	while (true)
+	{
+		size_t offset = sizeof(Entity) * capacity;
+		for (uint32_t type : archetype.vTypes)
+		{
+			const size_t ALIGNMENT = m_typeAlignments[type];
+			offset = (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+			archetype.offsets[type] = static_cast<uint32_t>(offset);
+			offset += static_cast<size_t>(m_typeSizes[type]) * capacity;
+		}
+
+		if (offset <= CHUNK_SIZE)
+		{
+			break;
+		}
+
+		capacity--;
+	}
+
+	if (capacity == 0)
+	{
+		throw std::runtime_error("Entity's components don't fit in a chunk!");
+	}
+
+	archetype.capacity = capacity;
+
+	const uint32_t INDEX = static_cast<uint32_t>(m_vArchetypes.size());
+	m_vArchetypes.push_back(std::move(archetype));
+	m_archetypeLookup.emplace(signature, INDEX);
+
+	return INDEX;
+}
+
+Entity EntityRegistry::AllocateEntity()
+{
+	Entity entity;
+
+	if (!m_vFreeIndices.empty())
+	{
+		entity.index = m_vFreeIndices.back();
+		m_vFreeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = static_cast<uint32_t>(m_vRecords.size());
+		m_vRecords.push_back({ INVALID, 0, 0 });
+	}
+
+	// Bumped on destroy, so a stale handle to this index no longer matches.
+	entity.generation = m_vRecords[entity.index].generation;
+	m_aliveCount++;
+
+	return entity;
+}
+
+uint32_t EntityRegistry::AddRow(uint32_t archetype, Entity entity)
+{
+	Archetype& arch = m_vArchetypes[archetype];
+
+	const uint32_t ROW = arch.count++;
+	if (ROW / arch.capacity == arch.vChunks.size())
+	{
+		arch.vChunks.push_back(std::make_unique<Chunk>());
+	}
+
+	reinterpret_cast<Entity*>(arch.vChunks[ROW / arch.capacity]->data)[ROW % arch.capacity] = entity;
+	m_vRecords[entity.index].archetype = archetype;
+	m_vRecords[entity.index].row = ROW;
+
+	return ROW;
+}
+
+void EntityRegistry::RemoveRow(uint32_t archetype, uint32_t row)
+{
+	Archetype& arch = m_vArchetypes[archetype];
+	const uint32_t LAST = arch.count - 1;
+
+	// Fill the hole with the last entity, so the arrays stay packed.
+	if (row != LAST)
+	{
+		Entity* pRowEntity = &reinterpret_cast<Entity*>(arch.vChunks[row / arch.capacity]->data)[row % arch.capacity];
+		const Entity MOVED = reinterpret_cast<Entity*>(arch.vChunks[LAST / arch.capacity]->data)[LAST % arch.capacity];
+
+		*pRowEntity = MOVED;
+		for (uint32_t type : arch.vTypes)
+		{
+			std::memcpy(Element(archetype, row, type), Element(archetype, LAST, type), m_typeSizes[type]);
+		}
+
+		m_vRecords[MOVED.index].row = row;
+	}
+
+	arch.count--;
+
+	// Empty chunks go straight back, a query never has to skip them.
+	if (arch.count % arch.capacity == 0 && arch.vChunks.size() > arch.count / arch.capacity)
+	{
+		arch.vChunks.pop_back();
+	}
+}
+
+void EntityRegistry::MoveEntity(Entity entity, uint32_t archetype)
+{
+	const Record OLD = m_vRecords[entity.index];
+	const uint32_t NEW_ROW = AddRow(archetype, entity);
+
+	// Carry over whatever both archetypes have. New components are the caller's to write.
+	for (uint32_t type : m_vArchetypes[OLD.archetype].vTypes)
+	{
+		if (m_vArchetypes[archetype].signature & (1ull << type))
+		{
+			std::memcpy(Element(archetype, NEW_ROW, type), Element(OLD.archetype, OLD.row, type), m_typeSizes[type]);
+		}
+	}
+
+	RemoveRow(OLD.archetype, OLD.row);
+}
+
+void EntityRegistry::Destroy(Entity entity)
+{
+	if (!Alive(entity))
+	{
+		return;
+	}
+
+	Record& record = m_vRecords[entity.index];
+	RemoveRow(record.archetype, record.row);
+
+	record.archetype = INVALID;
+	record.generation++;
+	m_vFreeIndices.push_back(entity.index);
+	m_aliveCount--;
+}
@@ -0,0 +1,289 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Archetype entity component store. Components live in structure of arrays chunks.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+// Stays valid through any amount of moving around, and stops matching once the entity is destroyed.
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+namespace EntityDetail
+{
+	// Ids are handed out the first time each component type is used, in any registry.
+	uint32_t NextComponentType();
+}
+
+// Const only says how a query uses the component, it's the same type.
+template<typename T>
+uint32_t ComponentType()
+{
+	if constexpr (std::is_const_v<T>)
+	{
+		return ComponentType<std::remove_const_t<T>>();
+	}
+	else
+	{
+		static const uint32_t ID = EntityDetail::NextComponentType();
+		return ID;
+	}
+}
+
+/*
+	Every entity with the same set of components shares an archetype. An archetype's entities are packed
+	into fixed size chunks, each component in its own array, so a query walks straight through memory.
+	Removing an entity moves the archetype's last entity into its place, rows are never left empty.
+
+	Components must be trivially copyable, they're moved between archetypes with memcpy. Structural changes
+	(create, destroy, add, remove) are single threaded and must not happen during a ForEach.
+*/
+class EntityRegistry
+{
+public:
+
+	static constexpr size_t CHUNK_SIZE = 16 * 1024;
+	static constexpr uint32_t MAX_COMPONENT_TYPES = 64;		// One bit each in an archetype's signature.
+
+	EntityRegistry();
+
+	template<typename... Ts>
+	Entity Create(const Ts&... components)
+	{
+		(RegisterType<Ts>(), ...);
+
+		const uint32_t ARCHETYPE = GetArchetype((Bit<Ts>() | ... | 0ull));
+		const Entity ENTITY = AllocateEntity();
+		const uint32_t ROW = AddRow(ARCHETYPE, ENTITY);
+		(Write(ARCHETYPE, ROW, components), ...);
+
+		return ENTITY;
+	}
+
+	void Destroy(Entity entity);
+
+	_NODISCARD bool Alive(Entity entity) const
+	{
+		return entity.index < m_vRecords.size() && m_vRecords[entity.index].generation == entity.generation && m_vRecords[entity.index].archetype != INVALID;
+	}
+
+	// Null when the entity doesn't have one. Only good until the next structural change.
+	template<typename T>
+	_NODISCARD T* Get(Entity entity)
+	{
+		if (!Alive(entity))
+		{
+			return nullptr;
+		}
+
+		const Record& RECORD = m_vRecords[entity.index];
+		const uint32_t TYPE = ComponentType<T>();
+		if ((m_vArchetypes[RECORD.archetype].signature & (1ull << TYPE)) == 0)
+		{
+			return nullptr;
+		}
+
+		return reinterpret_cast<T*>(Element(RECORD.archetype, RECORD.row, TYPE));
+	}
+
+	template<typename T>
+	_NODISCARD bool Has(Entity entity) { return Get<T>(entity) != nullptr; }
+
+	// Overwrites the component if the entity already has one.
+	template<typename T>
+	void Add(Entity entity, const T& component)
+	{
+		RegisterType<T>();
+
+		if (T* pExisting = Get<T>(entity))
+		{
+			*pExisting = component;
+			return;
+		}
+
+		if (!Alive(entity))
+		{
+			return;
+		}
+
+		const Record& RECORD = m_vRecords[entity.index];
+		const uint32_t ARCHETYPE = GetArchetype(m_vArchetypes[RECORD.archetype].signature | Bit<T>());
+		MoveEntity(entity, ARCHETYPE);
+		Write(ARCHETYPE, m_vRecords[entity.index].row, component);
+	}
+
+	template<typename T>
+	void Remove(Entity entity)
+	{
+		if (!Has<T>(entity))
+		{
+			return;
+		}
+
+		MoveEntity(entity, GetArchetype(m_vArchetypes[m_vRecords[entity.index].archetype].signature & ~Bit<T>()));
+	}
+
+	/*
+		Calls function(count, entities, Ts* arrays...) once per chunk holding all of Ts. The arrays run in parallel,
+		element i of each belongs to entities[i]. The loop over a chunk is the caller's, so it can be vectorised.
+	*/
+	template<typename... Ts, typename F>
+	void ForEach(F&& function)
+	{
+		const uint64_t REQUIRED = (Bit<Ts>() | ... | 0ull);
+
+		for (uint32_t a = 0; a < m_vArchetypes.size(); a++)
+		{
+			const Archetype& ARCHETYPE = m_vArchetypes[a];
+			if ((ARCHETYPE.signature & REQUIRED) != REQUIRED)
+			{
+				continue;
+			}
+
+			for (uint32_t c = 0; c < ARCHETYPE.vChunks.size(); c++)
+			{
+				RunChunk<Ts...>(a, c, function);
+			}
+		}
+	}
+
+	// As ForEach, with chunks spread over the job system. Returns once every chunk is done, so not from a worker.
+	template<typename... Ts, typename F>
+	void ParallelForEach(JobSystem& jobs, F&& function)
+	{
+		const uint64_t REQUIRED = (Bit<Ts>() | ... | 0ull);
+
+		m_vScratchChunks.clear();
+		for (uint32_t a = 0; a < m_vArchetypes.size(); a++)
+		{
+			if ((m_vArchetypes[a].signature & REQUIRED) == REQUIRED)
+			{
+				for (uint32_t c = 0; c < m_vArchetypes[a].vChunks.size(); c++)
+				{
+					m_vScratchChunks.push_back({ a, c });
+				}
+			}
+		}
+
+		// A chunk is already a good sized piece of work, so one per job.
+		JobSystem::Job* job = jobs.ParallelFor(static_cast<uint32_t>(m_vScratchChunks.size()), 1, [this, &function](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				RunChunk<Ts...>(m_vScratchChunks[i].archetype, m_vScratchChunks[i].chunk, function);
+			}
+		});
+
+		jobs.Wait(job);
+	}
+
+	_NODISCARD size_t Count() const { return m_aliveCount; }
+
+private:
+
+	static constexpr uint32_t INVALID = UINT32_MAX;
+
+	struct alignas(64) Chunk
+	{
+		unsigned char data[CHUNK_SIZE];
+	};
+
+	struct Archetype
+	{
+		uint64_t signature;
+		uint32_t capacity;								// Entities per chunk.
+		uint32_t count;									// Entities over all chunks, every chunk but the last is full.
+		uint32_t offsets[MAX_COMPONENT_TYPES];			// Where each component's array starts in a chunk. The entities array is at zero.
+		std::vector<uint32_t> vTypes;
+		std::vector<std::unique_ptr<Chunk>> vChunks;
+	};
+
+	struct Record
+	{
+		uint32_t archetype;
+		uint32_t row;
+		uint32_t generation;
+	};
+
+	struct ChunkRef
+	{
+		uint32_t archetype;
+		uint32_t chunk;
+	};
+
+	template<typename T>
+	static uint64_t Bit() { return 1ull << ComponentType<T>(); }
+
+	template<typename T>
+	void RegisterType()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Components are moved with memcpy, so must be trivially copyable!");
+		static_assert(alignof(T) <= alignof(Chunk), "Component is aligned more than a chunk!");
+
+		const uint32_t TYPE = ComponentType<T>();
+		if (m_typeSizes[TYPE] == 0)
+		{
+			m_typeSizes[TYPE] = sizeof(T);
+			m_typeAlignments[TYPE] = alignof(T);
+		}
+	}
+
+	template<typename T>
+	void Write(uint32_t archetype, uint32_t row, const T& component)
+	{
+		std::memcpy(Element(archetype, row, ComponentType<T>()), &component, sizeof(T));
+	}
+
+	template<typename... Ts, typename F>
+	void RunChunk(uint32_t archetype, uint32_t chunk, F& function)
+	{
+		const Archetype& ARCHETYPE = m_vArchetypes[archetype];
+		const uint32_t FIRST = chunk * ARCHETYPE.capacity;
+		const uint32_t COUNT = std::min(ARCHETYPE.capacity, ARCHETYPE.count - FIRST);
+		unsigned char* pData = ARCHETYPE.vChunks[chunk]->data;
+
+		function(COUNT, reinterpret_cast<const Entity*>(pData), reinterpret_cast<Ts*>(pData + ARCHETYPE.offsets[ComponentType<Ts>()])...);
+	}
+
+	unsigned char* Element(uint32_t archetype, uint32_t row, uint32_t type)
+	{
+		const Archetype& ARCHETYPE = m_vArchetypes[archetype];
+		Chunk& chunk = *ARCHETYPE.vChunks[row / ARCHETYPE.capacity];
+		return chunk.data + ARCHETYPE.offsets[type] + static_cast<size_t>(row % ARCHETYPE.capacity) * m_typeSizes[type];
+	}
+
+	uint32_t GetArchetype(uint64_t signature);
+	Entity AllocateEntity();
+	uint32_t AddRow(uint32_t archetype, Entity entity);
+	void RemoveRow(uint32_t archetype, uint32_t row);
+	void MoveEntity(Entity entity, uint32_t archetype);
+
+	std::vector<Archetype> m_vArchetypes;
+	std::unordered_map<uint64_t, uint32_t> m_archetypeLookup;
+
+	std::vector<Record> m_vRecords;						// Indexed by Entity::index.
+	std::vector<uint32_t> m_vFreeIndices;
+	size_t m_aliveCount;
+
+	uint32_t m_typeSizes[MAX_COMPONENT_TYPES];
+	uint32_t m_typeAlignments[MAX_COMPONENT_TYPES];
+
+	std::vector<ChunkRef> m_vScratchChunks;
+};
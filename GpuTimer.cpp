@@ -0,0 +1,129 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	GPU time of scopes within each frame's command buffer, from timestamp queries.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "GpuTimer.h"
+#include "VulkanUtils.h"
+
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+void GpuTimer::Init(VkDevice device, uint32_t framesInFlight, uint32_t scopeCount, float nanosecondsPerTick, uint32_t validBits)
+{
+	m_device = device;
+	m_scopeCount = scopeCount;
+
+	// Left without a pool, every read fails.
+	if (validBits == 0 || scopeCount == 0)
+	{
+		return;
+	}
+
+	m_millisecondsPerTick = static_cast<double>(nanosecondsPerTick) * 1e-6;
+	m_validMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+	m_vEnded.assign(static_cast<size_t>(framesInFlight) * scopeCount, false);
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = 2 * framesInFlight * scopeCount;
+
+	if (vkCreateQueryPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_queryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timestamp query pool!");
+	}
+}
+
+void GpuTimer::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyQueryPool(m_device, m_queryPool, GetAllocationCallbacks());
+	m_queryPool = VK_NULL_HANDLE;
+}
+
+void GpuTimer::Reset(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (!Supported())
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, 2 * frame * m_scopeCount, 2 * m_scopeCount);
+	for (uint32_t scope = 0; scope < m_scopeCount; scope++)
+	{
+		m_vEnded[frame * m_scopeCount + scope] = false;
+	}
+}
+
+void GpuTimer::Begin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope)
+{
+	if (Supported())
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * (frame * m_scopeCount + scope));
+	}
+}
+
+void GpuTimer::End(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope)
+{
+	if (Supported())
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * (frame * m_scopeCount + scope) + 1);
+		m_vEnded[frame * m_scopeCount + scope] = true;
+	}
+}
+
+bool GpuTimer::Read(uint32_t frame, uint32_t scope, double& milliseconds) const
+{
+	if (!Supported() || !m_vEnded[frame * m_scopeCount + scope])
+	{
+		return false;
+	}
+
+	// Without the wait flag this never blocks, not ready just means the submission was skipped or is still running.
+	uint64_t timestamps[2];
+	if (vkGetQueryPoolResults(m_device, m_queryPool, 2 * (frame * m_scopeCount + scope), 2, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	const uint64_t TICKS = ((timestamps[1] & m_validMask) - (timestamps[0] & m_validMask)) & m_validMask;
+	milliseconds = static_cast<double>(TICKS) * m_millisecondsPerTick;
+	return true;
+}
+
+void GpuScopeStats::Add(double milliseconds, uint64_t pixels)
+{
+	m_samples++;
+
+	const double DELTA = milliseconds - m_meanMilliseconds;
+	m_meanMilliseconds += DELTA / m_samples;
+	m_millisecondsM2 += DELTA * (milliseconds - m_meanMilliseconds);
+
+	const double PER_MEGAPIXEL = pixels > 0 ? milliseconds * 1e6 / static_cast<double>(pixels) : 0.0;
+	m_meanMillisecondsPerMegapixel += (PER_MEGAPIXEL - m_meanMillisecondsPerMegapixel) / m_samples;
+}
+
+void GpuScopeStats::Report(std::ostream& out, const char* name) const
+{
+	out << "GPU time " << name << ":" << std::endl;
+
+	if (m_samples < 2)
+	{
+		out << "    Not enough samples" << std::endl;
+		return;
+	}
+
+	const double STD_DEV = std::sqrt(m_millisecondsM2 / (m_samples - 1));
+
+	out << std::fixed << std::setprecision(3);
+	out << "    " << m_meanMilliseconds << " ms mean, " << STD_DEV << " ms std dev, " << m_meanMillisecondsPerMegapixel
+		<< " ms per megapixel over " << m_samples << " frames" << std::endl;
+}
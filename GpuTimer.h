@@ -0,0 +1,83 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	GPU time of scopes within each frame's command buffer, from timestamp queries.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+/*
+	Every frame in flight has its own pair of timestamps per scope, so a frame's times are read once its fence has
+	been waited on and never stall. Times are a frame or more old by then, which is as fresh as the GPU allows
+	without waiting for it. Queues without timestamp support report nothing, and everything else still works.
+*/
+class GpuTimer
+{
+public:
+
+	GpuTimer() :
+		m_device(VK_NULL_HANDLE),
+		m_queryPool(VK_NULL_HANDLE),
+		m_scopeCount(0),
+		m_millisecondsPerTick(0.0),
+		m_validMask(0)
+	{}
+
+	// nanosecondsPerTick is the device's timestampPeriod, validBits the queue family's timestampValidBits.
+	void Init(VkDevice device, uint32_t framesInFlight, uint32_t scopeCount, float nanosecondsPerTick, uint32_t validBits);
+	void Destroy();
+
+	// Outside any render pass, before any scope of the frame is begun. What the frame's slot last measured is lost.
+	void Reset(VkCommandBuffer commandBuffer, uint32_t frame);
+
+	// Scopes are timed from every earlier command finishing to every command up to End finishing.
+	void Begin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope);
+	void End(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope);
+
+	// False when the scope wasn't timed in the frame's last submission, or the results aren't in yet.
+	bool Read(uint32_t frame, uint32_t scope, double& milliseconds) const;
+
+	_NODISCARD bool Supported() const { return m_queryPool != VK_NULL_HANDLE; }
+
+private:
+
+	VkDevice m_device;
+	VkQueryPool m_queryPool;		// Two queries per scope per frame, begin then end.
+	uint32_t m_scopeCount;
+	double m_millisecondsPerTick;
+	uint64_t m_validMask;			// Bits past the queue's valid bits are undefined.
+	std::vector<bool> m_vEnded;		// Per scope per frame, whether its end was written since the last reset.
+};
+
+// Running statistics of one scope's times, for comparing ways of doing the same work.
+class GpuScopeStats
+{
+public:
+
+	GpuScopeStats() :
+		m_samples(0),
+		m_meanMilliseconds(0.0),
+		m_millisecondsM2(0.0),
+		m_meanMillisecondsPerMegapixel(0.0)
+	{}
+
+	// Pixels is how many the scope processed, so times taken at different resolutions still compare.
+	void Add(double milliseconds, uint64_t pixels);
+
+	_NODISCARD uint64_t Samples() const { return m_samples; }
+
+	void Report(std::ostream& out, const char* name) const;
+
+private:
+
+	uint64_t m_samples;
+	double m_meanMilliseconds;		// Welford's running mean and sum of squared differences.
+	double m_millisecondsM2;
+	double m_meanMillisecondsPerMegapixel;
+};
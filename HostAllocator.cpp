@@ -0,0 +1,332 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Host allocator handed to the driver through VkAllocationCallbacks, tracking what it allocates per scope.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "HostAllocator.h"
+#include "Constants.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+
+#define POOL_CHUNK_SIZE				Memory_constants::g_hostPoolChunkSize
+#define TRACK_HOST_ALLOCATIONS		Memory_constants::g_trackHostAllocations
+
+// Sits directly in front of every pointer we hand out.
+struct HostAllocator::AllocationHeader
+{
+	void* pRaw;			// What to give back to free(), or the pool block.
+	size_t size;
+	uint32_t scope;
+	int32_t sizeClass;	// -1 when it came from malloc.
+};
+
+namespace
+{
+	// Header space is a multiple of the pool alignment so pool blocks stay aligned.
+	constexpr size_t HEADER_SPACE = 32;
+	constexpr size_t POOL_ALIGNMENT = 16;
+	constexpr size_t SIZE_CLASSES[] = { 32, 64, 128, 256, 512 };
+
+	const char* SCOPE_NAMES[] = { "Command", "Object", "Cache", "Device", "Instance" };
+
+	int32_t FindSizeClass(size_t size, size_t alignment)
+	{
+		if (alignment > POOL_ALIGNMENT)
+		{
+			return -1;
+		}
+
+		for (int32_t i = 0; i < static_cast<int32_t>(std::size(SIZE_CLASSES)); i++)
+		{
+			if (size <= SIZE_CLASSES[i])
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+}
+
+HostAllocator::HostAllocator() :
+	m_callbacks{},
+	m_inFrame(false),
+	m_frame(0),
+	m_flagged{},
+	m_flaggedCount(0)
+{
+	m_callbacks.pUserData = this;
+	m_callbacks.pfnAllocation = Allocate;
+	m_callbacks.pfnReallocation = Reallocate;
+	m_callbacks.pfnFree = Free;
+	m_callbacks.pfnInternalAllocation = InternalAllocate;
+	m_callbacks.pfnInternalFree = InternalFree;
+}
+
+HostAllocator::~HostAllocator()
+{
+	// Anything still live in a pool goes with its chunk. By now the instance is gone, so there shouldn't be.
+	for (auto& pool : m_pools)
+	{
+		for (void* pChunk : pool.vChunks)
+		{
+			std::free(pChunk);
+		}
+	}
+}
+
+void HostAllocator::BeginFrame()
+{
+	m_frame++;
+	m_inFrame = true;
+}
+
+void HostAllocator::EndFrame()
+{
+	m_inFrame = false;
+}
+
+HostAllocator::ScopeStats HostAllocator::GetStats(VkSystemAllocationScope scope) const
+{
+	const ScopePool& POOL = m_pools[scope];
+
+	std::lock_guard<std::mutex> lock(POOL.mutex);
+	return POOL.stats;
+}
+
+void HostAllocator::Report(std::ostream& out) const
+{
+	out << "Driver host allocations:" << std::endl;
+	out << "    " << std::left << std::setw(10) << "Scope" << std::right
+		<< std::setw(10) << "Live" << std::setw(12) << "Live bytes" << std::setw(12) << "Peak bytes"
+		<< std::setw(10) << "Total" << std::setw(10) << "In frame" << std::setw(12) << "Internal" << std::endl;
+
+	for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++)
+	{
+		const ScopeStats STATS = GetStats(static_cast<VkSystemAllocationScope>(scope));
+
+		out << "    " << std::left << std::setw(10) << SCOPE_NAMES[scope] << std::right
+			<< std::setw(10) << STATS.liveCount << std::setw(12) << STATS.liveBytes << std::setw(12) << STATS.peakBytes
+			<< std::setw(10) << STATS.totalAllocations << std::setw(10) << STATS.frameAllocations << std::setw(12) << STATS.internalBytes << std::endl;
+	}
+
+	std::lock_guard<std::mutex> lock(m_flaggedMutex);
+	if (m_flaggedCount > 0)
+	{
+		out << "    First allocations made inside the frame loop:" << std::endl;
+		for (uint32_t i = 0; i < m_flaggedCount; i++)
+		{
+			const FlaggedAllocation& FLAGGED = m_flagged[i];
+			out << "        frame " << FLAGGED.frame << ": " << FLAGGED.size << " bytes, alignment " << FLAGGED.alignment << ", " << SCOPE_NAMES[FLAGGED.scope] << " scope" << std::endl;
+		}
+	}
+}
+
+// =================================================================================================================================================================
+// Callbacks, these may be called from any thread.
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::Allocate(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(pUserData)->DoAllocate(size, alignment, scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::Reallocate(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	HostAllocator* pThis = static_cast<HostAllocator*>(pUserData);
+
+	if (pOriginal == nullptr)
+	{
+		return pThis->DoAllocate(size, alignment, scope);
+	}
+
+	if (size == 0)
+	{
+		pThis->DoFree(pOriginal);
+		return nullptr;
+	}
+
+	// On failure the original must be left alone, so allocate before freeing.
+	void* pNew = pThis->DoAllocate(size, alignment, scope);
+	if (pNew == nullptr)
+	{
+		return nullptr;
+	}
+
+	const AllocationHeader* HEADER = reinterpret_cast<const AllocationHeader*>(static_cast<uint8_t*>(pOriginal) - sizeof(AllocationHeader));
+	std::memcpy(pNew, pOriginal, std::min(size, HEADER->size));
+	pThis->DoFree(pOriginal);
+
+	return pNew;
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::Free(void* pUserData, void* pMemory)
+{
+	if (pMemory != nullptr)
+	{
+		static_cast<HostAllocator*>(pUserData)->DoFree(pMemory);
+	}
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::InternalAllocate(void* pUserData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	ScopePool& pool = static_cast<HostAllocator*>(pUserData)->m_pools[scope];
+
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.stats.internalBytes += size;
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::InternalFree(void* pUserData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	ScopePool& pool = static_cast<HostAllocator*>(pUserData)->m_pools[scope];
+
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.stats.internalBytes -= size;
+}
+
+// =================================================================================================================================================================
+// Pools.
+
+void* HostAllocator::DoAllocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0)
+	{
+		return nullptr;
+	}
+
+	ScopePool& pool = m_pools[scope];
+	const int32_t SIZE_CLASS = FindSizeClass(size, alignment);
+	const bool IN_FRAME = m_inFrame;
+
+	uint8_t* pUser = nullptr;
+	void* pRaw = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		if (SIZE_CLASS >= 0)
+		{
+			pRaw = TakeBlock(pool, static_cast<uint32_t>(SIZE_CLASS));
+			if (pRaw != nullptr)
+			{
+				pUser = static_cast<uint8_t*>(pRaw) + HEADER_SPACE;
+			}
+		}
+
+		if (pRaw != nullptr || SIZE_CLASS < 0)
+		{
+			pool.stats.liveCount++;
+			pool.stats.liveBytes += size;
+			pool.stats.peakBytes = std::max(pool.stats.peakBytes, pool.stats.liveBytes);
+			pool.stats.totalAllocations++;
+			pool.stats.frameAllocations += IN_FRAME ? 1 : 0;
+		}
+	}
+
+	if (SIZE_CLASS < 0)
+	{
+		// Over allocate so there's room for the header in front of an aligned pointer.
+		const size_t ALIGNMENT = std::max(alignment, POOL_ALIGNMENT);
+		pRaw = std::malloc(size + ALIGNMENT + HEADER_SPACE);
+		if (pRaw == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			pool.stats.liveCount--;
+			pool.stats.liveBytes -= size;
+			pool.stats.totalAllocations--;
+			pool.stats.frameAllocations -= IN_FRAME ? 1 : 0;
+			return nullptr;
+		}
+
+		const uintptr_t FIRST = reinterpret_cast<uintptr_t>(pRaw) + HEADER_SPACE;
+		pUser = reinterpret_cast<uint8_t*>((FIRST + ALIGNMENT - 1) & ~static_cast<uintptr_t>(ALIGNMENT - 1));
+	}
+	else if (pRaw == nullptr)
+	{
+		return nullptr;
+	}
+
+	AllocationHeader* pHeader = reinterpret_cast<AllocationHeader*>(pUser - sizeof(AllocationHeader));
+	pHeader->pRaw = pRaw;
+	pHeader->size = size;
+	pHeader->scope = static_cast<uint32_t>(scope);
+	pHeader->sizeClass = SIZE_CLASS;
+
+	if (IN_FRAME)
+	{
+		std::lock_guard<std::mutex> lock(m_flaggedMutex);
+		if (m_flaggedCount < MAX_FLAGGED)
+		{
+			m_flagged[m_flaggedCount++] = { m_frame, size, alignment, scope };
+		}
+	}
+
+	return pUser;
+}
+
+void HostAllocator::DoFree(void* pMemory)
+{
+	const AllocationHeader HEADER = *reinterpret_cast<const AllocationHeader*>(static_cast<uint8_t*>(pMemory) - sizeof(AllocationHeader));
+	ScopePool& pool = m_pools[HEADER.scope];
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		pool.stats.liveCount--;
+		pool.stats.liveBytes -= HEADER.size;
+
+		if (HEADER.sizeClass >= 0)
+		{
+			// Back on the free list, the link lives in the first bytes of the block.
+			*static_cast<void**>(HEADER.pRaw) = pool.freeLists[HEADER.sizeClass];
+			pool.freeLists[HEADER.sizeClass] = HEADER.pRaw;
+			return;
+		}
+	}
+
+	std::free(HEADER.pRaw);
+}
+
+void* HostAllocator::TakeBlock(ScopePool& pool, uint32_t sizeClass)
+{
+	if (pool.freeLists[sizeClass] == nullptr)
+	{
+		const size_t BLOCK_SIZE = HEADER_SPACE + SIZE_CLASSES[sizeClass];
+		const size_t BLOCK_COUNT = POOL_CHUNK_SIZE / BLOCK_SIZE;
+
+		uint8_t* pChunk = static_cast<uint8_t*>(std::malloc(BLOCK_COUNT * BLOCK_SIZE));
+		if (pChunk == nullptr)
+		{
+			return nullptr;
+		}
+		pool.vChunks.push_back(pChunk);
+
+		// Thread the new blocks onto the free list, back to front so they're handed out in address order.
+		for (size_t i = BLOCK_COUNT; i > 0; i--)
+		{
+			void* pBlock = pChunk + (i - 1) * BLOCK_SIZE;
+			*static_cast<void**>(pBlock) = pool.freeLists[sizeClass];
+			pool.freeLists[sizeClass] = pBlock;
+		}
+	}
+
+	void* pBlock = pool.freeLists[sizeClass];
+	pool.freeLists[sizeClass] = *static_cast<void**>(pBlock);
+	return pBlock;
+}
+
+// =================================================================================================================================================================
+
+HostAllocator& GetHostAllocator()
+{
+	static HostAllocator s_allocator;
+	return s_allocator;
+}
+
+const VkAllocationCallbacks* GetAllocationCallbacks()
+{
+	return TRACK_HOST_ALLOCATIONS ? &GetHostAllocator().GetCallbacks() : nullptr;
+}
@@ -0,0 +1,99 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Host allocator handed to the driver through VkAllocationCallbacks, tracking what it allocates per scope.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+/*
+	Small allocations come from per scope pools of fixed size blocks, so short lived command scope allocations
+	don't hit the CRT heap. Anything larger or more aligned than a pool block goes to malloc.
+	Every allocation carries a small header so frees and reallocations know where they came from.
+*/
+class HostAllocator
+{
+public:
+
+	struct ScopeStats
+	{
+		uint64_t liveCount = 0;
+		uint64_t liveBytes = 0;
+		uint64_t peakBytes = 0;
+		uint64_t totalAllocations = 0;
+		uint64_t frameAllocations = 0;	// Made between BeginFrame and EndFrame.
+		uint64_t internalBytes = 0;		// Driver's own allocations it told us about.
+	};
+
+	HostAllocator();
+	~HostAllocator();
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	_NODISCARD const VkAllocationCallbacks& GetCallbacks() const { return m_callbacks; }
+
+	// Everything between these is counted as an in frame allocation, which we'd ideally have none of.
+	void BeginFrame();
+	void EndFrame();
+
+	_NODISCARD ScopeStats GetStats(VkSystemAllocationScope scope) const;
+	void Report(std::ostream& out) const;
+
+private:
+
+	static constexpr uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	static constexpr uint32_t SIZE_CLASS_COUNT = 5;		// 32, 64, 128, 256 and 512 bytes.
+	static constexpr uint32_t MAX_FLAGGED = 16;
+
+	struct AllocationHeader;
+
+	struct FlaggedAllocation
+	{
+		uint64_t frame;
+		size_t size;
+		size_t alignment;
+		VkSystemAllocationScope scope;
+	};
+
+	// One per scope. Scopes are locked separately since command scope traffic is the busy one.
+	struct ScopePool
+	{
+		mutable std::mutex mutex;
+		void* freeLists[SIZE_CLASS_COUNT] = {};
+		std::vector<void*> vChunks;
+		ScopeStats stats;
+	};
+
+	static VKAPI_ATTR void* VKAPI_CALL Allocate(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void* VKAPI_CALL Reallocate(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL Free(void* pUserData, void* pMemory);
+	static VKAPI_ATTR void VKAPI_CALL InternalAllocate(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static VKAPI_ATTR void VKAPI_CALL InternalFree(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	void* DoAllocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void DoFree(void* pMemory);
+	void* TakeBlock(ScopePool& pool, uint32_t sizeClass);
+
+	VkAllocationCallbacks m_callbacks;
+	ScopePool m_pools[SCOPE_COUNT];
+
+	std::atomic<bool> m_inFrame;
+	std::atomic<uint64_t> m_frame;
+
+	mutable std::mutex m_flaggedMutex;
+	FlaggedAllocation m_flagged[MAX_FLAGGED];
+	uint32_t m_flaggedCount;
+};
+
+// The app wide allocator. Returns nullptr when tracking is turned off in Constants.h, so the driver uses its own.
+_NODISCARD HostAllocator& GetHostAllocator();
+_NODISCARD const VkAllocationCallbacks* GetAllocationCallbacks();
@@ -0,0 +1,332 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Work stealing job system. One Chase-Lev deque per worker, dependencies run as continuations.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "JobSystem.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+	constexpr size_t DEQUE_CAPACITY = 4096;
+	constexpr size_t QUEUE_CAPACITY = 4096;		// Shared queues, for jobs from outside the pool and main thread jobs.
+	constexpr uint32_t IDLE_SPINS = 64;			// Failed searches before a worker sleeps.
+
+	thread_local int32_t t_workerIndex = -1;	// -1 for threads outside the pool.
+	thread_local uint32_t t_stealSeed = 0;
+
+	// Ring of jobs for whichever thread creates them, made the first time it does.
+	struct JobPool
+	{
+		std::unique_ptr<JobSystem::Job[]> jobs;
+		uint32_t next = 0;
+	};
+	thread_local JobPool t_jobPool;
+
+	void LockSuccessors(JobSystem::Job* job)
+	{
+		while (job->successorLock.exchange(true, std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void UnlockSuccessors(JobSystem::Job* job)
+	{
+		job->successorLock.store(false, std::memory_order_release);
+	}
+}
+
+void JobSystem::Init(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		const uint32_t CORES = std::thread::hardware_concurrency();
+		workerCount = CORES > 3 ? CORES - 2 : 1;
+	}
+
+	m_mainThreadId = std::this_thread::get_id();
+	m_injected = std::make_unique<RingBuffer<Job*>>(QUEUE_CAPACITY);
+	m_mainThreadJobs = std::make_unique<RingBuffer<Job*>>(QUEUE_CAPACITY);
+
+	// Every deque must exist before any worker can try to steal from it.
+	m_vWorkers.resize(workerCount);
+	for (Worker& worker : m_vWorkers)
+	{
+		worker.deque = std::make_unique<WorkStealingDeque<Job*>>(DEQUE_CAPACITY);
+	}
+
+	m_running = true;
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_vWorkers[i].thread = std::thread(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	if (!m_running.exchange(false))
+	{
+		return;
+	}
+
+	m_wake.notify_all();
+	for (Worker& worker : m_vWorkers)
+	{
+		worker.thread.join();
+	}
+
+	m_vWorkers.clear();
+}
+
+JobSystem::Job* JobSystem::AllocateJob(Job* parent, JobAffinity affinity)
+{
+	JobPool& pool = t_jobPool;
+	if (!pool.jobs)
+	{
+		pool.jobs.reset(new Job[JOBS_PER_THREAD]);
+		for (uint32_t i = 0; i < JOBS_PER_THREAD; i++)
+		{
+			pool.jobs[i].unfinished.store(0, std::memory_order_relaxed);
+			pool.jobs[i].successorLock.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	Job* job = &pool.jobs[pool.next++ % JOBS_PER_THREAD];
+
+	// Wrapping onto a job that hasn't finished means far too many are alive at once.
+	if (job->unfinished.load(std::memory_order_acquire) != 0)
+	{
+		throw std::runtime_error("Job pool exhausted, too many unfinished jobs on one thread!");
+	}
+
+	job->parent = parent;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->dependencies.store(1, std::memory_order_relaxed);
+	job->completed = false;
+	job->affinity = affinity;
+	job->successorCount = 0;
+
+	if (parent != nullptr)
+	{
+		parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+void JobSystem::AddDependency(Job* job, Job* before)
+{
+	LockSuccessors(before);
+
+	// Already done, so there's nothing to wait for.
+	if (!before->completed)
+	{
+		if (before->successorCount == MAX_SUCCESSORS)
+		{
+			UnlockSuccessors(before);
+			throw std::runtime_error("Too many jobs depend on one job, depend on a job that groups them instead!");
+		}
+
+		before->successors[before->successorCount++] = job;
+		job->dependencies.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	UnlockSuccessors(before);
+}
+
+void JobSystem::Submit(Job* job)
+{
+	// Drops the hold taken when the job was made, it goes now unless it's still waiting on something.
+	if (job->dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		Push(job);
+	}
+}
+
+void JobSystem::Push(Job* job)
+{
+	if (job->affinity == JobAffinity::MainThread)
+	{
+		if (IsMainThread())
+		{
+			Execute(job); // Already where it needs to be.
+			return;
+		}
+
+		while (!m_mainThreadJobs->TryPush(job))
+		{
+			std::this_thread::yield();
+		}
+
+		if (m_mainThreadWake)
+		{
+			m_mainThreadWake();
+		}
+		return;
+	}
+
+	// A full queue runs the job here instead. Slower, but it never blocks or loses work.
+	const bool QUEUED = t_workerIndex >= 0 ? m_vWorkers[t_workerIndex].deque->Push(job) : m_injected->TryPush(job);
+	if (!QUEUED)
+	{
+		Execute(job);
+		return;
+	}
+
+	WakeWorker();
+}
+
+void JobSystem::WakeWorker()
+{
+	if (m_sleeping.load(std::memory_order_acquire) > 0)
+	{
+		m_wake.notify_one();
+	}
+}
+
+JobSystem::Job* JobSystem::FindJob()
+{
+	Job* job = nullptr;
+
+	// Our own work first, newest first, it's what's in cache.
+	if (t_workerIndex >= 0 && m_vWorkers[t_workerIndex].deque->Pop(job))
+	{
+		return job;
+	}
+
+	if (m_injected->TryPop(job))
+	{
+		return job;
+	}
+
+	// Then steal, oldest first, starting from a different victim each time so thieves spread out.
+	const uint32_t WORKERS = static_cast<uint32_t>(m_vWorkers.size());
+	t_stealSeed = t_stealSeed * 1664525u + 1013904223u;
+	const uint32_t START = (t_stealSeed >> 16) % WORKERS;
+
+	for (uint32_t i = 0; i < WORKERS; i++)
+	{
+		const uint32_t VICTIM = (START + i) % WORKERS;
+		if (static_cast<int32_t>(VICTIM) != t_workerIndex && m_vWorkers[VICTIM].deque->Steal(job))
+		{
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->run(job);
+	Finish(job);
+}
+
+void JobSystem::Finish(Job* job)
+{
+	// Children still running, the last of them finishes this job.
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+	{
+		return;
+	}
+
+	Job* successors[MAX_SUCCESSORS];
+
+	LockSuccessors(job);
+	job->completed = true;
+	const uint32_t SUCCESSOR_COUNT = job->successorCount;
+	for (uint32_t i = 0; i < SUCCESSOR_COUNT; i++)
+	{
+		successors[i] = job->successors[i];
+	}
+	UnlockSuccessors(job);
+
+	// Nothing can use the function now, children that pointed into it are done.
+	job->destroy(job);
+
+	// These are the continuations, they run instead of anything waiting.
+	for (uint32_t i = 0; i < SUCCESSOR_COUNT; i++)
+	{
+		if (successors[i]->dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			Push(successors[i]);
+		}
+	}
+
+	if (job->parent != nullptr)
+	{
+		Finish(job->parent);
+	}
+}
+
+void JobSystem::Wait(const Job* job)
+{
+	if (t_workerIndex >= 0)
+	{
+		throw std::runtime_error("Workers must not wait on jobs, add a dependency instead!");
+	}
+
+	const bool MAIN_THREAD = IsMainThread();
+
+	while (!IsFinished(job))
+	{
+		Job* other = nullptr;
+
+		// The job may be stuck behind main thread work, so the main thread has to keep that moving.
+		if (MAIN_THREAD && m_mainThreadJobs->TryPop(other))
+		{
+			Execute(other);
+		}
+		else if ((other = FindJob()) != nullptr)
+		{
+			Execute(other);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+	Job* job = nullptr;
+	while (m_mainThreadJobs->TryPop(job))
+	{
+		Execute(job);
+	}
+}
+
+void JobSystem::WorkerLoop(uint32_t index)
+{
+	t_workerIndex = static_cast<int32_t>(index);
+	t_stealSeed = index * 2654435761u + 1;
+
+	uint32_t idle = 0;
+	while (m_running.load(std::memory_order_acquire))
+	{
+		Job* job = FindJob();
+		if (job != nullptr)
+		{
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < IDLE_SPINS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleeping.fetch_add(1, std::memory_order_acq_rel);
+		m_wake.wait_for(lock, std::chrono::milliseconds(1));
+		m_sleeping.fetch_sub(1, std::memory_order_acq_rel);
+		idle = 0;
+	}
+}
@@ -0,0 +1,195 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Work stealing job system. One Chase-Lev deque per worker, dependencies run as continuations.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "WorkStealingDeque.h"
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+
+enum class JobAffinity : uint32_t
+{
+	Any,
+	MainThread		// Only run by the thread that called Init, from RunMainThreadJobs or Wait. For GLFW and anything else tied to it.
+};
+
+/*
+	Workers never wait on a job. Anything that has to happen after a job is expressed as a dependency,
+	and becomes runnable when the last thing it depends on finishes. Only threads outside the pool, the main and
+	render threads, may Wait, and they run other jobs while they do.
+
+	Jobs come from a per thread ring, a handle stays valid until the thread that created it has created JOBS_PER_THREAD more.
+*/
+class JobSystem
+{
+public:
+
+	static constexpr uint32_t JOBS_PER_THREAD = 4096;
+	static constexpr size_t JOB_STORAGE = 64;		// Bytes for the job's function and whatever it captures.
+	static constexpr uint32_t MAX_SUCCESSORS = 16;
+
+	struct Job
+	{
+		void (*run)(Job*);
+		void (*destroy)(Job*);
+		Job* parent;
+		std::atomic<int32_t> unfinished;		// Itself plus children that haven't finished.
+		std::atomic<int32_t> dependencies;		// Predecessors that haven't finished, plus one released by Submit.
+		std::atomic<bool> successorLock;
+		bool completed;							// Guarded by successorLock, so late dependencies can see they're too late.
+		JobAffinity affinity;
+		uint32_t successorCount;
+		Job* successors[MAX_SUCCESSORS];
+		alignas(std::max_align_t) unsigned char storage[JOB_STORAGE];
+	};
+
+	JobSystem() :
+		m_running(false),
+		m_sleeping(0)
+	{}
+
+	~JobSystem() { Shutdown(); }
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Zero workers means one per core, less the main and render threads. The calling thread becomes the main thread.
+	void Init(uint32_t workerCount = 0);
+
+	// Anything still queued is dropped, wait on whatever matters first.
+	void Shutdown();
+
+	// Called when a main thread job is queued, so a main thread asleep in its event loop can be woken.
+	void SetMainThreadWake(std::function<void()> wake) { m_mainThreadWake = std::move(wake); }
+
+	/*
+		The function may take the Job* it runs in, to parent more jobs to it. A parent only finishes once its
+		children have. Nothing runs until Submit, dependencies must be added before then.
+	*/
+	template<typename F>
+	_NODISCARD Job* CreateJob(F&& function, Job* parent = nullptr, JobAffinity affinity = JobAffinity::Any)
+	{
+		using Function = std::decay_t<F>;
+		static_assert(sizeof(Function) <= JOB_STORAGE, "Job captures too much, capture a pointer instead!");
+		static_assert(alignof(Function) <= alignof(std::max_align_t), "Job function is over aligned!");
+
+		Job* job = AllocateJob(parent, affinity);
+		new (job->storage) Function(std::forward<F>(function));
+
+		job->run = [](Job* self)
+		{
+			Function& func = *std::launder(reinterpret_cast<Function*>(self->storage));
+			if constexpr (std::is_invocable_v<Function&, Job*>)
+			{
+				func(self);
+			}
+			else
+			{
+				func();
+			}
+		};
+		job->destroy = [](Job* self) { std::launder(reinterpret_cast<Function*>(self->storage))->~Function(); };
+
+		return job;
+	}
+
+	// job runs once before has finished. Must be called before job is submitted.
+	void AddDependency(Job* job, Job* before);
+
+	void Submit(Job* job);
+
+	// Creates and submits a job that runs once before has finished.
+	template<typename F>
+	Job* Then(Job* before, F&& function, JobAffinity affinity = JobAffinity::Any)
+	{
+		Job* job = CreateJob(std::forward<F>(function), nullptr, affinity);
+		AddDependency(job, before);
+		Submit(job);
+		return job;
+	}
+
+	/*
+		Calls function(begin, end) over [0, count) in ranges of at most grain. The range is split in half
+		recursively, so thieves take big pieces first. Submitted already, the returned job finishes with the last range.
+	*/
+	template<typename F>
+	Job* ParallelFor(uint32_t count, uint32_t grain, F&& function)
+	{
+		Job* root = CreateJob([this, func = std::forward<F>(function), count, grain](Job* self)
+		{
+			// The root holds the function until every range has finished, the ranges just point at it.
+			SplitRange(self, &func, 0, count, grain > 0 ? grain : 1);
+		});
+
+		Submit(root);
+		return root;
+	}
+
+	_NODISCARD bool IsFinished(const Job* job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+	// Runs other jobs until job has finished. Never from a worker, use a dependency.
+	void Wait(const Job* job);
+
+	// Main thread only.
+	void RunMainThreadJobs();
+
+	_NODISCARD uint32_t WorkerCount() const { return static_cast<uint32_t>(m_vWorkers.size()); }
+
+private:
+
+	template<typename Function>
+	void SplitRange(Job* parent, const Function* pFunction, uint32_t begin, uint32_t end, uint32_t grain)
+	{
+		// Keep the front half, hand off the back half.
+		while (end - begin > grain)
+		{
+			const uint32_t MIDDLE = begin + (end - begin) / 2;
+			Submit(CreateJob([this, pFunction, MIDDLE, end, grain](Job* self) { SplitRange(self, pFunction, MIDDLE, end, grain); }, parent));
+			end = MIDDLE;
+		}
+
+		(*pFunction)(begin, end);
+	}
+
+	Job* AllocateJob(Job* parent, JobAffinity affinity);
+	void Push(Job* job);
+	Job* FindJob();
+	void Execute(Job* job);
+	void Finish(Job* job);
+	void WorkerLoop(uint32_t index);
+	void WakeWorker();
+	_NODISCARD bool IsMainThread() const { return std::this_thread::get_id() == m_mainThreadId; }
+
+	struct Worker
+	{
+		std::unique_ptr<WorkStealingDeque<Job*>> deque;
+		std::thread thread;
+	};
+
+	std::vector<Worker> m_vWorkers;
+	std::unique_ptr<RingBuffer<Job*>> m_injected;			// From threads outside the pool, which don't have a deque.
+	std::unique_ptr<RingBuffer<Job*>> m_mainThreadJobs;
+	std::thread::id m_mainThreadId;
+	std::function<void()> m_mainThreadWake;
+
+	std::atomic<bool> m_running;
+
+	// Idle workers sleep here rather than spin. The wait has a timeout, so a wake that races going to sleep only costs a little latency.
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<uint32_t> m_sleeping;
+};
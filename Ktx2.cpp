@@ -0,0 +1,1043 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	KTX2 texture container parsing, plus a CPU transcoder for block compressed formats the GPU can't sample.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "Ktx2.h"
+#include "AstcDecoder.h"
+#include "VulkanUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// Layout straight from the KTX2 spec. Everything is little endian, as is every platform we build for.
+	struct Ktx2Header
+	{
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout.");
+
+	struct Ktx2LevelIndex
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+	static_assert(sizeof(Ktx2LevelIndex) == 24, "KTX2 level index must match the file layout.");
+
+	// =============================================================================================================================================================
+	// Block decoders. Each decodes one 4x4 block into a tightly packed 16 texel array.
+
+	// Expand 5:6:5 to 8 bits per channel, replicating the high bits into the low bits.
+	void Unpack565(uint16_t c, uint8_t out[4])
+	{
+		const uint32_t R = (c >> 11) & 0x1F;
+		const uint32_t G = (c >> 5) & 0x3F;
+		const uint32_t B = c & 0x1F;
+
+		out[0] = static_cast<uint8_t>((R << 3) | (R >> 2));
+		out[1] = static_cast<uint8_t>((G << 2) | (G >> 4));
+		out[2] = static_cast<uint8_t>((B << 3) | (B >> 2));
+		out[3] = 255;
+	}
+
+	// BC1 colour block. BC2 and BC3 always use four colour mode, only BC1 has the punch through alpha mode.
+	void DecodeColourBlock(const uint8_t* pBlock, uint8_t outRgba[16 * 4], bool allowPunchThrough)
+	{
+		uint16_t c0, c1;
+		uint32_t indices;
+		std::memcpy(&c0, pBlock, 2);
+		std::memcpy(&c1, pBlock + 2, 2);
+		std::memcpy(&indices, pBlock + 4, 4);
+
+		uint8_t palette[4][4];
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+
+		if (c0 > c1 || !allowPunchThrough)
+		{
+			for (int ch = 0; ch < 3; ch++)
+			{
+				palette[2][ch] = static_cast<uint8_t>((2 * palette[0][ch] + palette[1][ch] + 1) / 3);
+				palette[3][ch] = static_cast<uint8_t>((palette[0][ch] + 2 * palette[1][ch] + 1) / 3);
+			}
+			palette[2][3] = 255;
+			palette[3][3] = 255;
+		}
+		else
+		{
+			for (int ch = 0; ch < 3; ch++)
+			{
+				palette[2][ch] = static_cast<uint8_t>((palette[0][ch] + palette[1][ch]) / 2);
+				palette[3][ch] = 0;
+			}
+			palette[2][3] = 255;
+			palette[3][3] = 0; // Transparent black.
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			std::memcpy(&outRgba[i * 4], palette[(indices >> (i * 2)) & 0x3], 4);
+		}
+	}
+
+	// BC4 style single channel block, also used for BC3 alpha and both BC5 channels. Signed blocks store two's complement endpoints.
+	void DecodeChannelBlock(const uint8_t* pBlock, uint8_t out[16], size_t outStride, bool isSigned)
+	{
+		int e0, e1;
+		if (isSigned)
+		{
+			// -128 and -127 both mean -1.0, so clamp before interpolating.
+			e0 = std::max(static_cast<int>(static_cast<int8_t>(pBlock[0])), -127);
+			e1 = std::max(static_cast<int>(static_cast<int8_t>(pBlock[1])), -127);
+		}
+		else
+		{
+			e0 = pBlock[0];
+			e1 = pBlock[1];
+		}
+
+		const int MIN_VALUE = isSigned ? -127 : 0;
+		const int MAX_VALUE = isSigned ? 127 : 255;
+
+		int palette[8];
+		palette[0] = e0;
+		palette[1] = e1;
+
+		if (e0 > e1)
+		{
+			for (int i = 1; i < 7; i++)
+			{
+				palette[i + 1] = ((7 - i) * e0 + i * e1) / 7;
+			}
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+			{
+				palette[i + 1] = ((5 - i) * e0 + i * e1) / 5;
+			}
+			palette[6] = MIN_VALUE;
+			palette[7] = MAX_VALUE;
+		}
+
+		// 48 bits of 3 bit indices.
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			indices |= static_cast<uint64_t>(pBlock[2 + i]) << (8 * i);
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			out[i * outStride] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 0x7]);
+		}
+	}
+
+	// BC2 explicit 4 bit alpha.
+	void DecodeExplicitAlphaBlock(const uint8_t* pBlock, uint8_t outRgba[16 * 4])
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			const uint32_t NIBBLE = (pBlock[i / 2] >> ((i & 1) * 4)) & 0xF;
+			outRgba[i * 4 + 3] = static_cast<uint8_t>(NIBBLE * 17);
+		}
+	}
+
+	// =============================================================================================================================================================
+	// BC6H and BC7. Both split the block into up to three subsets, each with its own endpoints, from the same tables of shapes.
+
+	// Bit i is the subset of texel i, for the 64 two subset shapes. BC6H only uses the first 32.
+	constexpr uint16_t PARTITIONS_2[64] =
+	{
+		0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+		0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+		0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+		0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+	};
+
+	constexpr uint8_t PARTITIONS_3[64][16] =
+	{
+		{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 }, { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+		{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 }, { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+		{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+		{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 }, { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+		{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+		{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 }, { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+		{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 }, { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+		{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 }, { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+		{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 }, { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+		{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 }, { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+		{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 }, { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+		{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 }, { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+		{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 }, { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+		{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 }, { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 }, { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+		{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 }, { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+		{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 }, { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+		{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 }, { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+		{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 }, { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+		{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 }, { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+		{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+		{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+		{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+		{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 }, { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+		{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 }
+	};
+
+	// The texel of each later subset whose index is stored a bit short. Texel 0 is always the first subset's.
+	constexpr uint8_t ANCHORS_2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+	};
+
+	constexpr uint8_t ANCHORS_3[2][64] =
+	{
+		{
+			3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+			3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+			8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+			3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+		},
+		{
+			15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+			15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+			15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+			15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+		}
+	};
+
+	// Interpolation weights out of 64, by index size.
+	constexpr uint32_t WEIGHTS_2[4] = { 0, 21, 43, 64 };
+	constexpr uint32_t WEIGHTS_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	constexpr uint32_t WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	uint32_t IndexWeight(uint32_t indexBits, uint32_t index)
+	{
+		return indexBits == 2 ? WEIGHTS_2[index] : indexBits == 3 ? WEIGHTS_3[index] : WEIGHTS_4[index];
+	}
+
+	uint32_t TexelSubset(uint32_t subsetCount, uint32_t partition, uint32_t texel)
+	{
+		if (subsetCount == 2)
+		{
+			return (PARTITIONS_2[partition] >> texel) & 1;
+		}
+		return subsetCount == 3 ? PARTITIONS_3[partition][texel] : 0;
+	}
+
+	bool IsAnchorTexel(uint32_t subsetCount, uint32_t partition, uint32_t texel)
+	{
+		return texel == 0 ||
+			(subsetCount == 2 && texel == ANCHORS_2[partition]) ||
+			(subsetCount == 3 && (texel == ANCHORS_3[0][partition] || texel == ANCHORS_3[1][partition]));
+	}
+
+	// Reads a 128 bit block from its least significant bit up.
+	class BlockBitReader
+	{
+	public:
+
+		explicit BlockBitReader(const uint8_t* pBlock) : m_pBlock(pBlock), m_position(0) {}
+
+		uint32_t Read(uint32_t count)
+		{
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count && m_position < 128; i++, m_position++)
+			{
+				value |= ((m_pBlock[m_position >> 3] >> (m_position & 7)) & 1u) << i;
+			}
+			return value;
+		}
+
+		// Some BC6H fields are stored most significant bit first.
+		uint32_t ReadReversed(uint32_t count)
+		{
+			const uint32_t VALUE = Read(count);
+			uint32_t result = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				result |= ((VALUE >> i) & 1u) << (count - 1 - i);
+			}
+			return result;
+		}
+
+	private:
+
+		const uint8_t* m_pBlock;
+		uint32_t m_position;
+	};
+
+	// BC7, to RGBA8. Eight modes trade subsets, endpoint precision and index size, the mode is the position of the first set bit.
+	void DecodeBc7Block(const uint8_t* pBlock, uint8_t outRgba[16 * 4])
+	{
+		struct Bc7Mode
+		{
+			uint32_t subsets;
+			uint32_t partitionBits;
+			uint32_t rotationBits;
+			uint32_t indexSelectionBits;
+			uint32_t colourBits;
+			uint32_t alphaBits;
+			uint32_t endpointPBits;		// One low bit per endpoint.
+			uint32_t sharedPBits;		// One low bit per subset.
+			uint32_t indexBits;
+			uint32_t secondaryIndexBits;
+		};
+
+		constexpr Bc7Mode MODES[8] =
+		{
+			{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+			{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+			{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+			{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+			{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+			{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+			{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+			{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+		};
+
+		BlockBitReader bits(pBlock);
+
+		uint32_t modeIndex = 0;
+		while (modeIndex < 8 && bits.Read(1) == 0)
+		{
+			modeIndex++;
+		}
+
+		// No mode bit set is reserved, and decodes to transparent black.
+		if (modeIndex == 8)
+		{
+			std::memset(outRgba, 0, 16 * 4);
+			return;
+		}
+
+		const Bc7Mode& MODE = MODES[modeIndex];
+		const uint32_t PARTITION = bits.Read(MODE.partitionBits);
+		const uint32_t ROTATION = bits.Read(MODE.rotationBits);
+		const uint32_t INDEX_SELECTION = bits.Read(MODE.indexSelectionBits);
+
+		// Red for every endpoint, then green, blue and alpha.
+		uint32_t endpoints[3][2][4] = {};
+		for (uint32_t ch = 0; ch < 4; ch++)
+		{
+			const uint32_t CHANNEL_BITS = ch < 3 ? MODE.colourBits : MODE.alphaBits;
+			for (uint32_t subset = 0; subset < MODE.subsets; subset++)
+			{
+				endpoints[subset][0][ch] = bits.Read(CHANNEL_BITS);
+				endpoints[subset][1][ch] = bits.Read(CHANNEL_BITS);
+			}
+		}
+
+		uint32_t pBits[3][2] = {};
+		for (uint32_t subset = 0; subset < MODE.subsets; subset++)
+		{
+			if (MODE.endpointPBits)
+			{
+				pBits[subset][0] = bits.Read(1);
+				pBits[subset][1] = bits.Read(1);
+			}
+			else if (MODE.sharedPBits)
+			{
+				pBits[subset][0] = pBits[subset][1] = bits.Read(1);
+			}
+		}
+
+		// Append the p-bit, then widen to 8 bits by replicating the high bits.
+		const uint32_t HAS_P_BIT = MODE.endpointPBits | MODE.sharedPBits;
+		for (uint32_t subset = 0; subset < MODE.subsets; subset++)
+		{
+			for (uint32_t e = 0; e < 2; e++)
+			{
+				for (uint32_t ch = 0; ch < 4; ch++)
+				{
+					uint32_t& value = endpoints[subset][e][ch];
+					const uint32_t CHANNEL_BITS = ch < 3 ? MODE.colourBits : MODE.alphaBits;
+					if (CHANNEL_BITS == 0)
+					{
+						value = 255;
+						continue;
+					}
+
+					const uint32_t TOTAL_BITS = CHANNEL_BITS + HAS_P_BIT;
+					value = (value << HAS_P_BIT) | pBits[subset][e];
+					value <<= 8 - TOTAL_BITS;
+					value |= value >> TOTAL_BITS;
+				}
+			}
+		}
+
+		uint32_t indices[16];
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			indices[i] = bits.Read(MODE.indexBits - (IsAnchorTexel(MODE.subsets, PARTITION, i) ? 1 : 0));
+		}
+
+		uint32_t secondaryIndices[16] = {};
+		if (MODE.secondaryIndexBits)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				secondaryIndices[i] = bits.Read(MODE.secondaryIndexBits - (i == 0 ? 1 : 0));
+			}
+		}
+
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const uint32_t(&e)[2][4] = endpoints[TexelSubset(MODE.subsets, PARTITION, i)];
+
+			// With two index sets colour takes the primary and alpha the secondary, unless the selection bit swaps them.
+			uint32_t colourWeight = IndexWeight(MODE.indexBits, indices[i]);
+			uint32_t alphaWeight = colourWeight;
+			if (MODE.secondaryIndexBits)
+			{
+				alphaWeight = IndexWeight(MODE.secondaryIndexBits, secondaryIndices[i]);
+				if (INDEX_SELECTION)
+				{
+					std::swap(colourWeight, alphaWeight);
+				}
+			}
+
+			uint8_t* pTexel = &outRgba[i * 4];
+			for (uint32_t ch = 0; ch < 4; ch++)
+			{
+				const uint32_t WEIGHT = ch < 3 ? colourWeight : alphaWeight;
+				pTexel[ch] = static_cast<uint8_t>(((64 - WEIGHT) * e[0][ch] + WEIGHT * e[1][ch] + 32) >> 6);
+			}
+
+			// Rotation swaps alpha with one colour channel, to give that channel the separate indices.
+			if (ROTATION)
+			{
+				std::swap(pTexel[3], pTexel[ROTATION - 1]);
+			}
+		}
+	}
+
+	int32_t SignExtend(int32_t value, uint32_t bits)
+	{
+		const int32_t SHIFT = 32 - static_cast<int32_t>(bits);
+		return static_cast<int32_t>(static_cast<uint32_t>(value) << SHIFT) >> SHIFT;
+	}
+
+	// BC6H endpoints to the 16 bit range interpolation works in. The ends map exactly to the ends.
+	int32_t UnquantiseBc6h(int32_t value, uint32_t bits, bool isSigned)
+	{
+		if (!isSigned)
+		{
+			if (bits >= 15 || value == 0)
+			{
+				return value;
+			}
+			if (value == (1 << bits) - 1)
+			{
+				return 0xFFFF;
+			}
+			return ((value << 16) + 0x8000) >> bits;
+		}
+
+		if (bits >= 16)
+		{
+			return value;
+		}
+
+		const int32_t MAGNITUDE = value < 0 ? -value : value;
+		int32_t result;
+		if (MAGNITUDE == 0)
+		{
+			result = 0;
+		}
+		else if (MAGNITUDE >= (1 << (bits - 1)) - 1)
+		{
+			result = 0x7FFF;
+		}
+		else
+		{
+			result = ((MAGNITUDE << 15) + 0x4000) >> (bits - 1);
+		}
+		return value < 0 ? -result : result;
+	}
+
+	/*
+		BC6H, to RGBA16F with alpha at one. Fourteen modes, told apart by a 2 or 5 bit header, trade endpoint precision for
+		deltas from the first endpoint. Each mode scatters its endpoint bits through the block in its own order, so every
+		layout below is spelt out as in the format's spec: w is the first endpoint, x the second, y and z the second subset's.
+	*/
+	void DecodeBc6hBlock(const uint8_t* pBlock, uint8_t outRgba[16 * 8], bool isSigned)
+	{
+		BlockBitReader bits(pBlock);
+
+		int32_t endpoints[4][3] = {};
+		int32_t& rw = endpoints[0][0];	int32_t& gw = endpoints[0][1];	int32_t& bw = endpoints[0][2];
+		int32_t& rx = endpoints[1][0];	int32_t& gx = endpoints[1][1];	int32_t& bx = endpoints[1][2];
+		int32_t& ry = endpoints[2][0];	int32_t& gy = endpoints[2][1];	int32_t& by = endpoints[2][2];
+		int32_t& rz = endpoints[3][0];	int32_t& gz = endpoints[3][1];	int32_t& bz = endpoints[3][2];
+
+		auto take = [&](int32_t& field, uint32_t lowBit, uint32_t count)
+		{
+			field |= static_cast<int32_t>(bits.Read(count) << lowBit);
+		};
+		auto takeReversed = [&](int32_t& field, uint32_t lowBit, uint32_t count)
+		{
+			field |= static_cast<int32_t>(bits.ReadReversed(count) << lowBit);
+		};
+
+		uint32_t header = bits.Read(2);
+		if (header > 1)
+		{
+			header |= bits.Read(3) << 2;
+		}
+
+		uint32_t endpointBits;
+		uint32_t deltaBits[3];
+		bool transformed = true;
+		bool twoSubsets = true;
+
+		switch (header)
+		{
+		case 0x00: // 10.5.5.5
+			endpointBits = 10; deltaBits[0] = 5; deltaBits[1] = 5; deltaBits[2] = 5;
+			take(gy, 4, 1); take(by, 4, 1); take(bz, 4, 1); take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10);
+			take(rx, 0, 5); take(gz, 4, 1); take(gy, 0, 4); take(gx, 0, 5); take(bz, 0, 1); take(gz, 0, 4);
+			take(bx, 0, 5); take(bz, 1, 1); take(by, 0, 4); take(ry, 0, 5); take(bz, 2, 1); take(rz, 0, 5); take(bz, 3, 1);
+			break;
+
+		case 0x01: // 7.6.6.6
+			endpointBits = 7; deltaBits[0] = 6; deltaBits[1] = 6; deltaBits[2] = 6;
+			take(gy, 5, 1); take(gz, 4, 1); take(gz, 5, 1); take(rw, 0, 7); take(bz, 0, 1); take(bz, 1, 1); take(by, 4, 1);
+			take(gw, 0, 7); take(by, 5, 1); take(bz, 2, 1); take(gy, 4, 1); take(bw, 0, 7); take(bz, 3, 1); take(bz, 5, 1);
+			take(bz, 4, 1); take(rx, 0, 6); take(gy, 0, 4); take(gx, 0, 6); take(gz, 0, 4); take(bx, 0, 6); take(by, 0, 4);
+			take(ry, 0, 6); take(rz, 0, 6);
+			break;
+
+		case 0x02: // 11.5.4.4
+			endpointBits = 11; deltaBits[0] = 5; deltaBits[1] = 4; deltaBits[2] = 4;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 5); take(rw, 10, 1); take(gy, 0, 4);
+			take(gx, 0, 4); take(gw, 10, 1); take(bz, 0, 1); take(gz, 0, 4); take(bx, 0, 4); take(bw, 10, 1); take(bz, 1, 1);
+			take(by, 0, 4); take(ry, 0, 5); take(bz, 2, 1); take(rz, 0, 5); take(bz, 3, 1);
+			break;
+
+		case 0x06: // 11.4.5.4
+			endpointBits = 11; deltaBits[0] = 4; deltaBits[1] = 5; deltaBits[2] = 4;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 4); take(rw, 10, 1); take(gz, 4, 1);
+			take(gy, 0, 4); take(gx, 0, 5); take(gw, 10, 1); take(gz, 0, 4); take(bx, 0, 4); take(bw, 10, 1); take(bz, 1, 1);
+			take(by, 0, 4); take(ry, 0, 4); take(bz, 0, 1); take(bz, 2, 1); take(rz, 0, 4); take(gy, 4, 1); take(bz, 3, 1);
+			break;
+
+		case 0x0A: // 11.4.4.5
+			endpointBits = 11; deltaBits[0] = 4; deltaBits[1] = 4; deltaBits[2] = 5;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 4); take(rw, 10, 1); take(by, 4, 1);
+			take(gy, 0, 4); take(gx, 0, 4); take(gw, 10, 1); take(bz, 0, 1); take(gz, 0, 4); take(bx, 0, 5); take(bw, 10, 1);
+			take(by, 0, 4); take(ry, 0, 4); take(bz, 1, 1); take(bz, 2, 1); take(rz, 0, 4); take(bz, 4, 1); take(bz, 3, 1);
+			break;
+
+		case 0x0E: // 9.5.5.5
+			endpointBits = 9; deltaBits[0] = 5; deltaBits[1] = 5; deltaBits[2] = 5;
+			take(rw, 0, 9); take(by, 4, 1); take(gw, 0, 9); take(gy, 4, 1); take(bw, 0, 9); take(bz, 4, 1); take(rx, 0, 5);
+			take(gz, 4, 1); take(gy, 0, 4); take(gx, 0, 5); take(bz, 0, 1); take(gz, 0, 4); take(bx, 0, 5); take(bz, 1, 1);
+			take(by, 0, 4); take(ry, 0, 5); take(bz, 2, 1); take(rz, 0, 5); take(bz, 3, 1);
+			break;
+
+		case 0x12: // 8.6.5.5
+			endpointBits = 8; deltaBits[0] = 6; deltaBits[1] = 5; deltaBits[2] = 5;
+			take(rw, 0, 8); take(gz, 4, 1); take(by, 4, 1); take(gw, 0, 8); take(bz, 2, 1); take(gy, 4, 1); take(bw, 0, 8);
+			take(bz, 3, 1); take(bz, 4, 1); take(rx, 0, 6); take(gy, 0, 4); take(gx, 0, 5); take(bz, 0, 1); take(gz, 0, 4);
+			take(bx, 0, 5); take(bz, 1, 1); take(by, 0, 4); take(ry, 0, 6); take(rz, 0, 6);
+			break;
+
+		case 0x16: // 8.5.6.5
+			endpointBits = 8; deltaBits[0] = 5; deltaBits[1] = 6; deltaBits[2] = 5;
+			take(rw, 0, 8); take(bz, 0, 1); take(by, 4, 1); take(gw, 0, 8); take(gy, 5, 1); take(gy, 4, 1); take(bw, 0, 8);
+			take(gz, 5, 1); take(bz, 4, 1); take(rx, 0, 5); take(gz, 4, 1); take(gy, 0, 4); take(gx, 0, 6); take(gz, 0, 4);
+			take(bx, 0, 5); take(bz, 1, 1); take(by, 0, 4); take(ry, 0, 5); take(bz, 2, 1); take(rz, 0, 5); take(bz, 3, 1);
+			break;
+
+		case 0x1A: // 8.5.5.6
+			endpointBits = 8; deltaBits[0] = 5; deltaBits[1] = 5; deltaBits[2] = 6;
+			take(rw, 0, 8); take(bz, 1, 1); take(by, 4, 1); take(gw, 0, 8); take(by, 5, 1); take(gy, 4, 1); take(bw, 0, 8);
+			take(bz, 5, 1); take(bz, 4, 1); take(rx, 0, 5); take(gz, 4, 1); take(gy, 0, 4); take(gx, 0, 5); take(bz, 0, 1);
+			take(gz, 0, 4); take(bx, 0, 6); take(by, 0, 4); take(ry, 0, 5); take(bz, 2, 1); take(rz, 0, 5); take(bz, 3, 1);
+			break;
+
+		case 0x1E: // 6.6.6.6, every endpoint stored in full.
+			endpointBits = 6; deltaBits[0] = 6; deltaBits[1] = 6; deltaBits[2] = 6;
+			transformed = false;
+			take(rw, 0, 6); take(gz, 4, 1); take(bz, 0, 1); take(bz, 1, 1); take(by, 4, 1); take(gw, 0, 6); take(gy, 5, 1);
+			take(by, 5, 1); take(bz, 2, 1); take(gy, 4, 1); take(bw, 0, 6); take(gz, 5, 1); take(bz, 3, 1); take(bz, 5, 1);
+			take(bz, 4, 1); take(rx, 0, 6); take(gy, 0, 4); take(gx, 0, 6); take(gz, 0, 4); take(bx, 0, 6); take(by, 0, 4);
+			take(ry, 0, 6); take(rz, 0, 6);
+			break;
+
+		case 0x03: // 10.10, one subset, both endpoints stored in full.
+			endpointBits = 10; deltaBits[0] = 10; deltaBits[1] = 10; deltaBits[2] = 10;
+			transformed = false;
+			twoSubsets = false;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 10); take(gx, 0, 10); take(bx, 0, 10);
+			break;
+
+		case 0x07: // 11.9
+			endpointBits = 11; deltaBits[0] = 9; deltaBits[1] = 9; deltaBits[2] = 9;
+			twoSubsets = false;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 9); take(rw, 10, 1); take(gx, 0, 9);
+			take(gw, 10, 1); take(bx, 0, 9); take(bw, 10, 1);
+			break;
+
+		case 0x0B: // 12.8
+			endpointBits = 12; deltaBits[0] = 8; deltaBits[1] = 8; deltaBits[2] = 8;
+			twoSubsets = false;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 8); takeReversed(rw, 10, 2); take(gx, 0, 8);
+			takeReversed(gw, 10, 2); take(bx, 0, 8); takeReversed(bw, 10, 2);
+			break;
+
+		case 0x0F: // 16.4
+			endpointBits = 16; deltaBits[0] = 4; deltaBits[1] = 4; deltaBits[2] = 4;
+			twoSubsets = false;
+			take(rw, 0, 10); take(gw, 0, 10); take(bw, 0, 10); take(rx, 0, 4); takeReversed(rw, 10, 6); take(gx, 0, 4);
+			takeReversed(gw, 10, 6); take(bx, 0, 4); takeReversed(bw, 10, 6);
+			break;
+
+		default:
+			// Reserved modes decode to black.
+			std::memset(outRgba, 0, 16 * 8);
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				const uint16_t ONE = 0x3C00;
+				std::memcpy(&outRgba[i * 8 + 6], &ONE, 2);
+			}
+			return;
+		}
+
+		const uint32_t PARTITION = twoSubsets ? bits.Read(5) : 0;
+		const uint32_t ENDPOINT_COUNT = twoSubsets ? 4 : 2;
+		const int32_t ENDPOINT_MASK = (1 << endpointBits) - 1;
+
+		// Deltas are relative to the first endpoint and wrap within its precision.
+		for (uint32_t ch = 0; ch < 3; ch++)
+		{
+			if (isSigned)
+			{
+				endpoints[0][ch] = SignExtend(endpoints[0][ch], endpointBits);
+			}
+
+			for (uint32_t e = 1; e < ENDPOINT_COUNT; e++)
+			{
+				int32_t& value = endpoints[e][ch];
+				if (transformed)
+				{
+					value = (endpoints[0][ch] + SignExtend(value, deltaBits[ch])) & ENDPOINT_MASK;
+				}
+				if (isSigned)
+				{
+					value = SignExtend(value, endpointBits);
+				}
+			}
+
+			for (uint32_t e = 0; e < ENDPOINT_COUNT; e++)
+			{
+				endpoints[e][ch] = UnquantiseBc6h(endpoints[e][ch], endpointBits, isSigned);
+			}
+		}
+
+		const uint32_t INDEX_BITS = twoSubsets ? 3 : 4;
+		const uint32_t SUBSETS = twoSubsets ? 2 : 1;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const uint32_t INDEX = bits.Read(INDEX_BITS - (IsAnchorTexel(SUBSETS, PARTITION, i) ? 1 : 0));
+			const uint32_t WEIGHT = IndexWeight(INDEX_BITS, INDEX);
+			const uint32_t SUBSET = TexelSubset(SUBSETS, PARTITION, i);
+			const int32_t* pE0 = endpoints[SUBSET * 2];
+			const int32_t* pE1 = endpoints[SUBSET * 2 + 1];
+
+			uint16_t texel[4];
+			for (uint32_t ch = 0; ch < 3; ch++)
+			{
+				const int32_t VALUE = (static_cast<int32_t>(64 - WEIGHT) * pE0[ch] + static_cast<int32_t>(WEIGHT) * pE1[ch] + 32) >> 6;
+
+				// Scale to the largest finite half and reinterpret, BC6H works in the half float bit patterns themselves.
+				if (!isSigned)
+				{
+					texel[ch] = static_cast<uint16_t>((VALUE * 31) >> 6);
+				}
+				else if (VALUE < 0)
+				{
+					texel[ch] = static_cast<uint16_t>(0x8000 | (((-VALUE) * 31) >> 5));
+				}
+				else
+				{
+					texel[ch] = static_cast<uint16_t>((VALUE * 31) >> 5);
+				}
+			}
+			texel[3] = 0x3C00;
+
+			std::memcpy(&outRgba[i * 8], texel, sizeof(texel));
+		}
+	}
+
+	// The ASTC formats are contiguous, each footprint's UNORM followed by its SRGB.
+	bool IsAstcFormat(VkFormat format)
+	{
+		return format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+	}
+
+	bool IsAstcSrgbFormat(VkFormat format)
+	{
+		return IsAstcFormat(format) && ((format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) & 1) != 0;
+	}
+
+	// Decode a whole level, writing each block's texels into a linear image and clipping the blocks that overhang the edge.
+	std::vector<uint8_t> DecodeLevel(VkFormat format, const Ktx2Level& level)
+	{
+		const FormatBlockInfo BLOCK = GetFormatBlockInfo(format);
+		const VkFormat TARGET = Ktx2File::GetTranscodeTarget(format);
+		const uint32_t TEXEL_BYTES = GetFormatBlockInfo(TARGET).bytesPerBlock;
+
+		const uint32_t BLOCKS_X = (level.width + BLOCK.blockWidth - 1) / BLOCK.blockWidth;
+		const uint32_t BLOCKS_Y = (level.height + BLOCK.blockHeight - 1) / BLOCK.blockHeight;
+
+		if (level.byteLength < static_cast<uint64_t>(BLOCKS_X) * BLOCKS_Y * BLOCK.bytesPerBlock)
+		{
+			throw std::runtime_error("KTX2 level is smaller than its dimensions require!");
+		}
+
+		std::vector<uint8_t> decoded(static_cast<size_t>(level.width) * level.height * TEXEL_BYTES);
+		uint8_t texels[12 * 12 * 8];	// The largest ASTC footprint, or a BC6H block at 8 bytes a texel.
+
+		const uint8_t* pBlock = level.pData;
+		for (uint32_t by = 0; by < BLOCKS_Y; by++)
+		{
+			for (uint32_t bx = 0; bx < BLOCKS_X; bx++, pBlock += BLOCK.bytesPerBlock)
+			{
+				switch (format)
+				{
+				case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+				case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+					DecodeColourBlock(pBlock, texels, true);
+					for (int i = 0; i < 16; i++) texels[i * 4 + 3] = 255; // RGB variant has no alpha, punch through texels are black.
+					break;
+
+				case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+				case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+					DecodeColourBlock(pBlock, texels, true);
+					break;
+
+				case VK_FORMAT_BC2_UNORM_BLOCK:
+				case VK_FORMAT_BC2_SRGB_BLOCK:
+					DecodeColourBlock(pBlock + 8, texels, false);
+					DecodeExplicitAlphaBlock(pBlock, texels);
+					break;
+
+				case VK_FORMAT_BC3_UNORM_BLOCK:
+				case VK_FORMAT_BC3_SRGB_BLOCK:
+					DecodeColourBlock(pBlock + 8, texels, false);
+					DecodeChannelBlock(pBlock, texels + 3, 4, false);
+					break;
+
+				case VK_FORMAT_BC4_UNORM_BLOCK:
+				case VK_FORMAT_BC4_SNORM_BLOCK:
+					DecodeChannelBlock(pBlock, texels, 1, format == VK_FORMAT_BC4_SNORM_BLOCK);
+					break;
+
+				case VK_FORMAT_BC5_UNORM_BLOCK:
+				case VK_FORMAT_BC5_SNORM_BLOCK:
+					DecodeChannelBlock(pBlock, texels, 2, format == VK_FORMAT_BC5_SNORM_BLOCK);
+					DecodeChannelBlock(pBlock + 8, texels + 1, 2, format == VK_FORMAT_BC5_SNORM_BLOCK);
+					break;
+
+				case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+				case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+					DecodeBc6hBlock(pBlock, texels, format == VK_FORMAT_BC6H_SFLOAT_BLOCK);
+					break;
+
+				case VK_FORMAT_BC7_UNORM_BLOCK:
+				case VK_FORMAT_BC7_SRGB_BLOCK:
+					DecodeBc7Block(pBlock, texels);
+					break;
+
+				default:
+					if (!IsAstcFormat(format))
+					{
+						throw std::runtime_error("No CPU transcoder for this texture format!");
+					}
+					DecodeAstcBlock(pBlock, BLOCK.blockWidth, BLOCK.blockHeight, IsAstcSrgbFormat(format), texels);
+					break;
+				}
+
+				// Copy the block's rows out, skipping texels past the edge of small mips.
+				const uint32_t COLUMNS = std::min(BLOCK.blockWidth, level.width - bx * BLOCK.blockWidth);
+				const uint32_t ROWS = std::min(BLOCK.blockHeight, level.height - by * BLOCK.blockHeight);
+				for (uint32_t row = 0; row < ROWS; row++)
+				{
+					const size_t DST = ((static_cast<size_t>(by) * BLOCK.blockHeight + row) * level.width + bx * BLOCK.blockWidth) * TEXEL_BYTES;
+					std::memcpy(&decoded[DST], &texels[row * BLOCK.blockWidth * TEXEL_BYTES], COLUMNS * TEXEL_BYTES);
+				}
+			}
+		}
+
+		return decoded;
+	}
+}
+
+// =================================================================================================================================================================
+// Format information.
+
+FormatBlockInfo GetFormatBlockInfo(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SNORM:
+	case VK_FORMAT_R8_SRGB:
+		return { 1, 1, 1, false };
+
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SNORM:
+	case VK_FORMAT_R16_SFLOAT:
+		return { 1, 1, 2, false };
+
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_SFLOAT:
+		return { 1, 1, 4, false };
+
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return { 1, 1, 8, false };
+
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return { 1, 1, 16, false };
+
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		return { 4, 4, 8, true };
+
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return { 4, 4, 16, true };
+
+	// Every ASTC block is 128 bits, only the footprint changes.
+	case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:	case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:		return { 4, 4, 16, true };
+	case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:	case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:		return { 5, 4, 16, true };
+	case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:		return { 5, 5, 16, true };
+	case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:		return { 6, 5, 16, true };
+	case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:		return { 6, 6, 16, true };
+	case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:		return { 8, 5, 16, true };
+	case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:		return { 8, 6, 16, true };
+	case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:	case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:		return { 8, 8, 16, true };
+	case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:	return { 10, 5, 16, true };
+	case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:	return { 10, 6, 16, true };
+	case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:	return { 10, 8, 16, true };
+	case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:	case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:	return { 10, 10, 16, true };
+	case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:	case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:	return { 12, 10, 16, true };
+	case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:	case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:	return { 12, 12, 16, true };
+
+	default:
+		return {};
+	}
+}
+
+uint64_t GetImageBytes(const FormatBlockInfo& block, uint32_t width, uint32_t height)
+{
+	const uint64_t BLOCKS_X = (static_cast<uint64_t>(width) + block.blockWidth - 1) / block.blockWidth;
+	const uint64_t BLOCKS_Y = (static_cast<uint64_t>(height) + block.blockHeight - 1) / block.blockHeight;
+	return BLOCKS_X * BLOCKS_Y * block.bytesPerBlock;
+}
+
+VkFormat Ktx2File::GetTranscodeTarget(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return VK_FORMAT_R8G8B8A8_SRGB;
+
+	case VK_FORMAT_BC4_UNORM_BLOCK:	return VK_FORMAT_R8_UNORM;
+	case VK_FORMAT_BC4_SNORM_BLOCK:	return VK_FORMAT_R8_SNORM;
+	case VK_FORMAT_BC5_UNORM_BLOCK:	return VK_FORMAT_R8G8_UNORM;
+	case VK_FORMAT_BC5_SNORM_BLOCK:	return VK_FORMAT_R8G8_SNORM;
+
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		return VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	default:
+		if (IsAstcFormat(format))
+		{
+			return IsAstcSrgbFormat(format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+		}
+		return VK_FORMAT_UNDEFINED;
+	}
+}
+
+// =================================================================================================================================================================
+// Parsing.
+
+Ktx2File::Ktx2File(std::vector<char>&& fileData) :
+	m_vFileData(std::move(fileData)),
+	m_format(VK_FORMAT_UNDEFINED),
+	m_width(0),
+	m_height(0),
+	m_generateMips(false)
+{
+	if (m_vFileData.size() < sizeof(Ktx2Header))
+	{
+		throw std::runtime_error("File is too small to be KTX2!");
+	}
+
+	Ktx2Header header;
+	std::memcpy(&header, m_vFileData.data(), sizeof(header));
+
+	if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		throw std::runtime_error("Not a KTX2 file!");
+	}
+
+	// Basis Universal and zstd payloads need their own decoders, which we don't ship.
+	if (header.supercompressionScheme != 0)
+	{
+		throw std::runtime_error("Supercompressed KTX2 files are not supported!");
+	}
+
+	if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+	{
+		throw std::runtime_error("Only 2D KTX2 textures are supported!");
+	}
+
+	m_format = static_cast<VkFormat>(header.vkFormat);
+	const FormatBlockInfo BLOCK = GetFormatBlockInfo(m_format);
+	if (BLOCK.bytesPerBlock == 0)
+	{
+		throw std::runtime_error("Unsupported KTX2 texture format!");
+	}
+
+	if (header.pixelWidth == 0 || header.pixelHeight == 0)
+	{
+		throw std::runtime_error("KTX2 texture has no size!");
+	}
+
+	m_width = header.pixelWidth;
+	m_height = header.pixelHeight;
+	m_generateMips = header.levelCount == 0;
+
+	// No more levels than it takes to halve the larger side down to one texel.
+	uint32_t maxLevels = 1;
+	while ((std::max(m_width, m_height) >> maxLevels) > 0)
+	{
+		maxLevels++;
+	}
+
+	const uint32_t LEVEL_COUNT = std::max(header.levelCount, 1u);
+	if (LEVEL_COUNT > maxLevels)
+	{
+		throw std::runtime_error("KTX2 texture has more levels than its size allows!");
+	}
+
+	if (sizeof(Ktx2Header) + LEVEL_COUNT * sizeof(Ktx2LevelIndex) > m_vFileData.size())
+	{
+		throw std::runtime_error("KTX2 level index is truncated!");
+	}
+
+	m_vLevels.resize(LEVEL_COUNT);
+	for (uint32_t i = 0; i < LEVEL_COUNT; i++)
+	{
+		Ktx2LevelIndex index;
+		std::memcpy(&index, m_vFileData.data() + sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex), sizeof(index));
+
+		// Written so neither side can wrap, the offset and length both come straight from the file.
+		if (index.byteOffset > m_vFileData.size() || index.byteLength > m_vFileData.size() - index.byteOffset)
+		{
+			throw std::runtime_error("KTX2 level data is truncated!");
+		}
+
+		m_vLevels[i].pData = reinterpret_cast<const uint8_t*>(m_vFileData.data()) + index.byteOffset;
+		m_vLevels[i].byteLength = index.byteLength;
+		m_vLevels[i].width = std::max(m_width >> i, 1u);
+		m_vLevels[i].height = std::max(m_height >> i, 1u);
+
+		// Uploads and the transcoder read whole block rows, a short level would have them read past it.
+		if (index.byteLength < GetImageBytes(BLOCK, m_vLevels[i].width, m_vLevels[i].height))
+		{
+			throw std::runtime_error("KTX2 level is smaller than its size needs!");
+		}
+	}
+}
+
+Ktx2File Ktx2File::Load(const std::string& filename)
+{
+	return Ktx2File(ReadFile(filename));
+}
+
+void Ktx2File::Transcode()
+{
+	const VkFormat TARGET = GetTranscodeTarget(m_format);
+	if (TARGET == VK_FORMAT_UNDEFINED)
+	{
+		throw std::runtime_error("No CPU transcoder for this texture format!");
+	}
+
+	m_vDecodedLevels.resize(m_vLevels.size());
+	for (size_t i = 0; i < m_vLevels.size(); i++)
+	{
+		m_vDecodedLevels[i] = DecodeLevel(m_format, m_vLevels[i]);
+		m_vLevels[i].pData = m_vDecodedLevels[i].data();
+		m_vLevels[i].byteLength = m_vDecodedLevels[i].size();
+	}
+
+	// The compressed payload is no longer needed.
+	m_vFileData.clear();
+	m_vFileData.shrink_to_fit();
+	m_format = TARGET;
+}
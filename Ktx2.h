@@ -0,0 +1,81 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	KTX2 texture container parsing, plus a CPU transcoder for block compressed formats the GPU can't sample.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+// Block dimensions and size of a format. Uncompressed formats are treated as 1x1 blocks.
+struct FormatBlockInfo
+{
+	uint32_t blockWidth = 1;
+	uint32_t blockHeight = 1;
+	uint32_t bytesPerBlock = 0;	// Zero means the format isn't known to us.
+	bool compressed = false;
+};
+
+FormatBlockInfo GetFormatBlockInfo(VkFormat format);
+
+// Tightly packed bytes of one image of the given size, in whole blocks.
+uint64_t GetImageBytes(const FormatBlockInfo& block, uint32_t width, uint32_t height);
+
+struct Ktx2Level
+{
+	const uint8_t* pData = nullptr;
+	uint64_t byteLength = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+/*
+	A parsed KTX2 file. Only 2D, non-array, non-supercompressed textures are supported.
+	Level 0 is the most detailed mip, as in the file and in Vulkan.
+	A level count of 0 in the header means the file only has the base level and mips should be generated at load.
+
+	Supported formats, anything else is rejected when the file is parsed:
+		8 bit R, RG and RGBA/BGRA, 16 and 32 bit float R, RG and RGBA, loaded as stored.
+		BC1-5, BC7 and LDR ASTC in every footprint, transcoded to 8 bit R, RG or RGBA if the device can't sample them.
+		BC6H, transcoded to RGBA16F.
+*/
+class Ktx2File
+{
+public:
+
+	// Takes ownership of the file contents, level pointers point into it.
+	explicit Ktx2File(std::vector<char>&& fileData);
+
+	// Level pointers reference our own storage, so copies would dangle. Moving keeps the heap blocks where they are.
+	Ktx2File(const Ktx2File&) = delete;
+	Ktx2File(Ktx2File&&) = default;
+
+	static Ktx2File Load(const std::string& filename);
+
+	_NODISCARD VkFormat GetFormat() const { return m_format; }
+	_NODISCARD uint32_t GetWidth() const { return m_width; }
+	_NODISCARD uint32_t GetHeight() const { return m_height; }
+	_NODISCARD uint32_t GetLevelCount() const { return static_cast<uint32_t>(m_vLevels.size()); }
+	_NODISCARD bool WantsGeneratedMips() const { return m_generateMips; }
+	_NODISCARD const Ktx2Level& GetLevel(uint32_t level) const { return m_vLevels[level]; }
+
+	// Decode every level to an uncompressed format on the CPU. Used when the device can't sample the stored format.
+	void Transcode();
+
+	// The format Transcode() would produce. Every supported compressed format has one, uncompressed ones are VK_FORMAT_UNDEFINED.
+	static VkFormat GetTranscodeTarget(VkFormat format);
+
+private:
+
+	std::vector<char> m_vFileData;
+	std::vector<std::vector<uint8_t>> m_vDecodedLevels;	// Only filled once transcoded.
+	std::vector<Ktx2Level> m_vLevels;
+	VkFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	bool m_generateMips;
+};
@@ -0,0 +1,64 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Picks a level of detail from how big its simplification error would look on screen.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "SceneFile.h"
+#include "MathTypes.h"
+
+#include <cstdint>
+
+/*
+	Pixels covered by one model unit at an object's distance. projectionScale is the viewport height over
+	2 tan(fovY / 2), what a perspective projection multiplies by before dividing by depth. worldScale takes the
+	object's own scaling into account. The distance is to the near side of the bounding sphere, so an object
+	the camera is inside always gets its finest level.
+*/
+inline float PixelsPerUnit(const Float3& viewPosition, const Float3& center, float radius, float worldScale, float projectionScale)
+{
+	const Float3 OFFSET = center - viewPosition;
+	const float DISTANCE = std::sqrt(Dot(OFFSET, OFFSET)) - radius;
+	if (DISTANCE <= 0.0f)
+	{
+		return FLT_MAX;
+	}
+
+	return worldScale * projectionScale / DISTANCE;
+}
+
+/*
+	The coarsest level whose error would show as no more than thresholdPixels. Levels must be finest first,
+	errors increasing. With a hysteresis band, an object only gets coarser once the next level's error is under
+	threshold * (1 - hysteresis), but gets finer as soon as its current level's error crosses the threshold,
+	so an object sitting on a boundary doesn't swap back and forth every frame.
+*/
+inline uint32_t SelectLod(const SceneLod* pLods, uint32_t lodCount, float pixelsPerUnit, float thresholdPixels, float hysteresis, uint32_t current)
+{
+	if (lodCount == 0)
+	{
+		return 0;
+	}
+
+	current = current < lodCount ? current : lodCount - 1;
+
+	// Finer first, that's the one that shows.
+	if (pLods[current].error * pixelsPerUnit > thresholdPixels)
+	{
+		while (current > 0 && pLods[current].error * pixelsPerUnit > thresholdPixels)
+		{
+			current--;
+		}
+		return current;
+	}
+
+	const float COARSEN_BELOW = thresholdPixels * (1.0f - hysteresis);
+	while (current + 1 < lodCount && pLods[current + 1].error * pixelsPerUnit <= COARSEN_BELOW)
+	{
+		current++;
+	}
+
+	return current;
+}
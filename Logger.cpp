@@ -0,0 +1,281 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asynchronous logger for validation messages and status lines. Producers never block, a writer thread does the I/O.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "Logger.h"
+#include "VulkanUtils.h"
+#include "Constants.h"
+
+#include <iostream>
+#include <cstring>
+
+#define LOG_CAPACITY				Logging_constants::g_logCapacity
+#define MAX_PER_ID_PER_SECOND		Logging_constants::g_maxMessagesPerIdPerSecond
+
+namespace
+{
+	const char* SeverityName(uint32_t severity)
+	{
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)	return "error";
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)	return "warning";
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)	return "info";
+		return "verbose";
+	}
+
+	const char* TypeName(uint32_t type)
+	{
+		if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)	return "performance";
+		if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT)	return "validation";
+		return "general";
+	}
+
+	void WriteJsonString(std::ostream& out, const char* pText)
+	{
+		static const char HEX[] = "0123456789abcdef";
+
+		out << '"';
+		for (const char* p = pText; *p != '\0'; p++)
+		{
+			const unsigned char C = static_cast<unsigned char>(*p);
+			switch (C)
+			{
+			case '"':	out << "\\\"";	break;
+			case '\\':	out << "\\\\";	break;
+			case '\n':	out << "\\n";	break;
+			case '\r':	out << "\\r";	break;
+			case '\t':	out << "\\t";	break;
+			default:
+				if (C < 0x20)
+				{
+					out << "\\u00" << HEX[C >> 4] << HEX[C & 15];
+				}
+				else
+				{
+					out << *p;
+				}
+			}
+		}
+		out << '"';
+	}
+
+	void CopyTruncated(char* pDst, size_t dstSize, const char* pSrc)
+	{
+		if (pSrc == nullptr)
+		{
+			pDst[0] = '\0';
+			return;
+		}
+
+		const size_t LENGTH = strnlen(pSrc, dstSize - 1);
+		std::memcpy(pDst, pSrc, LENGTH);
+		pDst[LENGTH] = '\0';
+	}
+}
+
+void Logger::Init(const std::string& filename)
+{
+	m_file.open(filename, std::ios::trunc);
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("Failed to open log file!");
+	}
+
+	m_records = std::make_unique<RingBuffer<LogRecord>>(LOG_CAPACITY);
+	m_idSlots.reset(new IdSlot[ID_SLOTS]);
+	m_start = std::chrono::steady_clock::now();
+
+	m_running = true;
+	m_writer = std::thread(&Logger::WriterThread, this);
+}
+
+void Logger::Shutdown()
+{
+	if (!m_running.exchange(false))
+	{
+		return;
+	}
+
+	m_writer.join();
+	m_file.close();
+}
+
+Logger::IdSlot* Logger::FindSlot(int32_t messageId)
+{
+	// Linear probing from a multiplicative hash, IDs are often small or clustered.
+	uint32_t index = (static_cast<uint32_t>(messageId) * 2654435761u) % ID_SLOTS;
+
+	for (uint32_t probe = 0; probe < ID_SLOTS; probe++)
+	{
+		IdSlot& slot = m_idSlots[index];
+		int64_t key = slot.key.load(std::memory_order_acquire);
+
+		if (key == messageId)
+		{
+			return &slot;
+		}
+
+		if (key == EMPTY_KEY)
+		{
+			if (slot.key.compare_exchange_strong(key, messageId, std::memory_order_acq_rel) || key == messageId)
+			{
+				return &slot;
+			}
+		}
+
+		index = (index + 1) % ID_SLOTS;
+	}
+
+	return nullptr; // Table full, the message goes through unlimited.
+}
+
+void Logger::Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, int32_t messageId, const char* pMessageIdName, const char* pMessage)
+{
+	if (!m_running.load(std::memory_order_relaxed))
+	{
+		// Not set up, or already shut down. Don't lose errors though.
+		std::cerr << "Validation Layer: " << pMessage << '\n';
+		return;
+	}
+
+	const uint64_t MICROSECONDS = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+
+	LogRecord record;
+	record.suppressed = 0;
+	record.status = false;
+
+	IdSlot* pSlot = FindSlot(messageId);
+	if (pSlot != nullptr)
+	{
+		pSlot->total.fetch_add(1, std::memory_order_relaxed);
+
+		// One second windows. Whoever sees a new window first resets the count, a race here only lets one or two extra through.
+		const uint64_t WINDOW = MICROSECONDS / 1000000;
+		uint64_t current = pSlot->window.load(std::memory_order_relaxed);
+		if (current != WINDOW && pSlot->window.compare_exchange_strong(current, WINDOW, std::memory_order_relaxed))
+		{
+			pSlot->countInWindow.store(0, std::memory_order_relaxed);
+		}
+
+		if (pSlot->countInWindow.fetch_add(1, std::memory_order_relaxed) >= MAX_PER_ID_PER_SECOND)
+		{
+			pSlot->suppressed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		record.suppressed = pSlot->suppressed.exchange(0, std::memory_order_relaxed);
+	}
+
+	record.microseconds = MICROSECONDS;
+	record.severity = static_cast<uint32_t>(severity);
+	record.type = static_cast<uint32_t>(type);
+	record.messageId = messageId;
+	CopyTruncated(record.name, MAX_NAME, pMessageIdName);
+	CopyTruncated(record.message, MAX_MESSAGE, pMessage);
+
+	if (!m_records->TryPush(record))
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void Logger::Status(const char* pMessage)
+{
+	if (!m_running.load(std::memory_order_relaxed))
+	{
+		// Already shut down.
+		std::cout << pMessage << '\n';
+		return;
+	}
+
+	LogRecord record;
+	record.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+	record.severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+	record.type = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT;
+	record.messageId = 0;
+	record.suppressed = 0;
+	record.status = true;
+	CopyTruncated(record.name, MAX_NAME, "Status");
+	CopyTruncated(record.message, MAX_MESSAGE, pMessage);
+
+	if (!m_records->TryPush(record))
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void Logger::WriterThread()
+{
+	LogRecord record;
+
+	while (true)
+	{
+		// Read the flag before draining, so nothing pushed before Shutdown can be missed.
+		const bool RUNNING = m_running.load(std::memory_order_acquire);
+
+		bool wroteAny = false;
+		while (m_records->TryPop(record))
+		{
+			Write(record);
+			wroteAny = true;
+		}
+
+		if (wroteAny)
+		{
+			m_file.flush();
+		}
+
+		if (!RUNNING)
+		{
+			break;
+		}
+
+		if (!wroteAny)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+
+	// Summary of every message ID seen, and whatever the rate limit held back at the end.
+	for (uint32_t i = 0; i < ID_SLOTS; i++)
+	{
+		const IdSlot& SLOT = m_idSlots[i];
+		if (SLOT.key.load() == EMPTY_KEY)
+		{
+			continue;
+		}
+
+		m_file << "{\"summary\":true,\"id\":" << SLOT.key.load() << ",\"total\":" << SLOT.total.load() << ",\"suppressed\":" << SLOT.suppressed.load() << "}\n";
+	}
+
+	m_file << "{\"summary\":true,\"dropped\":" << m_dropped.load() << "}\n";
+	m_file.flush();
+}
+
+void Logger::Write(const LogRecord& record)
+{
+	m_file << "{\"t_us\":" << record.microseconds
+		<< ",\"severity\":\"" << SeverityName(record.severity)
+		<< "\",\"type\":\"" << TypeName(record.type)
+		<< "\",\"id\":" << record.messageId
+		<< ",\"name\":";
+	WriteJsonString(m_file, record.name);
+	m_file << ",\"message\":";
+	WriteJsonString(m_file, record.message);
+	if (record.suppressed > 0)
+	{
+		m_file << ",\"suppressed_before\":" << record.suppressed;
+	}
+	m_file << "}\n";
+
+	// The console still sees status lines and anything that needs attention, just not on the thread that raised them.
+	if (record.status)
+	{
+		std::cout << record.message << '\n';
+	}
+	else if (record.severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+	{
+		std::cerr << "Validation Layer [" << SeverityName(record.severity) << "]: " << record.message << '\n';
+	}
+}
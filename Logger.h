@@ -0,0 +1,93 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asynchronous logger for validation messages and status lines. Producers never block, a writer thread does the I/O.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "RingBuffer.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+class Logger
+{
+public:
+
+	Logger() :
+		m_records(nullptr),
+		m_dropped(0),
+		m_running(false)
+	{}
+
+	~Logger() { Shutdown(); }
+
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	// Structured output goes to filename as one JSON object per line. Warnings and errors are echoed to stderr too.
+	void Init(const std::string& filename);
+
+	// Drains anything still queued, then stops the writer.
+	void Shutdown();
+
+	/*
+		Safe from any thread, including the driver's inside a debug callback. Never allocates or blocks:
+		repeats of a message ID beyond the rate limit are only counted, and if the ring is full the message is dropped.
+	*/
+	void Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, int32_t messageId, const char* pMessageIdName, const char* pMessage);
+
+	// The renderer's own status lines, so the render thread never waits on the console. Echoed to stdout, never rate limited.
+	void Status(const char* pMessage);
+
+private:
+
+	static constexpr size_t MAX_NAME = 64;
+	static constexpr size_t MAX_MESSAGE = 1024;
+	static constexpr uint32_t ID_SLOTS = 512;	// Distinct message IDs we can rate limit, more than the validation layers tend to raise in a run.
+
+	struct LogRecord
+	{
+		uint64_t microseconds;
+		uint32_t severity;
+		uint32_t type;
+		int32_t messageId;
+		uint32_t suppressed;		// Repeats dropped since the last one that got through.
+		bool status;				// From Status rather than the validation layers.
+		char name[MAX_NAME];
+		char message[MAX_MESSAGE];
+	};
+
+	static constexpr int64_t EMPTY_KEY = INT64_MIN;
+
+	// Open addressed by message ID. A slot is claimed once, by swapping its key from empty, and never freed.
+	struct IdSlot
+	{
+		std::atomic<int64_t> key{ EMPTY_KEY };
+		std::atomic<uint64_t> window{ 0 };			// Which rate limit window the count belongs to.
+		std::atomic<uint32_t> countInWindow{ 0 };
+		std::atomic<uint32_t> suppressed{ 0 };
+		std::atomic<uint64_t> total{ 0 };
+	};
+
+	IdSlot* FindSlot(int32_t messageId);
+	void WriterThread();
+	void Write(const LogRecord& record);
+
+	std::unique_ptr<RingBuffer<LogRecord>> m_records;
+	std::unique_ptr<IdSlot[]> m_idSlots;
+	std::atomic<uint64_t> m_dropped;
+
+	std::atomic<bool> m_running;
+	std::thread m_writer;
+	std::ofstream m_file;
+	std::chrono::steady_clock::time_point m_start;
+};
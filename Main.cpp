@@ -6,15 +6,38 @@
 
 #include <iostream>		// Capture error reporting
 #include <cstdlib>		// Exit Macros
+#include <string>
 
 #include "VulkanApp.h"
+#include "Benchmarks.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+	// --bench runs the CPU benchmarks instead of the renderer, no window or device needed.
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--bench")
+		{
+			RunBenchmarks(std::cout);
+			return EXIT_SUCCESS;
+		}
+	}
+
 	VulkanApp app;
 
 	try
 	{
+		// --present=low-latency|throughput|power-saving
+		const std::string PRESENT_ARG = "--present=";
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string ARG = argv[i];
+			if (ARG.compare(0, PRESENT_ARG.size(), PRESENT_ARG) == 0)
+			{
+				app.SetPresentPolicy(ParsePresentPolicy(ARG.substr(PRESENT_ARG.size())));
+			}
+		}
+
 		app.Run();
 	}
 	catch(const std::exception& E)
@@ -23,6 +46,12 @@ int main()
 		return EXIT_FAILURE;
 	}
 
+	// New performance warnings fail the run, so test runs catch them as regressions.
+	if (app.PerfRegressed())
+	{
+		return EXIT_FAILURE;
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,164 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Read only memory mapped file. The OS pages it in on first touch, nothing is read up front.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+	m_pData(std::exchange(other.m_pData, nullptr)),
+	m_size(std::exchange(other.m_size, 0)),
+	m_fileHandle(std::exchange(other.m_fileHandle, nullptr)),
+	m_mappingHandle(std::exchange(other.m_mappingHandle, nullptr))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_pData = std::exchange(other.m_pData, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_fileHandle = std::exchange(other.m_fileHandle, nullptr);
+		m_mappingHandle = std::exchange(other.m_mappingHandle, nullptr);
+	}
+
+	return *this;
+}
+
+#ifdef _WIN32
+
+void MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Failed to open file for mapping!");
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map empty file!");
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* pView = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (pView == nullptr)
+	{
+		if (mapping != nullptr)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map file!");
+	}
+
+	m_pData = static_cast<const uint8_t*>(pView);
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_fileHandle = file;
+	m_mappingHandle = mapping;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData != nullptr)
+	{
+		UnmapViewOfFile(m_pData);
+		CloseHandle(m_mappingHandle);
+		CloseHandle(m_fileHandle);
+	}
+
+	m_pData = nullptr;
+	m_size = 0;
+	m_fileHandle = nullptr;
+	m_mappingHandle = nullptr;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+	if (offset >= m_size || size == 0)
+	{
+		return;
+	}
+
+	// Only a hint, a failure just means the pages fault in as they're touched.
+	WIN32_MEMORY_RANGE_ENTRY range{ const_cast<uint8_t*>(m_pData) + offset, std::min(size, m_size - offset) };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+void MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	const int DESCRIPTOR = open(filename.c_str(), O_RDONLY);
+	if (DESCRIPTOR < 0)
+	{
+		throw std::runtime_error("Failed to open file for mapping!");
+	}
+
+	struct stat info{};
+	if (fstat(DESCRIPTOR, &info) != 0 || info.st_size == 0)
+	{
+		close(DESCRIPTOR);
+		throw std::runtime_error("Failed to map empty file!");
+	}
+
+	void* pView = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, DESCRIPTOR, 0);
+	close(DESCRIPTOR);
+	if (pView == MAP_FAILED)
+	{
+		throw std::runtime_error("Failed to map file!");
+	}
+
+	m_pData = static_cast<const uint8_t*>(pView);
+	m_size = static_cast<size_t>(info.st_size);
+}
+
+void MappedFile::Close()
+{
+	if (m_pData != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(m_pData), m_size);
+	}
+
+	m_pData = nullptr;
+	m_size = 0;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+	if (offset >= m_size || size == 0)
+	{
+		return;
+	}
+
+	// madvise wants a page aligned start.
+	const size_t PAGE = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t START = offset - offset % PAGE;
+	const size_t END = offset + (size < m_size - offset ? size : m_size - offset);
+	madvise(const_cast<uint8_t*>(m_pData) + START, END - START, MADV_WILLNEED);
+}
+
+#endif
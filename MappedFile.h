@@ -0,0 +1,50 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Read only memory mapped file. The OS pages it in on first touch, nothing is read up front.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class MappedFile
+{
+public:
+
+	MappedFile() :
+		m_pData(nullptr),
+		m_size(0),
+		m_fileHandle(nullptr),
+		m_mappingHandle(nullptr)
+	{}
+
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	void Open(const std::string& filename);
+	void Close();
+
+	// Tells the OS a range is about to be read, so it can be paged in ahead of the reads rather than a fault at a time.
+	void Prefetch(size_t offset, size_t size) const;
+
+	_NODISCARD const uint8_t* Data() const { return m_pData; }
+	_NODISCARD size_t Size() const { return m_size; }
+	_NODISCARD bool IsOpen() const { return m_pData != nullptr; }
+
+private:
+
+	const uint8_t* m_pData;
+	size_t m_size;
+
+	// HANDLEs on Windows. Elsewhere the descriptor is closed once mapped, the mapping keeps the file alive.
+	void* m_fileHandle;
+	void* m_mappingHandle;
+};
@@ -0,0 +1,268 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Small math types laid out to match GLSL, with SIMD kernels for the hot paths.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define MATH_SSE 1
+#include <immintrin.h>
+#endif
+
+struct Float3
+{
+	float x, y, z;
+};
+
+inline Float3 operator+(const Float3& a, const Float3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline Float3 operator-(const Float3& a, const Float3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline Float3 operator*(const Float3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Float3 Cross(const Float3& a, const Float3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+inline Float3 Min(const Float3& a, const Float3& b) { return { a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z }; }
+inline Float3 Max(const Float3& a, const Float3& b) { return { a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z }; }
+
+// Column major, the same as a GLSL mat4, so it can be copied straight into a buffer.
+struct alignas(16) Float4x4
+{
+	float m[16];	// m[column * 4 + row]
+
+	static Float4x4 Identity()
+	{
+		return { { 1.0f, 0.0f, 0.0f, 0.0f,
+				   0.0f, 1.0f, 0.0f, 0.0f,
+				   0.0f, 0.0f, 1.0f, 0.0f,
+				   0.0f, 0.0f, 0.0f, 1.0f } };
+	}
+
+	static Float4x4 Translation(float x, float y, float z)
+	{
+		Float4x4 result = Identity();
+		result.m[12] = x;
+		result.m[13] = y;
+		result.m[14] = z;
+		return result;
+	}
+
+	static Float4x4 Scale(float x, float y, float z)
+	{
+		Float4x4 result = Identity();
+		result.m[0] = x;
+		result.m[5] = y;
+		result.m[10] = z;
+		return result;
+	}
+
+	Float3 GetTranslation() const { return { m[12], m[13], m[14] }; }
+
+	Float3 TransformPoint(const Float3& p) const
+	{
+		return { m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+				 m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+				 m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14] };
+	}
+
+	// Largest axis scale, enough to keep a transformed bounding sphere conservative.
+	float MaxScale() const
+	{
+		const float X = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+		const float Y = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+		const float Z = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+		return std::sqrt(X > Y ? (X > Z ? X : Z) : (Y > Z ? Y : Z));
+	}
+};
+
+struct Aabb
+{
+	Float3 min;
+	Float3 max;
+
+	static Aabb Empty() { return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } }; }
+	static Aabb FromSphere(const Float3& center, float radius) { return { center - Float3{ radius, radius, radius }, center + Float3{ radius, radius, radius } }; }
+
+	void Grow(const Aabb& other) { min = Min(min, other.min); max = Max(max, other.max); }
+	void Grow(const Float3& point) { min = Min(min, point); max = Max(max, point); }
+
+	Float3 Center() const { return (min + max) * 0.5f; }
+
+	// Half the surface area, the factor of two cancels out of every SAH comparison.
+	float HalfArea() const
+	{
+		const Float3 E = max - min;
+		return E.x < 0.0f ? 0.0f : E.x * E.y + E.y * E.z + E.z * E.x;
+	}
+
+	bool Overlaps(const Aabb& other) const
+	{
+		return min.x <= other.max.x && max.x >= other.min.x && min.y <= other.max.y && max.y >= other.min.y && min.z <= other.max.z && max.z >= other.min.z;
+	}
+};
+
+struct Ray
+{
+	Float3 origin;
+	Float3 direction;
+};
+
+// dot(normal, p) + distance >= 0 on the inside.
+struct Plane
+{
+	Float3 normal;
+	float distance;
+};
+
+struct Frustum
+{
+	Plane planes[6];	// Left, right, bottom, top, near, far.
+
+	// From a column major view projection with Vulkan's 0 to 1 clip depth. Planes point inwards.
+	static Frustum FromViewProjection(const Float4x4& vp)
+	{
+		auto row = [&vp](int r) { return Plane{ { vp.m[r], vp.m[4 + r], vp.m[8 + r] }, vp.m[12 + r] }; };
+		auto add = [](const Plane& a, const Plane& b, float sign) { return Plane{ a.normal + b.normal * sign, a.distance + b.distance * sign }; };
+
+		const Plane X = row(0);
+		const Plane Y = row(1);
+		const Plane Z = row(2);
+		const Plane W = row(3);
+
+		Frustum frustum{ { add(W, X, 1.0f), add(W, X, -1.0f), add(W, Y, 1.0f), add(W, Y, -1.0f), Z, add(W, Z, -1.0f) } };
+		for (Plane& plane : frustum.planes)
+		{
+			const float LENGTH = std::sqrt(Dot(plane.normal, plane.normal));
+			if (LENGTH > 0.0f)
+			{
+				plane.normal = plane.normal * (1.0f / LENGTH);
+				plane.distance /= LENGTH;
+			}
+		}
+
+		return frustum;
+	}
+};
+
+/*
+	result = a * b. Each column of the result is a's columns weighted by one column of b.
+	With AVX two result columns are built at once, a's columns are duplicated into both halves of a register.
+	result may alias a or b, both are fully loaded first.
+*/
+inline void Multiply(const Float4x4& a, const Float4x4& b, Float4x4& result)
+{
+#if defined(__AVX__)
+	const __m256 A0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.m[0]));
+	const __m256 A1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.m[4]));
+	const __m256 A2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.m[8]));
+	const __m256 A3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.m[12]));
+
+	// Matrices are only 16 byte aligned, unaligned loads cost nothing extra when they happen to be aligned.
+	const __m256 B01 = _mm256_loadu_ps(&b.m[0]);
+	const __m256 B23 = _mm256_loadu_ps(&b.m[8]);
+
+	auto columns = [&](__m256 bColumns)
+	{
+		// Shuffles stay within each 128 bit lane, so each half broadcasts from its own column of b.
+		__m256 sum = _mm256_mul_ps(A0, _mm256_shuffle_ps(bColumns, bColumns, 0x00));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(A1, _mm256_shuffle_ps(bColumns, bColumns, 0x55)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(A2, _mm256_shuffle_ps(bColumns, bColumns, 0xAA)));
+		return _mm256_add_ps(sum, _mm256_mul_ps(A3, _mm256_shuffle_ps(bColumns, bColumns, 0xFF)));
+	};
+
+	const __m256 R01 = columns(B01);
+	const __m256 R23 = columns(B23);
+	_mm256_storeu_ps(&result.m[0], R01);
+	_mm256_storeu_ps(&result.m[8], R23);
+#elif defined(MATH_SSE)
+	const __m128 A0 = _mm_load_ps(&a.m[0]);
+	const __m128 A1 = _mm_load_ps(&a.m[4]);
+	const __m128 A2 = _mm_load_ps(&a.m[8]);
+	const __m128 A3 = _mm_load_ps(&a.m[12]);
+
+	__m128 columns[4];
+	for (int c = 0; c < 4; c++)
+	{
+		const __m128 B = _mm_load_ps(&b.m[c * 4]);
+		__m128 sum = _mm_mul_ps(A0, _mm_shuffle_ps(B, B, 0x00));
+		sum = _mm_add_ps(sum, _mm_mul_ps(A1, _mm_shuffle_ps(B, B, 0x55)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(A2, _mm_shuffle_ps(B, B, 0xAA)));
+		columns[c] = _mm_add_ps(sum, _mm_mul_ps(A3, _mm_shuffle_ps(B, B, 0xFF)));
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		_mm_store_ps(&result.m[c * 4], columns[c]);
+	}
+#else
+	Float4x4 temp;
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			temp.m[c * 4 + r] = a.m[r] * b.m[c * 4] + a.m[4 + r] * b.m[c * 4 + 1] + a.m[8 + r] * b.m[c * 4 + 2] + a.m[12 + r] * b.m[c * 4 + 3];
+		}
+	}
+	result = temp;
+#endif
+}
+
+// General inverse by cofactors. Returns false, leaving result untouched, when a is singular.
+inline bool Inverse(const Float4x4& a, Float4x4& result)
+{
+	const float* m = a.m;
+	float inv[16];
+
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	const float DETERMINANT = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if (DETERMINANT == 0.0f)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		result.m[i] = inv[i] / DETERMINANT;
+	}
+	return true;
+}
+
+// For mapped GPU memory, which is usually write combined. Streaming stores skip the cache, which reads would only pollute.
+inline void StoreStreaming(Float4x4* pDestination, const Float4x4& source)
+{
+#if defined(MATH_SSE)
+	_mm_stream_ps(&pDestination->m[0], _mm_load_ps(&source.m[0]));
+	_mm_stream_ps(&pDestination->m[4], _mm_load_ps(&source.m[4]));
+	_mm_stream_ps(&pDestination->m[8], _mm_load_ps(&source.m[8]));
+	_mm_stream_ps(&pDestination->m[12], _mm_load_ps(&source.m[12]));
+#else
+	*pDestination = source;
+#endif
+}
+
+// Streaming stores are weakly ordered, fence before anything else (the GPU) may read them.
+inline void StreamingFence()
+{
+#if defined(MATH_SSE)
+	_mm_sfence();
+#endif
+}
@@ -0,0 +1,408 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asset time index and vertex reordering, for the post transform cache, overdraw and vertex fetch.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "MeshOptimizer.h"
+#include "MathTypes.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	// Forsyth's constants, from his article. The modelled cache is larger than any real one, which costs little.
+	constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	// Cache size the overdraw pass assumes when finding where the cache starts cold.
+	constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+	float VertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a flat score, so the next triangle doesn't just reuse its edge every time.
+			if (cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				const float SCALE = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * SCALE, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Vertices with few triangles left are finished off, rather than left to cost a miss later.
+		return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+	}
+
+	// Counts misses in a FIFO cache, one triangle at a time. Stamps avoid searching the cache.
+	class FifoCache
+	{
+	public:
+
+		FifoCache(uint32_t vertexCount, uint32_t size) :
+			m_vStamps(vertexCount, 0),
+			m_time(size + 1),
+			m_size(size)
+		{}
+
+		// Misses for the triangle, adding its vertices to the cache.
+		uint32_t Triangle(const uint32_t* pIndices)
+		{
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				// In the cache if it went in within the last size insertions.
+				if (m_time - m_vStamps[pIndices[k]] > m_size)
+				{
+					m_vStamps[pIndices[k]] = m_time++;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		// Everything falls out.
+		void Flush() { m_time += m_size + 1; }
+
+	private:
+
+		std::vector<uint32_t> m_vStamps;
+		uint32_t m_time;
+		uint32_t m_size;
+	};
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats{ 0.0f, 0.0f };
+	const size_t TRIANGLES = indices.size() / 3;
+	if (TRIANGLES == 0)
+	{
+		return stats;
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<uint8_t> vUsed(vertexCount, 0);
+	uint32_t misses = 0;
+	uint32_t used = 0;
+
+	for (size_t t = 0; t < TRIANGLES; t++)
+	{
+		misses += cache.Triangle(&indices[t * 3]);
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			used += vUsed[indices[t * 3 + k]] ? 0 : 1;
+			vUsed[indices[t * 3 + k]] = 1;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / TRIANGLES;
+	stats.atvr = static_cast<float>(misses) / used;
+	return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	const uint32_t TRIANGLES = static_cast<uint32_t>(indices.size() / 3);
+	if (TRIANGLES == 0)
+	{
+		return;
+	}
+
+	// Triangles around each vertex, packed. The first 'remaining' of each vertex's run are the ones not drawn yet.
+	std::vector<uint32_t> vRemaining(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		vRemaining[index]++;
+	}
+
+	std::vector<uint32_t> vFirst(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vFirst[v + 1] = vFirst[v] + vRemaining[v];
+	}
+
+	std::vector<uint32_t> vAdjacency(indices.size());
+	std::vector<uint32_t> vFill(vFirst.begin(), vFirst.end() - 1);
+	for (uint32_t t = 0; t < TRIANGLES; t++)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			vAdjacency[vFill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<int32_t> vCachePosition(vertexCount, -1);
+	std::vector<float> vVertexScore(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vVertexScore[v] = VertexScore(-1, vRemaining[v]);
+	}
+
+	std::vector<float> vTriangleScore(TRIANGLES);
+	std::vector<uint8_t> vDrawn(TRIANGLES, 0);
+	for (uint32_t t = 0; t < TRIANGLES; t++)
+	{
+		vTriangleScore[t] = vVertexScore[indices[t * 3]] + vVertexScore[indices[t * 3 + 1]] + vVertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> vOutput;
+	vOutput.reserve(indices.size());
+
+	// One list holds the cache and, past its end, the three that just fell out and still need their scores lowered.
+	std::vector<uint32_t> vCache;
+	std::vector<uint32_t> vNextCache;
+	vCache.reserve(FORSYTH_CACHE_SIZE + 3);
+	vNextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	uint32_t best = static_cast<uint32_t>(std::max_element(vTriangleScore.begin(), vTriangleScore.end()) - vTriangleScore.begin());
+	uint32_t scanCursor = 0;
+
+	for (uint32_t drawn = 0; drawn < TRIANGLES; drawn++)
+	{
+		// Nothing in the cache has triangles left, start again from the first one not drawn.
+		if (best == UINT32_MAX)
+		{
+			while (vDrawn[scanCursor])
+			{
+				scanCursor++;
+			}
+			best = scanCursor;
+		}
+
+		const uint32_t* pTriangle = &indices[best * 3];
+		vOutput.insert(vOutput.end(), pTriangle, pTriangle + 3);
+		vDrawn[best] = 1;
+
+		// Take the triangle off each of its vertices' remaining lists.
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			const uint32_t VERTEX = pTriangle[k];
+			uint32_t* pBegin = &vAdjacency[vFirst[VERTEX]];
+			uint32_t* pEnd = pBegin + vRemaining[VERTEX];
+			std::iter_swap(std::find(pBegin, pEnd, best), pEnd - 1);
+			vRemaining[VERTEX]--;
+		}
+
+		// The triangle's vertices move to the front, everything else keeps its order behind them.
+		vNextCache.assign(pTriangle, pTriangle + 3);
+		for (uint32_t vertex : vCache)
+		{
+			if (vertex != pTriangle[0] && vertex != pTriangle[1] && vertex != pTriangle[2])
+			{
+				vNextCache.push_back(vertex);
+			}
+		}
+		vCache.swap(vNextCache);
+
+		// Rescore everything that moved, and find the best triangle among those still in the cache.
+		for (uint32_t i = 0; i < vCache.size(); i++)
+		{
+			const uint32_t VERTEX = vCache[i];
+			vCachePosition[VERTEX] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+
+			const float SCORE = VertexScore(vCachePosition[VERTEX], vRemaining[VERTEX]);
+			const float DELTA = SCORE - vVertexScore[VERTEX];
+			vVertexScore[VERTEX] = SCORE;
+
+			for (uint32_t a = vFirst[VERTEX]; a < vFirst[VERTEX] + vRemaining[VERTEX]; a++)
+			{
+				vTriangleScore[vAdjacency[a]] += DELTA;
+			}
+		}
+
+		best = UINT32_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t i = 0; i < vCache.size() && i < FORSYTH_CACHE_SIZE; i++)
+		{
+			const uint32_t VERTEX = vCache[i];
+			for (uint32_t a = vFirst[VERTEX]; a < vFirst[VERTEX] + vRemaining[VERTEX]; a++)
+			{
+				if (vTriangleScore[vAdjacency[a]] > bestScore)
+				{
+					bestScore = vTriangleScore[vAdjacency[a]];
+					best = vAdjacency[a];
+				}
+			}
+		}
+
+		if (vCache.size() > FORSYTH_CACHE_SIZE)
+		{
+			vCache.resize(FORSYTH_CACHE_SIZE);
+		}
+	}
+
+	indices.swap(vOutput);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const MeshView& mesh, float threshold)
+{
+	const uint32_t TRIANGLES = static_cast<uint32_t>(indices.size() / 3);
+	if (TRIANGLES == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries: triangles that miss on all three vertices, the cache is cold there whatever the order.
+	std::vector<uint32_t> vHard;
+	{
+		FifoCache cache(mesh.vertexCount, OVERDRAW_CACHE_SIZE);
+		for (uint32_t t = 0; t < TRIANGLES; t++)
+		{
+			if (cache.Triangle(&indices[t * 3]) == 3)
+			{
+				vHard.push_back(t);
+			}
+		}
+		vHard.push_back(TRIANGLES);
+	}
+
+	// Soft boundaries: within each hard cluster, cut again as soon as the part so far is within threshold of the whole.
+	std::vector<uint32_t> vClusters;
+	for (size_t h = 0; h + 1 < vHard.size(); h++)
+	{
+		const uint32_t BEGIN = vHard[h];
+		const uint32_t END = vHard[h + 1];
+
+		FifoCache cache(mesh.vertexCount, OVERDRAW_CACHE_SIZE);
+		uint32_t misses = 0;
+		for (uint32_t t = BEGIN; t < END; t++)
+		{
+			misses += cache.Triangle(&indices[t * 3]);
+		}
+		const float CLUSTER_TARGET = static_cast<float>(misses) / (END - BEGIN) * threshold;
+
+		cache.Flush();
+		misses = 0;
+		uint32_t start = BEGIN;
+		vClusters.push_back(BEGIN);
+		for (uint32_t t = BEGIN; t < END; t++)
+		{
+			misses += cache.Triangle(&indices[t * 3]);
+			if (t + 1 < END && static_cast<float>(misses) / (t + 1 - start) <= CLUSTER_TARGET)
+			{
+				vClusters.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				cache.Flush();
+			}
+		}
+	}
+	vClusters.push_back(TRIANGLES);
+
+	auto position = [&mesh](uint32_t vertex)
+	{
+		Float3 result;
+		std::memcpy(&result, static_cast<const uint8_t*>(mesh.pVertices) + static_cast<size_t>(vertex) * mesh.vertexStride, sizeof(result));
+		return result;
+	};
+
+	// Area weighted centre of the whole mesh, then each cluster's centre and normal.
+	Float3 meshCenter{ 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+	const size_t CLUSTER_COUNT = vClusters.size() - 1;
+	std::vector<Float3> vCenters(CLUSTER_COUNT, { 0.0f, 0.0f, 0.0f });
+	std::vector<Float3> vNormals(CLUSTER_COUNT, { 0.0f, 0.0f, 0.0f });
+
+	for (size_t c = 0; c < CLUSTER_COUNT; c++)
+	{
+		float clusterArea = 0.0f;
+		for (uint32_t t = vClusters[c]; t < vClusters[c + 1]; t++)
+		{
+			const Float3 A = position(indices[t * 3]);
+			const Float3 B = position(indices[t * 3 + 1]);
+			const Float3 C = position(indices[t * 3 + 2]);
+			const Float3 E1 = B - A;
+			const Float3 E2 = C - A;
+			const Float3 NORMAL = { E1.y * E2.z - E1.z * E2.y, E1.z * E2.x - E1.x * E2.z, E1.x * E2.y - E1.y * E2.x };
+			const float AREA = std::sqrt(Dot(NORMAL, NORMAL));
+
+			vCenters[c] = vCenters[c] + (A + B + C) * (AREA / 3.0f);
+			vNormals[c] = vNormals[c] + NORMAL;
+			clusterArea += AREA;
+		}
+
+		meshCenter = meshCenter + vCenters[c];
+		meshArea += clusterArea;
+		vCenters[c] = clusterArea > 0.0f ? vCenters[c] * (1.0f / clusterArea) : position(indices[vClusters[c] * 3]);
+	}
+	meshCenter = meshArea > 0.0f ? meshCenter * (1.0f / meshArea) : meshCenter;
+
+	// The further a cluster sits out along its own normal, the more of the mesh it's likely to cover.
+	std::vector<float> vSortKey(CLUSTER_COUNT);
+	for (size_t c = 0; c < CLUSTER_COUNT; c++)
+	{
+		const float LENGTH = std::sqrt(Dot(vNormals[c], vNormals[c]));
+		const Float3 NORMAL = LENGTH > 0.0f ? vNormals[c] * (1.0f / LENGTH) : vNormals[c];
+		vSortKey[c] = Dot(vCenters[c] - meshCenter, NORMAL);
+	}
+
+	std::vector<uint32_t> vOrder(CLUSTER_COUNT);
+	std::iota(vOrder.begin(), vOrder.end(), 0);
+	std::stable_sort(vOrder.begin(), vOrder.end(), [&vSortKey](uint32_t a, uint32_t b) { return vSortKey[a] > vSortKey[b]; });
+
+	std::vector<uint32_t> vOutput;
+	vOutput.reserve(indices.size());
+	for (uint32_t c : vOrder)
+	{
+		vOutput.insert(vOutput.end(), indices.begin() + vClusters[c] * 3, indices.begin() + vClusters[c + 1] * 3);
+	}
+
+	indices.swap(vOutput);
+}
+
+uint32_t OptimizeVertexFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& vRemap)
+{
+	vRemap.assign(vertexCount, UINT32_MAX);
+
+	uint32_t next = 0;
+	for (uint32_t index : indices)
+	{
+		if (vRemap[index] == UINT32_MAX)
+		{
+			vRemap[index] = next++;
+		}
+	}
+
+	return next;
+}
+
+void RemapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& vRemap)
+{
+	for (uint32_t& index : indices)
+	{
+		index = vRemap[index];
+	}
+}
+
+std::vector<uint8_t> RemapVertices(const MeshView& mesh, const std::vector<uint32_t>& vRemap, uint32_t newVertexCount)
+{
+	std::vector<uint8_t> vVertices(static_cast<size_t>(newVertexCount) * mesh.vertexStride);
+	const uint8_t* pSource = static_cast<const uint8_t*>(mesh.pVertices);
+
+	for (uint32_t v = 0; v < mesh.vertexCount; v++)
+	{
+		if (vRemap[v] != UINT32_MAX)
+		{
+			std::memcpy(&vVertices[static_cast<size_t>(vRemap[v]) * mesh.vertexStride], pSource + static_cast<size_t>(v) * mesh.vertexStride, mesh.vertexStride);
+		}
+	}
+
+	return vVertices;
+}
@@ -0,0 +1,48 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asset time index and vertex reordering, for the post transform cache, overdraw and vertex fetch.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MeshSimplifier.h"
+
+#include <vector>
+#include <cstdint>
+
+struct VertexCacheStats
+{
+	float acmr;		// Average cache miss ratio: vertex shader runs per triangle. 0.5 is the ideal for a big regular grid, 3 the worst.
+	float atvr;		// Average transformed vertex ratio: vertex shader runs per vertex used. 1 is perfect.
+};
+
+// Models the post transform cache as a FIFO, which is close to how hardware behaves and what the literature reports against.
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+/*
+	Tom Forsyth's linear speed vertex cache optimisation. Each vertex is scored by how recently it was used and how
+	few triangles it has left, and the next triangle is always the best scoring one touching the cache, so the
+	mesh is drawn in small patches that keep reusing the same vertices.
+*/
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+/*
+	Sander, Nehab and Barczak's triangle reordering. A cache optimised index list is cut into clusters wherever the
+	cache would start cold anyway, or where a cut costs at most threshold times the cluster's miss ratio, and
+	the clusters are sorted so those facing out from the middle of the mesh come first. Drawn front to back
+	from most directions, so fewer fragments are shaded only to be covered up. Run after OptimizeVertexCache.
+*/
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const MeshView& mesh, float threshold);
+
+/*
+	Vertices in the order the indices first use them, so fetches walk forwards through the buffer. Fills vRemap
+	with each old vertex's new index, or UINT32_MAX for a vertex nothing uses, and returns the new vertex count.
+	Base it on the list that uses every vertex, then apply it to any others with RemapIndices.
+*/
+uint32_t OptimizeVertexFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& vRemap);
+
+void RemapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& vRemap);
+
+// Moves every used vertex to where vRemap says, returns the packed vertex data.
+std::vector<uint8_t> RemapVertices(const MeshView& mesh, const std::vector<uint32_t>& vRemap, uint32_t newVertexCount);
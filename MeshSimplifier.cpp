@@ -0,0 +1,563 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asset time mesh simplification by quadric error edge collapse, and LOD chains built from it.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "MeshSimplifier.h"
+#include "MathTypes.h"
+
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	// Border planes count for more than surface planes, so the outline holds its shape longer than the interior.
+	constexpr double BORDER_WEIGHT = 10.0;
+
+	// A collapse may not turn a triangle further than this, the cosine between its old and new normals.
+	constexpr float MIN_NORMAL_COSINE = 0.2f;
+
+	// Each level aims for this fraction of the triangles of the one before, and is dropped if it doesn't get below the second.
+	constexpr float LOD_REDUCTION = 0.5f;
+	constexpr float LOD_MIN_SHRINK = 0.9f;
+
+	enum class VertexKind : uint8_t
+	{
+		Interior,
+		Border,		// On an open edge, only slides along it.
+		Locked		// On a seam or a non manifold edge, never moves.
+	};
+
+	// Symmetric 4x4, upper triangle: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33.
+	struct Quadric
+	{
+		double a[10];
+
+		static Quadric FromPlane(double x, double y, double z, double d, double weight)
+		{
+			return { { x * x * weight, x * y * weight, x * z * weight, x * d * weight,
+					   y * y * weight, y * z * weight, y * d * weight,
+					   z * z * weight, z * d * weight,
+					   d * d * weight } };
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			for (int i = 0; i < 10; i++)
+			{
+				a[i] += other.a[i];
+			}
+			return *this;
+		}
+
+		// Sum of squared distances from p to every plane that went in.
+		double Evaluate(const Float3& p) const
+		{
+			const double X = p.x, Y = p.y, Z = p.z;
+			return a[0] * X * X + 2.0 * a[1] * X * Y + 2.0 * a[2] * X * Z + 2.0 * a[3] * X
+				+ a[4] * Y * Y + 2.0 * a[5] * Y * Z + 2.0 * a[6] * Y
+				+ a[7] * Z * Z + 2.0 * a[8] * Z
+				+ a[9];
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t fromStamp;
+		uint32_t toStamp;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	// Bit patterns rather than floats, so positions weld only when they're exactly the same.
+	struct PositionKey
+	{
+		uint32_t bits[3];
+
+		bool operator==(const PositionKey& other) const { return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2]; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (static_cast<size_t>(key.bits[0]) * 73856093u) ^ (static_cast<size_t>(key.bits[1]) * 19349663u) ^ (static_cast<size_t>(key.bits[2]) * 83492791u);
+		}
+	};
+
+	uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+	}
+
+	Float3 ReadPosition(const MeshView& mesh, uint32_t vertex)
+	{
+		Float3 position;
+		std::memcpy(&position, static_cast<const uint8_t*>(mesh.pVertices) + static_cast<size_t>(vertex) * mesh.vertexStride, sizeof(position));
+		return position;
+	}
+
+	// Everything the collapse loop works on, in welded vertex space.
+	class Simplifier
+	{
+	public:
+
+		Simplifier(const MeshView& mesh, const std::vector<uint32_t>& indices);
+
+		void Run(uint32_t targetIndexCount, double maxCost);
+
+		std::vector<uint32_t> Result() const;
+		double WorstCost() const { return m_worstCost; }
+
+	private:
+
+		void PushCollapses(uint32_t vertex);
+		void PushCollapse(uint32_t from, uint32_t to);
+		bool CanCollapse(uint32_t from, uint32_t to);
+		void DoCollapse(uint32_t from, uint32_t to);
+		void Neighbours(uint32_t vertex, std::vector<uint32_t>& vResult);
+
+		std::vector<Float3> m_vPositions;				// By welded vertex.
+		std::vector<Quadric> m_vQuadrics;
+		std::vector<VertexKind> m_vKinds;
+		std::vector<uint32_t> m_vStamps;				// Bumped whenever a vertex changes, queued collapses carry the stamp they saw.
+		std::vector<uint8_t> m_vRemoved;
+		std::vector<std::vector<uint32_t>> m_vTriangles;	// Triangles around each welded vertex, dead ones dropped lazily.
+
+		std::vector<uint32_t> m_vCorners;				// Welded vertex of each corner.
+		std::vector<uint32_t> m_vOriginals;				// Original vertex of each corner, what's written out.
+		std::vector<uint8_t> m_vAlive;					// By triangle.
+		uint32_t m_aliveTriangles;
+
+		std::unordered_set<uint64_t> m_borderEdges;
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+		double m_worstCost;
+
+		std::vector<uint32_t> m_vScratchA;
+		std::vector<uint32_t> m_vScratchB;
+	};
+
+	Simplifier::Simplifier(const MeshView& mesh, const std::vector<uint32_t>& indices) :
+		m_vCorners(indices.size()),
+		m_vOriginals(indices),
+		m_vAlive(indices.size() / 3, 1),
+		m_aliveTriangles(0),
+		m_worstCost(0.0)
+	{
+		// Weld by exact position. Seams duplicate vertices but keep them in the same place.
+		std::unordered_map<PositionKey, uint32_t, PositionKeyHash> weldLookup;
+		std::vector<uint32_t> vWeldOf(mesh.vertexCount, UINT32_MAX);
+		std::vector<uint32_t> vFirstOriginal;
+		std::vector<uint8_t> vSeam;
+
+		for (size_t c = 0; c < indices.size(); c++)
+		{
+			const uint32_t ORIGINAL = indices[c];
+			if (vWeldOf[ORIGINAL] == UINT32_MAX)
+			{
+				const Float3 POSITION = ReadPosition(mesh, ORIGINAL);
+				PositionKey key;
+				std::memcpy(key.bits, &POSITION, sizeof(key.bits));
+
+				const auto RESULT = weldLookup.emplace(key, static_cast<uint32_t>(m_vPositions.size()));
+				const uint32_t WELD = RESULT.first->second;
+				if (RESULT.second)
+				{
+					m_vPositions.push_back(POSITION);
+					vFirstOriginal.push_back(ORIGINAL);
+					vSeam.push_back(0);
+				}
+				else if (vFirstOriginal[WELD] != ORIGINAL)
+				{
+					vSeam[WELD] = 1;
+				}
+
+				vWeldOf[ORIGINAL] = WELD;
+			}
+
+			m_vCorners[c] = vWeldOf[ORIGINAL];
+		}
+
+		const uint32_t VERTICES = static_cast<uint32_t>(m_vPositions.size());
+		m_vQuadrics.assign(VERTICES, Quadric{});
+		m_vKinds.assign(VERTICES, VertexKind::Interior);
+		m_vStamps.assign(VERTICES, 0);
+		m_vRemoved.assign(VERTICES, 0);
+		m_vTriangles.resize(VERTICES);
+
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		for (uint32_t t = 0; t < m_vAlive.size(); t++)
+		{
+			const uint32_t* pCorner = &m_vCorners[t * 3];
+			if (pCorner[0] == pCorner[1] || pCorner[1] == pCorner[2] || pCorner[2] == pCorner[0])
+			{
+				m_vAlive[t] = 0;
+				continue;
+			}
+
+			m_aliveTriangles++;
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				m_vTriangles[pCorner[k]].push_back(t);
+				edgeUses[EdgeKey(pCorner[k], pCorner[(k + 1) % 3])]++;
+			}
+
+			const Float3 NORMAL = Cross(m_vPositions[pCorner[1]] - m_vPositions[pCorner[0]], m_vPositions[pCorner[2]] - m_vPositions[pCorner[0]]);
+			const double LENGTH = std::sqrt(static_cast<double>(Dot(NORMAL, NORMAL)));
+			if (LENGTH > 0.0)
+			{
+				const double X = NORMAL.x / LENGTH, Y = NORMAL.y / LENGTH, Z = NORMAL.z / LENGTH;
+				const Float3& P = m_vPositions[pCorner[0]];
+				const Quadric PLANE = Quadric::FromPlane(X, Y, Z, -(X * P.x + Y * P.y + Z * P.z), 1.0);
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					m_vQuadrics[pCorner[k]] += PLANE;
+				}
+			}
+		}
+
+		// Open edges get a plane through them at right angles to their triangle, which holds the border in place.
+		for (uint32_t t = 0; t < m_vAlive.size(); t++)
+		{
+			if (!m_vAlive[t])
+			{
+				continue;
+			}
+
+			const uint32_t* pCorner = &m_vCorners[t * 3];
+			const Float3 NORMAL = Cross(m_vPositions[pCorner[1]] - m_vPositions[pCorner[0]], m_vPositions[pCorner[2]] - m_vPositions[pCorner[0]]);
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				const uint32_t A = pCorner[k];
+				const uint32_t B = pCorner[(k + 1) % 3];
+				const uint32_t USES = edgeUses[EdgeKey(A, B)];
+
+				if (USES > 2)
+				{
+					m_vKinds[A] = VertexKind::Locked;
+					m_vKinds[B] = VertexKind::Locked;
+					continue;
+				}
+
+				if (USES != 1)
+				{
+					continue;
+				}
+
+				m_borderEdges.insert(EdgeKey(A, B));
+				for (uint32_t end : { A, B })
+				{
+					if (m_vKinds[end] == VertexKind::Interior)
+					{
+						m_vKinds[end] = VertexKind::Border;
+					}
+				}
+
+				const Float3 PERPENDICULAR = Cross(m_vPositions[B] - m_vPositions[A], NORMAL);
+				const double LENGTH = std::sqrt(static_cast<double>(Dot(PERPENDICULAR, PERPENDICULAR)));
+				if (LENGTH > 0.0)
+				{
+					const double X = PERPENDICULAR.x / LENGTH, Y = PERPENDICULAR.y / LENGTH, Z = PERPENDICULAR.z / LENGTH;
+					const Float3& P = m_vPositions[A];
+					const Quadric PLANE = Quadric::FromPlane(X, Y, Z, -(X * P.x + Y * P.y + Z * P.z), BORDER_WEIGHT);
+					m_vQuadrics[A] += PLANE;
+					m_vQuadrics[B] += PLANE;
+				}
+			}
+		}
+
+		for (uint32_t v = 0; v < VERTICES; v++)
+		{
+			if (vSeam[v])
+			{
+				m_vKinds[v] = VertexKind::Locked;
+			}
+		}
+
+		for (uint32_t v = 0; v < VERTICES; v++)
+		{
+			PushCollapses(v);
+		}
+	}
+
+	void Simplifier::Neighbours(uint32_t vertex, std::vector<uint32_t>& vResult)
+	{
+		vResult.clear();
+
+		std::vector<uint32_t>& vTriangles = m_vTriangles[vertex];
+		vTriangles.erase(std::remove_if(vTriangles.begin(), vTriangles.end(), [this](uint32_t t) { return !m_vAlive[t]; }), vTriangles.end());
+
+		for (uint32_t t : vTriangles)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				if (m_vCorners[t * 3 + k] != vertex)
+				{
+					vResult.push_back(m_vCorners[t * 3 + k]);
+				}
+			}
+		}
+
+		std::sort(vResult.begin(), vResult.end());
+		vResult.erase(std::unique(vResult.begin(), vResult.end()), vResult.end());
+	}
+
+	void Simplifier::PushCollapse(uint32_t from, uint32_t to)
+	{
+		if (m_vKinds[from] == VertexKind::Locked)
+		{
+			return;
+		}
+
+		// A border vertex sliding off its border would pull the outline inwards.
+		if (m_vKinds[from] == VertexKind::Border && m_borderEdges.count(EdgeKey(from, to)) == 0)
+		{
+			return;
+		}
+
+		Quadric combined = m_vQuadrics[from];
+		combined += m_vQuadrics[to];
+		m_queue.push({ std::max(0.0, combined.Evaluate(m_vPositions[to])), from, to, m_vStamps[from], m_vStamps[to] });
+	}
+
+	void Simplifier::PushCollapses(uint32_t vertex)
+	{
+		std::vector<uint32_t> vNeighbours;
+		Neighbours(vertex, vNeighbours);
+
+		for (uint32_t neighbour : vNeighbours)
+		{
+			PushCollapse(vertex, neighbour);
+			PushCollapse(neighbour, vertex);
+		}
+	}
+
+	bool Simplifier::CanCollapse(uint32_t from, uint32_t to)
+	{
+		// The link condition: the ends may only share the neighbours across the triangles on the edge, or the surface pinches.
+		Neighbours(from, m_vScratchA);
+		Neighbours(to, m_vScratchB);
+
+		uint32_t shared = 0;
+		for (uint32_t a = 0, b = 0; a < m_vScratchA.size() && b < m_vScratchB.size();)
+		{
+			if (m_vScratchA[a] == m_vScratchB[b])
+			{
+				shared++;
+				a++;
+				b++;
+			}
+			else if (m_vScratchA[a] < m_vScratchB[b])
+			{
+				a++;
+			}
+			else
+			{
+				b++;
+			}
+		}
+
+		uint32_t onEdge = 0;
+		for (uint32_t t : m_vTriangles[from])
+		{
+			const uint32_t* pCorner = &m_vCorners[t * 3];
+			if (pCorner[0] == to || pCorner[1] == to || pCorner[2] == to)
+			{
+				onEdge++;
+			}
+		}
+
+		if (onEdge == 0 || shared != onEdge)
+		{
+			return false;
+		}
+
+		// The triangles that survive must not fold over.
+		for (uint32_t t : m_vTriangles[from])
+		{
+			const uint32_t* pCorner = &m_vCorners[t * 3];
+			if (pCorner[0] == to || pCorner[1] == to || pCorner[2] == to)
+			{
+				continue;
+			}
+
+			Float3 before[3];
+			Float3 after[3];
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				before[k] = m_vPositions[pCorner[k]];
+				after[k] = pCorner[k] == from ? m_vPositions[to] : before[k];
+			}
+
+			const Float3 OLD_NORMAL = Cross(before[1] - before[0], before[2] - before[0]);
+			const Float3 NEW_NORMAL = Cross(after[1] - after[0], after[2] - after[0]);
+			const float OLD_LENGTH = std::sqrt(Dot(OLD_NORMAL, OLD_NORMAL));
+			const float NEW_LENGTH = std::sqrt(Dot(NEW_NORMAL, NEW_NORMAL));
+			if (NEW_LENGTH <= 0.0f || Dot(OLD_NORMAL, NEW_NORMAL) < MIN_NORMAL_COSINE * OLD_LENGTH * NEW_LENGTH)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Simplifier::DoCollapse(uint32_t from, uint32_t to)
+	{
+		// A triangle on the edge knows which copy of a seamed 'to' this side of the mesh uses.
+		uint32_t toOriginal = UINT32_MAX;
+		std::vector<uint32_t> vBorderNeighbours;
+		for (uint32_t t : m_vTriangles[from])
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				const uint32_t CORNER = m_vCorners[t * 3 + k];
+				if (CORNER == to && toOriginal == UINT32_MAX)
+				{
+					toOriginal = m_vOriginals[t * 3 + k];
+				}
+				if (CORNER != from && CORNER != to && m_borderEdges.count(EdgeKey(from, CORNER)) != 0)
+				{
+					vBorderNeighbours.push_back(CORNER);
+				}
+			}
+		}
+
+		// Border edges out of 'from' now start at 'to'.
+		m_borderEdges.erase(EdgeKey(from, to));
+		for (uint32_t neighbour : vBorderNeighbours)
+		{
+			m_borderEdges.erase(EdgeKey(from, neighbour));
+			m_borderEdges.insert(EdgeKey(to, neighbour));
+		}
+
+		for (uint32_t t : m_vTriangles[from])
+		{
+			uint32_t* pCorner = &m_vCorners[t * 3];
+			if (pCorner[0] == to || pCorner[1] == to || pCorner[2] == to)
+			{
+				m_vAlive[t] = 0;
+				m_aliveTriangles--;
+				continue;
+			}
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				if (pCorner[k] == from)
+				{
+					pCorner[k] = to;
+					m_vOriginals[t * 3 + k] = toOriginal;
+				}
+			}
+			m_vTriangles[to].push_back(t);
+		}
+
+		m_vTriangles[from].clear();
+		m_vQuadrics[to] += m_vQuadrics[from];
+		m_vRemoved[from] = 1;
+		m_vStamps[from]++;
+		m_vStamps[to]++;
+
+		PushCollapses(to);
+	}
+
+	void Simplifier::Run(uint32_t targetIndexCount, double maxCost)
+	{
+		while (m_aliveTriangles * 3 > targetIndexCount && !m_queue.empty())
+		{
+			const Collapse COLLAPSE = m_queue.top();
+			m_queue.pop();
+
+			if (COLLAPSE.cost > maxCost)
+			{
+				break;
+			}
+
+			if (m_vRemoved[COLLAPSE.from] || m_vRemoved[COLLAPSE.to] || COLLAPSE.fromStamp != m_vStamps[COLLAPSE.from] || COLLAPSE.toStamp != m_vStamps[COLLAPSE.to])
+			{
+				continue;
+			}
+
+			if (!CanCollapse(COLLAPSE.from, COLLAPSE.to))
+			{
+				continue;
+			}
+
+			DoCollapse(COLLAPSE.from, COLLAPSE.to);
+			m_worstCost = std::max(m_worstCost, COLLAPSE.cost);
+		}
+	}
+
+	std::vector<uint32_t> Simplifier::Result() const
+	{
+		std::vector<uint32_t> vIndices;
+		vIndices.reserve(static_cast<size_t>(m_aliveTriangles) * 3);
+
+		for (uint32_t t = 0; t < m_vAlive.size(); t++)
+		{
+			if (m_vAlive[t])
+			{
+				vIndices.insert(vIndices.end(), m_vOriginals.begin() + t * 3, m_vOriginals.begin() + t * 3 + 3);
+			}
+		}
+
+		return vIndices;
+	}
+}
+
+std::vector<uint32_t> SimplifyMesh(const MeshView& mesh, const std::vector<uint32_t>& indices, uint32_t targetIndexCount, float maxError, float& error)
+{
+	error = 0.0f;
+	if (indices.size() <= targetIndexCount)
+	{
+		return indices;
+	}
+
+	Simplifier simplifier(mesh, indices);
+	simplifier.Run(targetIndexCount, static_cast<double>(maxError) * maxError);
+
+	// Costs are squared distances.
+	error = static_cast<float>(std::sqrt(simplifier.WorstCost()));
+	return simplifier.Result();
+}
+
+std::vector<MeshLodLevel> GenerateLodChain(const MeshView& mesh, const std::vector<uint32_t>& indices, uint32_t maxLevels, uint32_t minTriangles)
+{
+	std::vector<MeshLodLevel> vLevels;
+	vLevels.push_back({ indices, 0.0f });
+
+	// Each level starts from the one before, the errors add up so they stay an upper bound against the original.
+	while (vLevels.size() < maxLevels)
+	{
+		const MeshLodLevel& PREVIOUS = vLevels.back();
+		const uint32_t TRIANGLES = static_cast<uint32_t>(PREVIOUS.indices.size() / 3);
+		if (TRIANGLES <= minTriangles)
+		{
+			break;
+		}
+
+		const uint32_t TARGET = std::max(minTriangles, static_cast<uint32_t>(TRIANGLES * LOD_REDUCTION));
+
+		float error = 0.0f;
+		std::vector<uint32_t> vSimplified = SimplifyMesh(mesh, PREVIOUS.indices, TARGET * 3, FLT_MAX, error);
+		if (vSimplified.size() > PREVIOUS.indices.size() * LOD_MIN_SHRINK)
+		{
+			break;
+		}
+
+		const float TOTAL_ERROR = PREVIOUS.error + error;
+		vLevels.push_back({ std::move(vSimplified), TOTAL_ERROR });
+	}
+
+	return vLevels;
+}
@@ -0,0 +1,41 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Asset time mesh simplification by quadric error edge collapse, and LOD chains built from it.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Positions are the first three floats of each vertex, the rest of the vertex is carried along untouched.
+struct MeshView
+{
+	const void* pVertices;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+};
+
+struct MeshLodLevel
+{
+	std::vector<uint32_t> indices;		// Into the original vertices, every level shares them.
+	float error;						// Furthest the surface has moved from the original, in model units.
+};
+
+/*
+	Garland and Heckbert's quadric error metric. Each vertex accumulates the planes of the triangles around it,
+	and the cheapest edge is collapsed, one end onto the other, until the index count is down to the target.
+	Vertices only ever move onto other vertices, so every level indexes the same vertex buffer.
+
+	Vertices sharing a position are welded for the topology. A vertex split by a UV or normal seam is never moved,
+	and open borders only collapse along themselves, so neither opens cracks. Collapses that would flip a triangle
+	are skipped. Returns the new indices, and the error of the worst collapse made in error.
+*/
+std::vector<uint32_t> SimplifyMesh(const MeshView& mesh, const std::vector<uint32_t>& indices, uint32_t targetIndexCount, float maxError, float& error);
+
+/*
+	Level 0 is the mesh as given. Each level after aims for half the triangles of the one before and stops once
+	a level can't get below minTriangles or stops shrinking. Errors only ever increase down the chain.
+*/
+std::vector<MeshLodLevel> GenerateLodChain(const MeshView& mesh, const std::vector<uint32_t>& indices, uint32_t maxLevels, uint32_t minTriangles);
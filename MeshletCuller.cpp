@@ -0,0 +1,650 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Culls meshlets on the GPU and draws the survivors, indirectly or with mesh shaders.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "MeshletCuller.h"
+#include "VulkanUtils.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Must match meshlet_cull.comp.
+	constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+	// Three words of task count ahead of the visible slots, see meshlet_cull.comp.
+	constexpr VkDeviceSize VISIBLE_HEADER_BYTES = 3 * sizeof(uint32_t);
+
+	enum Binding : uint32_t
+	{
+		BINDING_INSTANCES = 0,
+		BINDING_MESHLETS,
+		BINDING_DRAWS,
+		BINDING_MESHES,
+		BINDING_COMMANDS,
+		BINDING_VISIBLE,
+		BINDING_VISIBILITY,
+		BINDING_PREVIOUS_VISIBILITY,
+		BINDING_DEPTH_PYRAMID,		// The only image, culling only.
+		BINDING_MESHLET_VERTICES,	// The rest only for mesh shaders.
+		BINDING_MESHLET_TRIANGLES,
+		BINDING_VERTICES,
+		BINDING_COUNT
+	};
+
+	constexpr uint32_t VERTEX_PATH_BINDINGS = BINDING_MESHLET_VERTICES;
+
+	// Matches MeshInfo in meshlet.glsl.
+	struct MeshInfo
+	{
+		float positionOffset[3];
+		int32_t vertexOffset;		// In vertices.
+		float positionScale[3];
+		uint32_t pad;
+	};
+
+	// The frustum planes come from the view projection in the shader, there isn't room for both.
+	struct CullPushConstants
+	{
+		Float4x4 viewProjection;
+		float viewer[4];
+		uint32_t drawCount;
+		uint32_t phase;
+		float depthRegion[2];
+	};
+
+	static_assert(sizeof(MeshInfo) == 32 && sizeof(MeshletDraw) == 16, "Meshlet buffer layouts changed, update meshlet.glsl!");
+	static_assert(sizeof(CullPushConstants) <= 128 && sizeof(Float4x4) <= 128, "Push constants past the guaranteed minimum!");
+
+	VkShaderStageFlags DrawStages(bool meshShaders)
+	{
+#ifdef VK_EXT_mesh_shader
+		return meshShaders ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_VERTEX_BIT;
+#else
+		(void)meshShaders;
+		return VK_SHADER_STAGE_VERTEX_BIT;
+#endif
+	}
+}
+
+void MeshletCuller::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool multiDrawIndirect, bool meshShaders, VkDescriptorSetLayout fragmentSetLayout)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_multiDrawIndirect = multiDrawIndirect;
+	m_vFrames.resize(framesInFlight);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+	m_maxDrawIndirectCount = multiDrawIndirect ? std::max(properties.limits.maxDrawIndirectCount, 1u) : 1;
+
+#ifdef VK_EXT_mesh_shader
+	if (meshShaders)
+	{
+		VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+		meshShaderProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &meshShaderProperties;
+		vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties2);
+
+		m_maxMeshWorkGroups = meshShaderProperties.maxMeshWorkGroupCount[0];
+		m_pfnCmdDrawMeshTasksIndirect = vkGetDeviceProcAddr(m_device, "vkCmdDrawMeshTasksIndirectEXT");
+		m_meshShaders = m_pfnCmdDrawMeshTasksIndirect != nullptr;
+	}
+#else
+	(void)meshShaders;
+#endif
+
+	// Everything else is a storage buffer, visible to every stage that might read it.
+	const uint32_t BINDING_TOTAL = m_meshShaders ? BINDING_COUNT : VERTEX_PATH_BINDINGS;
+	VkDescriptorSetLayoutBinding bindings[BINDING_COUNT]{};
+	for (uint32_t i = 0; i < BINDING_TOTAL; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | DrawStages(m_meshShaders);
+	}
+	bindings[BINDING_DEPTH_PYRAMID].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[BINDING_DEPTH_PYRAMID].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = BINDING_TOTAL;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_cullPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet cull pipeline layout!");
+	}
+
+	// Drawing shares the set, and only needs the view projection pushed. Whatever the fragment shader reads comes after.
+	const VkDescriptorSetLayout DRAW_SET_LAYOUTS[] = { m_descriptorSetLayout, fragmentSetLayout };
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = DRAW_SET_LAYOUTS;
+	pushConstantRange.stageFlags = DrawStages(m_meshShaders);
+	pushConstantRange.size = sizeof(Float4x4);
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_drawPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet draw pipeline layout!");
+	}
+
+	VkShaderModule shaderModule = LoadShaderModule(m_device, "shaders/meshlet_cull.spv");
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_cullPipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_cullPipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet cull pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, shaderModule, GetAllocationCallbacks());
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = framesInFlight * (BINDING_TOTAL - 1);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = framesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = framesInFlight;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet descriptor pool!");
+	}
+
+	const std::vector<VkDescriptorSetLayout> LAYOUTS(framesInFlight, m_descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = framesInFlight;
+	allocInfo.pSetLayouts = LAYOUTS.data();
+
+	m_vDescriptorSets.resize(framesInFlight);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_vDescriptorSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate meshlet descriptor sets!");
+	}
+}
+
+void MeshletCuller::Destroy()
+{
+	// Never initialised, the device can't draw meshlets.
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (FrameBuffers& frame : m_vFrames)
+	{
+		DestroyBuffer(frame.draws);
+		DestroyBuffer(frame.commands);
+		DestroyBuffer(frame.visible);
+	}
+	m_vFrames.clear();
+
+	DestroyBuffer(m_meshlets);
+	DestroyBuffer(m_meshes);
+	DestroyBuffer(m_meshletVertices);
+	DestroyBuffer(m_meshletTriangles);
+	DestroyBuffer(m_visibility[0]);
+	DestroyBuffer(m_visibility[1]);
+	DestroyRetiredBuffers(true);
+
+	vkDestroyPipeline(m_device, m_cullPipeline, GetAllocationCallbacks());
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the sets.
+	vkDestroyPipelineLayout(m_device, m_drawPipelineLayout, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+
+	m_vDescriptorSets.clear();
+	m_ready = false;
+}
+
+void MeshletCuller::Upload(const SceneFile& file, VkCommandPool commandPool, VkQueue queue)
+{
+	std::vector<MeshInfo> vMeshes(file.MeshCount());
+	for (uint32_t i = 0; i < file.MeshCount(); i++)
+	{
+		const SceneMesh& MESH = file.Meshes()[i];
+		std::copy(std::begin(MESH.positionOffset), std::end(MESH.positionOffset), vMeshes[i].positionOffset);
+		std::copy(std::begin(MESH.positionScale), std::end(MESH.positionScale), vMeshes[i].positionScale);
+		vMeshes[i].vertexOffset = static_cast<int32_t>(MESH.vertexOffset / MESH.vertexStride);
+		vMeshes[i].pad = 0;
+	}
+
+	struct Source
+	{
+		const void* pData;
+		VkDeviceSize size;
+		Buffer* pBuffer;
+	};
+
+	// Meshlet records are already laid out for the shaders, they go from the mapping as they are.
+	const Source SOURCES[] =
+	{
+		{ file.Meshlets(), static_cast<VkDeviceSize>(file.MeshletCount()) * sizeof(SceneMeshlet), &m_meshlets },
+		{ vMeshes.data(), vMeshes.size() * sizeof(MeshInfo), &m_meshes },
+		{ file.MeshletVertices(), m_meshShaders ? static_cast<VkDeviceSize>(file.MeshletVertexCount()) * sizeof(uint32_t) : 0, &m_meshletVertices },
+		{ file.MeshletTriangles(), m_meshShaders ? static_cast<VkDeviceSize>(file.MeshletTriangleCount()) * sizeof(uint32_t) : 0, &m_meshletTriangles }
+	};
+
+	VkDeviceSize stagingSize = 0;
+	for (const Source& SOURCE : SOURCES)
+	{
+		stagingSize += SOURCE.size;
+	}
+
+	if (file.MeshletCount() == 0 || stagingSize == 0)
+	{
+		return;
+	}
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	CreateBuffer(m_physicalDevice, m_device, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+	void* pData = nullptr;
+	vkMapMemory(m_device, stagingMemory, 0, stagingSize, 0, &pData);
+
+	VkDeviceSize offset = 0;
+	std::vector<VkBufferCopy> vCopies;
+	for (const Source& SOURCE : SOURCES)
+	{
+		if (SOURCE.size == 0)
+		{
+			vCopies.push_back({});
+			continue;
+		}
+
+		DestroyBuffer(*SOURCE.pBuffer);
+		CreateBuffer(m_physicalDevice, m_device, SOURCE.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, SOURCE.pBuffer->buffer, SOURCE.pBuffer->memory);
+
+		std::memcpy(static_cast<uint8_t*>(pData) + offset, SOURCE.pData, static_cast<size_t>(SOURCE.size));
+		vCopies.push_back({ offset, 0, SOURCE.size });
+		offset += SOURCE.size;
+	}
+
+	vkUnmapMemory(m_device, stagingMemory);
+
+	SubmitImmediate(m_device, commandPool, queue, [&](VkCommandBuffer commandBuffer)
+	{
+		for (size_t i = 0; i < vCopies.size(); i++)
+		{
+			if (vCopies[i].size > 0)
+			{
+				vkCmdCopyBuffer(commandBuffer, stagingBuffer, SOURCES[i].pBuffer->buffer, 1, &vCopies[i]);
+			}
+		}
+	});
+
+	vkDestroyBuffer(m_device, stagingBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, stagingMemory, GetAllocationCallbacks());
+
+	WriteDescriptorSets();
+}
+
+void MeshletCuller::SetDraws(uint32_t frame, const std::vector<MeshletDraw>& draws)
+{
+	m_frameIndex++;
+	DestroyRetiredBuffers(false);
+
+	FrameBuffers& slot = m_vFrames[frame];
+	slot.vDraws.assign(draws.begin(), draws.end());
+	m_drawCount = static_cast<uint32_t>(draws.size());
+	if (m_drawCount == 0)
+	{
+		return;
+	}
+
+	// This frame's late pass writes the buffer the last frame read from, and reads the one it wrote.
+	ReserveFrame(slot, m_drawCount);
+	ReserveVisibility(m_latestVisibility ^ 1, m_drawCount);
+	if (m_visibility[m_latestVisibility].buffer == VK_NULL_HANDLE)
+	{
+		ReserveVisibility(m_latestVisibility, m_drawCount);
+	}
+
+	for (uint32_t i = 0; i < m_drawCount; i++)
+	{
+		MeshletDraw draw = draws[i];
+		draw.previous = PreviousSlot(draw);
+		slot.pDraws[i] = draw;
+	}
+
+	WriteDescriptorSet(frame);
+}
+
+void MeshletCuller::ReserveFrame(FrameBuffers& frame, uint32_t drawCount)
+{
+	if (drawCount <= frame.capacity)
+	{
+		return;
+	}
+
+	// Only this slot's frames use these, and its last one has finished. Doubling keeps growth to a handful of times.
+	DestroyBuffer(frame.draws);
+	DestroyBuffer(frame.commands);
+	DestroyBuffer(frame.visible);
+	frame.capacity = std::max(drawCount, frame.capacity * 2);
+
+	// Read once per draw per frame and written only by the host, so host visible memory saves a staging copy for little cost.
+	const VkDeviceSize DRAW_BYTES = static_cast<VkDeviceSize>(frame.capacity) * sizeof(MeshletDraw);
+	CreateBuffer(m_physicalDevice, m_device, DRAW_BYTES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.draws.buffer, frame.draws.memory);
+
+	void* pData = nullptr;
+	vkMapMemory(m_device, frame.draws.memory, 0, DRAW_BYTES, 0, &pData);
+	frame.pDraws = static_cast<MeshletDraw*>(pData);
+
+	CreateBuffer(m_physicalDevice, m_device, frame.capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands.buffer, frame.commands.memory);
+	CreateBuffer(m_physicalDevice, m_device, VISIBLE_HEADER_BYTES + frame.capacity * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.visible.buffer, frame.visible.memory);
+}
+
+void MeshletCuller::ReserveVisibility(uint32_t index, uint32_t drawCount)
+{
+	if (drawCount <= m_visibilityCapacity[index])
+	{
+		return;
+	}
+
+	// Frames still in flight can be reading it, whichever slot they're in. Nothing needs copying, every slot is written before it's read.
+	if (m_visibility[index].buffer != VK_NULL_HANDLE)
+	{
+		m_vRetiredBuffers.push_back({ m_visibility[index], m_frameIndex });
+		m_visibility[index] = {};
+	}
+
+	// Written and read by the GPU only.
+	m_visibilityCapacity[index] = std::max(drawCount, m_visibilityCapacity[index] * 2);
+	CreateBuffer(m_physicalDevice, m_device, m_visibilityCapacity[index] * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_visibility[index].buffer, m_visibility[index].memory);
+}
+
+void MeshletCuller::RememberCulledDraws(const FrameBuffers& frame)
+{
+	for (const MeshletDraw& DRAW : m_vCulledDraws)
+	{
+		m_vFirstCulledSlot[DRAW.instance] = NO_PREVIOUS_SLOT;
+	}
+
+	m_vCulledDraws = frame.vDraws;
+
+	// An instance's meshlets are set together and in order, so its first slot and meshlet find the rest.
+	for (uint32_t slot = 0; slot < m_vCulledDraws.size(); slot++)
+	{
+		const uint32_t INSTANCE = m_vCulledDraws[slot].instance;
+		if (INSTANCE >= m_vFirstCulledSlot.size())
+		{
+			m_vFirstCulledSlot.resize(INSTANCE + 1, NO_PREVIOUS_SLOT);
+		}
+
+		if (m_vFirstCulledSlot[INSTANCE] == NO_PREVIOUS_SLOT)
+		{
+			m_vFirstCulledSlot[INSTANCE] = slot;
+		}
+	}
+}
+
+uint32_t MeshletCuller::PreviousSlot(const MeshletDraw& draw) const
+{
+	if (draw.instance >= m_vFirstCulledSlot.size() || m_vFirstCulledSlot[draw.instance] == NO_PREVIOUS_SLOT)
+	{
+		return NO_PREVIOUS_SLOT;
+	}
+
+	// Checked, rather than assumed, in case the instance was drawn with different meshlets last time.
+	const uint32_t FIRST = m_vFirstCulledSlot[draw.instance];
+	const uint32_t SLOT = FIRST + (draw.meshlet - m_vCulledDraws[FIRST].meshlet);
+	if (SLOT >= m_vCulledDraws.size() || m_vCulledDraws[SLOT].meshlet != draw.meshlet || m_vCulledDraws[SLOT].instance != draw.instance)
+	{
+		return NO_PREVIOUS_SLOT;
+	}
+
+	return SLOT;
+}
+
+void MeshletCuller::DestroyRetiredBuffers(bool all)
+{
+	// Once every frame in flight has cycled, nothing can still reference the old buffer.
+	const uint64_t FRAMES_IN_FLIGHT = m_vFrames.size();
+	auto it = std::remove_if(m_vRetiredBuffers.begin(), m_vRetiredBuffers.end(), [&](const RetiredBuffer& retired)
+	{
+		if (all || m_frameIndex > retired.retireFrame + FRAMES_IN_FLIGHT)
+		{
+			Buffer buffer = retired.buffer;
+			DestroyBuffer(buffer);
+			return true;
+		}
+		return false;
+	});
+	m_vRetiredBuffers.erase(it, m_vRetiredBuffers.end());
+}
+
+void MeshletCuller::BindFrames(const std::vector<VkBuffer>& instanceBuffers, VkBuffer vertexBuffer)
+{
+	m_vInstanceBuffers = instanceBuffers;
+	m_vertexBuffer = vertexBuffer;
+	WriteDescriptorSets();
+}
+
+void MeshletCuller::BindDepthPyramid(VkImageView view, VkSampler sampler)
+{
+	m_depthPyramidView = view;
+	m_depthPyramidSampler = sampler;
+	WriteDescriptorSets();
+}
+
+void MeshletCuller::SetDepthRegion(float width, float height)
+{
+	m_depthRegion[0] = width;
+	m_depthRegion[1] = height;
+}
+
+void MeshletCuller::WriteDescriptorSets()
+{
+	// Sets are only written once everything they point at exists, which can come in any order.
+	const bool MESH_DATA = !m_meshShaders || (m_meshletVertices.buffer != VK_NULL_HANDLE && m_meshletTriangles.buffer != VK_NULL_HANDLE && m_vertexBuffer != VK_NULL_HANDLE);
+	m_ready = m_meshlets.buffer != VK_NULL_HANDLE && m_vInstanceBuffers.size() >= m_vDescriptorSets.size() && MESH_DATA
+		&& m_depthPyramidView != VK_NULL_HANDLE;
+
+	for (uint32_t frame = 0; frame < m_vDescriptorSets.size(); frame++)
+	{
+		WriteDescriptorSet(frame);
+	}
+}
+
+void MeshletCuller::WriteDescriptorSet(uint32_t frame)
+{
+	// Slots that haven't had draws yet are written by their first SetDraws.
+	if (!m_ready || m_vFrames[frame].capacity == 0 || m_visibility[0].buffer == VK_NULL_HANDLE || m_visibility[1].buffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	const VkBuffer BUFFERS[BINDING_COUNT] =
+	{
+		m_vInstanceBuffers[frame],
+		m_meshlets.buffer,
+		m_vFrames[frame].draws.buffer,
+		m_meshes.buffer,
+		m_vFrames[frame].commands.buffer,
+		m_vFrames[frame].visible.buffer,
+		m_visibility[m_latestVisibility ^ 1].buffer,
+		m_visibility[m_latestVisibility].buffer,
+		VK_NULL_HANDLE,
+		m_meshletVertices.buffer,
+		m_meshletTriangles.buffer,
+		m_vertexBuffer
+	};
+
+	const uint32_t BINDING_TOTAL = m_meshShaders ? BINDING_COUNT : VERTEX_PATH_BINDINGS;
+	VkDescriptorBufferInfo bufferInfos[BINDING_COUNT]{};
+	VkWriteDescriptorSet writes[BINDING_COUNT]{};
+	for (uint32_t i = 0; i < BINDING_TOTAL; i++)
+	{
+		bufferInfos[i] = { BUFFERS[i], 0, VK_WHOLE_SIZE };
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = m_vDescriptorSets[frame];
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	// Built into GENERAL and left there, see DepthPyramid.
+	const VkDescriptorImageInfo PYRAMID_INFO{ m_depthPyramidSampler, m_depthPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+	writes[BINDING_DEPTH_PYRAMID].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[BINDING_DEPTH_PYRAMID].pBufferInfo = nullptr;
+	writes[BINDING_DEPTH_PYRAMID].pImageInfo = &PYRAMID_INFO;
+
+	vkUpdateDescriptorSets(m_device, BINDING_TOTAL, writes, 0, nullptr);
+}
+
+void MeshletCuller::RecordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Float4x4& viewProjection, const Float3& viewer, bool viewerIsPosition, CullPhase phase)
+{
+	const FrameBuffers& FRAME = m_vFrames[frame];
+
+	/*
+		The buffers written here were last read by the previous pass's draws, and the visibility read here was last
+		written by the previous frame's late pass. Both were submitted earlier on this queue, so a barrier here covers them.
+	*/
+	VkMemoryBarrier reuseBarrier{};
+	reuseBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	reuseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	reuseBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+#ifdef VK_EXT_mesh_shader
+	srcStages |= m_meshShaders ? VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : 0;
+#endif
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &reuseBarrier, 0, nullptr, 0, nullptr);
+
+	// The mesh shader list starts empty, as zero groups wide by one by one. Nothing else needs clearing, every command is rewritten.
+	if (m_meshShaders)
+	{
+		vkCmdFillBuffer(commandBuffer, FRAME.visible.buffer, 0, sizeof(uint32_t), 0);
+		vkCmdFillBuffer(commandBuffer, FRAME.visible.buffer, sizeof(uint32_t), 2 * sizeof(uint32_t), 1);
+	}
+
+	if (m_meshShaders)
+	{
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	CullPushConstants constants{};
+	constants.viewProjection = viewProjection;
+	constants.viewer[0] = viewer.x;
+	constants.viewer[1] = viewer.y;
+	constants.viewer[2] = viewer.z;
+	constants.viewer[3] = viewerIsPosition ? 1.0f : 0.0f;
+	constants.drawCount = m_drawCount;
+	constants.phase = static_cast<uint32_t>(phase);
+	constants.depthRegion[0] = m_depthRegion[0];
+	constants.depthRegion[1] = m_depthRegion[1];
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 1, &m_vDescriptorSets[frame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (m_drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// Commands and the visible list are read as indirect arguments, and the list again by the mesh shader.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+#ifdef VK_EXT_mesh_shader
+	dstStages |= m_meshShaders ? VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : 0;
+#endif
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// Next frame's draws are matched against this list, and read the visibility just written for it.
+	if (phase == CullPhase::Late)
+	{
+		RememberCulledDraws(FRAME);
+		m_latestVisibility ^= 1;
+	}
+}
+
+void MeshletCuller::RecordDraws(VkCommandBuffer commandBuffer, uint32_t frame, const Float4x4& viewProjection) const
+{
+	const FrameBuffers& FRAME = m_vFrames[frame];
+	const VkShaderStageFlags STAGES = DrawStages(m_meshShaders);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_drawPipelineLayout, 0, 1, &m_vDescriptorSets[frame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_drawPipelineLayout, STAGES, 0, sizeof(viewProjection), &viewProjection);
+
+#ifdef VK_EXT_mesh_shader
+	if (UsesMeshShaders())
+	{
+		const PFN_vkCmdDrawMeshTasksIndirectEXT DRAW_MESH_TASKS_INDIRECT = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectEXT>(m_pfnCmdDrawMeshTasksIndirect);
+		DRAW_MESH_TASKS_INDIRECT(commandBuffer, FRAME.visible.buffer, 0, 1, sizeof(VkDrawMeshTasksIndirectCommandEXT));
+		return;
+	}
+#endif
+
+	// Culled draws are still issued, with no instances. Without multi draw it's one call per meshlet.
+	constexpr uint32_t STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t first = 0; first < m_drawCount; first += m_maxDrawIndirectCount)
+	{
+		const uint32_t COUNT = std::min(m_drawCount - first, m_maxDrawIndirectCount);
+		vkCmdDrawIndexedIndirect(commandBuffer, FRAME.commands.buffer, static_cast<VkDeviceSize>(first) * STRIDE, COUNT, STRIDE);
+	}
+}
+
+void MeshletCuller::DestroyBuffer(Buffer& buffer)
+{
+	vkDestroyBuffer(m_device, buffer.buffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, buffer.memory, GetAllocationCallbacks());
+	buffer = {};
+}
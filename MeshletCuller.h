@@ -0,0 +1,195 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Culls meshlets on the GPU and draws the survivors, indirectly or with mesh shaders.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "SceneFile.h"
+#include "MathTypes.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+
+// One meshlet of one instance, the unit the culling pass works on. Matches MeshletDraw in meshlet.glsl.
+struct MeshletDraw
+{
+	uint32_t meshlet;		// Into the scene's meshlets.
+	uint32_t instance;		// Into the instance buffer.
+	uint32_t mesh;			// Into the scene's meshes.
+	uint32_t previous;		// Filled in by SetDraws, the slot it had in the list last culled.
+};
+
+/*
+	Occlusion culling takes two passes a frame. Early draws what was visible last frame, the depth pyramid is built
+	from that, then Late tests everything against it, draws what Early missed, and remembers what's visible for the
+	next frame. Nothing is visible before the first frame, so it starts out drawing everything in the late pass.
+	Draws are matched to last frame's by meshlet and instance, so the list can change without losing what was visible.
+*/
+enum class CullPhase
+{
+	Early,
+	Late
+};
+
+/*
+	Every cull pass tests each meshlet draw against the frustum and its normal cone, and the late pass against the
+	depth pyramid too. It writes one indexed indirect command per draw, with no instances when it was culled. Without
+	mesh shaders those commands are drawn straight from the buffer. With them, the visible draws are also appended to
+	a list whose header is the task count, and one indirect call draws them all. Per frame buffers keep frames in
+	flight from overwriting each other's results, the two passes of a frame reuse them. They only grow, and are
+	rewritten in place each frame, so a list that changes every frame costs a copy rather than a stall.
+*/
+class MeshletCuller
+{
+public:
+
+	MeshletCuller() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_multiDrawIndirect(false),
+		m_meshShaders(false),
+		m_maxDrawIndirectCount(1),
+		m_maxMeshWorkGroups(0),
+		m_pfnCmdDrawMeshTasksIndirect(nullptr),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_cullPipelineLayout(VK_NULL_HANDLE),
+		m_drawPipelineLayout(VK_NULL_HANDLE),
+		m_cullPipeline(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_vertexBuffer(VK_NULL_HANDLE),
+		m_depthPyramidView(VK_NULL_HANDLE),
+		m_depthPyramidSampler(VK_NULL_HANDLE),
+		m_depthRegion{ 1.0f, 1.0f },
+		m_visibilityCapacity{ 0, 0 },
+		m_latestVisibility(0),
+		m_frameIndex(0),
+		m_drawCount(0),
+		m_ready(false)
+	{}
+
+	// Both flags must only be set when the matching device features were enabled. The draw pipeline layout takes fragmentSetLayout as set 1.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool multiDrawIndirect, bool meshShaders, VkDescriptorSetLayout fragmentSetLayout);
+	void Destroy();
+
+	// The scene's meshlets and mesh table, copied to device local buffers through a one off submission.
+	void Upload(const SceneFile& file, VkCommandPool commandPool, VkQueue queue);
+
+	/*
+		What's culled and drawn in this frame slot, whose last frame must have finished. Called every frame, before
+		recording. Each draw's previous slot is found here, so whatever was visible last frame is drawn early again.
+	*/
+	void SetDraws(uint32_t frame, const std::vector<MeshletDraw>& draws);
+
+	// Instance buffers one per frame in flight, and the scene vertex buffer the mesh shader reads.
+	void BindFrames(const std::vector<VkBuffer>& instanceBuffers, VkBuffer vertexBuffer);
+
+	// Read by the late pass, see DepthPyramid. Bind again whenever it's recreated.
+	void BindDepthPyramid(VkImageView view, VkSampler sampler);
+
+	// The fraction of the depth buffer, from its top left, that culls recorded from now on are drawn into.
+	void SetDepthRegion(float width, float height);
+
+	/*
+		Outside any render pass, before RecordDraws for the same frame and phase. The late pass must come after the
+		early pass's draws and the pyramid built from them. The viewer is a world position, or with viewerIsPosition
+		false the direction everything is seen along, for orthographic views.
+	*/
+	void RecordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Float4x4& viewProjection, const Float3& viewer, bool viewerIsPosition, CullPhase phase);
+
+	/*
+		Inside the render pass, with a pipeline built on DrawPipelineLayout bound, and its set 1. The vertex path also
+		needs the scene vertex and index buffers bound, the mesh shader path reads both itself.
+	*/
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t frame, const Float4x4& viewProjection) const;
+
+	// Draws have been set and every buffer they need is bound.
+	_NODISCARD bool Ready() const { return m_ready && m_drawCount > 0; }
+
+	// Whether RecordDraws will use mesh shaders. The list is drawn as one row of task groups, so it has to fit the device's limit.
+	_NODISCARD bool UsesMeshShaders() const { return m_meshShaders && m_drawCount <= m_maxMeshWorkGroups; }
+
+	// Whether the mesh shader path was set up at all, which needs its own pipeline. Not every draw list will fit it.
+	_NODISCARD bool HasMeshShaders() const { return m_meshShaders; }
+
+	_NODISCARD VkPipelineLayout DrawPipelineLayout() const { return m_drawPipelineLayout; }
+	_NODISCARD uint32_t DrawCount() const { return m_drawCount; }
+
+private:
+
+	struct Buffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+	};
+
+	struct FrameBuffers
+	{
+		Buffer draws;			// MeshletDraw per slot, host visible and left mapped.
+		Buffer commands;		// VkDrawIndexedIndirectCommand per draw.
+		Buffer visible;			// Task count header, then visible draw slots.
+		MeshletDraw* pDraws = nullptr;
+		uint32_t capacity = 0;	// Draws every buffer above has room for.
+		std::vector<MeshletDraw> vDraws;	// What was last set, kept to match the next list against once it's culled.
+	};
+
+	// Replaced buffers other frames in flight may still read, destroyed once they've all cycled.
+	struct RetiredBuffer
+	{
+		Buffer buffer;
+		uint64_t retireFrame;
+	};
+
+	static constexpr uint32_t NO_PREVIOUS_SLOT = UINT32_MAX;
+
+	void ReserveFrame(FrameBuffers& frame, uint32_t drawCount);
+	void ReserveVisibility(uint32_t index, uint32_t drawCount);
+	void RememberCulledDraws(const FrameBuffers& frame);
+	_NODISCARD uint32_t PreviousSlot(const MeshletDraw& draw) const;
+	void DestroyRetiredBuffers(bool all);
+	void DestroyBuffer(Buffer& buffer);
+	void WriteDescriptorSet(uint32_t frame);
+	void WriteDescriptorSets();
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	bool m_multiDrawIndirect;
+	bool m_meshShaders;
+	uint32_t m_maxDrawIndirectCount;
+	uint32_t m_maxMeshWorkGroups;
+	PFN_vkVoidFunction m_pfnCmdDrawMeshTasksIndirect;	// vkCmdDrawMeshTasksIndirectEXT, typed where it's called.
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_cullPipelineLayout;
+	VkPipelineLayout m_drawPipelineLayout;
+	VkPipeline m_cullPipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_vDescriptorSets;		// One per frame in flight.
+
+	// Static, from the scene.
+	Buffer m_meshlets;
+	Buffer m_meshes;
+	Buffer m_meshletVertices;
+	Buffer m_meshletTriangles;
+
+	// A word per draw, whether it passed the late pass. Each frame reads the latest and writes the other, they're culled in order.
+	Buffer m_visibility[2];
+	uint32_t m_visibilityCapacity[2];
+	uint32_t m_latestVisibility;
+	std::vector<MeshletDraw> m_vCulledDraws;	// The list m_visibility[m_latestVisibility] is for.
+	std::vector<uint32_t> m_vFirstCulledSlot;	// By instance, where its meshlets start in the list above.
+
+	std::vector<VkBuffer> m_vInstanceBuffers;
+	VkBuffer m_vertexBuffer;
+	VkImageView m_depthPyramidView;
+	VkSampler m_depthPyramidSampler;
+	float m_depthRegion[2];
+	std::vector<FrameBuffers> m_vFrames;
+	std::vector<RetiredBuffer> m_vRetiredBuffers;
+	uint64_t m_frameIndex;		// Counts SetDraws calls, to know when retired buffers are out of use.
+	uint32_t m_drawCount;		// In the list last set, the one being recorded.
+	bool m_ready;				// Every buffer bound, apart from the draws.
+};
@@ -0,0 +1,183 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Splits meshes into meshlets, small clusters of triangles that are culled and drawn on their own.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	// Below this the normals spread over more than a hemisphere, give or take, and the cone would cull too rarely to be worth testing.
+	constexpr float MIN_CONE_SPREAD = 0.1f;
+
+	constexpr uint32_t NOT_IN_MESHLET = UINT32_MAX;
+
+	Float3 Position(const MeshView& mesh, uint32_t vertex)
+	{
+		Float3 position;
+		std::memcpy(&position, static_cast<const uint8_t*>(mesh.pVertices) + static_cast<size_t>(vertex) * mesh.vertexStride, sizeof(position));
+		return position;
+	}
+}
+
+MeshletSet BuildMeshlets(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	// Local indices are stored in a byte.
+	maxVertices = std::min(std::max(maxVertices, 3u), 256u);
+	maxTriangles = std::max(maxTriangles, 1u);
+
+	MeshletSet set;
+	const size_t TRIANGLES = indices.size() / 3;
+	set.vTriangles.reserve(TRIANGLES);
+
+	// Where each mesh vertex sits in the current meshlet, reset for its vertices whenever a meshlet is finished.
+	std::vector<uint32_t> vLocal(vertexCount, NOT_IN_MESHLET);
+	Meshlet current{ 0, 0, 0, 0 };
+
+	auto finish = [&]()
+	{
+		if (current.triangleCount == 0)
+		{
+			return;
+		}
+
+		for (uint32_t v = 0; v < current.vertexCount; v++)
+		{
+			vLocal[set.vVertices[current.vertexOffset + v]] = NOT_IN_MESHLET;
+		}
+
+		set.vMeshlets.push_back(current);
+		current = { static_cast<uint32_t>(set.vVertices.size()), static_cast<uint32_t>(set.vTriangles.size()), 0, 0 };
+	};
+
+	for (size_t t = 0; t < TRIANGLES; t++)
+	{
+		const uint32_t* pTriangle = &indices[t * 3];
+
+		uint32_t newVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			// A triangle can name a vertex twice, it only joins once.
+			const bool REPEATED = (k > 0 && pTriangle[k] == pTriangle[0]) || (k > 1 && pTriangle[k] == pTriangle[1]);
+			newVertices += vLocal[pTriangle[k]] == NOT_IN_MESHLET && !REPEATED ? 1 : 0;
+		}
+
+		if (current.vertexCount + newVertices > maxVertices || current.triangleCount == maxTriangles)
+		{
+			finish();
+		}
+
+		uint32_t packed = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t& local = vLocal[pTriangle[k]];
+			if (local == NOT_IN_MESHLET)
+			{
+				local = current.vertexCount++;
+				set.vVertices.push_back(pTriangle[k]);
+			}
+			packed |= local << (k * 8);
+		}
+
+		set.vTriangles.push_back(packed);
+		current.triangleCount++;
+	}
+
+	finish();
+	return set;
+}
+
+MeshletBounds ComputeMeshletBounds(const MeshletSet& set, const Meshlet& meshlet, const MeshView& mesh)
+{
+	MeshletBounds bounds{};
+	bounds.coneAxis = { 0.0f, 0.0f, 1.0f };
+	bounds.coneCutoff = 1.0f;
+	if (meshlet.vertexCount == 0)
+	{
+		return bounds;
+	}
+
+	// Sphere around the box of the vertices. Not the tightest, but a sphere is what the GPU test takes.
+	Float3 minimum = Position(mesh, set.vVertices[meshlet.vertexOffset]);
+	Float3 maximum = minimum;
+	for (uint32_t v = 1; v < meshlet.vertexCount; v++)
+	{
+		const Float3 POSITION = Position(mesh, set.vVertices[meshlet.vertexOffset + v]);
+		minimum = Min(minimum, POSITION);
+		maximum = Max(maximum, POSITION);
+	}
+
+	bounds.center = (minimum + maximum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (uint32_t v = 0; v < meshlet.vertexCount; v++)
+	{
+		const Float3 OFFSET = Position(mesh, set.vVertices[meshlet.vertexOffset + v]) - bounds.center;
+		radiusSquared = std::max(radiusSquared, Dot(OFFSET, OFFSET));
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+	bounds.coneApex = bounds.center;
+
+	// Unit normals of each triangle, degenerate ones have none and don't constrain the cone.
+	std::vector<Float3> vNormals;
+	std::vector<Float3> vCorners;
+	vNormals.reserve(meshlet.triangleCount);
+	vCorners.reserve(meshlet.triangleCount);
+	Float3 normalSum{ 0.0f, 0.0f, 0.0f };
+
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+	{
+		const uint32_t PACKED = set.vTriangles[meshlet.triangleOffset + t];
+		const Float3 A = Position(mesh, set.vVertices[meshlet.vertexOffset + (PACKED & 0xFF)]);
+		const Float3 B = Position(mesh, set.vVertices[meshlet.vertexOffset + ((PACKED >> 8) & 0xFF)]);
+		const Float3 C = Position(mesh, set.vVertices[meshlet.vertexOffset + ((PACKED >> 16) & 0xFF)]);
+
+		const Float3 NORMAL = Cross(B - A, C - A);
+		const float LENGTH = std::sqrt(Dot(NORMAL, NORMAL));
+		if (LENGTH > 0.0f)
+		{
+			vNormals.push_back(NORMAL * (1.0f / LENGTH));
+			vCorners.push_back(A);
+			normalSum = normalSum + vNormals.back();
+		}
+	}
+
+	const float SUM_LENGTH = std::sqrt(Dot(normalSum, normalSum));
+	if (vNormals.empty() || SUM_LENGTH == 0.0f)
+	{
+		return bounds;
+	}
+
+	const Float3 AXIS = normalSum * (1.0f / SUM_LENGTH);
+	float minimumDot = 1.0f;
+	for (const Float3& NORMAL : vNormals)
+	{
+		minimumDot = std::min(minimumDot, Dot(AXIS, NORMAL));
+	}
+
+	if (minimumDot <= MIN_CONE_SPREAD)
+	{
+		return bounds;
+	}
+
+	/*
+		The apex is pulled back along the axis until every triangle's plane is in front of it, so anything that sees
+		the apex from outside the cone sees the back of every triangle. Each plane's distance along the axis is
+		divided by how much the plane faces along it, which minimumDot keeps well away from zero.
+	*/
+	float apexDistance = 0.0f;
+	for (size_t t = 0; t < vNormals.size(); t++)
+	{
+		const float DISTANCE = Dot(bounds.center - vCorners[t], vNormals[t]) / Dot(AXIS, vNormals[t]);
+		apexDistance = std::max(apexDistance, DISTANCE);
+	}
+
+	bounds.coneApex = bounds.center - AXIS * apexDistance;
+	bounds.coneAxis = AXIS;
+	bounds.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+	return bounds;
+}
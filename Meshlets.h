@@ -0,0 +1,57 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Splits meshes into meshlets, small clusters of triangles that are culled and drawn on their own.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MeshSimplifier.h"
+#include "MathTypes.h"
+
+#include <vector>
+#include <cstdint>
+
+// 64 vertices and 124 triangles fill a mesh shader's output well on current hardware, and a triangle's indices fit in a byte each.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	uint32_t vertexOffset;			// Into MeshletSet::vVertices.
+	uint32_t triangleOffset;		// Into MeshletSet::vTriangles.
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+struct MeshletSet
+{
+	std::vector<Meshlet> vMeshlets;
+	std::vector<uint32_t> vVertices;	// Mesh vertex indices, each meshlet's run of them together.
+	std::vector<uint32_t> vTriangles;	// One per triangle, three 8 bit indices into its meshlet's vertices, lowest byte first.
+};
+
+/*
+	What culling a meshlet needs. The sphere bounds its triangles, the cone bounds their normals: the meshlet
+	faces entirely away from a viewer when dot(normalize(coneApex - viewer), coneAxis) >= coneCutoff. A cutoff
+	of 1 means the normals are too spread out for the cone to ever cull.
+*/
+struct MeshletBounds
+{
+	Float3 center;
+	float radius;
+	Float3 coneApex;
+	Float3 coneAxis;
+	float coneCutoff;
+};
+
+/*
+	Walks the triangles in order, starting a new meshlet whenever the next triangle would take the current one past
+	either limit. Meant for indices already in vertex cache order, so neighbouring triangles share vertices and
+	meshlets come out close to full. The order is kept: a meshlet's triangles are the same run of the index list,
+	so the indices can still be drawn a meshlet at a time without a second copy.
+*/
+MeshletSet BuildMeshlets(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Positions are the first three floats of each vertex, in the space the meshlet's culling will happen in once transformed.
+MeshletBounds ComputeMeshletBounds(const MeshletSet& set, const Meshlet& meshlet, const MeshView& mesh);
@@ -0,0 +1,440 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Generates mip chains on the GPU, with a blit chain or a single dispatch compute downsampler.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "MipGenerator.h"
+#include "VulkanUtils.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define MAX_GENERATIONS				Texture_constants::g_maxMipGenerationsInFlight
+
+namespace
+{
+	// Must match mipgen.comp and spd.glsl.
+	constexpr uint32_t MIPS_PER_DISPATCH = 12;
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr uint32_t MAX_SETS_PER_GENERATION = 2; // Enough for 16k textures.
+
+	struct MipGenPushConstants
+	{
+		int32_t srcWidth;
+		int32_t srcHeight;
+		uint32_t mipCount;
+		uint32_t workgroupCount;
+		uint32_t counterIndex;
+	};
+
+	const char* const SHADER_FILES[] =
+	{
+		"shaders/mipgen_rgba8.spv",
+		"shaders/mipgen_rgba16f.spv",
+		"shaders/mipgen_rgba32f.spv"
+	};
+
+	VkImageMemoryBarrier MipBarrier(VkImage image, uint32_t baseMip, uint32_t mipCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = baseMip;
+		barrier.subresourceRange.levelCount = mipCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		return barrier;
+	}
+}
+
+void MipGenerator::Init(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+
+	// Source mip, destination mips, completion counters.
+	VkDescriptorSetLayoutBinding bindings[3]{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = MIPS_PER_DISPATCH;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[2].binding = 2;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount = 1;
+	bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 3;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mip generation descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(MipGenPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mip generation pipeline layout!");
+	}
+
+	// One pipeline per storage format qualifier.
+	for (uint32_t i = 0; i < STORAGE_VARIANT_COUNT; i++)
+	{
+		VkShaderModule shaderModule = LoadShaderModule(m_device, SHADER_FILES[i]);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = m_pipelineLayout;
+
+		if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipelines[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create mip generation pipeline!");
+		}
+
+		vkDestroyShaderModule(m_device, shaderModule, GetAllocationCallbacks());
+	}
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[0].descriptorCount = MAX_GENERATIONS * MAX_SETS_PER_GENERATION * (MIPS_PER_DISPATCH + 1);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = MAX_GENERATIONS * MAX_SETS_PER_GENERATION;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.maxSets = MAX_GENERATIONS * MAX_SETS_PER_GENERATION;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mip generation descriptor pool!");
+	}
+
+	// Counters start at zero and the shader puts them back to zero, so they're only cleared here.
+	const VkDeviceSize COUNTER_BYTES = MAX_GENERATIONS * sizeof(uint32_t);
+	CreateBuffer
+	(
+		m_physicalDevice, m_device, COUNTER_BYTES,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_counterBuffer, m_counterMemory
+	);
+
+	void* pData;
+	vkMapMemory(m_device, m_counterMemory, 0, COUNTER_BYTES, 0, &pData);
+	std::memset(pData, 0, static_cast<size_t>(COUNTER_BYTES));
+	vkUnmapMemory(m_device, m_counterMemory);
+}
+
+void MipGenerator::Destroy()
+{
+	for (VkPipeline pipeline : m_pipelines)
+	{
+		vkDestroyPipeline(m_device, pipeline, GetAllocationCallbacks());
+	}
+
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees any sets still allocated.
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+	vkDestroyBuffer(m_device, m_counterBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_counterMemory, GetAllocationCallbacks());
+}
+
+MipGenPath MipGenerator::SelectPath(VkFormat format) const
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+
+	const VkFormatFeatureFlags FEATURES = properties.optimalTilingFeatures;
+
+	// Blitting is the cheapest to set up, and the hardware may filter better than a box filter.
+	constexpr VkFormatFeatureFlags BLIT_FEATURES = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if ((FEATURES & BLIT_FEATURES) == BLIT_FEATURES)
+	{
+		return MipGenPath::Blit;
+	}
+
+	if (GetStorageVariant(format) != STORAGE_NONE && (FEATURES & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+	{
+		return MipGenPath::Compute;
+	}
+
+	return MipGenPath::None;
+}
+
+VkImageUsageFlags MipGenerator::RequiredUsage(MipGenPath path)
+{
+	switch (path)
+	{
+	case MipGenPath::Blit:		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	case MipGenPath::Compute:	return VK_IMAGE_USAGE_STORAGE_BIT;
+	default:					return 0;
+	}
+}
+
+uint32_t MipGenerator::FullMipCount(VkExtent2D extent)
+{
+	uint32_t largest = std::max(extent.width, extent.height);
+	uint32_t count = 1;
+
+	while (largest > 1)
+	{
+		largest >>= 1;
+		count++;
+	}
+
+	return count;
+}
+
+MipGenerator::StorageVariant MipGenerator::GetStorageVariant(VkFormat format)
+{
+	// sRGB formats can't be storage images in Vulkan 1.0, so they only ever take the blit path.
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:			return STORAGE_RGBA8;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:		return STORAGE_RGBA16F;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:		return STORAGE_RGBA32F;
+	default:								return STORAGE_NONE;
+	}
+}
+
+MipGenResources MipGenerator::Record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipCount)
+{
+	const MipGenPath PATH = mipCount > 1 ? SelectPath(format) : MipGenPath::None;
+
+	if (PATH == MipGenPath::Blit)
+	{
+		RecordBlitChain(commandBuffer, image, extent, mipCount);
+		return {};
+	}
+
+	if (PATH == MipGenPath::Compute)
+	{
+		return RecordCompute(commandBuffer, image, format, extent, mipCount);
+	}
+
+	// Nothing to generate, just make the base level readable.
+	VkImageMemoryBarrier barrier = MipBarrier(image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	return {};
+}
+
+void MipGenerator::Release(MipGenResources& resources)
+{
+	for (VkImageView view : resources.vViews)
+	{
+		vkDestroyImageView(m_device, view, GetAllocationCallbacks());
+	}
+
+	if (!resources.vDescriptorSets.empty())
+	{
+		vkFreeDescriptorSets(m_device, m_descriptorPool, static_cast<uint32_t>(resources.vDescriptorSets.size()), resources.vDescriptorSets.data());
+	}
+
+	resources = {};
+}
+
+// =================================================================================================================================================================
+// Blit path. One barrier per mip is the minimum, as each blit reads what the previous one wrote.
+
+void MipGenerator::RecordBlitChain(VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, uint32_t mipCount)
+{
+	// Base level becomes the first source, and every other level is prepared as a destination in the same call.
+	VkImageMemoryBarrier setup[2] =
+	{
+		MipBarrier(image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT),
+		MipBarrier(image, 1, mipCount - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT)
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, setup);
+
+	int32_t width = static_cast<int32_t>(extent.width);
+	int32_t height = static_cast<int32_t>(extent.height);
+
+	for (uint32_t i = 1; i < mipCount; i++)
+	{
+		const int32_t NEXT_WIDTH = std::max(width / 2, 1);
+		const int32_t NEXT_HEIGHT = std::max(height / 2, 1);
+
+		VkImageBlit blit{};
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { width, height, 1 };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { NEXT_WIDTH, NEXT_HEIGHT, 1 };
+
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		// The last level is never a source, it goes straight to shader read below.
+		if (i + 1 < mipCount)
+		{
+			VkImageMemoryBarrier barrier = MipBarrier(image, i, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		width = NEXT_WIDTH;
+		height = NEXT_HEIGHT;
+	}
+
+	// Hand the whole chain to the shaders in one call.
+	VkImageMemoryBarrier finish[2] =
+	{
+		MipBarrier(image, 0, mipCount - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT),
+		MipBarrier(image, mipCount - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, finish);
+}
+
+// =================================================================================================================================================================
+// Compute path. One barrier in, one dispatch, one barrier out for anything up to 4096x4096.
+
+MipGenResources MipGenerator::RecordCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipCount)
+{
+	MipGenResources resources;
+
+	VkImageMemoryBarrier setup[2] =
+	{
+		MipBarrier(image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+		MipBarrier(image, 1, mipCount - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, setup);
+
+	// A single level view of every mip, the shader binds them as separate storage images.
+	resources.vViews.resize(mipCount);
+	for (uint32_t i = 0; i < mipCount; i++)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+
+		if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &resources.vViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create mip view!");
+		}
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[GetStorageVariant(format)]);
+
+	uint32_t baseMip = 0;
+	while (baseMip + 1 < mipCount)
+	{
+		const uint32_t SRC_WIDTH = std::max(extent.width >> baseMip, 1u);
+		const uint32_t SRC_HEIGHT = std::max(extent.height >> baseMip, 1u);
+
+		// The last workgroup can only finish the chain if the sixth mip fits in one tile, i.e. the source is at most 4096 wide.
+		uint32_t count = std::min(mipCount - 1 - baseMip, MIPS_PER_DISPATCH);
+		if (std::max(SRC_WIDTH, SRC_HEIGHT) > TILE_SIZE * TILE_SIZE)
+		{
+			count = std::min(count, MIPS_PER_DISPATCH / 2);
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+		VkDescriptorSet descriptorSet;
+		if (vkAllocateDescriptorSets(m_device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Ran out of mip generation descriptor sets!");
+		}
+		resources.vDescriptorSets.push_back(descriptorSet);
+
+		// Every array element must be valid, so unused slots repeat the last real destination. The shader never writes them.
+		VkDescriptorImageInfo srcInfo{ VK_NULL_HANDLE, resources.vViews[baseMip], VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorImageInfo dstInfos[MIPS_PER_DISPATCH];
+		for (uint32_t i = 0; i < MIPS_PER_DISPATCH; i++)
+		{
+			dstInfos[i] = { VK_NULL_HANDLE, resources.vViews[baseMip + 1 + std::min(i, count - 1)], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		VkDescriptorBufferInfo counterInfo{ m_counterBuffer, 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet writes[3]{};
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = i;
+		}
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &srcInfo;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = MIPS_PER_DISPATCH;
+		writes[1].pImageInfo = dstInfos;
+		writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[2].descriptorCount = 1;
+		writes[2].pBufferInfo = &counterInfo;
+
+		vkUpdateDescriptorSets(m_device, 3, writes, 0, nullptr);
+
+		const uint32_t GROUPS_X = (SRC_WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+		const uint32_t GROUPS_Y = (SRC_HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+
+		MipGenPushConstants constants{};
+		constants.srcWidth = static_cast<int32_t>(SRC_WIDTH);
+		constants.srcHeight = static_cast<int32_t>(SRC_HEIGHT);
+		constants.mipCount = count;
+		constants.workgroupCount = GROUPS_X * GROUPS_Y;
+		constants.counterIndex = m_nextCounter;
+		m_nextCounter = (m_nextCounter + 1) % MAX_GENERATIONS;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, GROUPS_X, GROUPS_Y, 1);
+
+		baseMip += count;
+
+		// Only textures above 4096 get here, the next dispatch reads what this one wrote.
+		if (baseMip + 1 < mipCount)
+		{
+			VkMemoryBarrier memoryBarrier{};
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	VkImageMemoryBarrier finish = MipBarrier(image, 0, mipCount, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &finish);
+
+	return resources;
+}
@@ -0,0 +1,88 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Generates mip chains on the GPU, with a blit chain or a single dispatch compute downsampler.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+
+enum class MipGenPath
+{
+	None,		// Neither path works for the format, the texture keeps its base level only.
+	Blit,		// vkCmdBlitImage from each mip to the next, needs linear filtering of the format.
+	Compute		// One dispatch writes up to twelve mips, needs storage image support.
+};
+
+// Per generation objects that must live until the command buffer that used them has finished.
+struct MipGenResources
+{
+	std::vector<VkImageView> vViews;
+	std::vector<VkDescriptorSet> vDescriptorSets;
+};
+
+class MipGenerator
+{
+public:
+
+	MipGenerator() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_counterBuffer(VK_NULL_HANDLE),
+		m_counterMemory(VK_NULL_HANDLE),
+		m_nextCounter(0)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device);
+	void Destroy();
+
+	_NODISCARD MipGenPath SelectPath(VkFormat format) const;
+
+	// Usage flags the image must be created with for the chosen path.
+	_NODISCARD static VkImageUsageFlags RequiredUsage(MipGenPath path);
+
+	/*
+		Expects mip 0 in TRANSFER_DST_OPTIMAL, fresh from an upload, and every other mip UNDEFINED.
+		Leaves the whole chain in SHADER_READ_ONLY_OPTIMAL, ready for fragment shaders.
+	*/
+	MipGenResources Record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipCount);
+
+	void Release(MipGenResources& resources);
+
+	_NODISCARD static uint32_t FullMipCount(VkExtent2D extent);
+
+private:
+
+	enum StorageVariant
+	{
+		STORAGE_RGBA8 = 0,
+		STORAGE_RGBA16F,
+		STORAGE_RGBA32F,
+		STORAGE_VARIANT_COUNT,
+		STORAGE_NONE = STORAGE_VARIANT_COUNT
+	};
+
+	_NODISCARD static StorageVariant GetStorageVariant(VkFormat format);
+
+	void RecordBlitChain(VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, uint32_t mipCount);
+	MipGenResources RecordCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipCount);
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipelines[STORAGE_VARIANT_COUNT] = {};
+	VkDescriptorPool m_descriptorPool;
+
+	// Workgroup completion counters, one per generation in flight.
+	VkBuffer m_counterBuffer;
+	VkDeviceMemory m_counterMemory;
+	uint32_t m_nextCounter;
+};
@@ -0,0 +1,172 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Collects performance warnings from the validation layers into a report keyed by VUID and message ID.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "PerfWarningReport.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <cstring>
+
+namespace
+{
+	const char* BEST_PRACTICES_PREFIX = "UNASSIGNED-BestPractices";
+}
+
+bool PerfWarningReport::IsPerformanceWarning(VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* pCallBackData)
+{
+	if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT)
+	{
+		return true;
+	}
+
+	const char* pVuid = pCallBackData->pMessageIdName;
+	return pVuid != nullptr && std::strncmp(pVuid, BEST_PRACTICES_PREFIX, std::strlen(BEST_PRACTICES_PREFIX)) == 0;
+}
+
+uint64_t PerfWarningReport::MakeKey(int32_t messageId, const char* pVuid)
+{
+	// FNV-1a over the VUID, then the ID mixed in.
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* p = pVuid; p != nullptr && *p != '\0'; p++)
+	{
+		hash = (hash ^ static_cast<unsigned char>(*p)) * 1099511628211ull;
+	}
+
+	return (hash ^ static_cast<uint32_t>(messageId)) * 1099511628211ull;
+}
+
+void PerfWarningReport::Record(const VkDebugUtilsMessengerCallbackDataEXT* pCallBackData)
+{
+	const uint64_t KEY = MakeKey(pCallBackData->messageIdNumber, pCallBackData->pMessageIdName);
+	const uint64_t FRAME = m_frame.load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_warnings.find(KEY);
+	if (it == m_warnings.end())
+	{
+		// First time we've seen it, keep enough to find the culprit: the message and the objects it names.
+		Warning warning;
+		warning.messageId = pCallBackData->messageIdNumber;
+		warning.vuid = pCallBackData->pMessageIdName != nullptr ? pCallBackData->pMessageIdName : "";
+		warning.firstFrame = FRAME;
+		warning.lastFrame = FRAME;
+		warning.framesSeen = 1;
+		warning.firstMessage = pCallBackData->pMessage != nullptr ? pCallBackData->pMessage : "";
+
+		for (uint32_t i = 0; i < pCallBackData->objectCount; i++)
+		{
+			const VkDebugUtilsObjectNameInfoEXT& OBJECT = pCallBackData->pObjects[i];
+			warning.vFirstObjects.push_back({ OBJECT.objectType, OBJECT.objectHandle, OBJECT.pObjectName != nullptr ? OBJECT.pObjectName : "" });
+		}
+
+		it = m_warnings.emplace(KEY, std::move(warning)).first;
+	}
+
+	Warning& warning = it->second;
+	if (warning.lastFrame != FRAME)
+	{
+		warning.lastFrame = FRAME;
+		warning.framesSeen++;
+		warning.countThisFrame = 0;
+	}
+
+	warning.count++;
+	warning.countThisFrame++;
+	warning.maxPerFrame = std::max(warning.maxPerFrame, warning.countThisFrame);
+}
+
+void PerfWarningReport::CompareWithBaseline(const std::string& baselineFilename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_vRegressions.clear();
+
+	std::ifstream baseline(baselineFilename);
+	if (!baseline.is_open())
+	{
+		// Nothing to compare against, so this run becomes the baseline.
+		std::ofstream out(baselineFilename);
+		for (const auto& ENTRY : m_warnings)
+		{
+			out << ENTRY.second.messageId << ' ' << ENTRY.second.vuid << '\n';
+		}
+		return;
+	}
+
+	// One "<message id> <vuid>" per line.
+	std::set<uint64_t> known;
+	std::string line;
+	while (std::getline(baseline, line))
+	{
+		std::istringstream fields(line);
+		int32_t messageId;
+		std::string vuid;
+		if (fields >> messageId)
+		{
+			fields >> vuid;
+			known.insert(MakeKey(messageId, vuid.c_str()));
+		}
+	}
+
+	for (const auto& ENTRY : m_warnings)
+	{
+		if (known.count(ENTRY.first) == 0)
+		{
+			m_vRegressions.push_back(ENTRY.first);
+		}
+	}
+}
+
+void PerfWarningReport::Summary(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_warnings.empty())
+	{
+		out << "Performance warnings: none" << std::endl;
+		return;
+	}
+
+	// Worst first.
+	std::vector<const Warning*> sorted;
+	for (const auto& ENTRY : m_warnings)
+	{
+		sorted.push_back(&ENTRY.second);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const Warning* a, const Warning* b) { return a->count > b->count; });
+
+	const uint64_t FRAMES = std::max<uint64_t>(m_frame.load(), 1);
+
+	out << "Performance warnings over " << FRAMES << " frames:" << std::endl;
+	for (const Warning* pWarning : sorted)
+	{
+		const uint64_t KEY = MakeKey(pWarning->messageId, pWarning->vuid.c_str());
+		const bool REGRESSION = std::find(m_vRegressions.begin(), m_vRegressions.end(), KEY) != m_vRegressions.end();
+
+		out << (REGRESSION ? "  NEW " : "      ") << pWarning->vuid << " (" << pWarning->messageId << ")" << std::endl;
+		out << "        " << pWarning->count << " total, " << static_cast<double>(pWarning->count) / FRAMES << " per frame, in "
+			<< pWarning->framesSeen << " frames, at most " << pWarning->maxPerFrame << " in one, first in frame " << pWarning->firstFrame << std::endl;
+
+		for (const ObjectInfo& OBJECT : pWarning->vFirstObjects)
+		{
+			out << "        object type " << OBJECT.type << " 0x" << std::hex << OBJECT.handle << std::dec;
+			if (!OBJECT.name.empty())
+			{
+				out << " \"" << OBJECT.name << "\"";
+			}
+			out << std::endl;
+		}
+
+		out << "        " << pWarning->firstMessage << std::endl;
+	}
+
+	if (!m_vRegressions.empty())
+	{
+		out << m_vRegressions.size() << " performance warning(s) not in the baseline." << std::endl;
+	}
+}
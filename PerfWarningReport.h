@@ -0,0 +1,75 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Collects performance warnings from the validation layers into a report keyed by VUID and message ID.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+
+class PerfWarningReport
+{
+public:
+
+	PerfWarningReport() :
+		m_frame(0)
+	{}
+
+	// Performance type messages, and the best practices layer's, which arrive typed as validation.
+	_NODISCARD static bool IsPerformanceWarning(VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* pCallBackData);
+
+	// Thread safe, called from the debug callback. Only the first occurrence of a warning allocates.
+	void Record(const VkDebugUtilsMessengerCallbackDataEXT* pCallBackData);
+
+	void NextFrame() { m_frame.fetch_add(1, std::memory_order_relaxed); }
+
+	/*
+		Warnings not listed in the baseline file count as regressions. Without a baseline file,
+		the current set is written out to become one, so the first run on a machine always passes.
+	*/
+	void CompareWithBaseline(const std::string& baselineFilename);
+	_NODISCARD bool HasRegressions() const { return !m_vRegressions.empty(); }
+
+	void Summary(std::ostream& out) const;
+
+private:
+
+	struct ObjectInfo
+	{
+		VkObjectType type;
+		uint64_t handle;
+		std::string name;	// From vkSetDebugUtilsObjectNameEXT, empty if we never named it.
+	};
+
+	struct Warning
+	{
+		int32_t messageId = 0;
+		std::string vuid;
+		uint64_t count = 0;
+		uint64_t firstFrame = 0;
+		uint64_t lastFrame = 0;
+		uint64_t framesSeen = 0;
+		uint64_t countThisFrame = 0;
+		uint64_t maxPerFrame = 0;
+		std::string firstMessage;
+		std::vector<ObjectInfo> vFirstObjects;
+	};
+
+	// The VUID and the ID hashed together, without allocating, since this runs for every warning.
+	static uint64_t MakeKey(int32_t messageId, const char* pVuid);
+
+	std::atomic<uint64_t> m_frame;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<uint64_t, Warning> m_warnings;
+	std::vector<uint64_t> m_vRegressions;	// Keys, since a VUID alone can be shared by several message IDs.
+};
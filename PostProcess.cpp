@@ -0,0 +1,376 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Tonemapping, grading, sharpening, vignette and film grain in compute, fused or one effect at a time.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "PostProcess.h"
+#include "VulkanUtils.h"
+
+#include <stdexcept>
+
+namespace
+{
+	// Must match post_process.comp.
+	constexpr uint32_t GROUP_SIZE = 16;
+
+	constexpr VkFormat INTERMEDIATE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+	constexpr VkFormat OUTPUT_STORAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+	constexpr VkFormat OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+	// In the order they're applied, see compile.bat.
+	const char* const STAGE_SHADERS[] =
+	{
+		"shaders/post_tonemap.spv",
+		"shaders/post_grade.spv",
+		"shaders/post_sharpen.spv",
+		"shaders/post_vignette.spv",
+		"shaders/post_grain.spv"
+	};
+
+	// Must match post_process.glsl.
+	struct PostPushConstants
+	{
+		float tint[4];
+		int32_t renderSize[2];
+		uint32_t frame;
+		float exposure;
+		float contrast;
+		float saturation;
+		float vignette;
+		float grain;
+		float sharpen;
+	};
+
+	VkPipeline CreateComputePipeline(VkDevice device, VkPipelineLayout layout, const char* shaderPath)
+	{
+		VkShaderModule shaderModule = LoadShaderModule(device, shaderPath);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create post-processing pipeline!");
+		}
+
+		vkDestroyShaderModule(device, shaderModule, GetAllocationCallbacks());
+		return pipeline;
+	}
+}
+
+void PostProcess::Init(VkPhysicalDevice physicalDevice, VkDevice device, const PostProcessSettings& settings)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_settings = settings;
+
+	// Scene colour, intermediate read, intermediate written, output.
+	VkDescriptorSetLayoutBinding bindings[4]{};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PostPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing pipeline layout!");
+	}
+
+	// Every variant shares the layout, so switching between them costs nothing but the bind.
+	m_fusedPipeline = CreateComputePipeline(m_device, m_pipelineLayout, "shaders/post_fused.spv");
+	for (uint32_t stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		m_stagePipelines[stage] = CreateComputePipeline(m_device, m_pipelineLayout, STAGE_SHADERS[stage]);
+	}
+
+	VkDescriptorPoolSize poolSizes[2]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = 2;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = 6;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 2;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing descriptor pool!");
+	}
+
+	// Rewritten whenever the targets are recreated.
+	const VkDescriptorSetLayout SET_LAYOUTS[2] = { m_descriptorSetLayout, m_descriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 2;
+	allocInfo.pSetLayouts = SET_LAYOUTS;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_descriptorSets) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate post-processing descriptor sets!");
+	}
+
+	// The scene is only read with texelFetch.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing sampler!");
+	}
+}
+
+void PostProcess::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	ReleaseTargets();
+
+	vkDestroySampler(m_device, m_sampler, GetAllocationCallbacks());
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the sets.
+	for (VkPipeline pipeline : m_stagePipelines)
+	{
+		vkDestroyPipeline(m_device, pipeline, GetAllocationCallbacks());
+	}
+	vkDestroyPipeline(m_device, m_fusedPipeline, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+}
+
+void PostProcess::CreateTargets(VkExtent2D targetExtent, VkImageView sceneView)
+{
+	ReleaseTargets();
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = INTERMEDIATE_FORMAT;
+	imageInfo.extent = { targetExtent.width, targetExtent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_intermediateImages[i], m_intermediateMemory[i]);
+
+		viewInfo.image = m_intermediateImages[i];
+		viewInfo.format = INTERMEDIATE_FORMAT;
+
+		if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_intermediateViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create post-processing intermediate view!");
+		}
+	}
+
+	// Written as UNORM, sampled as sRGB. The formats are compatible, but the image has to be told it'll be viewed as both.
+	imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+	imageInfo.format = OUTPUT_STORAGE_FORMAT;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_outputImage, m_outputMemory);
+
+	viewInfo.image = m_outputImage;
+	viewInfo.format = OUTPUT_STORAGE_FORMAT;
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_outputStorageView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing output storage view!");
+	}
+
+	// sRGB formats generally can't be storage images, so this view leaves the usage out.
+	VkImageViewUsageCreateInfo viewUsage{};
+	viewUsage.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+	viewUsage.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	viewInfo.pNext = &viewUsage;
+	viewInfo.format = OUTPUT_FORMAT;
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_outputView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create post-processing output view!");
+	}
+
+	// Set i writes intermediate i and reads the other, the fused dispatch only uses the scene and output.
+	const VkDescriptorImageInfo SCENE_INFO = { m_sampler, sceneView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	const VkDescriptorImageInfo OUTPUT_INFO = { VK_NULL_HANDLE, m_outputStorageView, VK_IMAGE_LAYOUT_GENERAL };
+	const VkDescriptorImageInfo INTERMEDIATE_INFOS[2] =
+	{
+		{ VK_NULL_HANDLE, m_intermediateViews[0], VK_IMAGE_LAYOUT_GENERAL },
+		{ VK_NULL_HANDLE, m_intermediateViews[1], VK_IMAGE_LAYOUT_GENERAL }
+	};
+
+	VkWriteDescriptorSet writes[8]{};
+	for (uint32_t set = 0; set < 2; set++)
+	{
+		const VkDescriptorImageInfo* pInfos[4] = { &SCENE_INFO, &INTERMEDIATE_INFOS[1 - set], &INTERMEDIATE_INFOS[set], &OUTPUT_INFO };
+		for (uint32_t binding = 0; binding < 4; binding++)
+		{
+			VkWriteDescriptorSet& write = writes[set * 4 + binding];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = m_descriptorSets[set];
+			write.dstBinding = binding;
+			write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.descriptorCount = 1;
+			write.pImageInfo = pInfos[binding];
+		}
+	}
+
+	vkUpdateDescriptorSets(m_device, 8, writes, 0, nullptr);
+}
+
+void PostProcess::ReleaseTargets()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		vkDestroyImageView(m_device, m_intermediateViews[i], GetAllocationCallbacks());
+		vkDestroyImage(m_device, m_intermediateImages[i], GetAllocationCallbacks());
+		vkFreeMemory(m_device, m_intermediateMemory[i], GetAllocationCallbacks());
+		m_intermediateViews[i] = VK_NULL_HANDLE;
+		m_intermediateImages[i] = VK_NULL_HANDLE;
+		m_intermediateMemory[i] = VK_NULL_HANDLE;
+	}
+
+	vkDestroyImageView(m_device, m_outputView, GetAllocationCallbacks());
+	vkDestroyImageView(m_device, m_outputStorageView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_outputImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_outputMemory, GetAllocationCallbacks());
+	m_outputView = VK_NULL_HANDLE;
+	m_outputStorageView = VK_NULL_HANDLE;
+	m_outputImage = VK_NULL_HANDLE;
+	m_outputMemory = VK_NULL_HANDLE;
+}
+
+void PostProcess::Record(VkCommandBuffer commandBuffer, VkExtent2D renderExtent, bool fused)
+{
+	PostPushConstants constants{};
+	constants.tint[0] = m_settings.tint[0];
+	constants.tint[1] = m_settings.tint[1];
+	constants.tint[2] = m_settings.tint[2];
+	constants.renderSize[0] = static_cast<int32_t>(renderExtent.width);
+	constants.renderSize[1] = static_cast<int32_t>(renderExtent.height);
+	constants.frame = m_frame++;
+	constants.exposure = m_settings.exposure;
+	constants.contrast = m_settings.contrast;
+	constants.saturation = m_settings.saturation;
+	constants.vignette = m_settings.vignette;
+	constants.grain = m_settings.grain;
+	constants.sharpen = m_settings.sharpen;
+
+	/*
+		Last frame's contents are never read, so everything starts from UNDEFINED. The upscale may still be sampling
+		the output and the last unfused chain may still be using the intermediates, which only needs them to finish.
+	*/
+	VkImageMemoryBarrier barriers[3]{};
+	const VkImage IMAGES[3] = { m_outputImage, m_intermediateImages[0], m_intermediateImages[1] };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].image = IMAGES[i];
+		barriers[i].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barriers[i].srcAccessMask = 0;
+		barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, fused ? 1 : 3, barriers);
+
+	const uint32_t GROUPS_X = (renderExtent.width + GROUP_SIZE - 1) / GROUP_SIZE;
+	const uint32_t GROUPS_Y = (renderExtent.height + GROUP_SIZE - 1) / GROUP_SIZE;
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	if (fused)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_fusedPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[0], 0, nullptr);
+		vkCmdDispatch(commandBuffer, GROUPS_X, GROUPS_Y, 1);
+	}
+	else
+	{
+		// Each effect waits for the whole of the last one, the same full screen round trip a chain of passes makes.
+		VkMemoryBarrier stageBarrier{};
+		stageBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		stageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		stageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		for (uint32_t stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			if (stage > 0)
+			{
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &stageBarrier, 0, nullptr, 0, nullptr);
+			}
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_stagePipelines[stage]);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[stage % 2], 0, nullptr);
+			vkCmdDispatch(commandBuffer, GROUPS_X, GROUPS_Y, 1);
+		}
+	}
+
+	VkImageMemoryBarrier& outputBarrier = barriers[0];
+	outputBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	outputBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	outputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	outputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &outputBarrier);
+}
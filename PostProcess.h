@@ -0,0 +1,102 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Tonemapping, grading, sharpening, vignette and film grain in compute, fused or one effect at a time.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+
+struct PostProcessSettings
+{
+	float exposure;			// Scales the scene before tonemapping.
+	float contrast;			// Power around mid grey, 1 leaves it alone.
+	float saturation;		// 0 is greyscale, 1 leaves it alone.
+	float tint[3];			// Multiplies the tonemapped colour.
+	float vignette;			// How much darker the corners get, 0 to 1.
+	float grain;			// Noise amplitude, in sRGB encoded values from 0 to 1.
+	float sharpen;			// 0 to 1.
+};
+
+/*
+	Turns the HDR scene into the 8 bit image the upscale samples, at render resolution. Fused, one dispatch reads
+	each scene pixel once and writes each output pixel once; tonemapped neighbours for the sharpen are shared through
+	workgroup memory rather than written out. Unfused, every effect is its own dispatch, round tripping a 16 bit
+	intermediate through memory between each, the way a chain of full screen passes would. Both are built so either
+	can be recorded on any frame, and timed against each other.
+
+	The output is written sRGB encoded through a UNORM storage view, since sRGB formats can't be storage images, and
+	read back linear through an sRGB view.
+*/
+class PostProcess
+{
+public:
+
+	PostProcess() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_settings(),
+		m_frame(0),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_fusedPipeline(VK_NULL_HANDLE),
+		m_stagePipelines(),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_descriptorSets(),
+		m_sampler(VK_NULL_HANDLE),
+		m_intermediateImages(),
+		m_intermediateMemory(),
+		m_intermediateViews(),
+		m_outputImage(VK_NULL_HANDLE),
+		m_outputMemory(VK_NULL_HANDLE),
+		m_outputStorageView(VK_NULL_HANDLE),
+		m_outputView(VK_NULL_HANDLE)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const PostProcessSettings& settings);
+	void Destroy();
+
+	// Images the size of the scene's targets, reading the scene's colour in SHADER_READ_ONLY_OPTIMAL. Replaces any previous ones.
+	void CreateTargets(VkExtent2D targetExtent, VkImageView sceneView);
+	void ReleaseTargets();
+
+	/*
+		Outside any render pass, with the scene's colour readable from compute. Processes the corner drawn at
+		renderExtent, and leaves the output ready for fragment shaders to sample.
+	*/
+	void Record(VkCommandBuffer commandBuffer, VkExtent2D renderExtent, bool fused);
+
+	// Linear through an sRGB view, in SHADER_READ_ONLY_OPTIMAL.
+	_NODISCARD VkImageView OutputView() const { return m_outputView; }
+
+private:
+
+	// One dispatch each when unfused, in the order they're applied. Must match the STAGE_ defines in compile.bat.
+	static constexpr uint32_t STAGE_COUNT = 5;
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	PostProcessSettings m_settings;
+	uint32_t m_frame;						// Reseeds the grain.
+
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_fusedPipeline;
+	VkPipeline m_stagePipelines[STAGE_COUNT];
+	VkDescriptorPool m_descriptorPool;
+	VkDescriptorSet m_descriptorSets[2];	// Even stages read intermediate 1 and write 0, odd ones the other way around.
+	VkSampler m_sampler;
+
+	// Ping ponged between by the unfused stages.
+	VkImage m_intermediateImages[2];
+	VkDeviceMemory m_intermediateMemory[2];
+	VkImageView m_intermediateViews[2];
+
+	VkImage m_outputImage;
+	VkDeviceMemory m_outputMemory;
+	VkImageView m_outputStorageView;		// UNORM, written sRGB encoded.
+	VkImageView m_outputView;				// sRGB, sampled.
+};
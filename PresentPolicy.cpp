@@ -0,0 +1,118 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Present mode, swap chain depth and frames in flight chosen together, plus the timings to compare them.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "PresentPolicy.h"
+#include "VulkanUtils.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <cmath>
+
+#define MAX_FRAMES_IN_FLIGHT		Render_constants::g_maxFramesInFlight
+
+namespace
+{
+	const PresentSettings SETTINGS[] =
+	{
+		// LowLatency: mailbox always presents the newest image, and a single frame in flight keeps the CPU from running ahead of the GPU.
+		{ { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR }, 1, 1 },
+
+		// Throughput: never block on the display, and keep enough work queued that the GPU never waits on us.
+		{ { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR }, 2, MAX_FRAMES_IN_FLIGHT },
+
+		// PowerSaving: FIFO blocks at the refresh rate, the minimum image count is enough when we never render ahead.
+		{ { VK_PRESENT_MODE_FIFO_KHR }, 0, 2 },
+	};
+
+	const char* NAMES[] = { "low-latency", "throughput", "power-saving" };
+
+	static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == static_cast<size_t>(PresentPolicy::Count), "Every present policy needs a name!");
+}
+
+const PresentSettings& GetPresentSettings(PresentPolicy policy)
+{
+	return SETTINGS[static_cast<size_t>(policy)];
+}
+
+const char* PresentPolicyName(PresentPolicy policy)
+{
+	return NAMES[static_cast<size_t>(policy)];
+}
+
+PresentPolicy ParsePresentPolicy(const std::string& name)
+{
+	for (uint32_t i = 0; i < static_cast<uint32_t>(PresentPolicy::Count); i++)
+	{
+		if (name == NAMES[i])
+		{
+			return static_cast<PresentPolicy>(i);
+		}
+	}
+
+	throw std::runtime_error("Unknown present policy, expected low-latency, throughput or power-saving!");
+}
+
+void PresentStats::Presented(Clock::time_point presentTime)
+{
+	if (m_hasLastPresent)
+	{
+		const double FRAME_TIME = std::chrono::duration<double, std::milli>(presentTime - m_lastPresent).count();
+
+		m_frames++;
+		const double DELTA = FRAME_TIME - m_meanFrameTime;
+		m_meanFrameTime += DELTA / m_frames;
+		m_frameTimeM2 += DELTA * (FRAME_TIME - m_meanFrameTime);
+	}
+
+	m_lastPresent = presentTime;
+	m_hasLastPresent = true;
+}
+
+void PresentStats::AddLatency(Clock::duration latency)
+{
+	const float MILLISECONDS = std::chrono::duration<float, std::milli>(latency).count();
+
+	if (m_vLatencies.size() < MAX_LATENCY_SAMPLES)
+	{
+		m_vLatencies.push_back(MILLISECONDS);
+	}
+	else
+	{
+		m_vLatencies[m_nextLatency] = MILLISECONDS;
+		m_nextLatency = (m_nextLatency + 1) % MAX_LATENCY_SAMPLES;
+	}
+}
+
+void PresentStats::Report(std::ostream& out, const char* name) const
+{
+	out << "Present policy " << name << ":" << std::endl;
+
+	if (m_frames < 2)
+	{
+		out << "    Not enough frames" << std::endl;
+		return;
+	}
+
+	const double STD_DEV = std::sqrt(m_frameTimeM2 / (m_frames - 1));
+
+	out << std::fixed << std::setprecision(2);
+	out << "    Frame time     " << m_meanFrameTime << " ms mean, " << STD_DEV << " ms std dev, " << STD_DEV * STD_DEV << " ms^2 variance over " << m_frames << " frames" << std::endl;
+
+	if (m_vLatencies.empty())
+	{
+		out << "    Input latency  no input received" << std::endl;
+		return;
+	}
+
+	std::vector<float> sorted = m_vLatencies;
+	std::sort(sorted.begin(), sorted.end());
+
+	auto percentile = [&sorted](double fraction) { return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))]; };
+
+	out << "    Input latency  " << percentile(0.5) << " ms median, " << percentile(0.95) << " ms 95th, " << sorted.back() << " ms worst over "
+		<< sorted.size() << " samples" << std::endl;
+}
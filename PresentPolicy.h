@@ -0,0 +1,79 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Present mode, swap chain depth and frames in flight chosen together, plus the timings to compare them.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+enum class PresentPolicy : uint32_t
+{
+	LowLatency,		// Mailbox, shallow swap chain, one frame in flight. Input is sampled as late as the GPU allows.
+	Throughput,		// Immediate or mailbox, deep swap chain, as many frames in flight as we have sync objects for.
+	PowerSaving,	// FIFO, capped to the display's refresh rate so the GPU idles between frames.
+	Count
+};
+
+struct PresentSettings
+{
+	std::vector<VkPresentModeKHR> vPresentModes;	// In order of preference, FIFO is always last since it's the only guaranteed mode.
+	uint32_t extraImages;							// Requested on top of the surface's minimum image count.
+	uint32_t framesInFlight;
+};
+
+_NODISCARD const PresentSettings& GetPresentSettings(PresentPolicy policy);
+_NODISCARD const char* PresentPolicyName(PresentPolicy policy);
+
+// Accepts the names PresentPolicyName returns. Throws on anything else, so a typo on the command line isn't silently ignored.
+_NODISCARD PresentPolicy ParsePresentPolicy(const std::string& name);
+
+/*
+	Frame time and input to present latency for one policy. Latency runs from the first input event
+	a frame could see to vkQueuePresentKHR returning, so FIFO adds up to one refresh on top of what's reported.
+*/
+class PresentStats
+{
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	PresentStats() :
+		m_frames(0),
+		m_meanFrameTime(0.0),
+		m_frameTimeM2(0.0),
+		m_lastPresent(),
+		m_hasLastPresent(false),
+		m_nextLatency(0)
+	{}
+
+	// The first present after a policy change only starts the clock, the gap before it includes the swap chain rebuild.
+	void Restart() { m_hasLastPresent = false; }
+
+	void Presented(Clock::time_point presentTime);
+	void AddLatency(Clock::duration latency);
+
+	_NODISCARD uint64_t Frames() const { return m_frames; }
+
+	void Report(std::ostream& out, const char* name) const;
+
+private:
+
+	static constexpr size_t MAX_LATENCY_SAMPLES = 8192;	// Percentiles come from the most recent samples only.
+
+	uint64_t m_frames;
+	double m_meanFrameTime;		// Welford's running mean and sum of squared differences, in milliseconds.
+	double m_frameTimeM2;
+	Clock::time_point m_lastPresent;
+	bool m_hasLastPresent;
+
+	std::vector<float> m_vLatencies;
+	size_t m_nextLatency;
+};
@@ -0,0 +1,126 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Bounded lock-free multi-producer, multi-consumer ring buffer.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+/*
+	Each cell carries a sequence number saying whose turn it is: a producer may write it when sequence == position,
+	a consumer may read it when sequence == position + 1. Positions only ever grow, a compare exchange claims one.
+	Nothing ever blocks, a full or empty buffer simply returns false.
+*/
+template<typename T>
+class RingBuffer
+{
+public:
+
+	explicit RingBuffer(size_t capacity) :
+		m_mask(capacity - 1),
+		m_cells(new Cell[capacity]),
+		m_enqueuePos(0),
+		m_dequeuePos(0)
+	{
+		if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		{
+			throw std::runtime_error("Ring buffer capacity must be a power of two!");
+		}
+
+		for (size_t i = 0; i < capacity; i++)
+		{
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	_NODISCARD bool TryPush(const T& value)
+	{
+		Cell* pCell;
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			pCell = &m_cells[pos & m_mask];
+			const size_t SEQUENCE = pCell->sequence.load(std::memory_order_acquire);
+			const intptr_t DIFF = static_cast<intptr_t>(SEQUENCE) - static_cast<intptr_t>(pos);
+
+			if (DIFF == 0)
+			{
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (DIFF < 0)
+			{
+				return false; // Full.
+			}
+			else
+			{
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		pCell->data = value;
+		pCell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	_NODISCARD bool TryPop(T& value)
+	{
+		Cell* pCell;
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			pCell = &m_cells[pos & m_mask];
+			const size_t SEQUENCE = pCell->sequence.load(std::memory_order_acquire);
+			const intptr_t DIFF = static_cast<intptr_t>(SEQUENCE) - static_cast<intptr_t>(pos + 1);
+
+			if (DIFF == 0)
+			{
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (DIFF < 0)
+			{
+				return false; // Empty.
+			}
+			else
+			{
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = pCell->data;
+		pCell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	_NODISCARD size_t Capacity() const { return m_mask + 1; }
+
+private:
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	// Producers and consumers each hammer their own position, keep them on separate cache lines.
+	const size_t m_mask;
+	std::unique_ptr<Cell[]> m_cells;
+	alignas(64) std::atomic<size_t> m_enqueuePos;
+	alignas(64) std::atomic<size_t> m_dequeuePos;
+};
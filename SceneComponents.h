@@ -0,0 +1,66 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Components the renderer reads from the entity registry.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "EntityRegistry.h"
+#include "TransformHierarchy.h"
+
+#include <cstdint>
+
+// Mesh 0 is the built in triangle, meshes loaded from a scene file follow it.
+constexpr uint32_t TRIANGLE_MESH = 0;
+
+// Anything with one of these gets drawn.
+struct MeshInstance
+{
+	uint32_t mesh;
+	uint32_t material;
+};
+
+// A node in the TransformHierarchy. The node's world matrix is written to the instance buffer at the same index.
+struct Transform
+{
+	uint32_t node;
+};
+
+// The level of detail a mesh was last drawn at, kept so the next choice can stick with it near a boundary.
+struct LodState
+{
+	uint32_t lod;
+};
+
+enum class LightType : uint32_t
+{
+	Point,
+	Spot
+};
+
+// Lights from its Transform's world position. Spot lights shine down the node's +z axis.
+struct Light
+{
+	LightType type;
+	float color[3];			// Linear, premultiplied by intensity.
+	float range;			// Nothing is lit past this.
+	float spotCosOuter;		// Cosines of the cone's half angles, spot lights only.
+	float spotCosInner;
+};
+
+// Drawn into the sun's shadow cascades. Static casters are cached per cascade, dynamic ones are drawn every refresh.
+struct ShadowCaster
+{
+	bool isStatic;
+};
+
+// One entry of the per frame draw list, built by querying the registry.
+struct DrawItem
+{
+	Entity entity;
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t instance;		// Index of its world matrix in the instance buffer.
+	uint32_t lod;			// Level of detail to draw, 0 is the full mesh.
+};
@@ -0,0 +1,540 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Binary scene container, memory mapped and used in place rather than parsed.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "SceneFile.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Meshlets.h"
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	constexpr uint32_t SCENE_FILE_MAGIC = 0x4E435356; // 'VSCN'
+	constexpr uint32_t SCENE_FILE_VERSION = 4;
+
+	constexpr uint32_t ELEMENT_SIZES[static_cast<size_t>(SceneSectionType::Count)] =
+	{
+		sizeof(SceneMesh),
+		sizeof(SceneNode),
+		1,
+		sizeof(uint32_t),
+		1,
+		sizeof(SceneLod),
+		sizeof(SceneMeshlet),
+		sizeof(uint32_t),
+		sizeof(uint32_t)
+	};
+
+	// LODs stop here, below it a draw is too cheap for fewer triangles to matter.
+	constexpr uint32_t MIN_LOD_TRIANGLES = 32;
+
+	// How much worse than the cache pass alone the overdraw clusters may make the miss ratio.
+	constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// A bounding sphere around the box of the positions, assumed to be the first three floats of each vertex.
+	void ComputeBounds(const void* pVertices, uint32_t vertexCount, uint32_t vertexStride, SceneMesh& mesh)
+	{
+		if (vertexCount == 0 || vertexStride < sizeof(Float3))
+		{
+			return;
+		}
+
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pVertices);
+		Float3 minimum{};
+		Float3 maximum{};
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			Float3 position;
+			std::memcpy(&position, pBytes + static_cast<size_t>(v) * vertexStride, sizeof(position));
+			minimum = v == 0 ? position : Min(minimum, position);
+			maximum = v == 0 ? position : Max(maximum, position);
+		}
+
+		mesh.boundsCenter[0] = (minimum.x + maximum.x) * 0.5f;
+		mesh.boundsCenter[1] = (minimum.y + maximum.y) * 0.5f;
+		mesh.boundsCenter[2] = (minimum.z + maximum.z) * 0.5f;
+
+		float radiusSquared = 0.0f;
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			Float3 position;
+			std::memcpy(&position, pBytes + static_cast<size_t>(v) * vertexStride, sizeof(position));
+			const Float3 OFFSET = position - Float3{ mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2] };
+			radiusSquared = std::max(radiusSquared, Dot(OFFSET, OFFSET));
+		}
+		mesh.boundsRadius = std::sqrt(radiusSquared);
+	}
+}
+
+// =================================================================================================================================================================
+// Scene file.
+
+SceneFile::SceneFile() :
+	m_pSections{},
+	m_sectionSizes{},
+	m_sectionCounts{}
+{}
+
+void SceneFile::Open(const std::string& filename)
+{
+	Close();
+	m_file.Open(filename);
+
+	const uint8_t* pBase = m_file.Data();
+	const uint64_t FILE_SIZE = m_file.Size();
+
+	SceneFileHeader header{};
+	if (FILE_SIZE >= sizeof(header))
+	{
+		std::memcpy(&header, pBase, sizeof(header));
+	}
+
+	if (header.magic != SCENE_FILE_MAGIC || header.version != SCENE_FILE_VERSION)
+	{
+		Close();
+		throw std::runtime_error("Not a scene file!");
+	}
+
+	if (header.fileSize != FILE_SIZE || header.sectionCount > (FILE_SIZE - sizeof(header)) / sizeof(SceneSection))
+	{
+		Close();
+		throw std::runtime_error("Scene file is truncated!");
+	}
+
+	// The table of contents is all that's read. Each entry is checked, then its offset becomes an address.
+	const SceneSection* pToc = reinterpret_cast<const SceneSection*>(pBase + sizeof(header));
+	for (uint32_t i = 0; i < header.sectionCount; i++)
+	{
+		const SceneSection& SECTION = pToc[i];
+
+		// Sections this build doesn't know about are skipped, so new ones can be added without a version bump.
+		if (SECTION.type >= static_cast<uint32_t>(SceneSectionType::Count))
+		{
+			continue;
+		}
+
+		const bool IN_BOUNDS = SECTION.offset <= FILE_SIZE && SECTION.size <= FILE_SIZE - SECTION.offset;
+		const bool ALIGNED = SECTION.offset % SCENE_SECTION_ALIGNMENT == 0;
+		const bool SIZED = SECTION.elementSize == ELEMENT_SIZES[SECTION.type] && SECTION.size == SECTION.count * SECTION.elementSize;
+		if (!IN_BOUNDS || !ALIGNED || !SIZED || SECTION.count > UINT32_MAX || m_pSections[SECTION.type] != nullptr)
+		{
+			Close();
+			throw std::runtime_error("Scene file has a bad section!");
+		}
+
+		m_pSections[SECTION.type] = pBase + SECTION.offset;
+		m_sectionSizes[SECTION.type] = SECTION.size;
+		m_sectionCounts[SECTION.type] = SECTION.count;
+	}
+
+	try
+	{
+		ValidateRecords();
+	}
+	catch (...)
+	{
+		Close();
+		throw;
+	}
+}
+
+void SceneFile::ValidateRecords() const
+{
+	// Only what would otherwise be read out of bounds. A linear pass over small records, then over the indices.
+	const uint64_t STRINGS = m_sectionSizes[Index(SceneSectionType::Strings)];
+	if (STRINGS > 0 && m_pSections[Index(SceneSectionType::Strings)][STRINGS - 1] != '\0')
+	{
+		throw std::runtime_error("Scene file strings aren't terminated!");
+	}
+
+	const SceneMesh* pMeshes = Meshes();
+	for (uint32_t i = 0; i < MeshCount(); i++)
+	{
+		const SceneMesh& MESH = pMeshes[i];
+		const uint64_t VERTEX_BYTES = static_cast<uint64_t>(MESH.vertexCount) * MESH.vertexStride;
+		const uint64_t INDEX_BYTES = static_cast<uint64_t>(MESH.indexCount) * sizeof(uint32_t);
+
+		if (MESH.vertexOffset > VertexDataSize() || VERTEX_BYTES > VertexDataSize() - MESH.vertexOffset
+			|| MESH.indexOffset % sizeof(uint32_t) != 0 || MESH.indexOffset > m_sectionSizes[Index(SceneSectionType::Indices)]
+			|| INDEX_BYTES > m_sectionSizes[Index(SceneSectionType::Indices)] - MESH.indexOffset
+			|| (MESH.name != SCENE_NO_INDEX && MESH.name >= STRINGS)
+			|| MESH.firstLod > LodCount() || MESH.lodCount > LodCount() - MESH.firstLod)
+		{
+			throw std::runtime_error("Scene file mesh is out of bounds!");
+		}
+
+		if (MESH.vertexFormat > static_cast<uint32_t>(SceneVertexFormat::Quantized)
+			|| (MESH.vertexFormat == static_cast<uint32_t>(SceneVertexFormat::Quantized) && MESH.vertexStride != sizeof(QuantizedVertex))
+			|| (MESH.vertexFormat == static_cast<uint32_t>(SceneVertexFormat::Raw) && MESH.vertexStride < 3 * sizeof(float)))
+		{
+			throw std::runtime_error("Scene file mesh has an unknown vertex format!");
+		}
+
+		if (MESH.firstMeshlet > MeshletCount() || MESH.meshletCount > MeshletCount() - MESH.firstMeshlet)
+		{
+			throw std::runtime_error("Scene file mesh meshlets are out of bounds!");
+		}
+	}
+
+	// Only the ranges. What's in them is bulk data, like the index section, and isn't read here.
+	const SceneMeshlet* pMeshlets = Meshlets();
+	for (uint32_t i = 0; i < MeshletCount(); i++)
+	{
+		const SceneMeshlet& MESHLET = pMeshlets[i];
+		if (MESHLET.vertexCount > MESHLET_MAX_VERTICES || MESHLET.triangleCount > MESHLET_MAX_TRIANGLES
+			|| MESHLET.vertexOffset > MeshletVertexCount() || MESHLET.vertexCount > MeshletVertexCount() - MESHLET.vertexOffset
+			|| MESHLET.triangleOffset > MeshletTriangleCount() || MESHLET.triangleCount > MeshletTriangleCount() - MESHLET.triangleOffset
+			|| MESHLET.firstIndex > IndexCount() || static_cast<uint64_t>(MESHLET.triangleCount) * 3 > IndexCount() - MESHLET.firstIndex)
+		{
+			throw std::runtime_error("Scene file meshlet is out of bounds!");
+		}
+	}
+
+	const SceneLod* pLods = Lods();
+	for (uint32_t i = 0; i < LodCount(); i++)
+	{
+		const SceneLod& LOD = pLods[i];
+		if (LOD.indexOffset % sizeof(uint32_t) != 0 || LOD.indexOffset > m_sectionSizes[Index(SceneSectionType::Indices)]
+			|| static_cast<uint64_t>(LOD.indexCount) * sizeof(uint32_t) > m_sectionSizes[Index(SceneSectionType::Indices)] - LOD.indexOffset)
+		{
+			throw std::runtime_error("Scene file LOD is out of bounds!");
+		}
+	}
+
+	/*
+		Every range above is in bounds, now what's in them. Indices are relative to their mesh's first vertex, so one
+		past its vertex count would have the GPU fetch another mesh's vertices or read past the buffer. This is the
+		only pass over bulk data, the index sections are a fraction of the vertex data and are read once.
+	*/
+	const auto INDICES_IN_RANGE = [](const uint32_t* pIndices, uint64_t count, uint32_t vertexCount)
+	{
+		return std::all_of(pIndices, pIndices + count, [vertexCount](uint32_t index) { return index < vertexCount; });
+	};
+
+	for (uint32_t i = 0; i < MeshCount(); i++)
+	{
+		const SceneMesh& MESH = pMeshes[i];
+		bool valid = INDICES_IN_RANGE(Indices() + MESH.indexOffset / sizeof(uint32_t), MESH.indexCount, MESH.vertexCount);
+
+		for (uint32_t lod = MESH.firstLod; valid && lod < MESH.firstLod + MESH.lodCount; lod++)
+		{
+			valid = INDICES_IN_RANGE(Indices() + pLods[lod].indexOffset / sizeof(uint32_t), pLods[lod].indexCount, MESH.vertexCount);
+		}
+
+		for (uint32_t meshlet = MESH.firstMeshlet; valid && meshlet < MESH.firstMeshlet + MESH.meshletCount; meshlet++)
+		{
+			const SceneMeshlet& MESHLET = pMeshlets[meshlet];
+			valid = INDICES_IN_RANGE(MeshletVertices() + MESHLET.vertexOffset, MESHLET.vertexCount, MESH.vertexCount)
+				&& INDICES_IN_RANGE(Indices() + MESHLET.firstIndex, static_cast<uint64_t>(MESHLET.triangleCount) * 3, MESH.vertexCount);
+
+			// Each packs three 8 bit indices into the meshlet's own vertices.
+			const uint32_t* pTriangles = MeshletTriangles() + MESHLET.triangleOffset;
+			for (uint32_t triangle = 0; valid && triangle < MESHLET.triangleCount; triangle++)
+			{
+				valid = (pTriangles[triangle] & 0xFF) < MESHLET.vertexCount && ((pTriangles[triangle] >> 8) & 0xFF) < MESHLET.vertexCount
+					&& ((pTriangles[triangle] >> 16) & 0xFF) < MESHLET.vertexCount;
+			}
+		}
+
+		if (!valid)
+		{
+			throw std::runtime_error("Scene file mesh indexes past its vertices!");
+		}
+	}
+
+	const SceneNode* pNodes = Nodes();
+	for (uint32_t i = 0; i < NodeCount(); i++)
+	{
+		const SceneNode& NODE = pNodes[i];
+		if ((NODE.parent != SCENE_NO_INDEX && NODE.parent >= i)
+			|| (NODE.mesh != SCENE_NO_INDEX && NODE.mesh >= MeshCount())
+			|| (NODE.name != SCENE_NO_INDEX && NODE.name >= STRINGS))
+		{
+			throw std::runtime_error("Scene file node is out of bounds!");
+		}
+	}
+}
+
+void SceneFile::Close()
+{
+	m_file.Close();
+
+	for (size_t i = 0; i < static_cast<size_t>(SceneSectionType::Count); i++)
+	{
+		m_pSections[i] = nullptr;
+		m_sectionSizes[i] = 0;
+		m_sectionCounts[i] = 0;
+	}
+}
+
+const char* SceneFile::GetString(uint32_t offset) const
+{
+	if (offset == SCENE_NO_INDEX)
+	{
+		return "";
+	}
+
+	return reinterpret_cast<const char*>(m_pSections[Index(SceneSectionType::Strings)]) + offset;
+}
+
+void SceneFile::PrefetchGeometry() const
+{
+	const SceneSectionType GEOMETRY[] = { SceneSectionType::Vertices, SceneSectionType::Indices };
+	for (SceneSectionType type : GEOMETRY)
+	{
+		if (m_pSections[Index(type)] != nullptr)
+		{
+			m_file.Prefetch(static_cast<size_t>(m_pSections[Index(type)] - m_file.Data()), static_cast<size_t>(m_sectionSizes[Index(type)]));
+		}
+	}
+}
+
+// =================================================================================================================================================================
+// Scene builder.
+
+uint32_t SceneBuilder::AddMesh(const std::string& name, const void* pVertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<uint32_t>& indices, uint32_t lodLevels)
+{
+	return AddMeshData(name, { pVertices, vertexCount, vertexStride }, indices, lodLevels, SceneVertexFormat::Raw);
+}
+
+uint32_t SceneBuilder::AddMesh(const std::string& name, const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t lodLevels)
+{
+	return AddMeshData(name, { vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(MeshVertex) }, indices, lodLevels, SceneVertexFormat::Quantized);
+}
+
+uint32_t SceneBuilder::AddMeshData(const std::string& name, const MeshView& source, const std::vector<uint32_t>& indices, uint32_t lodLevels, SceneVertexFormat format)
+{
+	if (source.vertexStride == 0)
+	{
+		throw std::runtime_error("Scene mesh needs a vertex stride!");
+	}
+
+	for (uint32_t index : indices)
+	{
+		if (index >= source.vertexCount)
+		{
+			throw std::runtime_error("Scene mesh index is out of range!");
+		}
+	}
+
+	// Every level indexes the same vertices, so the LODs only add indices.
+	std::vector<MeshLodLevel> levels = GenerateLodChain(source, indices, std::max(lodLevels, 1u), MIN_LOD_TRIANGLES);
+
+	// Each level in cache order, then cut up and sorted for overdraw, which only costs a little of the cache gain.
+	SceneMeshReport report{};
+	report.before = AnalyzeVertexCache(levels[0].indices, source.vertexCount);
+	for (MeshLodLevel& level : levels)
+	{
+		OptimizeVertexCache(level.indices, source.vertexCount);
+		OptimizeOverdraw(level.indices, source, OVERDRAW_THRESHOLD);
+	}
+
+	// The full mesh uses every vertex any coarser level does, so its order decides the vertex layout for all of them.
+	std::vector<uint32_t> vRemap;
+	const uint32_t USED_VERTICES = OptimizeVertexFetchRemap(levels[0].indices, source.vertexCount, vRemap);
+	std::vector<uint8_t> vertices = RemapVertices(source, vRemap, USED_VERTICES);
+	for (MeshLodLevel& level : levels)
+	{
+		RemapIndices(level.indices, vRemap);
+	}
+	report.after = AnalyzeVertexCache(levels[0].indices, USED_VERTICES);
+
+	// Meshlets follow the final order of the full mesh, and take their bounds from the vertices before any quantisation.
+	const MeshletSet MESHLETS = BuildMeshlets(levels[0].indices, USED_VERTICES);
+	const MeshView REMAPPED = { vertices.data(), USED_VERTICES, source.vertexStride };
+
+	SceneMesh mesh{};
+	mesh.vertexFormat = static_cast<uint32_t>(format);
+	mesh.vertexStride = source.vertexStride;
+
+	// Last of all, nothing before it should see the rounding.
+	if (format == SceneVertexFormat::Quantized)
+	{
+		const MeshVertex* pFull = reinterpret_cast<const MeshVertex*>(vertices.data());
+		const VertexQuantization QUANTIZATION = ComputeQuantization(pFull, USED_VERTICES);
+		const std::vector<QuantizedVertex> QUANTIZED = QuantizeVertices(pFull, USED_VERTICES, QUANTIZATION);
+
+		std::copy(std::begin(QUANTIZATION.offset), std::end(QUANTIZATION.offset), mesh.positionOffset);
+		std::copy(std::begin(QUANTIZATION.scale), std::end(QUANTIZATION.scale), mesh.positionScale);
+		mesh.vertexStride = sizeof(QuantizedVertex);
+
+		// Bounds come from the full precision positions, which the quantised ones stay inside.
+		ComputeBounds(pFull, USED_VERTICES, sizeof(MeshVertex), mesh);
+
+		const uint8_t* pQuantized = reinterpret_cast<const uint8_t*>(QUANTIZED.data());
+		vertices.assign(pQuantized, pQuantized + QUANTIZED.size() * sizeof(QuantizedVertex));
+	}
+	else
+	{
+		ComputeBounds(vertices.data(), USED_VERTICES, source.vertexStride, mesh);
+	}
+
+	// Each mesh starts on a whole vertex, so it can be drawn from a shared buffer with a vertex offset.
+	m_vVertices.resize(AlignUp(m_vVertices.size(), mesh.vertexStride), 0);
+
+	mesh.vertexOffset = m_vVertices.size();
+	mesh.indexOffset = m_vIndices.size() * sizeof(uint32_t);
+	mesh.vertexCount = USED_VERTICES;
+	mesh.indexCount = static_cast<uint32_t>(levels[0].indices.size());
+	mesh.name = AddString(name);
+
+	mesh.firstMeshlet = static_cast<uint32_t>(m_vMeshlets.size());
+	mesh.meshletCount = static_cast<uint32_t>(MESHLETS.vMeshlets.size());
+	const uint32_t FIRST_INDEX = static_cast<uint32_t>(m_vIndices.size());
+	for (const Meshlet& MESHLET : MESHLETS.vMeshlets)
+	{
+		const MeshletBounds BOUNDS = ComputeMeshletBounds(MESHLETS, MESHLET, REMAPPED);
+
+		SceneMeshlet meshlet{};
+		meshlet.center[0] = BOUNDS.center.x;
+		meshlet.center[1] = BOUNDS.center.y;
+		meshlet.center[2] = BOUNDS.center.z;
+		meshlet.radius = BOUNDS.radius;
+		meshlet.coneApex[0] = BOUNDS.coneApex.x;
+		meshlet.coneApex[1] = BOUNDS.coneApex.y;
+		meshlet.coneApex[2] = BOUNDS.coneApex.z;
+		meshlet.coneCutoff = BOUNDS.coneCutoff;
+		meshlet.coneAxis[0] = BOUNDS.coneAxis.x;
+		meshlet.coneAxis[1] = BOUNDS.coneAxis.y;
+		meshlet.coneAxis[2] = BOUNDS.coneAxis.z;
+		meshlet.vertexCount = MESHLET.vertexCount;
+		meshlet.vertexOffset = static_cast<uint32_t>(m_vMeshletVertices.size()) + MESHLET.vertexOffset;
+		meshlet.triangleOffset = static_cast<uint32_t>(m_vMeshletTriangles.size()) + MESHLET.triangleOffset;
+		meshlet.triangleCount = MESHLET.triangleCount;
+		meshlet.firstIndex = FIRST_INDEX + MESHLET.triangleOffset * 3;	// The full mesh's indices are written first, below.
+		m_vMeshlets.push_back(meshlet);
+	}
+	m_vMeshletVertices.insert(m_vMeshletVertices.end(), MESHLETS.vVertices.begin(), MESHLETS.vVertices.end());
+	m_vMeshletTriangles.insert(m_vMeshletTriangles.end(), MESHLETS.vTriangles.begin(), MESHLETS.vTriangles.end());
+
+	mesh.firstLod = static_cast<uint32_t>(m_vLods.size());
+	mesh.lodCount = static_cast<uint32_t>(levels.size());
+	for (const MeshLodLevel& LEVEL : levels)
+	{
+		m_vLods.push_back({ m_vIndices.size() * sizeof(uint32_t), static_cast<uint32_t>(LEVEL.indices.size()), LEVEL.error });
+		m_vIndices.insert(m_vIndices.end(), LEVEL.indices.begin(), LEVEL.indices.end());
+	}
+
+	m_vVertices.insert(m_vVertices.end(), vertices.begin(), vertices.end());
+	m_vReports.push_back(report);
+	m_vMeshes.push_back(mesh);
+
+	return static_cast<uint32_t>(m_vMeshes.size() - 1);
+}
+
+uint32_t SceneBuilder::AddNode(const std::string& name, uint32_t parent, const Float4x4& local, uint32_t mesh, uint32_t material)
+{
+	const uint32_t NODE = static_cast<uint32_t>(m_vNodes.size());
+	if ((parent != SCENE_NO_INDEX && parent >= NODE) || (mesh != SCENE_NO_INDEX && mesh >= m_vMeshes.size()))
+	{
+		throw std::runtime_error("Scene node refers to something not added yet!");
+	}
+
+	SceneNode node{};
+	node.local = local;
+	node.parent = parent;
+	node.mesh = mesh;
+	node.material = material;
+	node.name = AddString(name);
+	m_vNodes.push_back(node);
+
+	return NODE;
+}
+
+uint32_t SceneBuilder::AddString(const std::string& text)
+{
+	if (text.empty())
+	{
+		return SCENE_NO_INDEX;
+	}
+
+	const uint32_t OFFSET = static_cast<uint32_t>(m_vStrings.size());
+	m_vStrings.insert(m_vStrings.end(), text.begin(), text.end());
+	m_vStrings.push_back('\0');
+	return OFFSET;
+}
+
+void SceneBuilder::Write(const std::string& filename) const
+{
+	struct Payload
+	{
+		SceneSectionType type;
+		const void* pData;
+		uint64_t count;
+	};
+
+	const Payload PAYLOADS[] =
+	{
+		{ SceneSectionType::Meshes, m_vMeshes.data(), m_vMeshes.size() },
+		{ SceneSectionType::Nodes, m_vNodes.data(), m_vNodes.size() },
+		{ SceneSectionType::Vertices, m_vVertices.data(), m_vVertices.size() },
+		{ SceneSectionType::Indices, m_vIndices.data(), m_vIndices.size() },
+		{ SceneSectionType::Strings, m_vStrings.data(), m_vStrings.size() },
+		{ SceneSectionType::Lods, m_vLods.data(), m_vLods.size() },
+		{ SceneSectionType::Meshlets, m_vMeshlets.data(), m_vMeshlets.size() },
+		{ SceneSectionType::MeshletVertices, m_vMeshletVertices.data(), m_vMeshletVertices.size() },
+		{ SceneSectionType::MeshletTriangles, m_vMeshletTriangles.data(), m_vMeshletTriangles.size() }
+	};
+	constexpr uint32_t SECTION_COUNT = static_cast<uint32_t>(std::size(PAYLOADS));
+
+	// Lay the sections out first, the header and table of contents need to know where everything goes.
+	SceneSection toc[SECTION_COUNT]{};
+	uint64_t offset = AlignUp(sizeof(SceneFileHeader) + sizeof(toc), SCENE_SECTION_ALIGNMENT);
+	for (uint32_t i = 0; i < SECTION_COUNT; i++)
+	{
+		const uint32_t TYPE = static_cast<uint32_t>(PAYLOADS[i].type);
+		toc[i].type = TYPE;
+		toc[i].elementSize = ELEMENT_SIZES[TYPE];
+		toc[i].offset = offset;
+		toc[i].count = PAYLOADS[i].count;
+		toc[i].size = PAYLOADS[i].count * ELEMENT_SIZES[TYPE];
+		offset = AlignUp(offset + toc[i].size, SCENE_SECTION_ALIGNMENT);
+	}
+
+	SceneFileHeader header{};
+	header.magic = SCENE_FILE_MAGIC;
+	header.version = SCENE_FILE_VERSION;
+	header.sectionCount = SECTION_COUNT;
+	header.fileSize = offset;
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to create scene file!");
+	}
+
+	const char PADDING[SCENE_SECTION_ALIGNMENT] = {};
+	auto padTo = [&file, &PADDING](uint64_t target)
+	{
+		const uint64_t POSITION = static_cast<uint64_t>(file.tellp());
+		file.write(PADDING, static_cast<std::streamsize>(target - POSITION));
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(toc), sizeof(toc));
+	for (uint32_t i = 0; i < SECTION_COUNT; i++)
+	{
+		padTo(toc[i].offset);
+		file.write(static_cast<const char*>(PAYLOADS[i].pData), static_cast<std::streamsize>(toc[i].size));
+	}
+	padTo(header.fileSize);
+
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write scene file!");
+	}
+}
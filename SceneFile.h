@@ -0,0 +1,237 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Binary scene container, memory mapped and used in place rather than parsed.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MappedFile.h"
+#include "MathTypes.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+	Scene file layout (.vscene), all little endian:
+
+		SceneFileHeader
+		SceneSection[sectionCount]		The table of contents.
+		Sections, each starting on a SCENE_SECTION_ALIGNMENT boundary, zero padded in between.
+
+	Nothing stored is a pointer. Records refer to each other by index and into other sections by byte offset,
+	so the mapping can be used wherever the OS puts it. Opening a file checks the table of contents and turns
+	each section's offset into an address, vertex and index data are already in the layout the GPU reads.
+	Any change to a record's layout bumps the version, old files are rejected rather than converted.
+*/
+enum class SceneSectionType : uint32_t
+{
+	Meshes,				// SceneMesh
+	Nodes,				// SceneNode, parents before children.
+	Vertices,			// Raw vertex data, each mesh's run described by its SceneMesh.
+	Indices,			// uint32_t, relative to the mesh's first vertex.
+	Strings,			// Null terminated names, referred to by byte offset.
+	Lods,				// SceneLod, each mesh's chain together, finest first.
+	Meshlets,			// SceneMeshlet, each mesh's together.
+	MeshletVertices,	// uint32_t, relative to the mesh's first vertex, each meshlet's run together.
+	MeshletTriangles,	// uint32_t, three 8 bit indices into the meshlet's vertices, lowest byte first.
+	Count
+};
+
+// Covers the strictest record alignment, and the offset alignment any buffer copy could want.
+constexpr uint64_t SCENE_SECTION_ALIGNMENT = 256;
+constexpr uint32_t SCENE_NO_INDEX = UINT32_MAX;
+
+struct SceneFileHeader
+{
+	uint32_t magic;				// 'VSCN'
+	uint32_t version;
+	uint32_t sectionCount;
+	uint32_t reserved;
+	uint64_t fileSize;			// A truncated file is caught here, before anything reads past the end.
+	uint64_t reserved2;
+};
+
+struct SceneSection
+{
+	uint32_t type;				// SceneSectionType.
+	uint32_t elementSize;		// Checked against the record this build expects.
+	uint64_t offset;			// From the start of the file.
+	uint64_t size;				// In bytes, elementSize * count.
+	uint64_t count;
+};
+
+enum class SceneVertexFormat : uint32_t
+{
+	Raw,				// As given to the builder, the position the first three floats.
+	Quantized			// QuantizedVertex, positions restored with the mesh's positionOffset and positionScale.
+};
+
+struct SceneMesh
+{
+	uint64_t vertexOffset;		// Bytes into the vertex section.
+	uint64_t indexOffset;		// Bytes into the index section.
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t name;				// Offset into the string section.
+	float boundsCenter[3];
+	float boundsRadius;
+	uint32_t firstLod;			// Into the LOD section. The first is the full mesh, the same range as above.
+	uint32_t lodCount;
+	uint32_t vertexFormat;		// SceneVertexFormat.
+	float positionOffset[3];	// VertexQuantization, unused for raw vertices.
+	float positionScale[3];
+	uint32_t firstMeshlet;		// Into the meshlet section, covering the full mesh.
+	uint32_t meshletCount;
+	uint32_t reserved;
+};
+
+// A simplified version of a mesh: its own indices over the mesh's vertices.
+struct SceneLod
+{
+	uint64_t indexOffset;		// Bytes into the index section.
+	uint32_t indexCount;
+	float error;				// How far the surface may have moved, in model units.
+};
+
+/*
+	A cluster of the full mesh's triangles, culled on its own. Laid out for std430 so the section can be copied
+	straight into a storage buffer. Bounds are in the mesh's space, before any quantisation. The triangles are a run
+	of the mesh's own index list as well as packed, so either the index buffer or the mesh shader path can draw them.
+*/
+struct SceneMeshlet
+{
+	float center[3];
+	float radius;
+	float coneApex[3];
+	float coneCutoff;			// 1 when the cone can't cull, see MeshletBounds.
+	float coneAxis[3];
+	uint32_t vertexCount;
+	uint32_t vertexOffset;		// Elements into the meshlet vertex section.
+	uint32_t triangleOffset;	// Elements into the meshlet triangle section.
+	uint32_t triangleCount;
+	uint32_t firstIndex;		// Elements into the index section.
+};
+
+// Asset build default, the chain stops sooner if a mesh stops simplifying.
+constexpr uint32_t SCENE_MAX_LODS = 8;
+
+struct SceneNode
+{
+	Float4x4 local;
+	uint32_t parent;			// An earlier node, or SCENE_NO_INDEX.
+	uint32_t mesh;				// SCENE_NO_INDEX for a node that only carries a transform.
+	uint32_t material;
+	uint32_t name;
+};
+
+static_assert(sizeof(SceneFileHeader) == 32 && sizeof(SceneSection) == 32, "Scene file header layout changed, bump the version!");
+static_assert(sizeof(SceneMesh) == 96 && sizeof(SceneNode) == 80 && sizeof(SceneLod) == 16, "Scene record layout changed, bump the version!");
+static_assert(sizeof(SceneMeshlet) == 64, "Scene meshlet layout changed, bump the version and update the meshlet shaders!");
+
+class SceneFile
+{
+public:
+
+	SceneFile();
+
+	// Maps the file and validates it. Throws if it isn't a scene file this build understands.
+	void Open(const std::string& filename);
+	void Close();
+
+	_NODISCARD bool IsOpen() const { return m_file.IsOpen(); }
+
+	// Straight into the mapping, valid until Close.
+	_NODISCARD const SceneMesh* Meshes() const { return reinterpret_cast<const SceneMesh*>(m_pSections[Index(SceneSectionType::Meshes)]); }
+	_NODISCARD uint32_t MeshCount() const { return Count(SceneSectionType::Meshes); }
+
+	_NODISCARD const SceneNode* Nodes() const { return reinterpret_cast<const SceneNode*>(m_pSections[Index(SceneSectionType::Nodes)]); }
+	_NODISCARD uint32_t NodeCount() const { return Count(SceneSectionType::Nodes); }
+
+	_NODISCARD const uint8_t* VertexData() const { return m_pSections[Index(SceneSectionType::Vertices)]; }
+	_NODISCARD uint64_t VertexDataSize() const { return m_sectionSizes[Index(SceneSectionType::Vertices)]; }
+
+	_NODISCARD const uint32_t* Indices() const { return reinterpret_cast<const uint32_t*>(m_pSections[Index(SceneSectionType::Indices)]); }
+	_NODISCARD uint32_t IndexCount() const { return Count(SceneSectionType::Indices); }
+
+	_NODISCARD const SceneLod* Lods() const { return reinterpret_cast<const SceneLod*>(m_pSections[Index(SceneSectionType::Lods)]); }
+	_NODISCARD uint32_t LodCount() const { return Count(SceneSectionType::Lods); }
+
+	_NODISCARD const SceneMeshlet* Meshlets() const { return reinterpret_cast<const SceneMeshlet*>(m_pSections[Index(SceneSectionType::Meshlets)]); }
+	_NODISCARD uint32_t MeshletCount() const { return Count(SceneSectionType::Meshlets); }
+
+	_NODISCARD const uint32_t* MeshletVertices() const { return reinterpret_cast<const uint32_t*>(m_pSections[Index(SceneSectionType::MeshletVertices)]); }
+	_NODISCARD uint32_t MeshletVertexCount() const { return Count(SceneSectionType::MeshletVertices); }
+
+	_NODISCARD const uint32_t* MeshletTriangles() const { return reinterpret_cast<const uint32_t*>(m_pSections[Index(SceneSectionType::MeshletTriangles)]); }
+	_NODISCARD uint32_t MeshletTriangleCount() const { return Count(SceneSectionType::MeshletTriangles); }
+
+	_NODISCARD const char* GetString(uint32_t offset) const;
+
+	// Pages the geometry in ahead of copying it out, so the copy doesn't stall on a fault every page.
+	void PrefetchGeometry() const;
+
+private:
+
+	static constexpr size_t Index(SceneSectionType type) { return static_cast<size_t>(type); }
+
+	uint32_t Count(SceneSectionType type) const { return static_cast<uint32_t>(m_sectionCounts[Index(type)]); }
+
+	void ValidateRecords() const;
+
+	MappedFile m_file;
+	const uint8_t* m_pSections[static_cast<size_t>(SceneSectionType::Count)];
+	uint64_t m_sectionSizes[static_cast<size_t>(SceneSectionType::Count)];
+	uint64_t m_sectionCounts[static_cast<size_t>(SceneSectionType::Count)];
+};
+
+// What the optimisation stage did to a mesh's full detail indices.
+struct SceneMeshReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+// Gathers meshes and nodes in memory, then writes them out as a scene file. For tools and tests, not the runtime.
+class SceneBuilder
+{
+public:
+
+	/*
+		Up to lodLevels levels of detail are generated, then every level's triangles are reordered for the vertex
+		cache and overdraw, and the vertices are reordered for fetch and stripped of any the mesh doesn't use. The full
+		mesh is then split into meshlets. Returns the mesh's index. Vertices are stored as they are, raw.
+	*/
+	uint32_t AddMesh(const std::string& name, const void* pVertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<uint32_t>& indices, uint32_t lodLevels = SCENE_MAX_LODS);
+
+	// The same, except the vertices are quantised once everything else is done, so simplification sees full precision.
+	uint32_t AddMesh(const std::string& name, const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices, uint32_t lodLevels = SCENE_MAX_LODS);
+
+	// The parent must already have been added. Returns the node's index.
+	uint32_t AddNode(const std::string& name, uint32_t parent, const Float4x4& local, uint32_t mesh = SCENE_NO_INDEX, uint32_t material = 0);
+
+	void Write(const std::string& filename) const;
+
+	// One per mesh, in the order they were added.
+	_NODISCARD const std::vector<SceneMeshReport>& MeshReports() const { return m_vReports; }
+
+private:
+
+	uint32_t AddString(const std::string& text);
+	uint32_t AddMeshData(const std::string& name, const MeshView& source, const std::vector<uint32_t>& indices, uint32_t lodLevels, SceneVertexFormat format);
+
+	std::vector<SceneMesh> m_vMeshes;
+	std::vector<SceneLod> m_vLods;
+	std::vector<SceneMeshlet> m_vMeshlets;
+	std::vector<uint32_t> m_vMeshletVertices;
+	std::vector<uint32_t> m_vMeshletTriangles;
+	std::vector<SceneNode> m_vNodes;
+	std::vector<uint8_t> m_vVertices;
+	std::vector<uint32_t> m_vIndices;
+	std::vector<char> m_vStrings;
+	std::vector<SceneMeshReport> m_vReports;
+};
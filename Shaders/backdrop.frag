@@ -0,0 +1,37 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+// The backdrop, sampled from the virtual texture. Its feedback is what decides which pages get streamed in.
+// Compiled with DEFERRED for the geometry subpass, where it's written unlit like the triangle. Compiled with STREAMED,
+// it's an ordinary texture from the texture streamer instead, for devices or builds without the virtual texture.
+
+#ifdef STREAMED
+layout(set = 0, binding = 0) uniform sampler2D backdrop;
+#else
+#define VT_SET 0
+#include "virtual_texture.glsl"
+#endif
+
+layout(location = 0) in vec2 fragUv;
+
+#ifdef DEFERRED
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+#else
+layout(location = 0) out vec4 outColor;
+#endif
+
+void main()
+{
+#ifdef STREAMED
+    vec3 color = texture(backdrop, fragUv).rgb;
+#else
+    vec3 color = SampleVirtualTexture(fragUv).rgb;
+#endif
+#ifdef DEFERRED
+    outAlbedo = vec4(color, 1.0);
+    outNormal = vec4(0.0);
+#else
+    outColor = vec4(color, 1.0);
+#endif
+}
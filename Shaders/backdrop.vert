@@ -0,0 +1,13 @@
+#version 450
+
+// A triangle over the whole view just in front of the far plane, so it's only seen where the scene leaves gaps.
+// The uv runs 0 to 1 across the visible part, the rest of the triangle is clipped.
+
+layout(location = 0) out vec2 fragUv;
+
+void main()
+{
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    fragUv = uv;
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.99999, 1.0);
+}
@@ -0,0 +1,143 @@
+// Lights binned into a grid of clusters over the screen, shared by light_cull.comp which fills the lists and the
+// fragment shaders that walk them. Define LIGHT_SET before including, and LIGHT_CULL in the shader that writes.
+//
+// Clusters split the screen into tiles and clip space depth into even slices. With no camera, clip space is the
+// view and depth is linear, so even slices are even in distance too.
+
+// Must match ClusteredLights.h.
+const uint CLUSTERS_X = 16;
+const uint CLUSTERS_Y = 9;
+const uint CLUSTERS_Z = 24;
+const uint CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+const uint MAX_SHADOW_CASCADES = 4;
+
+const uint LIGHT_POINT = 0;
+const uint LIGHT_SPOT = 1;
+
+// Matches GpuLight.
+struct Light
+{
+    vec3 position;
+    float range;            // Nothing is lit past this, it's the bound the light is binned by.
+    vec3 color;             // Premultiplied by intensity.
+    uint type;
+    vec3 direction;         // Spot lights only, normalised.
+    float spotCosOuter;
+    float spotCosInner;
+    float pad0;
+    float pad1;
+    float pad2;
+};
+
+// Written by the CPU for each frame in flight. The sun matches GpuSun.
+layout(set = LIGHT_SET, binding = 0, std430) readonly buffer Lights
+{
+    mat4 worldFromClip;
+    vec2 screenSize;
+    uint lightCount;
+    uint lightsPad;
+    mat4 sunShadowFromWorld[MAX_SHADOW_CASCADES];
+    vec4 sunCascadeEnds;    // Clip space depth each cascade reaches.
+    vec3 sunDirection;      // The way the light travels.
+    uint sunCascadeCount;
+    vec3 sunColor;
+    float sunPad;
+    Light lights[];
+};
+
+// Per cluster, a count then that many light indices. Fixed size, lights past the limit are dropped.
+#ifdef LIGHT_CULL
+layout(set = LIGHT_SET, binding = 1, std430) writeonly buffer Clusters
+#else
+layout(set = LIGHT_SET, binding = 1, std430) readonly buffer Clusters
+#endif
+{
+    uint clusterWords[];
+};
+
+const uint CLUSTER_STRIDE = 1 + MAX_LIGHTS_PER_CLUSTER;
+
+vec3 WorldFromClip(vec3 ndc)
+{
+    vec4 world = worldFromClip * vec4(ndc, 1.0);
+    return world.xyz / world.w;
+}
+
+#ifndef LIGHT_CULL
+// One layer per cascade, see ShadowCascades. Outside a cascade reads as lit.
+layout(set = LIGHT_SET, binding = 2) uniform sampler2DArrayShadow sunShadowMap;
+
+// So nothing is black where no light reaches.
+const vec3 AMBIENT = vec3(0.15);
+
+// The world position under a pixel, from its window coordinates and depth.
+vec3 WorldFromFragment(vec2 fragCoord, float depth)
+{
+    return WorldFromClip(vec3(fragCoord / screenSize * 2.0 - 1.0, depth));
+}
+
+uint ClusterOf(vec4 fragCoord)
+{
+    uvec3 cell = uvec3(fragCoord.xy / screenSize * vec2(CLUSTERS_X, CLUSTERS_Y), fragCoord.z * float(CLUSTERS_Z));
+    cell = min(cell, uvec3(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z) - 1);
+    return (cell.z * CLUSTERS_Y + cell.y) * CLUSTERS_X + cell.x;
+}
+
+// Windowed inverse square, so it reaches zero exactly at the range the light was binned by.
+float Attenuation(float distanceSquared, float range)
+{
+    float ratio = distanceSquared / (range * range);
+    float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+    return window * window / max(distanceSquared, 0.0001);
+}
+
+// Diffuse only, there are no materials yet.
+vec3 ShadeClusterLights(vec4 fragCoord, vec3 position, vec3 normal)
+{
+    uint base = ClusterOf(fragCoord) * CLUSTER_STRIDE;
+    uint count = clusterWords[base];
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < count; i++)
+    {
+        Light light = lights[clusterWords[base + 1 + i]];
+
+        vec3 toLight = light.position - position;
+        float distanceSquared = dot(toLight, toLight);
+        vec3 l = toLight * inversesqrt(max(distanceSquared, 0.0001));
+
+        float intensity = Attenuation(distanceSquared, light.range) * max(dot(normal, l), 0.0);
+        if (light.type == LIGHT_SPOT)
+        {
+            intensity *= smoothstep(light.spotCosOuter, light.spotCosInner, dot(-l, light.direction));
+        }
+
+        result += light.color * intensity;
+    }
+    return result;
+}
+
+// The nearest cascade that reaches the fragment's depth. Comparison and linear filtering soften the edge a little.
+float SunShadow(vec3 position, float depth)
+{
+    uint cascade = 0;
+    while (cascade + 1 < sunCascadeCount && depth > sunCascadeEnds[cascade])
+    {
+        cascade++;
+    }
+
+    vec4 shadowPosition = sunShadowFromWorld[cascade] * vec4(position, 1.0);
+    return texture(sunShadowMap, vec4(shadowPosition.xy * 0.5 + 0.5, float(cascade), shadowPosition.z));
+}
+
+vec3 ShadeSun(vec3 position, vec3 normal, float depth)
+{
+    float facing = max(dot(normal, -sunDirection), 0.0);
+    if (facing == 0.0 || sunColor == vec3(0.0))
+    {
+        return vec3(0.0);
+    }
+    return sunColor * facing * SunShadow(position, depth);
+}
+#endif
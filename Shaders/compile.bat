@@ -1,3 +1,31 @@
 C:/VulkanSDK/1.2.198.1/Bin/glslc.exe shader.vert -o vert.spv
 C:/VulkanSDK/1.2.198.1/Bin/glslc.exe shader.frag -o frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DFORMAT_RGBA8 mipgen.comp -o mipgen_rgba8.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DFORMAT_RGBA16F mipgen.comp -o mipgen_rgba16f.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DFORMAT_RGBA32F mipgen.comp -o mipgen_rgba32f.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe mesh.vert -o mesh_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe meshlet_cull.comp -o meshlet_cull.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe meshlet.vert -o meshlet_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe --target-env=vulkan1.2 meshlet.mesh -o meshlet_mesh.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe depth_pyramid.comp -o depth_pyramid.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe light_cull.comp -o light_cull.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe lit.frag -o lit_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DLIGHT_SET=1 lit.frag -o lit_meshlet_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe gbuffer.frag -o gbuffer_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DUNLIT gbuffer.frag -o gbuffer_unlit_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe fullscreen.vert -o fullscreen_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe deferred_light.frag -o deferred_light_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe shadow.vert -o shadow_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe upscale.frag -o upscale_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DFUSED post_process.comp -o post_fused.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTAGE_TONEMAP post_process.comp -o post_tonemap.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTAGE_GRADE post_process.comp -o post_grade.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTAGE_SHARPEN post_process.comp -o post_sharpen.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTAGE_VIGNETTE post_process.comp -o post_vignette.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTAGE_GRAIN post_process.comp -o post_grain.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe backdrop.vert -o backdrop_vert.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe backdrop.frag -o backdrop_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DDEFERRED backdrop.frag -o backdrop_gbuffer_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTREAMED backdrop.frag -o backdrop_streamed_frag.spv
+C:/VulkanSDK/1.2.198.1/Bin/glslc.exe -DSTREAMED -DDEFERRED backdrop.frag -o backdrop_streamed_gbuffer_frag.spv
 pause
\ No newline at end of file
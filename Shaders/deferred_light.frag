@@ -0,0 +1,42 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+// The lighting subpass of deferred shading. Each pixel reads back what the geometry subpass left at the same pixel,
+// so the G-buffer never has to leave tile memory, and is lit once from its cluster's lights however many
+// triangles were drawn over it.
+
+#define LIGHT_SET 1
+#include "clustered_lights.glsl"
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput normalInput;
+layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput depthInput;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    vec4 albedo = subpassLoad(albedoInput);
+
+    // Nothing drawn here this pass. With occlusion culling the pass is split in two, and each keeps what the
+    // other wrote.
+    if (albedo.a == 0.0)
+    {
+        discard;
+    }
+
+    vec4 normal = subpassLoad(normalInput);
+    if (normal.w == 0.0)
+    {
+        outColor = vec4(albedo.rgb, 1.0);
+        return;
+    }
+
+    float depth = subpassLoad(depthInput).r;
+    vec3 position = WorldFromFragment(gl_FragCoord.xy, depth);
+    vec4 fragCoord = vec4(gl_FragCoord.xy, depth, 1.0);
+
+    vec3 n = normalize(normal.xyz);
+    vec3 light = AMBIENT + ShadeSun(position, n, depth) + ShadeClusterLights(fragCoord, position, n);
+    outColor = vec4(albedo.rgb * light, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 450
+
+// The geometry subpass of deferred shading, see deferred_light.frag. Compiled with UNLIT for the triangle, which
+// has no normal and is shown as it is.
+
+layout(location = 0) in vec3 fragColor;
+#ifndef UNLIT
+layout(location = 1) in vec3 fragNormal;
+#endif
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+
+void main()
+{
+    // Alpha marks the pixel as drawn, the clear leaves it zero.
+    outAlbedo = vec4(fragColor, 1.0);
+#ifdef UNLIT
+    outNormal = vec4(0.0);
+#else
+    outNormal = vec4(normalize(fragNormal), 1.0);
+#endif
+}
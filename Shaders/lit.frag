@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+// Scene meshes lit by whichever lights were binned into the fragment's cluster. The light set is 0 for meshes and
+// 1 for meshlets, whose set 0 is the culler's, so this is compiled once for each, see compile.bat.
+
+#ifndef LIGHT_SET
+#define LIGHT_SET 0
+#endif
+
+#include "clustered_lights.glsl"
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // Reconstructed rather than interpolated, mesh.vert has no room left in its push constants for the dequantisation.
+    vec3 position = WorldFromFragment(gl_FragCoord.xy, gl_FragCoord.z);
+    vec3 normal = normalize(fragNormal);
+
+    vec3 light = AMBIENT + ShadeSun(position, normal, gl_FragCoord.z) + ShadeClusterLights(gl_FragCoord, position, normal);
+    outColor = vec4(fragColor * light, 1.0);
+}
@@ -0,0 +1,44 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+
+// Must match QUANTIZED_VERTEX_LAYOUT in VertexFormat.h. The formats do the unpacking to floats.
+layout(location = 0) in vec4 inPosition;	// R16G16B16A16_UNORM: xyz within the mesh's bounds, w the bitangent sign.
+layout(location = 1) in vec2 inNormal;		// R16G16_SNORM, octahedral.
+layout(location = 2) in vec2 inTangent;		// R16G16_SNORM, octahedral.
+layout(location = 3) in vec2 inUv;			// R16G16_SFLOAT.
+
+// The mesh's dequantisation is folded into clipFromVertex, so positions go straight from 0..1 to clip space.
+layout(push_constant) uniform MeshConstants
+{
+    mat4 clipFromVertex;
+    mat4 world;
+} constants;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+
+vec3 OctahedralDecode(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-direction.z, 0.0);
+    direction.x += direction.x >= 0.0 ? -fold : fold;
+    direction.y += direction.y >= 0.0 ? -fold : fold;
+    return normalize(direction);
+}
+
+void main() 
+{
+    gl_Position = constants.clipFromVertex * vec4(inPosition.xyz, 1.0);
+
+    // Scaling is assumed uniform, as it is everywhere else the world matrix is used.
+    vec3 normal = normalize(mat3(constants.world) * OctahedralDecode(inNormal));
+    vec3 tangent = normalize(mat3(constants.world) * OctahedralDecode(inTangent));
+    float handedness = inPosition.w * 2.0 - 1.0;
+
+    // No materials yet. The normal as a colour shows the shape, a uv checker shows the mapping survived, and
+    // the tangent frame shades the checker so a broken one stands out.
+    float checker = mod(floor(inUv.x * 8.0) + floor(inUv.y * 8.0), 2.0);
+    float frame = dot(cross(normal, tangent) * handedness, normalize(vec3(1.0))) * 0.5 + 0.5;
+    fragColor = (normal * 0.5 + 0.5) * mix(0.8, 1.0, checker * frame);
+    fragNormal = normal;
+}
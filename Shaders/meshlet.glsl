@@ -0,0 +1,59 @@
+// Meshlet culling and drawing, shared by meshlet_cull.comp, meshlet.vert and meshlet.mesh.
+// Matches MeshletCuller.cpp: one descriptor set for all three, some bindings only used by some stages.
+
+struct Meshlet
+{
+    vec3 center;            // Bounds in the mesh's space, before quantisation.
+    float radius;
+    vec3 coneApex;
+    float coneCutoff;       // 1 when the cone can't cull.
+    vec3 coneAxis;
+    uint vertexCount;
+    uint vertexOffset;      // Into meshletVertices.
+    uint triangleOffset;    // Into meshletTriangles.
+    uint triangleCount;
+    uint firstIndex;        // Into the scene index buffer.
+};
+
+// One meshlet of one instance. A draw's slot is its index, in the commands and as the instance index it's drawn with.
+struct MeshletDraw
+{
+    uint meshlet;
+    uint instance;
+    uint mesh;
+    uint previous;          // Its slot in the list last culled, where its visibility was kept, or NO_PREVIOUS_SLOT.
+};
+
+const uint NO_PREVIOUS_SLOT = 0xFFFFFFFFu;
+
+struct MeshInfo
+{
+    vec3 positionOffset;    // Dequantisation, see VertexQuantization.
+    int vertexOffset;       // In vertices, into the scene vertex buffer.
+    vec3 positionScale;
+    uint pad;
+};
+
+layout(set = 0, binding = 0, std430) readonly buffer Instances { mat4 instances[]; };
+layout(set = 0, binding = 1, std430) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(set = 0, binding = 2, std430) readonly buffer Draws { MeshletDraw draws[]; };
+layout(set = 0, binding = 3, std430) readonly buffer Meshes { MeshInfo meshes[]; };
+
+vec3 OctahedralDecode(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-direction.z, 0.0);
+    direction.x += direction.x >= 0.0 ? -fold : fold;
+    direction.y += direction.y >= 0.0 ? -fold : fold;
+    return normalize(direction);
+}
+
+// Same debug colouring as mesh.vert, so the two paths can be told apart only by what they cull.
+vec3 DebugColor(mat4 world, vec3 normal, vec3 tangent, float handedness, vec2 uv)
+{
+    normal = normalize(mat3(world) * normal);
+    tangent = normalize(mat3(world) * tangent);
+    float checker = mod(floor(uv.x * 8.0) + floor(uv.y * 8.0), 2.0);
+    float frame = dot(cross(normal, tangent) * handedness, normalize(vec3(1.0))) * 0.5 + 0.5;
+    return (normal * 0.5 + 0.5) * mix(0.8, 1.0, checker * frame);
+}
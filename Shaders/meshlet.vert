@@ -0,0 +1,35 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+// Meshlets drawn through the vertex pipeline, one indirect draw each. The draw's slot comes in as the instance
+// index, which is how the world matrix and dequantisation are found without per draw push constants.
+
+#include "meshlet.glsl"
+
+// Must match QUANTIZED_VERTEX_LAYOUT in VertexFormat.h, the same as mesh.vert.
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTangent;
+layout(location = 3) in vec2 inUv;
+
+layout(push_constant) uniform DrawConstants
+{
+    mat4 viewProjection;
+} constants;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+
+void main()
+{
+    MeshletDraw draw = draws[gl_InstanceIndex];
+    MeshInfo mesh = meshes[draw.mesh];
+    mat4 world = instances[draw.instance];
+
+    vec3 position = mesh.positionOffset + mesh.positionScale * inPosition.xyz;
+    gl_Position = constants.viewProjection * world * vec4(position, 1.0);
+
+    vec3 normal = OctahedralDecode(inNormal);
+    fragColor = DebugColor(world, normal, OctahedralDecode(inTangent), inPosition.w * 2.0 - 1.0, inUv);
+    fragNormal = normalize(mat3(world) * normal);
+}
@@ -0,0 +1,73 @@
+// Post-processing effects, shared by the fused dispatch and the chain of one dispatch per effect it's measured
+// against. Applied in order: tonemap, grade, sharpen, vignette, then grain on the sRGB encoded result.
+
+// Must match PostPushConstants in PostProcess.cpp.
+layout(push_constant) uniform PostConstants
+{
+    vec4 tint;              // Multiplies the tonemapped colour, w unused.
+    ivec2 renderSize;       // Pixels drawn this frame, from the top left of every image.
+    uint frame;             // Reseeds the grain every frame.
+    float exposure;         // Scales scene colour before tonemapping.
+    float contrast;         // Power around mid grey, 1 leaves it alone.
+    float saturation;       // 0 is greyscale, 1 leaves it alone.
+    float vignette;         // How much darker the corners get.
+    float grain;            // Noise amplitude in encoded values.
+    float sharpen;          // 0 leaves it alone, 1 is a full unsharp mask.
+} constants;
+
+const vec3 LUMA = vec3(0.2126, 0.7152, 0.0722);
+
+// Narkowicz's fit of the ACES filmic curve, HDR in, display linear out.
+vec3 Tonemap(vec3 hdr)
+{
+    const vec3 X = max(hdr, vec3(0.0)) * constants.exposure;
+    return clamp((X * (2.51 * X + 0.03)) / (X * (2.43 * X + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 Grade(vec3 color)
+{
+    color *= constants.tint.rgb;
+    color = 0.18 * pow(max(color, vec3(0.0)) / 0.18, vec3(constants.contrast));
+    color = mix(vec3(dot(color, LUMA)), color, constants.saturation);
+    return clamp(color, 0.0, 1.0);
+}
+
+// An unsharp mask over the four neighbours, held within their range so hard edges don't ring.
+vec3 Sharpen(vec3 centre, vec3 north, vec3 south, vec3 east, vec3 west)
+{
+    const vec3 LOWEST = min(centre, min(min(north, south), min(east, west)));
+    const vec3 HIGHEST = max(centre, max(max(north, south), max(east, west)));
+    const vec3 SHARPENED = centre + constants.sharpen * (centre - 0.25 * (north + south + east + west));
+    return clamp(SHARPENED, LOWEST, HIGHEST);
+}
+
+vec3 Vignette(vec3 color, ivec2 pixel)
+{
+    const vec2 OFFSET = (vec2(pixel) + 0.5) / vec2(constants.renderSize) - 0.5;
+    return color * (1.0 - constants.vignette * smoothstep(0.0, 1.0, 2.0 * dot(OFFSET, OFFSET)));
+}
+
+vec3 EncodeSrgb(vec3 color)
+{
+    const vec3 LOW = color * 12.92;
+    const vec3 HIGH = 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055;
+    return mix(HIGH, LOW, lessThanEqual(color, vec3(0.0031308)));
+}
+
+// Integer hash, so the noise doesn't repeat or band the way sin based ones do at large pixel coordinates.
+float Noise(ivec2 pixel)
+{
+    uint h = uint(pixel.x) * 0x8da6b343u ^ uint(pixel.y) * 0xd8163841u ^ constants.frame * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return float(h) * (1.0 / 4294967296.0) - 0.5;
+}
+
+// Added after encoding, so it's as visible in the shadows as in the highlights. The result is what's stored.
+vec4 GrainAndEncode(vec3 color, ivec2 pixel)
+{
+    return vec4(clamp(EncodeSrgb(color) + constants.grain * Noise(pixel), 0.0, 1.0), 1.0);
+}
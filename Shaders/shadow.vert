@@ -0,0 +1,17 @@
+#version 450
+
+// Depth only, for the sun's shadow cascades. Only the position is read, see ShadowCascades.
+
+// Must match QUANTIZED_VERTEX_LAYOUT in VertexFormat.h.
+layout(location = 0) in vec4 inPosition;    // R16G16B16A16_UNORM: xyz within the mesh's bounds.
+
+// The mesh's dequantisation is folded in, as in mesh.vert.
+layout(push_constant) uniform ShadowConstants
+{
+    mat4 clipFromVertex;
+} constants;
+
+void main()
+{
+    gl_Position = constants.clipFromVertex * vec4(inPosition.xyz, 1.0);
+}
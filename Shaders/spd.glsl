@@ -0,0 +1,152 @@
+// Single pass downsampler, shared by mipgen.comp and depth_pyramid.comp.
+// Each workgroup reduces a 64x64 tile of the source down to a single texel, writing up to six mips on the way.
+// The last workgroup to finish then reduces the (at most 64x64) sixth mip the same way, producing up to six more.
+//
+// Before including, define:
+//   SPD_TYPE                  float or vec4, what Reduce works on.
+//   SPD_SOURCE_SIZE           Size of the source, which is mip -1.
+//   SPD_COUNTER               The uint in a coherent buffer counting finished workgroups, zero between dispatches.
+//   dstMips[MAX_MIPS]         The coherent storage images written.
+//   params                    With uint mipCount, the mips to write, and uint workgroupCount.
+//   SPD_TYPE LoadSource(ivec2 p)
+//   SPD_TYPE Reduce(SPD_TYPE a, SPD_TYPE b, SPD_TYPE c, SPD_TYPE d)
+
+layout(local_size_x = 256) in;
+
+shared SPD_TYPE tile[16 * 16];
+shared bool isLastWorkgroup;
+
+// Storage image arrays can only be indexed with constants without the dynamic indexing feature.
+SPD_TYPE LoadMip(int mip, ivec2 p)
+{
+    switch (mip)
+    {
+        case -1: return LoadSource(p);
+        case 5:  return SPD_TYPE(imageLoad(dstMips[5], p));
+    }
+    return SPD_TYPE(0.0);
+}
+
+void StoreMip(int mip, ivec2 p, SPD_TYPE value)
+{
+    const vec4 TEXEL = vec4(value);
+    switch (mip)
+    {
+        case 0:  imageStore(dstMips[0], p, TEXEL); break;
+        case 1:  imageStore(dstMips[1], p, TEXEL); break;
+        case 2:  imageStore(dstMips[2], p, TEXEL); break;
+        case 3:  imageStore(dstMips[3], p, TEXEL); break;
+        case 4:  imageStore(dstMips[4], p, TEXEL); break;
+        case 5:  imageStore(dstMips[5], p, TEXEL); break;
+        case 6:  imageStore(dstMips[6], p, TEXEL); break;
+        case 7:  imageStore(dstMips[7], p, TEXEL); break;
+        case 8:  imageStore(dstMips[8], p, TEXEL); break;
+        case 9:  imageStore(dstMips[9], p, TEXEL); break;
+        case 10: imageStore(dstMips[10], p, TEXEL); break;
+        case 11: imageStore(dstMips[11], p, TEXEL); break;
+    }
+}
+
+ivec2 MipSize(int mip)
+{
+    // Mip -1 is the source.
+    return max(SPD_SOURCE_SIZE >> (mip + 1), ivec2(1));
+}
+
+void StoreIfInside(int mip, ivec2 p, SPD_TYPE value)
+{
+    if (mip < int(params.mipCount) && all(lessThan(p, MipSize(mip))))
+    {
+        StoreMip(mip, p, value);
+    }
+}
+
+// Reduce a 64x64 region of sourceMip, whose top left texel is at origin, into mips firstMip .. firstMip + 5.
+// Reads past the edge are clamped, which only repeats texels that are already in the footprint.
+void DownsampleTile(int sourceMip, int firstMip, ivec2 origin)
+{
+    const uint T = gl_LocalInvocationIndex;
+    const ivec2 P = ivec2(T % 16, T / 16);
+    const ivec2 SOURCE_MAX = MipSize(sourceMip) - 1;
+
+    // Each thread reduces a 4x4 block of the source to 2x2 texels of the first mip and then one texel of the second.
+    SPD_TYPE quad[4];
+    for (int q = 0; q < 4; q++)
+    {
+        const ivec2 O = ivec2(q & 1, q >> 1);
+        const ivec2 BASE = origin + P * 4 + O * 2;
+
+        quad[q] = Reduce(LoadMip(sourceMip, min(BASE, SOURCE_MAX)),
+                         LoadMip(sourceMip, min(BASE + ivec2(1, 0), SOURCE_MAX)),
+                         LoadMip(sourceMip, min(BASE + ivec2(0, 1), SOURCE_MAX)),
+                         LoadMip(sourceMip, min(BASE + ivec2(1, 1), SOURCE_MAX)));
+
+        StoreIfInside(firstMip, (origin >> 1) + P * 2 + O, quad[q]);
+    }
+
+    SPD_TYPE value = Reduce(quad[0], quad[1], quad[2], quad[3]);
+    StoreIfInside(firstMip + 1, (origin >> 2) + P, value);
+    tile[T] = value;
+
+    // The remaining four mips come out of shared memory, halving the active threads each time.
+    for (int level = 2; level < 6; level++)
+    {
+        const int SIZE = 16 >> (level - 1);
+        const bool ACTIVE = T < uint(SIZE * SIZE);
+        const ivec2 Q = ivec2(int(T) % SIZE, int(T) / SIZE);
+
+        barrier();
+
+        if (ACTIVE)
+        {
+            value = Reduce(tile[(Q.y * 2) * 16 + Q.x * 2],
+                           tile[(Q.y * 2) * 16 + Q.x * 2 + 1],
+                           tile[(Q.y * 2 + 1) * 16 + Q.x * 2],
+                           tile[(Q.y * 2 + 1) * 16 + Q.x * 2 + 1]);
+
+            StoreIfInside(firstMip + level, (origin >> (level + 1)) + Q, value);
+        }
+
+        barrier();
+
+        if (ACTIVE)
+        {
+            tile[Q.y * 16 + Q.x] = value;
+        }
+    }
+}
+
+void main()
+{
+    DownsampleTile(-1, 0, ivec2(gl_WorkGroupID.xy) * 64);
+
+    if (params.mipCount <= 6)
+    {
+        return;
+    }
+
+    // Make this workgroup's sixth mip texel visible to whichever workgroup finishes last.
+    memoryBarrierImage();
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        const uint DONE = atomicAdd(SPD_COUNTER, 1);
+        isLastWorkgroup = DONE == params.workgroupCount - 1;
+    }
+
+    barrier();
+
+    if (!isLastWorkgroup)
+    {
+        return;
+    }
+
+    memoryBarrierImage();
+    DownsampleTile(5, 6, ivec2(0));
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        SPD_COUNTER = 0;
+    }
+}
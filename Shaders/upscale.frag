@@ -0,0 +1,49 @@
+#version 450
+
+// Resamples the corner of the scene target drawn this frame onto the whole swap chain image. Catmull-Rom keeps
+// edges sharp where bilinear would soften them, and its 4x4 footprint is folded into 3x3 bilinear taps by
+// sampling the middle pair of each axis between their texels, in proportion to their weights.
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform UpscaleConstants
+{
+    vec2 renderSize;        // Texels of the target drawn this frame, from the top left.
+    vec2 targetTexel;       // One over the target's full size.
+    vec2 renderPerOutput;   // Render texels per swap chain pixel.
+} constants;
+
+layout(location = 0) out vec4 outColor;
+
+// Texel centres outside the drawn corner hold older, larger frames, so taps are kept inside it.
+vec3 Tap(vec2 position)
+{
+    vec2 clamped = clamp(position, vec2(0.5), constants.renderSize - 0.5);
+    return textureLod(sceneColor, clamped * constants.targetTexel, 0.0).rgb;
+}
+
+void main()
+{
+    vec2 position = gl_FragCoord.xy * constants.renderPerOutput;
+
+    // The texel centre below and left of the sample, and how far past it the sample is.
+    vec2 centre = floor(position - 0.5) + 0.5;
+    vec2 f = position - centre;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 p0 = centre - 1.0;
+    vec2 p12 = centre + w2 / w12;
+    vec2 p3 = centre + 2.0;
+
+    vec3 color = (Tap(vec2(p0.x, p0.y)) * w0.x + Tap(vec2(p12.x, p0.y)) * w12.x + Tap(vec2(p3.x, p0.y)) * w3.x) * w0.y
+               + (Tap(vec2(p0.x, p12.y)) * w0.x + Tap(vec2(p12.x, p12.y)) * w12.x + Tap(vec2(p3.x, p12.y)) * w3.x) * w12.y
+               + (Tap(vec2(p0.x, p3.y)) * w0.x + Tap(vec2(p12.x, p3.y)) * w12.x + Tap(vec2(p3.x, p3.y)) * w3.x) * w3.y;
+
+    // The negative lobes can overshoot past black at hard edges.
+    outColor = vec4(max(color, vec3(0.0)), 1.0);
+}
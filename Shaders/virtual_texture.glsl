@@ -0,0 +1,68 @@
+// Software virtual texture lookup, shared by any fragment shader that samples a virtual texture.
+// Define VT_SET before including to choose the descriptor set, bindings 0 to 3 are taken.
+// Matches VirtualTexture.cpp: page table texels are (cacheX, cacheY, mapped mip, valid), page ids run mip 0 first, row major.
+
+#ifndef VT_SET
+#define VT_SET 1
+#endif
+
+layout(set = VT_SET, binding = 0) uniform usampler2D vtPageTable;
+layout(set = VT_SET, binding = 1) uniform sampler2D vtCache;
+
+// One bit per virtual page, cleared by the host after it has been read.
+layout(set = VT_SET, binding = 2, std430) buffer VtFeedback
+{
+    uint vtFeedbackBits[];
+};
+
+layout(set = VT_SET, binding = 3) uniform VtParams
+{
+    float virtualSize;
+    float pageSize;
+    float border;
+    float cacheSize;
+    uint pagesPerSide;
+    uint mipCount;
+    uint frameNumber;
+} vtParams;
+
+uint VtMipPageOffset(uint mip)
+{
+    uint offset = 0;
+    for (uint i = 0; i < mip; i++)
+    {
+        uint side = vtParams.pagesPerSide >> i;
+        offset += side * side;
+    }
+    return offset;
+}
+
+vec4 SampleVirtualTexture(vec2 uv)
+{
+    // Mip wanted, from the screen space footprint in virtual texels.
+    vec2 dx = dFdx(uv * vtParams.virtualSize);
+    vec2 dy = dFdy(uv * vtParams.virtualSize);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+    uint mip = min(uint(lod), vtParams.mipCount - 1);
+
+    uint side = vtParams.pagesPerSide >> mip;
+    uvec2 page = min(uvec2(uv * float(side)), uvec2(side - 1));
+
+    // Only one pixel in each 4x4 block reports, rotating every frame, so the atomics stay cheap and every pixel is covered in 16 frames.
+    uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+    if (pixel.x + pixel.y * 4u == (vtParams.frameNumber & 15u))
+    {
+        uint pageId = VtMipPageOffset(mip) + page.y * side + page.x;
+        atomicOr(vtFeedbackBits[pageId >> 5], 1u << (pageId & 31u));
+    }
+
+    // The entry points at the finest resident page covering this one, which may be a coarser mip.
+    uvec4 entry = texelFetch(vtPageTable, ivec2(page), int(mip));
+    float mappedSide = float(vtParams.pagesPerSide >> entry.z);
+    vec2 inPage = fract(uv * mappedSide);
+
+    float storedSize = vtParams.pageSize + 2.0 * vtParams.border;
+    vec2 cacheTexel = vec2(entry.xy) * storedSize + vtParams.border + inPage * vtParams.pageSize;
+
+    return textureLod(vtCache, cacheTexel / vtParams.cacheSize, 0.0);
+}
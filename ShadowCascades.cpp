@@ -0,0 +1,661 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Cascaded sun shadow maps, with static casters cached per cascade and refreshes staggered.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "ShadowCascades.h"
+#include "VulkanUtils.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace
+{
+	// Slope scaled, so surfaces at a grazing angle to the sun don't shadow themselves.
+	constexpr float DEPTH_BIAS_CONSTANT = 1.25f;
+	constexpr float DEPTH_BIAS_SLOPE = 1.75f;
+
+	Float3 Normalize(const Float3& v)
+	{
+		const float LENGTH = std::sqrt(Dot(v, v));
+		return LENGTH > 0.0f ? v * (1.0f / LENGTH) : Float3{ 0.0f, 0.0f, 1.0f };
+	}
+
+	// A point through a projective matrix, with the divide.
+	Float3 TransformProjected(const Float4x4& matrix, const Float3& p)
+	{
+		const float* m = matrix.m;
+		const float W = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+		return matrix.TransformPoint(p) * (W != 0.0f ? 1.0f / W : 1.0f);
+	}
+}
+
+void ShadowCascades::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat depthFormat, const ShadowCascadeSettings& settings)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_format = depthFormat;
+	m_settings = settings;
+	m_settings.cascadeCount = std::min(std::max(settings.cascadeCount, 1u), MAX_SHADOW_CASCADES);
+
+#ifndef NDEBUG
+	CheckSmallMovesScroll();
+#endif
+
+	// Both are copied both ways, a scroll passes the cache through the live layer. The live layers are also sampled.
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = m_format;
+	imageInfo.extent = { m_settings.mapSize, m_settings.mapSize, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = m_settings.cascadeCount;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_cacheImage, m_cacheMemory);
+
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_liveImage, m_liveMemory);
+
+	m_liveView = CreateLayerView(m_liveImage, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, m_settings.cascadeCount);
+
+	CreateRenderPasses();
+	CreatePipeline();
+
+	for (uint32_t i = 0; i < m_settings.cascadeCount; i++)
+	{
+		Cascade& cascade = m_cascades[i];
+		cascade.cacheView = CreateLayerView(m_cacheImage, VK_IMAGE_VIEW_TYPE_2D, i, 1);
+		cascade.liveView = CreateLayerView(m_liveImage, VK_IMAGE_VIEW_TYPE_2D, i, 1);
+		cascade.cacheFramebuffer = CreateFramebuffer(m_cacheRenderPass, cascade.cacheView);
+		cascade.liveFramebuffer = CreateFramebuffer(m_liveRenderPass, cascade.liveView);
+	}
+
+	// Hardware comparison with linear filtering gives a 2x2 percentage closer filter for free. Outside the map is lit.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow map sampler!");
+	}
+}
+
+void ShadowCascades::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (Cascade& cascade : m_cascades)
+	{
+		vkDestroyFramebuffer(m_device, cascade.cacheFramebuffer, GetAllocationCallbacks());
+		vkDestroyFramebuffer(m_device, cascade.liveFramebuffer, GetAllocationCallbacks());
+		vkDestroyImageView(m_device, cascade.cacheView, GetAllocationCallbacks());
+		vkDestroyImageView(m_device, cascade.liveView, GetAllocationCallbacks());
+		cascade = Cascade();
+	}
+
+	vkDestroyImageView(m_device, m_liveView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_liveImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_liveMemory, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_cacheImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_cacheMemory, GetAllocationCallbacks());
+
+	vkDestroySampler(m_device, m_sampler, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_pipeline, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_liveRenderPass, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_scrollRenderPass, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_cacheRenderPass, GetAllocationCallbacks());
+}
+
+void ShadowCascades::Update(const Float4x4& viewProjection, const Float3& sunDirection)
+{
+	// A singular view projection sees nothing, identity just keeps the maths finite.
+	Float4x4 clipToWorld;
+	if (!Inverse(viewProjection, clipToWorld))
+	{
+		clipToWorld = Float4x4::Identity();
+	}
+
+	const Float3 SUN_DIRECTION = Normalize(sunDirection);
+
+	float sliceStart = 0.0f;
+	for (uint32_t i = 0; i < m_settings.cascadeCount; i++)
+	{
+		Cascade& cascade = m_cascades[i];
+		const uint32_t INTERVAL = std::max(m_settings.refreshIntervals[i], 1u);
+		const float SLICE_END = m_settings.cascadeEnds[i];
+
+		// Offset by the cascade, so cascades sharing an interval don't all land on the same frame.
+		cascade.refresh = !cascade.drawn || (m_frame + i) % INTERVAL == 0;
+		if (cascade.refresh)
+		{
+			cascade.lightViewProjection = FitCascade(clipToWorld, sliceStart, SLICE_END, SUN_DIRECTION);
+		}
+
+		sliceStart = SLICE_END;
+	}
+
+	m_frame++;
+}
+
+void ShadowCascades::InvalidateStatic()
+{
+	for (Cascade& cascade : m_cascades)
+	{
+		cascade.cacheValid = false;
+	}
+}
+
+void ShadowCascades::FillSun(GpuSun& sun) const
+{
+	// Unused cascades reach past everything, so the search in the shader always stops at a real one.
+	for (uint32_t i = 0; i < MAX_SHADOW_CASCADES; i++)
+	{
+		const bool USED = i < m_settings.cascadeCount;
+		sun.shadowFromWorld[i] = USED ? m_cascades[i].lightViewProjection : Float4x4::Identity();
+		sun.cascadeEnds[i] = USED ? m_settings.cascadeEnds[i] : 2.0f;
+	}
+	sun.cascadeCount = m_settings.cascadeCount;
+}
+
+void ShadowCascades::CreateRenderPasses()
+{
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 0;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	VkAttachmentDescription attachment{};
+	attachment.format = m_format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+	VkSubpassDependency dependencies[2]{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &attachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 2;
+	renderPassInfo.pDependencies = dependencies;
+
+	// The cache starts from nothing, after any earlier copy out of it, and is copied out straight after.
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	if (vkCreateRenderPass(m_device, &renderPassInfo, GetAllocationCallbacks(), &m_cacheRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow cache render pass!");
+	}
+
+	// A scrolled cache keeps what was copied back into it, only the strips coming into view are cleared and drawn.
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	if (vkCreateRenderPass(m_device, &renderPassInfo, GetAllocationCallbacks(), &m_scrollRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow cache scroll render pass!");
+	}
+
+	// The live layer starts from the cache copied into it, and is sampled by shading.
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	if (vkCreateRenderPass(m_device, &renderPassInfo, GetAllocationCallbacks(), &m_liveRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow render pass!");
+	}
+}
+
+void ShadowCascades::CreatePipeline()
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(Float4x4);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow pipeline layout!");
+	}
+
+	// Depth only, there's no fragment shader.
+	VkShaderModule vertShaderModule = LoadShaderModule(m_device, "shaders/shadow_vert.spv");
+
+	VkPipelineShaderStageCreateInfo shaderStage{};
+	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStage.module = vertShaderModule;
+	shaderStage.pName = "main";
+
+	// Only the position of the scene's quantised vertices is read.
+	const VkVertexInputBindingDescription BINDING = QuantizedVertexBinding(0);
+	const VkVertexInputAttributeDescription POSITION = QuantizedVertexAttributes(0)[0];
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.pVertexBindingDescriptions = &BINDING;
+	vertexInputInfo.vertexAttributeDescriptionCount = 1;
+	vertexInputInfo.pVertexAttributeDescriptions = &POSITION;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(m_settings.mapSize);
+	viewport.height = static_cast<float>(m_settings.mapSize);
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.extent = { m_settings.mapSize, m_settings.mapSize };
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
+
+	// Scrolled caches only draw the strips that came into view.
+	const VkDynamicState DYNAMIC_STATES[] = { VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 1;
+	dynamicState.pDynamicStates = DYNAMIC_STATES;
+
+	// Both faces, meshes aren't guaranteed closed.
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_TRUE;
+	rasterizer.depthBiasConstantFactor = DEPTH_BIAS_CONSTANT;
+	rasterizer.depthBiasSlopeFactor = DEPTH_BIAS_SLOPE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	// Both passes have the same single depth attachment, so one pipeline suits either.
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = &shaderStage;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_pipelineLayout;
+	pipelineInfo.renderPass = m_liveRenderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow pipeline!");
+	}
+
+	vkDestroyShaderModule(m_device, vertShaderModule, GetAllocationCallbacks());
+}
+
+VkImageView ShadowCascades::CreateLayerView(VkImage image, VkImageViewType viewType, uint32_t layer, uint32_t layerCount) const
+{
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = viewType;
+	viewInfo.format = m_format;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, layer, layerCount };
+
+	VkImageView view;
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow map view!");
+	}
+
+	return view;
+}
+
+VkFramebuffer ShadowCascades::CreateFramebuffer(VkRenderPass renderPass, VkImageView view) const
+{
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = renderPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &view;
+	framebufferInfo.width = m_settings.mapSize;
+	framebufferInfo.height = m_settings.mapSize;
+	framebufferInfo.layers = 1;
+
+	VkFramebuffer framebuffer;
+	if (vkCreateFramebuffer(m_device, &framebufferInfo, GetAllocationCallbacks(), &framebuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow framebuffer!");
+	}
+
+	return framebuffer;
+}
+
+Float4x4 ShadowCascades::FitCascade(const Float4x4& clipToWorld, float sliceStart, float sliceEnd, const Float3& sunDirection) const
+{
+	// The slice's corners in the world, and a sphere around them. A sphere's bounds don't change as the view turns.
+	Float3 corners[8];
+	Float3 center = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		const Float3 NDC = { (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? sliceEnd : sliceStart };
+		corners[i] = TransformProjected(clipToWorld, NDC);
+		center = center + corners[i] * 0.125f;
+	}
+
+	float radius = 0.0f;
+	for (const Float3& CORNER : corners)
+	{
+		const Float3 OFFSET = CORNER - center;
+		radius = std::max(radius, std::sqrt(Dot(OFFSET, OFFSET)));
+	}
+	radius = std::max(std::ceil(radius * 16.0f) / 16.0f, 1.0f / 16.0f);	// Rounded up, so float noise doesn't change the scale.
+
+	// Any basis around the sun's direction will do, as long as it's the same every frame.
+	const Float3 FORWARD = sunDirection;
+	const Float3 HELPER = std::fabs(FORWARD.y) < 0.99f ? Float3{ 0.0f, 1.0f, 0.0f } : Float3{ 1.0f, 0.0f, 0.0f };
+	const Float3 RIGHT = Normalize(Cross(HELPER, FORWARD));
+	const Float3 UP = Cross(FORWARD, RIGHT);
+
+	/*
+		Light space x and y cover the sphere, z reaches back towards the sun for casters outside the slice. Depth is
+		measured from the start of the slab, a radius deep, that the centre is in, so it doesn't shift with every move
+		and the cache can be scrolled. The range is a radius longer to cover wherever in the slab the centre is.
+	*/
+	const float SLAB = std::floor(Dot(FORWARD, center) / radius) * radius;
+	const float DEPTH_RANGE = 3.0f * radius + m_settings.casterReach;
+	const Float3 ROW_X = RIGHT * (1.0f / radius);
+	const Float3 ROW_Y = UP * (1.0f / radius);
+	const Float3 ROW_Z = FORWARD * (1.0f / DEPTH_RANGE);
+
+	Float4x4 result = Float4x4::Identity();
+	result.m[0] = ROW_X.x;	result.m[4] = ROW_X.y;	result.m[8] = ROW_X.z;
+	result.m[1] = ROW_Y.x;	result.m[5] = ROW_Y.y;	result.m[9] = ROW_Y.z;
+	result.m[2] = ROW_Z.x;	result.m[6] = ROW_Z.y;	result.m[10] = ROW_Z.z;
+	result.m[12] = -Dot(ROW_X, center);
+	result.m[13] = -Dot(ROW_Y, center);
+	result.m[14] = (radius + m_settings.casterReach - SLAB) / DEPTH_RANGE;
+
+	// Whole texels only, so as the slice moves the world stays on the same texels and edges don't crawl.
+	const float TEXEL = 2.0f / static_cast<float>(m_settings.mapSize);
+	result.m[12] = std::round(result.m[12] / TEXEL) * TEXEL;
+	result.m[13] = std::round(result.m[13] / TEXEL) * TEXEL;
+
+	return result;
+}
+
+bool ShadowCascades::CanScroll(const Float4x4& cached, const Float4x4& live, int32_t& shiftX, int32_t& shiftY) const
+{
+	// Everything but the x and y offset must match exactly, anything else is a different scale, basis or depth.
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		if (i != 12 && i != 13 && cached.m[i] != live.m[i])
+		{
+			return false;
+		}
+	}
+
+	// Both offsets are whole texels, so their difference rounds to one exactly.
+	const float TEXEL = 2.0f / static_cast<float>(m_settings.mapSize);
+	const float SIZE = static_cast<float>(m_settings.mapSize);
+	const float SHIFT_X = std::round((live.m[12] - cached.m[12]) / TEXEL);
+	const float SHIFT_Y = std::round((live.m[13] - cached.m[13]) / TEXEL);
+	if (std::fabs(SHIFT_X) >= SIZE || std::fabs(SHIFT_Y) >= SIZE)
+	{
+		return false;
+	}
+
+	shiftX = static_cast<int32_t>(SHIFT_X);
+	shiftY = static_cast<int32_t>(SHIFT_Y);
+	return true;
+}
+
+void ShadowCascades::CheckSmallMovesScroll() const
+{
+	// A view under a straight down sun, then the same view a few units to the side, as walking would move it.
+	const Float3 SUN_DIRECTION = { 0.0f, -1.0f, 0.0f };
+	Float4x4 clipToWorld = Float4x4::Scale(20.0f, 20.0f, 100.0f);
+	const Float4x4 BEFORE = FitCascade(clipToWorld, 0.0f, m_settings.cascadeEnds[0], SUN_DIRECTION);
+
+	clipToWorld.m[12] = 3.3f;
+	clipToWorld.m[14] = -1.7f;
+	const Float4x4 AFTER = FitCascade(clipToWorld, 0.0f, m_settings.cascadeEnds[0], SUN_DIRECTION);
+
+	int32_t shiftX = 0;
+	int32_t shiftY = 0;
+	if (!CanScroll(BEFORE, AFTER, shiftX, shiftY) || (shiftX == 0 && shiftY == 0))
+	{
+		throw std::runtime_error("A small camera move redraws every static shadow caster!");
+	}
+}
+
+uint32_t ShadowCascades::BeginCachePass(VkCommandBuffer commandBuffer, uint32_t cascade, VkRect2D rects[2])
+{
+	Cascade& target = m_cascades[cascade];
+	target.scrolled = false;
+
+	int32_t shiftX = 0;
+	int32_t shiftY = 0;
+	const bool SCROLL = target.cacheValid && CanScroll(target.cachedViewProjection, target.lightViewProjection, shiftX, shiftY);
+	if (SCROLL && shiftX == 0 && shiftY == 0)
+	{
+		return 0;
+	}
+
+	target.cachedViewProjection = target.lightViewProjection;
+	target.cacheValid = true;
+
+	const uint32_t SIZE = m_settings.mapSize;
+
+	VkClearValue clearValue{};
+	clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.framebuffer = target.cacheFramebuffer;
+	renderPassInfo.renderArea.extent = { SIZE, SIZE };
+
+	if (!SCROLL)
+	{
+		renderPassInfo.renderPass = m_cacheRenderPass;
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearValue;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		rects[0] = { { 0, 0 }, { SIZE, SIZE } };
+		return 1;
+	}
+
+	ScrollCache(commandBuffer, cascade, shiftX, shiftY);
+	target.scrolled = true;
+
+	// What came into view: a column on the side the grid moved away from, then a row across the rest.
+	const uint32_t SHIFT_X = static_cast<uint32_t>(std::abs(shiftX));
+	const uint32_t SHIFT_Y = static_cast<uint32_t>(std::abs(shiftY));
+	uint32_t rectCount = 0;
+	if (SHIFT_X > 0)
+	{
+		rects[rectCount++] = { { shiftX > 0 ? 0 : static_cast<int32_t>(SIZE - SHIFT_X), 0 }, { SHIFT_X, SIZE } };
+	}
+	if (SHIFT_Y > 0)
+	{
+		rects[rectCount++] = { { std::max(shiftX, 0), shiftY > 0 ? 0 : static_cast<int32_t>(SIZE - SHIFT_Y) }, { SIZE - SHIFT_X, SHIFT_Y } };
+	}
+
+	renderPassInfo.renderPass = m_scrollRenderPass;
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The strips still hold whatever scrolled out of the other side.
+	const VkClearAttachment CLEAR = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, clearValue };
+	VkClearRect clearRects[2];
+	for (uint32_t i = 0; i < rectCount; i++)
+	{
+		clearRects[i] = { rects[i], 0, 1 };
+	}
+	vkCmdClearAttachments(commandBuffer, 1, &CLEAR, rectCount, clearRects);
+
+	return rectCount;
+}
+
+void ShadowCascades::ScrollCache(VkCommandBuffer commandBuffer, uint32_t cascade, int32_t shiftX, int32_t shiftY)
+{
+	Cascade& target = m_cascades[cascade];
+	const uint32_t SIZE = m_settings.mapSize;
+
+	// A copy can't overlap itself, so the cache goes through the live layer, which is about to be replaced anyway.
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = target.drawn ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_liveImage;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, cascade, 1 };
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	// What stays in view, moved to where it lands under the new matrix.
+	VkImageCopy region{};
+	region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+	region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+	region.srcOffset = { std::max(-shiftX, 0), std::max(-shiftY, 0), 0 };
+	region.dstOffset = { std::max(shiftX, 0), std::max(shiftY, 0), 0 };
+	region.extent = { SIZE - static_cast<uint32_t>(std::abs(shiftX)), SIZE - static_cast<uint32_t>(std::abs(shiftY)), 1 };
+
+	vkCmdCopyImage(commandBuffer, m_cacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_liveImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	// And back into the cache, in the same place.
+	VkImageMemoryBarrier barriers[2] = { barrier, barrier };
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[1].image = m_cacheImage;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	region.srcOffset = region.dstOffset;
+	vkCmdCopyImage(commandBuffer, m_liveImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_cacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+void ShadowCascades::BeginLivePass(VkCommandBuffer commandBuffer, uint32_t cascade)
+{
+	Cascade& target = m_cascades[cascade];
+
+	// The last frame's shading may still be sampling it. Its old contents are about to be replaced.
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = target.drawn ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_liveImage;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, cascade, 1 };
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	// A scroll has already waited out the sampling, and left the layer as the source of its second copy.
+	VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	if (target.scrolled)
+	{
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	// The static casters, as they were cached for this same matrix.
+	VkImageCopy region{};
+	region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+	region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+	region.extent = { m_settings.mapSize, m_settings.mapSize, 1 };
+
+	vkCmdCopyImage(commandBuffer, m_cacheImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_liveImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	target.drawn = true;
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_liveRenderPass;
+	renderPassInfo.framebuffer = target.liveFramebuffer;
+	renderPassInfo.renderArea.extent = { m_settings.mapSize, m_settings.mapSize };
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	const VkRect2D SCISSOR = { { 0, 0 }, { m_settings.mapSize, m_settings.mapSize } };
+	vkCmdSetScissor(commandBuffer, 0, 1, &SCISSOR);
+}
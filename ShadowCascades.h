@@ -0,0 +1,177 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Cascaded sun shadow maps, with static casters cached per cascade and refreshes staggered.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "ClusteredLights.h"
+#include "MathTypes.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+
+struct ShadowCascadeSettings
+{
+	uint32_t cascadeCount;								// At most MAX_SHADOW_CASCADES.
+	uint32_t mapSize;									// Texels across each cascade.
+	float casterReach;									// How far towards the sun past a cascade's slice casters are still caught.
+	float cascadeEnds[MAX_SHADOW_CASCADES];				// Clip space depth each cascade reaches, increasing, the last 1.
+	uint32_t refreshIntervals[MAX_SHADOW_CASCADES];		// Frames between each cascade's refreshes, 1 is every frame.
+};
+
+/*
+	The view's depth is split into slices and each gets an orthographic map from the sun, a layer of one array. Every
+	cascade keeps two layers: a cache holding only static casters, and the live map shading samples. A refresh copies
+	the cache into the live layer and draws just the dynamic casters over it, so static geometry, most of what's
+	drawn, isn't drawn again as the view moves. Cascades are snapped to their own texels, and their depth to slabs a
+	cascade deep, so moving the view only slides the cascade across the light's grid by whole texels. The cache is
+	scrolled by the same amount and only the strip that comes into view is drawn. Turning the view or the sun, or
+	crossing into another slab, still redraws it whole.
+
+	Distant cascades refresh less often. Between refreshes they keep the matrix they were drawn with, so their
+	dynamic shadows lag but stay where they were cast. Every cascade is drawn on the first frame.
+*/
+class ShadowCascades
+{
+public:
+
+	ShadowCascades() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_settings(),
+		m_format(VK_FORMAT_UNDEFINED),
+		m_cacheRenderPass(VK_NULL_HANDLE),
+		m_scrollRenderPass(VK_NULL_HANDLE),
+		m_liveRenderPass(VK_NULL_HANDLE),
+		m_pipelineLayout(VK_NULL_HANDLE),
+		m_pipeline(VK_NULL_HANDLE),
+		m_sampler(VK_NULL_HANDLE),
+		m_cacheImage(VK_NULL_HANDLE),
+		m_cacheMemory(VK_NULL_HANDLE),
+		m_liveImage(VK_NULL_HANDLE),
+		m_liveMemory(VK_NULL_HANDLE),
+		m_liveView(VK_NULL_HANDLE),
+		m_cascades(),
+		m_frame(0)
+	{}
+
+	// depthFormat has to be attachable, sampleable and copyable.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat depthFormat, const ShadowCascadeSettings& settings);
+	void Destroy();
+
+	// Fits the cascades to the view and picks which refresh this frame. Once a frame, before Record and FillSun.
+	void Update(const Float4x4& viewProjection, const Float3& sunDirection);
+
+	// Static casters changed, every cache is redrawn at its cascade's next refresh.
+	void InvalidateStatic();
+
+	/*
+		Outside any render pass. drawCasters(commandBuffer, lightViewProjection, staticCasters) draws one kind of
+		caster with Pipeline bound, pushing each caster's clip from vertex matrix to PipelineLayout. Leaves the live
+		layers ready for fragment shaders to sample.
+	*/
+	template<typename DrawCasters>
+	void Record(VkCommandBuffer commandBuffer, DrawCasters&& drawCasters);
+
+	// The matrices the live layers were last drawn with, for shading.
+	void FillSun(GpuSun& sun) const;
+
+	// Every live layer as an array, in DEPTH_STENCIL_READ_ONLY_OPTIMAL, to be read through Sampler with depth comparison.
+	_NODISCARD VkImageView View() const { return m_liveView; }
+	_NODISCARD VkSampler Sampler() const { return m_sampler; }
+	_NODISCARD VkPipelineLayout PipelineLayout() const { return m_pipelineLayout; }
+	_NODISCARD VkPipeline Pipeline() const { return m_pipeline; }
+
+private:
+
+	struct Cascade
+	{
+		Float4x4 lightViewProjection = Float4x4::Identity();	// What the live layer was drawn with.
+		Float4x4 cachedViewProjection = Float4x4::Identity();	// What the cache was drawn with.
+		bool cacheValid = false;
+		bool drawn = false;										// The live layer has been drawn at least once.
+		bool refresh = false;									// Drawn this frame.
+		bool scrolled = false;									// This frame's scroll left the live layer as a copy source.
+
+		VkImageView cacheView = VK_NULL_HANDLE;
+		VkImageView liveView = VK_NULL_HANDLE;
+		VkFramebuffer cacheFramebuffer = VK_NULL_HANDLE;
+		VkFramebuffer liveFramebuffer = VK_NULL_HANDLE;
+	};
+
+	void CreateRenderPasses();
+	void CreatePipeline();
+	VkImageView CreateLayerView(VkImage image, VkImageViewType viewType, uint32_t layer, uint32_t layerCount) const;
+	VkFramebuffer CreateFramebuffer(VkRenderPass renderPass, VkImageView view) const;
+
+	// The light's view and orthographic projection around a slice of the view, snapped to whole texels.
+	Float4x4 FitCascade(const Float4x4& clipToWorld, float sliceStart, float sliceEnd, const Float3& sunDirection) const;
+
+	// Whether a cache drawn with one matrix can be slid into place for the other, and by how many texels.
+	bool CanScroll(const Float4x4& cached, const Float4x4& live, int32_t& shiftX, int32_t& shiftY) const;
+
+	// Debug builds only. Throws if moving the view a little would redraw every static caster.
+	void CheckSmallMovesScroll() const;
+
+	/*
+		Returns how many of rects need static casters drawn, with the cache pass begun, or 0 when the cache is still
+		valid and no pass was begun. Each rect is drawn with its own scissor.
+	*/
+	uint32_t BeginCachePass(VkCommandBuffer commandBuffer, uint32_t cascade, VkRect2D rects[2]);
+	void ScrollCache(VkCommandBuffer commandBuffer, uint32_t cascade, int32_t shiftX, int32_t shiftY);
+	void BeginLivePass(VkCommandBuffer commandBuffer, uint32_t cascade);
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	ShadowCascadeSettings m_settings;
+	VkFormat m_format;
+
+	VkRenderPass m_cacheRenderPass;		// Clears, and leaves the layer ready to copy from.
+	VkRenderPass m_scrollRenderPass;	// The same, but keeps what was scrolled into the cache.
+	VkRenderPass m_liveRenderPass;		// Loads the copied cache, and leaves the layer ready to sample.
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkSampler m_sampler;
+
+	VkImage m_cacheImage;
+	VkDeviceMemory m_cacheMemory;
+	VkImage m_liveImage;
+	VkDeviceMemory m_liveMemory;
+	VkImageView m_liveView;
+
+	Cascade m_cascades[MAX_SHADOW_CASCADES];
+	uint64_t m_frame;
+};
+
+template<typename DrawCasters>
+void ShadowCascades::Record(VkCommandBuffer commandBuffer, DrawCasters&& drawCasters)
+{
+	for (uint32_t i = 0; i < m_settings.cascadeCount; i++)
+	{
+		if (!m_cascades[i].refresh)
+		{
+			continue;
+		}
+
+		VkRect2D rects[2];
+		const uint32_t RECT_COUNT = BeginCachePass(commandBuffer, i, rects);
+		if (RECT_COUNT > 0)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+			for (uint32_t j = 0; j < RECT_COUNT; j++)
+			{
+				vkCmdSetScissor(commandBuffer, 0, 1, &rects[j]);
+				drawCasters(commandBuffer, m_cascades[i].lightViewProjection, true);
+			}
+			vkCmdEndRenderPass(commandBuffer);
+		}
+
+		BeginLivePass(commandBuffer, i);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+		drawCasters(commandBuffer, m_cascades[i].lightViewProjection, false);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+}
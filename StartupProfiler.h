@@ -0,0 +1,89 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Times each start up step and the time to the first presented frame.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+
+class StartupProfiler
+{
+public:
+
+	StartupProfiler() :
+		m_start(Clock::now()),
+		m_firstFrame(),
+		m_firstFrameDone(false)
+	{}
+
+	void Begin()
+	{
+		m_start = Clock::now();
+		m_vSteps.clear();
+		m_firstFrameDone = false;
+	}
+
+	template<typename StepFunc>
+	void Step(const char* name, StepFunc&& step)
+	{
+		const Clock::time_point STEP_START = Clock::now();
+		step();
+		m_vSteps.push_back({ name, Milliseconds(Clock::now() - STEP_START) });
+	}
+
+	// Only the first call counts.
+	void MarkFirstFrame()
+	{
+		if (!m_firstFrameDone)
+		{
+			m_firstFrame = Clock::now();
+			m_firstFrameDone = true;
+		}
+	}
+
+	_NODISCARD bool FirstFrameDone() const { return m_firstFrameDone; }
+
+	void Report(std::ostream& out) const
+	{
+		double total = 0.0;
+
+		out << "Start up:" << std::endl;
+		for (const auto& STEP : m_vSteps)
+		{
+			out << "    " << std::left << std::setw(28) << STEP.name << std::right << std::fixed << std::setprecision(2) << std::setw(9) << STEP.milliseconds << " ms" << std::endl;
+			total += STEP.milliseconds;
+		}
+		out << "    " << std::left << std::setw(28) << "Steps total" << std::right << std::setw(9) << total << " ms" << std::endl;
+
+		if (m_firstFrameDone)
+		{
+			out << "    " << std::left << std::setw(28) << "Time to first frame" << std::right << std::setw(9) << Milliseconds(m_firstFrame - m_start) << " ms" << std::endl;
+		}
+	}
+
+private:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct StepTime
+	{
+		std::string name;
+		double milliseconds;
+	};
+
+	static double Milliseconds(Clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	Clock::time_point m_start;
+	Clock::time_point m_firstFrame;
+	bool m_firstFrameDone;
+	std::vector<StepTime> m_vSteps;
+};
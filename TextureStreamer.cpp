@@ -0,0 +1,451 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Loads KTX2 textures and streams their mip chains to the GPU, smallest mip first.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "TextureStreamer.h"
+#include "VulkanUtils.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define MAX_FRAMES_IN_FLIGHT		Render_constants::g_maxFramesInFlight
+#define STREAMING_BUDGET			Texture_constants::g_streamingBudgetPerFrame
+
+namespace
+{
+	// Copy offsets must be a multiple of the texel block size and of 4. 16 covers every format we load.
+	constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool CanSample(VkPhysicalDevice physicalDevice, VkFormat format)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		constexpr VkFormatFeatureFlags REQUIRED = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		return (properties.optimalTilingFeatures & REQUIRED) == REQUIRED;
+	}
+}
+
+void TextureStreamer::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_queue = queue;
+
+	// Our own pool so upload command buffers can be reset individually without touching the frame's command buffers.
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create texture upload command pool!");
+	}
+
+	m_vSlots.resize(MAX_FRAMES_IN_FLIGHT);
+
+	std::vector<VkCommandBuffer> commandBuffers(m_vSlots.size());
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate texture upload command buffers!");
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	for (size_t i = 0; i < m_vSlots.size(); i++)
+	{
+		m_vSlots[i].commandBuffer = commandBuffers[i];
+
+		if (vkCreateFence(m_device, &fenceInfo, GetAllocationCallbacks(), &m_vSlots[i].fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create texture upload fence!");
+		}
+	}
+
+	// One persistently mapped staging buffer, each slot owns one budget sized slice of it.
+	CreateBuffer
+	(
+		m_physicalDevice, m_device,
+		STREAMING_BUDGET * m_vSlots.size(),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_stagingBuffer, m_stagingMemory
+	);
+
+	vkMapMemory(m_device, m_stagingMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&m_pStagingData));
+
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = VK_FALSE;	// The device feature isn't enabled.
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;		// The view decides which mips exist.
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create texture sampler!");
+	}
+
+	m_mipGenerator.Init(m_physicalDevice, m_device);
+}
+
+void TextureStreamer::Destroy()
+{
+	// Caller is expected to have waited for the device to go idle.
+	DestroyRetiredViews(true);
+
+	for (auto& texture : m_vTextures)
+	{
+		vkDestroyImageView(m_device, texture->view, GetAllocationCallbacks());
+		vkDestroyImage(m_device, texture->image, GetAllocationCallbacks());
+		vkFreeMemory(m_device, texture->memory, GetAllocationCallbacks());
+	}
+	m_vTextures.clear();
+
+	for (auto& slot : m_vSlots)
+	{
+		for (auto& resources : slot.vMipGenResources)
+		{
+			m_mipGenerator.Release(resources);
+		}
+		vkDestroyFence(m_device, slot.fence, GetAllocationCallbacks());
+	}
+	m_vSlots.clear();
+
+	m_mipGenerator.Destroy();
+
+	vkDestroySampler(m_device, m_sampler, GetAllocationCallbacks());
+	vkDestroyBuffer(m_device, m_stagingBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_stagingMemory, GetAllocationCallbacks()); // Implicitly unmapped.
+	vkDestroyCommandPool(m_device, m_commandPool, GetAllocationCallbacks());
+}
+
+TextureHandle TextureStreamer::Load(const std::string& filename)
+{
+	auto texture = std::make_unique<StreamedTexture>(Ktx2File::Load(filename));
+
+	SelectDeviceFormat(*texture);
+
+	// Uploads copy whole block rows of the format actually uploaded, which may be a transcode of the stored one.
+	const FormatBlockInfo BLOCK = GetFormatBlockInfo(texture->format);
+	for (uint32_t i = 0; i < texture->source.GetLevelCount(); i++)
+	{
+		const Ktx2Level& LEVEL = texture->source.GetLevel(i);
+		if (LEVEL.byteLength < GetImageBytes(BLOCK, LEVEL.width, LEVEL.height))
+		{
+			throw std::runtime_error("Texture level is smaller than its size needs!");
+		}
+	}
+
+	CreateTextureImage(*texture);
+
+	m_vTextures.push_back(std::move(texture));
+	return static_cast<TextureHandle>(m_vTextures.size() - 1);
+}
+
+void TextureStreamer::Update()
+{
+	m_frameIndex++;
+	DestroyRetiredViews(false);
+
+	UploadSlot& slot = m_vSlots[m_currentSlot];
+
+	// This slot was submitted a full cycle of frames ago, so the wait is almost always free.
+	if (slot.submitted)
+	{
+		vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+		RetireSlot(slot);
+	}
+
+	const bool WORK_PENDING = std::any_of(m_vTextures.begin(), m_vTextures.end(), [](const auto& texture) { return texture->pendingMips > 0; });
+	if (!WORK_PENDING)
+	{
+		return;
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(slot.commandBuffer, 0);
+	vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+	const bool RECORDED = RecordUploads(slot.commandBuffer, STREAMING_BUDGET * m_currentSlot, slot);
+	vkEndCommandBuffer(slot.commandBuffer);
+
+	if (RECORDED)
+	{
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &slot.commandBuffer;
+
+		vkResetFences(m_device, 1, &slot.fence);
+		if (vkQueueSubmit(m_queue, 1, &submitInfo, slot.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit texture uploads!");
+		}
+
+		slot.submitted = true;
+	}
+
+	m_currentSlot = (m_currentSlot + 1) % static_cast<uint32_t>(m_vSlots.size());
+}
+
+// =================================================================================================================================================================
+// Texture creation.
+
+void TextureStreamer::SelectDeviceFormat(StreamedTexture& texture)
+{
+	const VkFormat STORED_FORMAT = texture.source.GetFormat();
+
+	if (CanSample(m_physicalDevice, STORED_FORMAT))
+	{
+		texture.format = STORED_FORMAT;
+		return;
+	}
+
+	/*
+		The device can't sample the stored format, BC on most mobile GPUs or ASTC on most desktop GPUs, so decode on the CPU.
+		Every compressed format has a target every device can sample, so only an optional uncompressed format, such as
+		R8 SRGB, is turned away here. That happens at load, before anything is created or queued for streaming.
+	*/
+	const VkFormat TARGET = Ktx2File::GetTranscodeTarget(STORED_FORMAT);
+	if (TARGET == VK_FORMAT_UNDEFINED || !CanSample(m_physicalDevice, TARGET))
+	{
+		throw std::runtime_error("Texture format is not supported by the device and can't be transcoded!");
+	}
+
+	texture.source.Transcode();
+	texture.format = TARGET;
+	texture.transcoded = true;
+}
+
+void TextureStreamer::CreateTextureImage(StreamedTexture& texture)
+{
+	const VkExtent2D EXTENT = { texture.source.GetWidth(), texture.source.GetHeight() };
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	texture.mipCount = texture.source.GetLevelCount();
+	texture.pendingMips = texture.mipCount;
+
+	// A file without mips gets its chain built on the GPU, which is far quicker than building it on the CPU and uploads a quarter less.
+	const MipGenPath MIP_PATH = texture.source.WantsGeneratedMips() ? m_mipGenerator.SelectPath(texture.format) : MipGenPath::None;
+	if (MIP_PATH != MipGenPath::None)
+	{
+		texture.generateMips = true;
+		texture.mipCount = MipGenerator::FullMipCount(EXTENT);
+		texture.pendingMips = 1;
+		usage |= MipGenerator::RequiredUsage(MIP_PATH);
+	}
+
+	texture.residentMip = texture.mipCount;
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = texture.format;
+	imageInfo.extent = { EXTENT.width, EXTENT.height, 1 };
+	imageInfo.mipLevels = texture.mipCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.memory);
+}
+
+void TextureStreamer::RebuildView(StreamedTexture& texture)
+{
+	if (texture.view != VK_NULL_HANDLE)
+	{
+		m_vRetiredViews.push_back({ texture.view, m_frameIndex });
+	}
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = texture.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = texture.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = texture.residentMip;			// Mips above this are still in UNDEFINED layout.
+	viewInfo.subresourceRange.levelCount = texture.mipCount - texture.residentMip;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &texture.view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create texture image view!");
+	}
+}
+
+// =================================================================================================================================================================
+// Streaming.
+
+bool TextureStreamer::RecordUploads(VkCommandBuffer commandBuffer, VkDeviceSize stagingBase, UploadSlot& slot)
+{
+	VkDeviceSize used = 0;
+	bool recorded = false;
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	for (TextureHandle handle = 0; handle < m_vTextures.size(); handle++)
+	{
+		StreamedTexture& texture = *m_vTextures[handle];
+
+		while (texture.pendingMips > 0)
+		{
+			const uint32_t MIP = texture.pendingMips - 1;
+			const Ktx2Level& LEVEL = texture.source.GetLevel(MIP);
+			const FormatBlockInfo BLOCK = GetFormatBlockInfo(texture.format);
+
+			const uint32_t BLOCKS_Y = (LEVEL.height + BLOCK.blockHeight - 1) / BLOCK.blockHeight;
+			const VkDeviceSize ROW_PITCH = ((LEVEL.width + BLOCK.blockWidth - 1) / BLOCK.blockWidth) * BLOCK.bytesPerBlock;
+
+			// Fit as many block rows as the budget allows, a mip may take several frames.
+			const VkDeviceSize OFFSET = AlignUp(used, STAGING_ALIGNMENT);
+			const VkDeviceSize SPACE = OFFSET < STREAMING_BUDGET ? STREAMING_BUDGET - OFFSET : 0;
+			const uint32_t ROWS = static_cast<uint32_t>(std::min<VkDeviceSize>(SPACE / ROW_PITCH, BLOCKS_Y - texture.nextBlockRow));
+
+			if (ROWS == 0)
+			{
+				return recorded; // Budget spent for this frame.
+			}
+
+			std::memcpy(m_pStagingData + stagingBase + OFFSET, LEVEL.pData + texture.nextBlockRow * ROW_PITCH, ROWS * ROW_PITCH);
+			used = OFFSET + ROWS * ROW_PITCH;
+
+			barrier.image = texture.image;
+			barrier.subresourceRange.baseMipLevel = MIP;
+
+			if (texture.nextBlockRow == 0)
+			{
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			}
+
+			const uint32_t FIRST_TEXEL_ROW = texture.nextBlockRow * BLOCK.blockHeight;
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = stagingBase + OFFSET;
+			region.bufferRowLength = 0;		// Tightly packed.
+			region.bufferImageHeight = 0;	//
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = MIP;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, static_cast<int32_t>(FIRST_TEXEL_ROW), 0 };
+			region.imageExtent = { LEVEL.width, std::min(ROWS * BLOCK.blockHeight, LEVEL.height - FIRST_TEXEL_ROW), 1 };
+
+			vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+			recorded = true;
+
+			texture.nextBlockRow += ROWS;
+			if (texture.nextBlockRow < BLOCKS_Y)
+			{
+				return recorded; // Only a partial mip fitted, so the budget is spent.
+			}
+
+			// Mip complete, make it readable. It only becomes visible through the view once this submission has finished.
+			if (texture.generateMips)
+			{
+				// The generator leaves the whole chain readable, so the texture goes from nothing to fully resident in one step.
+				const VkExtent2D EXTENT = { LEVEL.width, LEVEL.height };
+				slot.vMipGenResources.push_back(m_mipGenerator.Record(commandBuffer, texture.image, texture.format, EXTENT, texture.mipCount));
+			}
+			else
+			{
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			}
+
+			slot.vCompletedMips.push_back({ handle, MIP });
+			texture.nextBlockRow = 0;
+			texture.pendingMips--;
+		}
+	}
+
+	return recorded;
+}
+
+void TextureStreamer::RetireSlot(UploadSlot& slot)
+{
+	std::vector<TextureHandle> touched;
+
+	for (const PendingMip& MIP : slot.vCompletedMips)
+	{
+		StreamedTexture& texture = *m_vTextures[MIP.texture];
+		texture.residentMip = std::min(texture.residentMip, MIP.mip);
+		touched.push_back(MIP.texture);
+	}
+
+	// A batch often completes several mips of the same texture, only rebuild its view once.
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+	for (TextureHandle handle : touched)
+	{
+		RebuildView(*m_vTextures[handle]);
+	}
+
+	for (auto& resources : slot.vMipGenResources)
+	{
+		m_mipGenerator.Release(resources);
+	}
+
+	slot.vMipGenResources.clear();
+	slot.vCompletedMips.clear();
+	slot.submitted = false;
+}
+
+void TextureStreamer::DestroyRetiredViews(bool all)
+{
+	// Once every frame in flight has cycled, nothing can still reference the old view.
+	auto it = std::remove_if(m_vRetiredViews.begin(), m_vRetiredViews.end(), [&](const RetiredView& retired)
+	{
+		if (all || m_frameIndex > retired.retireFrame + MAX_FRAMES_IN_FLIGHT)
+		{
+			vkDestroyImageView(m_device, retired.view, GetAllocationCallbacks());
+			return true;
+		}
+		return false;
+	});
+
+	m_vRetiredViews.erase(it, m_vRetiredViews.end());
+}
@@ -0,0 +1,121 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Loads KTX2 textures and streams their mip chains to the GPU, smallest mip first.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "Ktx2.h"
+#include "MipGenerator.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <memory>
+#include <string>
+
+/*
+	Every texture is created with its full mip chain, but only the mips that have arrived are visible through its image view.
+	The smallest mips are tiny, so a texture becomes visible on the first frame after loading and sharpens as the larger mips arrive.
+	Uploads are spread over frames with a fixed byte budget, which keeps a large load from stalling a frame or blowing up staging memory.
+*/
+struct StreamedTexture
+{
+	Ktx2File source;
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;		// Covers [residentMip, mipCount).
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t mipCount = 0;
+	uint32_t residentMip = 0;				// Most detailed mip that is visible, mipCount while nothing is.
+	uint32_t pendingMips = 0;				// Mips [0, pendingMips) still need uploading, the next one is pendingMips - 1.
+	uint32_t nextBlockRow = 0;				// Large mips are uploaded a band of block rows at a time.
+	bool transcoded = false;				// The device couldn't sample the stored format so we decoded it on the CPU.
+	bool generateMips = false;				// Only the base level is uploaded, the rest of the chain is built on the GPU.
+
+	explicit StreamedTexture(Ktx2File&& file) : source(std::move(file)) {}
+};
+
+using TextureHandle = uint32_t;
+
+class TextureStreamer
+{
+public:
+
+	TextureStreamer() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_queue(VK_NULL_HANDLE),
+		m_commandPool(VK_NULL_HANDLE),
+		m_sampler(VK_NULL_HANDLE),
+		m_stagingBuffer(VK_NULL_HANDLE),
+		m_stagingMemory(VK_NULL_HANDLE),
+		m_pStagingData(nullptr),
+		m_currentSlot(0),
+		m_frameIndex(0)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily);
+	void Destroy();
+
+	// Parses the file and creates the image. Nothing is uploaded until Update() runs.
+	TextureHandle Load(const std::string& filename);
+
+	// Called once per frame. Retires finished uploads, then records and submits the next batch within the budget.
+	void Update();
+
+	_NODISCARD VkImageView GetImageView(TextureHandle handle) const { return m_vTextures[handle]->view; }
+	_NODISCARD VkSampler GetSampler() const { return m_sampler; }
+	_NODISCARD bool IsFullyResident(TextureHandle handle) const { return m_vTextures[handle]->residentMip == 0; }
+
+private:
+
+	struct PendingMip
+	{
+		TextureHandle texture;
+		uint32_t mip;
+	};
+
+	// One slot per frame in flight, each with its own slice of the staging buffer.
+	struct UploadSlot
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<PendingMip> vCompletedMips;	// Mips whose last band was recorded into this slot.
+		std::vector<MipGenResources> vMipGenResources;
+		bool submitted = false;
+	};
+
+	// A replaced view may still be bound by a frame in flight, so it lives until those frames have finished.
+	struct RetiredView
+	{
+		VkImageView view;
+		uint64_t retireFrame;
+	};
+
+	void SelectDeviceFormat(StreamedTexture& texture);
+	void CreateTextureImage(StreamedTexture& texture);
+	void RebuildView(StreamedTexture& texture);
+	bool RecordUploads(VkCommandBuffer commandBuffer, VkDeviceSize stagingBase, UploadSlot& slot);
+	void RetireSlot(UploadSlot& slot);
+	void DestroyRetiredViews(bool all);
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	VkQueue m_queue;
+	VkCommandPool m_commandPool;
+	VkSampler m_sampler;
+	MipGenerator m_mipGenerator;
+
+	VkBuffer m_stagingBuffer;			// Persistently mapped, split evenly between the upload slots.
+	VkDeviceMemory m_stagingMemory;
+	uint8_t* m_pStagingData;
+
+	std::vector<UploadSlot> m_vSlots;
+	uint32_t m_currentSlot;
+	uint64_t m_frameIndex;
+	std::vector<RetiredView> m_vRetiredViews;
+
+	std::vector<std::unique_ptr<StreamedTexture>> m_vTextures;
+};
@@ -0,0 +1,306 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Flat transform hierarchy. Only changed subtrees are updated, one level at a time across the job system.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Below this a level is updated on the calling thread, a job costs more than a few hundred multiplies.
+	constexpr uint32_t PARALLEL_GRAIN = 512;
+}
+
+uint32_t TransformHierarchy::Add(uint32_t parent, const Float4x4& local, uint32_t instance)
+{
+	const uint32_t NODE = Count();
+	if (parent != NO_PARENT && parent >= NODE)
+	{
+		throw std::runtime_error("Transform parent must be added before its children!");
+	}
+
+	// Goes on the end for now, the next Update puts it in breadth first order.
+	m_vSlotOfNode.push_back(NODE);
+	m_vParentNode.push_back(parent);
+
+	m_vLocal.push_back(local);
+	m_vWorld.push_back(Float4x4::Identity());
+	m_vNodeOfSlot.push_back(NODE);
+	m_vInstance.push_back(instance);
+
+	m_topologyChanged = true;
+	return NODE;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const Float4x4& local)
+{
+	const uint32_t SLOT = m_vSlotOfNode[node];
+	m_vLocal[SLOT] = local;
+
+	// A rebuild updates everything anyway.
+	if (!m_topologyChanged)
+	{
+		QueueSlot(SLOT);
+	}
+}
+
+void TransformHierarchy::QueueSlot(uint32_t slot)
+{
+	if (!m_vQueued[slot])
+	{
+		m_vQueued[slot] = 1;
+		m_vDirtyByDepth[m_vDepth[slot]].push_back(slot);
+	}
+}
+
+void TransformHierarchy::SetInstanceTargets(const std::vector<Float4x4*>& vTargets, uint32_t capacity)
+{
+	m_vTargets = vTargets;
+	m_instanceCapacity = capacity;
+
+	// New buffers know nothing, every instance has to be written to each of them.
+	m_vPendingBySlot.assign(vTargets.size(), {});
+	for (auto& vPending : m_vPendingBySlot)
+	{
+		for (uint32_t slot = 0; slot < Count(); slot++)
+		{
+			vPending.push_back(slot);
+		}
+	}
+}
+
+void TransformHierarchy::Rebuild()
+{
+	const uint32_t COUNT = Count();
+
+	// Children of each node, packed by parent.
+	std::vector<uint32_t> childStart(COUNT + 1, 0);
+	for (uint32_t node = 0; node < COUNT; node++)
+	{
+		if (m_vParentNode[node] != NO_PARENT)
+		{
+			childStart[m_vParentNode[node] + 1]++;
+		}
+	}
+	for (uint32_t node = 0; node < COUNT; node++)
+	{
+		childStart[node + 1] += childStart[node];
+	}
+
+	std::vector<uint32_t> children(childStart[COUNT]);
+	std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+	for (uint32_t node = 0; node < COUNT; node++)
+	{
+		if (m_vParentNode[node] != NO_PARENT)
+		{
+			children[fill[m_vParentNode[node]]++] = node;
+		}
+	}
+
+	// Breadth first from every root. Appending a node's children as it's visited keeps them together.
+	std::vector<uint32_t> order;
+	order.reserve(COUNT);
+	for (uint32_t node = 0; node < COUNT; node++)
+	{
+		if (m_vParentNode[node] == NO_PARENT)
+		{
+			order.push_back(node);
+		}
+	}
+
+	std::vector<Float4x4> vLocal(COUNT);
+	std::vector<uint32_t> vInstance(COUNT);
+	m_vParentSlot.assign(COUNT, NO_PARENT);
+	m_vFirstChild.assign(COUNT, 0);
+	m_vChildCount.assign(COUNT, 0);
+	m_vDepth.assign(COUNT, 0);
+
+	uint32_t maxDepth = 0;
+	for (uint32_t slot = 0; slot < order.size(); slot++)
+	{
+		const uint32_t NODE = order[slot];
+		const uint32_t OLD_SLOT = m_vSlotOfNode[NODE];
+
+		vLocal[slot] = m_vLocal[OLD_SLOT];
+		vInstance[slot] = m_vInstance[OLD_SLOT];
+
+		m_vFirstChild[slot] = static_cast<uint32_t>(order.size());
+		m_vChildCount[slot] = childStart[NODE + 1] - childStart[NODE];
+		for (uint32_t c = childStart[NODE]; c < childStart[NODE + 1]; c++)
+		{
+			m_vParentSlot[order.size()] = slot;
+			m_vDepth[order.size()] = m_vDepth[slot] + 1;
+			maxDepth = std::max(maxDepth, m_vDepth[slot] + 1);
+			order.push_back(children[c]);
+		}
+	}
+
+	// Only now, old slots were needed until every node had moved.
+	for (uint32_t slot = 0; slot < COUNT; slot++)
+	{
+		m_vSlotOfNode[order[slot]] = slot;
+	}
+
+	m_vLocal = std::move(vLocal);
+	m_vInstance = std::move(vInstance);
+	m_vNodeOfSlot = std::move(order);
+	m_vWorld.assign(COUNT, Float4x4::Identity());
+	m_vQueued.assign(COUNT, 0);
+
+	m_vDirtyByDepth.resize(maxDepth + 1);
+	for (auto& vDirty : m_vDirtyByDepth)
+	{
+		vDirty.clear();
+	}
+
+	// Everything moved, so everything is recomputed: queue the roots and their subtrees follow.
+	for (uint32_t slot = 0; slot < COUNT && m_vParentSlot[slot] == NO_PARENT; slot++)
+	{
+		QueueSlot(slot);
+	}
+
+	for (auto& vPending : m_vPendingBySlot)
+	{
+		vPending.clear();
+	}
+
+	m_topologyChanged = false;
+}
+
+void TransformHierarchy::UpdateLevel(JobSystem& jobs, const std::vector<uint32_t>& vSlots, Float4x4* pTarget)
+{
+	auto update = [this, &vSlots, pTarget](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const uint32_t SLOT = vSlots[i];
+			const uint32_t PARENT = m_vParentSlot[SLOT];
+
+			// Parents are a level up, already final.
+			if (PARENT == NO_PARENT)
+			{
+				m_vWorld[SLOT] = m_vLocal[SLOT];
+			}
+			else
+			{
+				Multiply(m_vWorld[PARENT], m_vLocal[SLOT], m_vWorld[SLOT]);
+			}
+
+			const uint32_t INSTANCE = m_vInstance[SLOT];
+			if (pTarget != nullptr && INSTANCE < m_instanceCapacity)
+			{
+				StoreStreaming(pTarget + INSTANCE, m_vWorld[SLOT]);
+			}
+		}
+	};
+
+	const uint32_t COUNT = static_cast<uint32_t>(vSlots.size());
+	if (COUNT < PARALLEL_GRAIN)
+	{
+		update(0, COUNT);
+	}
+	else
+	{
+		jobs.Wait(jobs.ParallelFor(COUNT, PARALLEL_GRAIN, update));
+	}
+}
+
+void TransformHierarchy::Update(JobSystem& jobs, uint32_t frameSlot)
+{
+	if (m_topologyChanged)
+	{
+		Rebuild();
+	}
+
+	Float4x4* pTarget = frameSlot < m_vTargets.size() ? m_vTargets[frameSlot] : nullptr;
+
+	// Catch this frame's buffer up on whatever changed while the GPU was still reading it.
+	if (pTarget != nullptr)
+	{
+		std::vector<uint32_t>& vPending = m_vPendingBySlot[frameSlot];
+		for (uint32_t slot : vPending)
+		{
+			if (m_vInstance[slot] < m_instanceCapacity)
+			{
+				StoreStreaming(pTarget + m_vInstance[slot], m_vWorld[slot]);
+			}
+		}
+		vPending.clear();
+	}
+
+	m_vChanged.clear();
+	m_vNextLevel.clear();
+
+	for (uint32_t depth = 0; depth < m_vDirtyByDepth.size(); depth++)
+	{
+		// This level's own changes, plus the children of everything updated on the level above.
+		m_vLevel.swap(m_vDirtyByDepth[depth]);
+		m_vLevel.insert(m_vLevel.end(), m_vNextLevel.begin(), m_vNextLevel.end());
+		m_vDirtyByDepth[depth].clear();
+
+		if (m_vLevel.empty())
+		{
+			continue;
+		}
+
+		UpdateLevel(jobs, m_vLevel, pTarget);
+
+		m_vNextLevel.clear();
+		for (uint32_t slot : m_vLevel)
+		{
+			for (uint32_t child = m_vFirstChild[slot]; child < m_vFirstChild[slot] + m_vChildCount[slot]; child++)
+			{
+				if (!m_vQueued[child])
+				{
+					m_vQueued[child] = 1;
+					m_vNextLevel.push_back(child);
+				}
+			}
+		}
+
+		m_vChanged.insert(m_vChanged.end(), m_vLevel.begin(), m_vLevel.end());
+		m_vLevel.clear();
+	}
+
+	if (m_vChanged.empty())
+	{
+		return;
+	}
+
+	for (uint32_t slot : m_vChanged)
+	{
+		m_vQueued[slot] = 0;
+	}
+
+	// The other frames' buffers get these when their turn comes. Past a full copy's worth, just send everything.
+	for (uint32_t i = 0; i < m_vPendingBySlot.size(); i++)
+	{
+		if (i == frameSlot && pTarget != nullptr)
+		{
+			continue;
+		}
+
+		std::vector<uint32_t>& vPending = m_vPendingBySlot[i];
+		if (vPending.size() + m_vChanged.size() > Count())
+		{
+			vPending.resize(Count());
+			for (uint32_t slot = 0; slot < Count(); slot++)
+			{
+				vPending[slot] = slot;
+			}
+		}
+		else
+		{
+			vPending.insert(vPending.end(), m_vChanged.begin(), m_vChanged.end());
+		}
+	}
+
+	if (pTarget != nullptr)
+	{
+		StreamingFence();
+	}
+}
@@ -0,0 +1,85 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Flat transform hierarchy. Only changed subtrees are updated, one level at a time across the job system.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MathTypes.h"
+#include "JobSystem.h"
+
+#include <vector>
+#include <cstdint>
+
+/*
+	Nodes are stored breadth first, so every parent comes before its children and a node's children sit next to each other.
+	That makes each depth a contiguous run, and lets a changed node find its whole subtree without chasing pointers.
+
+	Changing a local matrix queues the node. Update walks down from the queued nodes only, a level at a time, so
+	a frame where nothing moved does no work at all. World matrices of nodes that have an instance are streamed
+	straight into the mapped instance buffer for the frame, and queued for the other frames' buffers.
+*/
+class TransformHierarchy
+{
+public:
+
+	static constexpr uint32_t NO_PARENT = UINT32_MAX;
+	static constexpr uint32_t NO_INSTANCE = UINT32_MAX;
+
+	TransformHierarchy() :
+		m_topologyChanged(false),
+		m_instanceCapacity(0)
+	{}
+
+	// The parent must already exist. Returns the node's id, which stays the same however the nodes are reordered.
+	uint32_t Add(uint32_t parent, const Float4x4& local, uint32_t instance = NO_INSTANCE);
+
+	void SetLocal(uint32_t node, const Float4x4& local);
+	_NODISCARD const Float4x4& GetLocal(uint32_t node) const { return m_vLocal[m_vSlotOfNode[node]]; }
+
+	// As of the last Update.
+	_NODISCARD const Float4x4& GetWorld(uint32_t node) const { return m_vWorld[m_vSlotOfNode[node]]; }
+
+	// One mapped buffer per frame in flight, each with room for capacity matrices, indexed by instance.
+	void SetInstanceTargets(const std::vector<Float4x4*>& vTargets, uint32_t capacity);
+
+	// Call once the frame slot's buffer is no longer read by the GPU. Not from a job system worker.
+	void Update(JobSystem& jobs, uint32_t frameSlot);
+
+	// Whether the last Update changed any world matrix.
+	_NODISCARD bool Moved() const { return !m_vChanged.empty(); }
+
+	_NODISCARD uint32_t Count() const { return static_cast<uint32_t>(m_vSlotOfNode.size()); }
+
+private:
+
+	void Rebuild();
+	void QueueSlot(uint32_t slot);
+	void UpdateLevel(JobSystem& jobs, const std::vector<uint32_t>& vSlots, Float4x4* pTarget);
+
+	// By node id. Only used to rebuild the order when nodes are added.
+	std::vector<uint32_t> m_vSlotOfNode;
+	std::vector<uint32_t> m_vParentNode;
+
+	// By slot, breadth first.
+	std::vector<Float4x4> m_vLocal;
+	std::vector<Float4x4> m_vWorld;
+	std::vector<uint32_t> m_vNodeOfSlot;
+	std::vector<uint32_t> m_vParentSlot;
+	std::vector<uint32_t> m_vFirstChild;
+	std::vector<uint32_t> m_vChildCount;
+	std::vector<uint32_t> m_vDepth;
+	std::vector<uint32_t> m_vInstance;
+	std::vector<uint8_t> m_vQueued;					// Already in a dirty list, so it isn't added twice.
+
+	std::vector<std::vector<uint32_t>> m_vDirtyByDepth;	// Slots whose local matrix changed, by depth.
+	std::vector<uint32_t> m_vLevel;						// Scratch, the level being updated.
+	std::vector<uint32_t> m_vNextLevel;
+	std::vector<uint32_t> m_vChanged;					// Every slot updated this frame.
+	bool m_topologyChanged;
+
+	std::vector<Float4x4*> m_vTargets;
+	std::vector<std::vector<uint32_t>> m_vPendingBySlot;	// Changed since that frame slot's buffer was last written.
+	uint32_t m_instanceCapacity;
+};
@@ -0,0 +1,238 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Vertex layouts, and the quantisation that packs full precision vertices into the one the GPU reads.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	constexpr float UNORM16_MAX = 65535.0f;
+	constexpr float SNORM16_MAX = 32767.0f;
+
+	uint16_t ToUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * UNORM16_MAX));
+	}
+
+	int16_t ToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * SNORM16_MAX));
+	}
+
+	// Both -32768 and -32767 are -1, as the hardware reads them.
+	float FromSnorm16(int16_t value)
+	{
+		return std::max(value / SNORM16_MAX, -1.0f);
+	}
+
+	float NonZeroSign(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+VertexQuantization ComputeQuantization(const MeshVertex* pVertices, uint32_t vertexCount)
+{
+	VertexQuantization quantization{};
+	if (vertexCount == 0)
+	{
+		return quantization;
+	}
+
+	Float3 minimum = pVertices[0].position;
+	Float3 maximum = pVertices[0].position;
+	for (uint32_t v = 1; v < vertexCount; v++)
+	{
+		minimum = Min(minimum, pVertices[v].position);
+		maximum = Max(maximum, pVertices[v].position);
+	}
+
+	// Each axis gets its own scale, a long thin mesh doesn't waste precision across its short axes.
+	const float MINIMUM[3] = { minimum.x, minimum.y, minimum.z };
+	const float MAXIMUM[3] = { maximum.x, maximum.y, maximum.z };
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		quantization.offset[axis] = MINIMUM[axis];
+		quantization.scale[axis] = MAXIMUM[axis] - MINIMUM[axis];
+	}
+
+	return quantization;
+}
+
+std::vector<QuantizedVertex> QuantizeVertices(const MeshVertex* pVertices, uint32_t vertexCount, const VertexQuantization& quantization)
+{
+	float inverseScale[3];
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		inverseScale[axis] = quantization.scale[axis] > 0.0f ? 1.0f / quantization.scale[axis] : 0.0f;
+	}
+
+	std::vector<QuantizedVertex> vQuantized(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		const MeshVertex& SOURCE = pVertices[v];
+		QuantizedVertex& vertex = vQuantized[v];
+
+		vertex.position[0] = ToUnorm16((SOURCE.position.x - quantization.offset[0]) * inverseScale[0]);
+		vertex.position[1] = ToUnorm16((SOURCE.position.y - quantization.offset[1]) * inverseScale[1]);
+		vertex.position[2] = ToUnorm16((SOURCE.position.z - quantization.offset[2]) * inverseScale[2]);
+		vertex.position[3] = SOURCE.tangent[3] < 0.0f ? 0 : UINT16_MAX;
+
+		OctahedralEncode(SOURCE.normal, vertex.normal);
+		OctahedralEncode({ SOURCE.tangent[0], SOURCE.tangent[1], SOURCE.tangent[2] }, vertex.tangent);
+
+		vertex.uv[0] = FloatToHalf(SOURCE.uv[0]);
+		vertex.uv[1] = FloatToHalf(SOURCE.uv[1]);
+	}
+
+	return vQuantized;
+}
+
+MeshVertex DequantizeVertex(const QuantizedVertex& vertex, const VertexQuantization& quantization)
+{
+	MeshVertex result;
+	result.position.x = quantization.offset[0] + quantization.scale[0] * (vertex.position[0] / UNORM16_MAX);
+	result.position.y = quantization.offset[1] + quantization.scale[1] * (vertex.position[1] / UNORM16_MAX);
+	result.position.z = quantization.offset[2] + quantization.scale[2] * (vertex.position[2] / UNORM16_MAX);
+	result.normal = OctahedralDecode(vertex.normal);
+
+	const Float3 TANGENT = OctahedralDecode(vertex.tangent);
+	result.tangent[0] = TANGENT.x;
+	result.tangent[1] = TANGENT.y;
+	result.tangent[2] = TANGENT.z;
+	result.tangent[3] = vertex.position[3] == 0 ? -1.0f : 1.0f;
+
+	result.uv[0] = HalfToFloat(vertex.uv[0]);
+	result.uv[1] = HalfToFloat(vertex.uv[1]);
+	return result;
+}
+
+VkVertexInputBindingDescription QuantizedVertexBinding(uint32_t binding)
+{
+	VkVertexInputBindingDescription description{};
+	description.binding = binding;
+	description.stride = sizeof(QuantizedVertex);
+	description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return description;
+}
+
+std::vector<VkVertexInputAttributeDescription> QuantizedVertexAttributes(uint32_t binding)
+{
+	std::vector<VkVertexInputAttributeDescription> vAttributes;
+	uint32_t location = 0;
+
+#define DESCRIBE_VERTEX_MEMBER(TYPE, NAME, COUNT, FORMAT) \
+	vAttributes.push_back({ location++, binding, FORMAT, static_cast<uint32_t>(offsetof(QuantizedVertex, NAME)) });
+
+	QUANTIZED_VERTEX_LAYOUT(DESCRIBE_VERTEX_MEMBER)
+
+#undef DESCRIBE_VERTEX_MEMBER
+
+	return vAttributes;
+}
+
+void OctahedralEncode(const Float3& direction, int16_t encoded[2])
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half out over the corners of the square.
+	const float LENGTH = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+	if (LENGTH == 0.0f)
+	{
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float u = direction.x / LENGTH;
+	float v = direction.y / LENGTH;
+	if (direction.z < 0.0f)
+	{
+		const float FOLDED_U = (1.0f - std::fabs(v)) * NonZeroSign(u);
+		const float FOLDED_V = (1.0f - std::fabs(u)) * NonZeroSign(v);
+		u = FOLDED_U;
+		v = FOLDED_V;
+	}
+
+	encoded[0] = ToSnorm16(u);
+	encoded[1] = ToSnorm16(v);
+}
+
+Float3 OctahedralDecode(const int16_t encoded[2])
+{
+	// The same as the vertex shader, so tools see what the GPU will.
+	Float3 direction = { FromSnorm16(encoded[0]), FromSnorm16(encoded[1]), 0.0f };
+	direction.z = 1.0f - std::fabs(direction.x) - std::fabs(direction.y);
+
+	const float FOLD = std::max(-direction.z, 0.0f);
+	direction.x += direction.x >= 0.0f ? -FOLD : FOLD;
+	direction.y += direction.y >= 0.0f ? -FOLD : FOLD;
+
+	return direction * (1.0f / std::sqrt(Dot(direction, direction)));
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const uint16_t SIGN = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	const uint32_t MAGNITUDE = bits & 0x7FFFFFFF;
+
+	// Infinity stays infinity, NaN stays NaN.
+	if (MAGNITUDE >= 0x7F800000)
+	{
+		return static_cast<uint16_t>(SIGN | 0x7C00 | (MAGNITUDE > 0x7F800000 ? 0x0200 : 0));
+	}
+
+	// 65520 and up round to infinity.
+	if (MAGNITUDE >= 0x477FF000)
+	{
+		return static_cast<uint16_t>(SIGN | 0x7C00);
+	}
+
+	// Below the smallest normal half, 2^-14. Scaled so a unit is the smallest subnormal and rounded as a float.
+	if (MAGNITUDE < 0x38800000)
+	{
+		float magnitude;
+		std::memcpy(&magnitude, &MAGNITUDE, sizeof(magnitude));
+		return static_cast<uint16_t>(SIGN | std::lrint(magnitude * 16777216.0f));
+	}
+
+	// Rebias the exponent and drop 13 mantissa bits, rounding to even. A carry out of the mantissa bumps the exponent, which is right.
+	const uint32_t REBIASED = MAGNITUDE - 0x38000000;
+	return static_cast<uint16_t>(SIGN | ((REBIASED + 0x0FFF + ((REBIASED >> 13) & 1)) >> 13));
+}
+
+float HalfToFloat(uint16_t half)
+{
+	const uint32_t SIGN = static_cast<uint32_t>(half & 0x8000) << 16;
+	const uint32_t EXPONENT = (half >> 10) & 0x1F;
+	const uint32_t MANTISSA = half & 0x03FF;
+
+	uint32_t bits;
+	if (EXPONENT == 0)
+	{
+		// Zero or subnormal, exactly representable as a float.
+		const float MAGNITUDE = std::ldexp(static_cast<float>(MANTISSA), -24);
+		std::memcpy(&bits, &MAGNITUDE, sizeof(bits));
+		bits |= SIGN;
+	}
+	else if (EXPONENT == 0x1F)
+	{
+		bits = SIGN | 0x7F800000 | (MANTISSA << 13);
+	}
+	else
+	{
+		bits = SIGN | ((EXPONENT + 112) << 23) | (MANTISSA << 13);
+	}
+
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
@@ -0,0 +1,70 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Vertex layouts, and the quantisation that packs full precision vertices into the one the GPU reads.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include "MathTypes.h"
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <cstdint>
+
+// Full precision, what tools produce and what simplification and optimisation work on. Position must stay first.
+struct MeshVertex
+{
+	Float3 position;
+	Float3 normal;
+	float tangent[4];		// xyz, w is the bitangent's sign.
+	float uv[2];
+};
+
+/*
+	The quantised layout, declared once. Each entry is the member's type, name, element count and the format the
+	vertex shader reads it as. QuantizedVertex and its attribute descriptions are both generated from this, so
+	adding or changing an attribute here is the only edit needed on the C++ side. Locations follow declaration order.
+*/
+#define QUANTIZED_VERTEX_LAYOUT(ATTRIBUTE)																	\
+	ATTRIBUTE(uint16_t,	position,	4,	VK_FORMAT_R16G16B16A16_UNORM)	/* xyz within the mesh's bounds, w the bitangent sign. */	\
+	ATTRIBUTE(int16_t,	normal,		2,	VK_FORMAT_R16G16_SNORM)			/* Octahedral. */											\
+	ATTRIBUTE(int16_t,	tangent,	2,	VK_FORMAT_R16G16_SNORM)			/* Octahedral. */											\
+	ATTRIBUTE(uint16_t,	uv,			2,	VK_FORMAT_R16G16_SFLOAT)		/* Half floats. */
+
+#define DECLARE_VERTEX_MEMBER(TYPE, NAME, COUNT, FORMAT) TYPE NAME[COUNT];
+
+struct QuantizedVertex
+{
+	QUANTIZED_VERTEX_LAYOUT(DECLARE_VERTEX_MEMBER)
+};
+
+#undef DECLARE_VERTEX_MEMBER
+
+static_assert(sizeof(QuantizedVertex) == 20, "Quantized vertex layout changed, update the vertex shaders and bump the scene file version!");
+
+// Position = offset + scale * stored, per axis, with stored read as 0 to 1. Chosen per mesh to cover its bounds.
+struct VertexQuantization
+{
+	float offset[3];
+	float scale[3];
+};
+
+VertexQuantization ComputeQuantization(const MeshVertex* pVertices, uint32_t vertexCount);
+
+std::vector<QuantizedVertex> QuantizeVertices(const MeshVertex* pVertices, uint32_t vertexCount, const VertexQuantization& quantization);
+
+// What the vertex shader will see, for checking the error a layout introduces.
+MeshVertex DequantizeVertex(const QuantizedVertex& vertex, const VertexQuantization& quantization);
+
+VkVertexInputBindingDescription QuantizedVertexBinding(uint32_t binding);
+std::vector<VkVertexInputAttributeDescription> QuantizedVertexAttributes(uint32_t binding);
+
+// Octahedral unit vectors: the sphere folded onto a square, two components instead of three with an even error everywhere.
+void OctahedralEncode(const Float3& direction, int16_t encoded[2]);
+Float3 OctahedralDecode(const int16_t encoded[2]);
+
+// IEEE half precision, rounded to nearest even.
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t half);
@@ -0,0 +1,979 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Software paged virtual texturing. A fixed page cache on the GPU, fed from disk by a loader thread.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#include "VirtualTexture.h"
+#include "VulkanUtils.h"
+#include "Constants.h"
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#define MAX_FRAMES_IN_FLIGHT		Render_constants::g_maxFramesInFlight
+#define CACHE_SLOTS_PER_SIDE		VirtualTexture_constants::g_cacheSlotsPerSide
+#define PAGES_PER_FRAME				VirtualTexture_constants::g_pagesUploadedPerFrame
+
+namespace
+{
+	constexpr uint32_t PAGE_FILE_MAGIC = 0x58455456; // 'VTEX'
+	constexpr uint32_t PAGE_FILE_VERSION = 1;
+
+	// Must match VtParams in virtual_texture.glsl (std140).
+	struct VtParams
+	{
+		float virtualSize;
+		float pageSize;
+		float border;
+		float cacheSize;
+		uint32_t pagesPerSide;
+		uint32_t mipCount;
+		uint32_t frameNumber;
+		uint32_t padding;
+	};
+}
+
+// =================================================================================================================================================================
+// Page file.
+
+void PageFile::Open(const std::string& filename)
+{
+	m_file.open(filename, std::ios::binary);
+	if (!m_file.is_open())
+	{
+		throw std::runtime_error("Failed to open virtual texture page file!");
+	}
+
+	m_file.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+	if (!m_file || m_header.magic != PAGE_FILE_MAGIC || m_header.version != PAGE_FILE_VERSION)
+	{
+		throw std::runtime_error("Not a virtual texture page file!");
+	}
+
+	// Past 2^15 pages per side, page ids no longer fit in 32 bits.
+	const uint32_t PAGES = m_header.pagesPerSide;
+	if (PAGES == 0 || (PAGES & (PAGES - 1)) != 0 || PAGES > (1u << 15))
+	{
+		throw std::runtime_error("Virtual texture must be a power of two number of pages!");
+	}
+
+	// Exactly enough mips to reach a single page, counted rather than shifted by so a bad count can't shift too far.
+	uint32_t mipsToSinglePage = 1;
+	while ((PAGES >> (mipsToSinglePage - 1)) > 1)
+	{
+		mipsToSinglePage++;
+	}
+
+	if (m_header.mipCount != mipsToSinglePage)
+	{
+		throw std::runtime_error("Virtual texture mips must go down to a single page!");
+	}
+
+	const FormatBlockInfo BLOCK = GetFormatBlockInfo(static_cast<VkFormat>(m_header.format));
+	const uint32_t STORED_SIZE = m_header.pageSize + 2 * m_header.border;
+	if (BLOCK.bytesPerBlock == 0 || m_header.pageSize == 0 || STORED_SIZE % BLOCK.blockWidth != 0 || STORED_SIZE % BLOCK.blockHeight != 0)
+	{
+		throw std::runtime_error("Unsupported virtual texture page format!");
+	}
+
+	m_pageBytes = (STORED_SIZE / BLOCK.blockWidth) * (STORED_SIZE / BLOCK.blockHeight) * BLOCK.bytesPerBlock;
+
+	m_vMipPageOffsets.resize(m_header.mipCount + 1);
+	m_vMipPageOffsets[0] = 0;
+	for (uint32_t mip = 0; mip < m_header.mipCount; mip++)
+	{
+		const uint32_t SIDE = PAGES >> mip;
+		m_vMipPageOffsets[mip + 1] = m_vMipPageOffsets[mip] + SIDE * SIDE;
+	}
+
+	// Pages are read on demand, so a short file would otherwise only show up as a failed read much later.
+	m_file.seekg(0, std::ios::end);
+	const uint64_t FILE_BYTES = static_cast<uint64_t>(m_file.tellg());
+	if (FILE_BYTES < sizeof(PageFileHeader) + static_cast<uint64_t>(GetTotalPages()) * m_pageBytes)
+	{
+		throw std::runtime_error("Virtual texture page file is truncated!");
+	}
+}
+
+void PageFile::ReadPage(uint32_t pageId, uint8_t* pDst)
+{
+	const std::streamoff OFFSET = sizeof(PageFileHeader) + static_cast<std::streamoff>(pageId) * m_pageBytes;
+
+	m_file.seekg(OFFSET);
+	m_file.read(reinterpret_cast<char*>(pDst), m_pageBytes);
+
+	if (!m_file)
+	{
+		throw std::runtime_error("Failed to read virtual texture page!");
+	}
+}
+
+void PageFile::GetPageCoords(uint32_t pageId, uint32_t& mip, uint32_t& x, uint32_t& y) const
+{
+	mip = static_cast<uint32_t>(std::upper_bound(m_vMipPageOffsets.begin(), m_vMipPageOffsets.end(), pageId) - m_vMipPageOffsets.begin()) - 1;
+
+	const uint32_t LOCAL = pageId - m_vMipPageOffsets[mip];
+	const uint32_t SIDE = m_header.pagesPerSide >> mip;
+	x = LOCAL % SIDE;
+	y = LOCAL / SIDE;
+}
+
+void PageFile::Build(const std::string& filename, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t pageSize, uint32_t border)
+{
+	const uint32_t PAGES = width / pageSize;
+	if (PAGES == 0 || PAGES * pageSize != width || (PAGES & (PAGES - 1)) != 0 || rgba.size() != static_cast<size_t>(width) * width * 4)
+	{
+		throw std::runtime_error("Virtual texture source must be square and a power of two multiple of the page size!");
+	}
+
+	PageFileHeader header{};
+	header.magic = PAGE_FILE_MAGIC;
+	header.version = PAGE_FILE_VERSION;
+	header.format = VK_FORMAT_R8G8B8A8_UNORM;
+	header.pageSize = pageSize;
+	header.border = border;
+	header.pagesPerSide = PAGES;
+	header.mipCount = 1;
+	while ((PAGES >> (header.mipCount - 1)) > 1)
+	{
+		header.mipCount++;
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to create virtual texture page file!");
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const uint32_t STORED_SIZE = pageSize + 2 * border;
+	std::vector<uint8_t> page(static_cast<size_t>(STORED_SIZE) * STORED_SIZE * 4);
+	std::vector<uint8_t> mipImage = rgba;
+	uint32_t mipWidth = width;
+
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+	{
+		const uint32_t SIDE = PAGES >> mip;
+		for (uint32_t py = 0; py < SIDE; py++)
+		{
+			for (uint32_t px = 0; px < SIDE; px++)
+			{
+				// Borders are copied from the neighbouring pages, clamped at the edge of the texture.
+				for (uint32_t y = 0; y < STORED_SIZE; y++)
+				{
+					const int64_t SRC_Y = std::clamp<int64_t>(static_cast<int64_t>(py * pageSize + y) - border, 0, mipWidth - 1);
+					for (uint32_t x = 0; x < STORED_SIZE; x++)
+					{
+						const int64_t SRC_X = std::clamp<int64_t>(static_cast<int64_t>(px * pageSize + x) - border, 0, mipWidth - 1);
+						std::memcpy(&page[(static_cast<size_t>(y) * STORED_SIZE + x) * 4], &mipImage[(SRC_Y * mipWidth + SRC_X) * 4], 4);
+					}
+				}
+
+				file.write(reinterpret_cast<const char*>(page.data()), page.size());
+			}
+		}
+
+		// Box filter down to the next mip.
+		const uint32_t NEXT_WIDTH = mipWidth / 2;
+		if (NEXT_WIDTH < pageSize)
+		{
+			break;
+		}
+
+		std::vector<uint8_t> next(static_cast<size_t>(NEXT_WIDTH) * NEXT_WIDTH * 4);
+		for (uint32_t y = 0; y < NEXT_WIDTH; y++)
+		{
+			for (uint32_t x = 0; x < NEXT_WIDTH; x++)
+			{
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					const size_t ROW0 = (static_cast<size_t>(y) * 2 * mipWidth + x * 2) * 4 + c;
+					const size_t ROW1 = ROW0 + static_cast<size_t>(mipWidth) * 4;
+					next[(static_cast<size_t>(y) * NEXT_WIDTH + x) * 4 + c] = static_cast<uint8_t>((mipImage[ROW0] + mipImage[ROW0 + 4] + mipImage[ROW1] + mipImage[ROW1 + 4] + 2) / 4);
+				}
+			}
+		}
+
+		mipImage.swap(next);
+		mipWidth = NEXT_WIDTH;
+	}
+}
+
+// =================================================================================================================================================================
+// Virtual texture.
+
+void VirtualTexture::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, const std::string& filename)
+{
+	m_physicalDevice = physicalDevice;
+	m_device = device;
+	m_queue = queue;
+
+	m_pageFile.Open(filename);
+
+	const uint32_t TOTAL_PAGES = m_pageFile.GetTotalPages();
+	m_vPageToSlot.assign(TOTAL_PAGES, -1);
+	m_vRequested.assign(TOTAL_PAGES, 0);
+	m_vPageTable.assign(TOTAL_PAGES, PageTableEntry{ 0, 0, 0, 0 });
+
+	// Every slot starts free at the back of the LRU list, the pinned slot is taken out when the coarsest page is loaded.
+	m_cacheSlotsPerSide = CACHE_SLOTS_PER_SIDE;
+	m_vSlots.resize(static_cast<size_t>(m_cacheSlotsPerSide) * m_cacheSlotsPerSide);
+	for (uint32_t i = 0; i < m_vSlots.size(); i++)
+	{
+		m_vSlots[i].lruPosition = m_lru.insert(m_lru.end(), i);
+	}
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create virtual texture command pool!");
+	}
+
+	CreateImages();
+	CreateFrameResources();
+	CreateDescriptors();
+	LoadPinnedPage();
+
+	m_loader = std::thread(&VirtualTexture::LoaderThread, this);
+}
+
+void VirtualTexture::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all();
+
+	if (m_loader.joinable())
+	{
+		m_loader.join();
+	}
+
+	// Caller is expected to have waited for the device to go idle.
+	for (auto& frame : m_vFrames)
+	{
+		vkDestroyBuffer(m_device, frame.feedbackBuffer, GetAllocationCallbacks());
+		vkFreeMemory(m_device, frame.feedbackMemory, GetAllocationCallbacks());
+		vkDestroyBuffer(m_device, frame.paramsBuffer, GetAllocationCallbacks());
+		vkFreeMemory(m_device, frame.paramsMemory, GetAllocationCallbacks());
+		vkDestroyFence(m_device, frame.fence, GetAllocationCallbacks());
+	}
+	m_vFrames.clear();
+
+	vkDestroyBuffer(m_device, m_stagingBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_stagingMemory, GetAllocationCallbacks());
+
+	vkDestroySampler(m_device, m_cacheSampler, GetAllocationCallbacks());
+	vkDestroySampler(m_device, m_pageTableSampler, GetAllocationCallbacks());
+	vkDestroyImageView(m_device, m_cacheView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_cacheImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_cacheMemory, GetAllocationCallbacks());
+	vkDestroyImageView(m_device, m_pageTableView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_pageTableImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_pageTableMemory, GetAllocationCallbacks());
+
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, GetAllocationCallbacks()); // Frees the sets.
+	vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, GetAllocationCallbacks());
+
+	vkDestroyCommandPool(m_device, m_commandPool, GetAllocationCallbacks());
+}
+
+void VirtualTexture::CreateImages()
+{
+	const PageFileHeader& HEADER = m_pageFile.GetHeader();
+	const uint32_t STORED_SIZE = HEADER.pageSize + 2 * HEADER.border;
+
+	// Physical page cache. Its size is fixed, which is what bounds memory use no matter how big the virtual texture is.
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = static_cast<VkFormat>(HEADER.format);
+	imageInfo.extent = { m_cacheSlotsPerSide * STORED_SIZE, m_cacheSlotsPerSide * STORED_SIZE, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_cacheImage, m_cacheMemory);
+
+	// Page table, one texel per virtual page and one mip per virtual mip.
+	imageInfo.format = VK_FORMAT_R8G8B8A8_UINT;
+	imageInfo.extent = { HEADER.pagesPerSide, HEADER.pagesPerSide, 1 };
+	imageInfo.mipLevels = HEADER.mipCount;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_pageTableImage, m_pageTableMemory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.image = m_cacheImage;
+	viewInfo.format = static_cast<VkFormat>(HEADER.format);
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_cacheView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create page cache view!");
+	}
+
+	viewInfo.image = m_pageTableImage;
+	viewInfo.format = VK_FORMAT_R8G8B8A8_UINT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, HEADER.mipCount, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_pageTableView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create page table view!");
+	}
+
+	// The cache is sampled bilinearly inside a page, the borders make that safe. The page table is only ever fetched.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.maxLod = 0.0f;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_cacheSampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create page cache sampler!");
+	}
+
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, GetAllocationCallbacks(), &m_pageTableSampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create page table sampler!");
+	}
+}
+
+void VirtualTexture::CreateFrameResources()
+{
+	const VkDeviceSize FEEDBACK_BYTES = ((m_pageFile.GetTotalPages() + 31) / 32) * sizeof(uint32_t);
+	const VkDeviceSize STAGING_PER_FRAME = static_cast<VkDeviceSize>(PAGES_PER_FRAME) * m_pageFile.GetPageBytes() + m_vPageTable.size() * sizeof(PageTableEntry);
+
+	m_vFrames.resize(MAX_FRAMES_IN_FLIGHT);
+
+	std::vector<VkCommandBuffer> commandBuffers(m_vFrames.size());
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate virtual texture command buffers!");
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	for (size_t i = 0; i < m_vFrames.size(); i++)
+	{
+		FrameResources& frame = m_vFrames[i];
+		frame.commandBuffer = commandBuffers[i];
+
+		if (vkCreateFence(m_device, &fenceInfo, GetAllocationCallbacks(), &frame.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create virtual texture fence!");
+		}
+
+		// Feedback is written by the GPU and read back here, so it lives in host visible memory.
+		CreateBuffer
+		(
+			m_physicalDevice, m_device, FEEDBACK_BYTES,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			frame.feedbackBuffer, frame.feedbackMemory
+		);
+		vkMapMemory(m_device, frame.feedbackMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&frame.pFeedback));
+		std::memset(frame.pFeedback, 0, static_cast<size_t>(FEEDBACK_BYTES));
+
+		CreateBuffer
+		(
+			m_physicalDevice, m_device, sizeof(VtParams),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			frame.paramsBuffer, frame.paramsMemory
+		);
+		vkMapMemory(m_device, frame.paramsMemory, 0, VK_WHOLE_SIZE, 0, &frame.pParams);
+		WriteParams(frame);
+	}
+
+	CreateBuffer
+	(
+		m_physicalDevice, m_device, STAGING_PER_FRAME * m_vFrames.size(),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_stagingBuffer, m_stagingMemory
+	);
+	vkMapMemory(m_device, m_stagingMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&m_pStagingData));
+}
+
+void VirtualTexture::CreateDescriptors()
+{
+	// Page table, cache, feedback and params, in the order virtual_texture.glsl declares them.
+	const VkDescriptorType TYPES[4] =
+	{
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+	};
+
+	VkDescriptorSetLayoutBinding bindings[4]{};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = TYPES[i];
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_descriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create virtual texture descriptor set layout!");
+	}
+
+	const uint32_t FRAME_COUNT = static_cast<uint32_t>(m_vFrames.size());
+
+	VkDescriptorPoolSize poolSizes[3]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = FRAME_COUNT * 2;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = FRAME_COUNT;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[2].descriptorCount = FRAME_COUNT;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = FRAME_COUNT;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_descriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create virtual texture descriptor pool!");
+	}
+
+	const VkDescriptorImageInfo IMAGE_INFOS[2] =
+	{
+		{ m_pageTableSampler, m_pageTableView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ m_cacheSampler, m_cacheView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+	};
+
+	for (FrameResources& frame : m_vFrames)
+	{
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(m_device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate virtual texture descriptor sets!");
+		}
+
+		const VkDescriptorBufferInfo BUFFER_INFOS[2] =
+		{
+			{ frame.feedbackBuffer, 0, VK_WHOLE_SIZE },
+			{ frame.paramsBuffer, 0, VK_WHOLE_SIZE }
+		};
+
+		VkWriteDescriptorSet writes[4]{};
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorType = TYPES[i];
+			writes[i].descriptorCount = 1;
+		}
+		writes[0].pImageInfo = &IMAGE_INFOS[0];
+		writes[1].pImageInfo = &IMAGE_INFOS[1];
+		writes[2].pBufferInfo = &BUFFER_INFOS[0];
+		writes[3].pBufferInfo = &BUFFER_INFOS[1];
+
+		vkUpdateDescriptorSets(m_device, 4, writes, 0, nullptr);
+	}
+}
+
+void VirtualTexture::LoadPinnedPage()
+{
+	// The single page of the coarsest mip is always resident, so every lookup has something to fall back on.
+	const uint32_t PINNED_PAGE = m_pageFile.GetTotalPages() - 1;
+
+	std::vector<LoadedPage> pages(1);
+	pages[0].pageId = PINNED_PAGE;
+	pages[0].data.resize(m_pageFile.GetPageBytes());
+	m_pageFile.ReadPage(PINNED_PAGE, pages[0].data.data());
+
+	uint32_t slotIndex;
+	AllocateSlot(slotIndex);
+	m_lru.erase(m_vSlots[slotIndex].lruPosition);
+	m_vSlots[slotIndex].pinned = true;
+	MapPage(PINNED_PAGE, slotIndex);
+
+	// Both images start out UNDEFINED, so bring them to the layout every later upload expects before the normal path runs.
+	SubmitImmediate(m_device, m_commandPool, m_queue, [&](VkCommandBuffer commandBuffer)
+	{
+		VkImageMemoryBarrier barriers[2]{};
+		for (auto& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		}
+		barriers[0].image = m_cacheImage;
+		barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barriers[1].image = m_pageTableImage;
+		barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+		RecordUploads(commandBuffer, 0, pages);
+	});
+}
+
+// =================================================================================================================================================================
+// Per frame.
+
+void VirtualTexture::BeginFrame(uint32_t frameSlot)
+{
+	// A page the loader couldn't read is as fatal as one read on this thread would have been.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_loaderError)
+		{
+			std::rethrow_exception(m_loaderError);
+		}
+	}
+
+	m_frameNumber++;
+	FrameResources& frame = m_vFrames[frameSlot];
+
+	// Uploads from this slot's last use have finished once its fence signals, so its staging space is free again.
+	if (frame.submitted)
+	{
+		vkWaitForFences(m_device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+		frame.submitted = false;
+	}
+
+	ProcessFeedback(frame);
+	WriteParams(frame);
+
+	std::vector<LoadedPage> pages;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const size_t COUNT = std::min<size_t>(m_vLoaded.size(), PAGES_PER_FRAME);
+		pages.assign(std::make_move_iterator(m_vLoaded.begin()), std::make_move_iterator(m_vLoaded.begin() + COUNT));
+		m_vLoaded.erase(m_vLoaded.begin(), m_vLoaded.begin() + COUNT);
+	}
+
+	// Find a home for each arrived page. If everything in the cache was used this frame, the page is dropped and asked for again later.
+	auto it = std::remove_if(pages.begin(), pages.end(), [&](const LoadedPage& page)
+	{
+		uint32_t slotIndex;
+		if (!AllocateSlot(slotIndex))
+		{
+			m_vRequested[page.pageId] = 0;
+			return true;
+		}
+
+		MapPage(page.pageId, slotIndex);
+		return false;
+	});
+	pages.erase(it, pages.end());
+
+	if (pages.empty() && !m_pageTableDirty)
+	{
+		return;
+	}
+
+	const VkDeviceSize STAGING_PER_FRAME = static_cast<VkDeviceSize>(PAGES_PER_FRAME) * m_pageFile.GetPageBytes() + m_vPageTable.size() * sizeof(PageTableEntry);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(frame.commandBuffer, 0);
+	vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+	RecordUploads(frame.commandBuffer, STAGING_PER_FRAME * frameSlot, pages);
+	vkEndCommandBuffer(frame.commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+	vkResetFences(m_device, 1, &frame.fence);
+	if (vkQueueSubmit(m_queue, 1, &submitInfo, frame.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit virtual texture uploads!");
+	}
+
+	frame.submitted = true;
+}
+
+void VirtualTexture::RecordFeedbackBarrier(VkCommandBuffer commandBuffer) const
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VirtualTexture::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, uint32_t frameSlot) const
+{
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &m_vFrames[frameSlot].descriptorSet, 0, nullptr);
+}
+
+void VirtualTexture::WriteParams(FrameResources& frame)
+{
+	const PageFileHeader& HEADER = m_pageFile.GetHeader();
+
+	VtParams params{};
+	params.virtualSize = static_cast<float>(HEADER.pagesPerSide * HEADER.pageSize);
+	params.pageSize = static_cast<float>(HEADER.pageSize);
+	params.border = static_cast<float>(HEADER.border);
+	params.cacheSize = static_cast<float>(m_cacheSlotsPerSide * (HEADER.pageSize + 2 * HEADER.border));
+	params.pagesPerSide = HEADER.pagesPerSide;
+	params.mipCount = HEADER.mipCount;
+	params.frameNumber = static_cast<uint32_t>(m_frameNumber);
+
+	std::memcpy(frame.pParams, &params, sizeof(params));
+}
+
+void VirtualTexture::ProcessFeedback(FrameResources& frame)
+{
+	const uint32_t WORDS = (m_pageFile.GetTotalPages() + 31) / 32;
+
+	for (uint32_t word = 0; word < WORDS; word++)
+	{
+		uint32_t bits = frame.pFeedback[word];
+		frame.pFeedback[word] = 0; // Clear for the next frame that uses this slot.
+
+		while (bits != 0)
+		{
+			uint32_t bit = 0;
+			while (((bits >> bit) & 1) == 0)
+			{
+				bit++;
+			}
+			bits &= bits - 1;
+
+			const uint32_t PAGE_ID = word * 32 + bit;
+			const int32_t SLOT = m_vPageToSlot[PAGE_ID];
+
+			if (SLOT >= 0)
+			{
+				// Resident, so refresh its place in the LRU order.
+				CacheSlot& slot = m_vSlots[SLOT];
+				slot.lastUsedFrame = m_frameNumber;
+				if (!slot.pinned)
+				{
+					m_lru.splice(m_lru.begin(), m_lru, slot.lruPosition);
+				}
+			}
+			else
+			{
+				RequestPage(PAGE_ID);
+			}
+		}
+	}
+}
+
+void VirtualTexture::RequestPage(uint32_t pageId)
+{
+	// Ask for the missing ancestors too, so a page far from anything resident improves in steps rather than all at once.
+	std::vector<uint32_t> chain;
+
+	uint32_t mip, x, y;
+	m_pageFile.GetPageCoords(pageId, mip, x, y);
+
+	while (mip < m_pageFile.GetHeader().mipCount)
+	{
+		const uint32_t ID = m_pageFile.GetPageId(mip, x, y);
+		if (m_vPageToSlot[ID] >= 0)
+		{
+			break;
+		}
+
+		if (!m_vRequested[ID])
+		{
+			m_vRequested[ID] = 1;
+			chain.push_back(ID);
+		}
+
+		mip++;
+		x >>= 1;
+		y >>= 1;
+	}
+
+	if (chain.empty())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.insert(m_requests.end(), chain.begin(), chain.end());
+	}
+	m_condition.notify_one();
+}
+
+bool VirtualTexture::AllocateSlot(uint32_t& slotIndex)
+{
+	if (m_lru.empty())
+	{
+		return false;
+	}
+
+	// The back of the list is either free or the least recently used page.
+	slotIndex = m_lru.back();
+	CacheSlot& slot = m_vSlots[slotIndex];
+
+	if (slot.pageId != UINT32_MAX)
+	{
+		// Evicting a page that was needed this frame would just thrash, better to keep the coarser fallback for the new one.
+		if (slot.lastUsedFrame == m_frameNumber)
+		{
+			return false;
+		}
+
+		UnmapPage(slot.pageId);
+	}
+
+	slot.lastUsedFrame = m_frameNumber;
+	m_lru.splice(m_lru.begin(), m_lru, slot.lruPosition);
+	return true;
+}
+
+void VirtualTexture::MapPage(uint32_t pageId, uint32_t slotIndex)
+{
+	CacheSlot& slot = m_vSlots[slotIndex];
+	slot.pageId = pageId;
+	m_vPageToSlot[pageId] = static_cast<int32_t>(slotIndex);
+	m_vRequested[pageId] = 0;
+
+	uint32_t mip, x, y;
+	m_pageFile.GetPageCoords(pageId, mip, x, y);
+
+	const PageTableEntry ENTRY =
+	{
+		static_cast<uint8_t>(slotIndex % m_cacheSlotsPerSide),
+		static_cast<uint8_t>(slotIndex / m_cacheSlotsPerSide),
+		static_cast<uint8_t>(mip),
+		1
+	};
+
+	// Point every page this one covers at it, unless they already have something finer.
+	for (uint32_t level = 0; level <= mip; level++)
+	{
+		const uint32_t SHIFT = mip - level;
+		for (uint32_t py = y << SHIFT; py < (y + 1) << SHIFT; py++)
+		{
+			for (uint32_t px = x << SHIFT; px < (x + 1) << SHIFT; px++)
+			{
+				PageTableEntry& entry = m_vPageTable[m_pageFile.GetPageId(level, px, py)];
+				if (!entry.valid || entry.mip > mip)
+				{
+					entry = ENTRY;
+				}
+			}
+		}
+	}
+
+	m_pageTableDirty = true;
+}
+
+void VirtualTexture::UnmapPage(uint32_t pageId)
+{
+	uint32_t mip, x, y;
+	m_pageFile.GetPageCoords(pageId, mip, x, y);
+
+	// The parent's entry is always valid because the coarsest page is pinned.
+	const PageTableEntry PARENT = m_vPageTable[m_pageFile.GetPageId(mip + 1, x >> 1, y >> 1)];
+
+	for (uint32_t level = 0; level <= mip; level++)
+	{
+		const uint32_t SHIFT = mip - level;
+		for (uint32_t py = y << SHIFT; py < (y + 1) << SHIFT; py++)
+		{
+			for (uint32_t px = x << SHIFT; px < (x + 1) << SHIFT; px++)
+			{
+				PageTableEntry& entry = m_vPageTable[m_pageFile.GetPageId(level, px, py)];
+				if (entry.mip == mip)
+				{
+					entry = PARENT;
+				}
+			}
+		}
+	}
+
+	m_vSlots[m_vPageToSlot[pageId]].pageId = UINT32_MAX;
+	m_vPageToSlot[pageId] = -1;
+	m_pageTableDirty = true;
+}
+
+void VirtualTexture::RecordUploads(VkCommandBuffer commandBuffer, VkDeviceSize stagingBase, const std::vector<LoadedPage>& pages)
+{
+	const PageFileHeader& HEADER = m_pageFile.GetHeader();
+	const uint32_t STORED_SIZE = HEADER.pageSize + 2 * HEADER.border;
+	const uint32_t PAGE_BYTES = m_pageFile.GetPageBytes();
+
+	VkImageMemoryBarrier barriers[2]{};
+	for (auto& barrier : barriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	}
+	barriers[0].image = m_cacheImage;
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	barriers[1].image = m_pageTableImage;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, HEADER.mipCount, 0, 1 };
+
+	const uint32_t BARRIER_COUNT = m_pageTableDirty ? 2 : 1;
+
+	// Earlier frames may still be sampling, the fragment shader stage in the source scope keeps us from overwriting under them.
+	for (auto& barrier : barriers)
+	{
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, BARRIER_COUNT, barriers);
+
+	VkDeviceSize offset = stagingBase;
+	std::vector<VkBufferImageCopy> regions;
+
+	for (const LoadedPage& PAGE : pages)
+	{
+		std::memcpy(m_pStagingData + offset, PAGE.data.data(), PAGE_BYTES);
+
+		const uint32_t SLOT = static_cast<uint32_t>(m_vPageToSlot[PAGE.pageId]);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { static_cast<int32_t>((SLOT % m_cacheSlotsPerSide) * STORED_SIZE), static_cast<int32_t>((SLOT / m_cacheSlotsPerSide) * STORED_SIZE), 0 };
+		region.imageExtent = { STORED_SIZE, STORED_SIZE, 1 };
+		regions.push_back(region);
+
+		offset += PAGE_BYTES;
+	}
+
+	if (!regions.empty())
+	{
+		vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, m_cacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	// The page table is small, a few kilobytes even for huge textures, so it goes up whole whenever it changed.
+	if (m_pageTableDirty)
+	{
+		std::memcpy(m_pStagingData + offset, m_vPageTable.data(), m_vPageTable.size() * sizeof(PageTableEntry));
+
+		regions.clear();
+		for (uint32_t mip = 0; mip < HEADER.mipCount; mip++)
+		{
+			const uint32_t SIDE = HEADER.pagesPerSide >> mip;
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset + static_cast<VkDeviceSize>(m_pageFile.GetPageId(mip, 0, 0)) * sizeof(PageTableEntry);
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			region.imageExtent = { SIDE, SIDE, 1 };
+			regions.push_back(region);
+		}
+
+		vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, m_pageTableImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+		m_pageTableDirty = false;
+	}
+
+	for (auto& barrier : barriers)
+	{
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, BARRIER_COUNT, barriers);
+}
+
+// =================================================================================================================================================================
+// Loader thread.
+
+void VirtualTexture::LoaderThread()
+{
+	const uint32_t PAGE_BYTES = m_pageFile.GetPageBytes();
+
+	try
+	{
+		while (true)
+		{
+			uint32_t pageId;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_quit || !m_requests.empty(); });
+
+				if (m_quit)
+				{
+					return;
+				}
+
+				// Coarsest first. Page ids grow with the mip, so that's simply the largest id.
+				auto best = std::max_element(m_requests.begin(), m_requests.end());
+				pageId = *best;
+				m_requests.erase(best);
+			}
+
+			LoadedPage page;
+			page.pageId = pageId;
+			page.data.resize(PAGE_BYTES);
+			m_pageFile.ReadPage(pageId, page.data.data());
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_vLoaded.push_back(std::move(page));
+		}
+	}
+	catch (...)
+	{
+		// Rethrown from BeginFrame on the render thread. Nothing more is loaded, Destroy still joins as normal.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_loaderError = std::current_exception();
+	}
+}
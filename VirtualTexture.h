@@ -0,0 +1,217 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Software paged virtual texturing. A fixed page cache on the GPU, fed from disk by a loader thread.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+/*
+	Page file layout (.vtex), all little endian:
+
+		PageFileHeader
+		Pages, mip 0 first, row major within a mip. Every page is the same size: (pageSize + 2 * border)^2 texels.
+
+	The virtual texture must be square with a power of two number of pages per side, so the coarsest mip is a single page.
+	Pages carry a border copied from their neighbours so bilinear filtering never reads across into an unrelated page.
+*/
+struct PageFileHeader
+{
+	uint32_t magic;				// 'VTEX'
+	uint32_t version;
+	uint32_t format;			// VkFormat of the stored pages.
+	uint32_t pageSize;			// Payload texels per side, excluding the border.
+	uint32_t border;
+	uint32_t pagesPerSide;		// At mip 0.
+	uint32_t mipCount;
+	uint32_t reserved;
+};
+
+class PageFile
+{
+public:
+
+	void Open(const std::string& filename);
+
+	// Reads one page into dst, which must hold GetPageBytes() bytes. Only called from the loader thread.
+	void ReadPage(uint32_t pageId, uint8_t* pDst);
+
+	_NODISCARD const PageFileHeader& GetHeader() const { return m_header; }
+	_NODISCARD uint32_t GetPageBytes() const { return m_pageBytes; }
+	_NODISCARD uint32_t GetPageId(uint32_t mip, uint32_t x, uint32_t y) const { return m_vMipPageOffsets[mip] + y * (m_header.pagesPerSide >> mip) + x; }
+	_NODISCARD uint32_t GetTotalPages() const { return m_vMipPageOffsets.back(); }
+	void GetPageCoords(uint32_t pageId, uint32_t& mip, uint32_t& x, uint32_t& y) const;
+
+	// Build a page file from an uncompressed RGBA8 image, which must be square and a power of two multiple of pageSize.
+	static void Build(const std::string& filename, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t pageSize, uint32_t border);
+
+private:
+
+	std::ifstream m_file;
+	PageFileHeader m_header{};
+	uint32_t m_pageBytes = 0;
+	std::vector<uint32_t> m_vMipPageOffsets;	// One past the end for the last mip, so back() is the page count.
+};
+
+class VirtualTexture
+{
+public:
+
+	VirtualTexture() :
+		m_physicalDevice(VK_NULL_HANDLE),
+		m_device(VK_NULL_HANDLE),
+		m_queue(VK_NULL_HANDLE),
+		m_commandPool(VK_NULL_HANDLE),
+		m_cacheImage(VK_NULL_HANDLE),
+		m_cacheMemory(VK_NULL_HANDLE),
+		m_cacheView(VK_NULL_HANDLE),
+		m_pageTableImage(VK_NULL_HANDLE),
+		m_pageTableMemory(VK_NULL_HANDLE),
+		m_pageTableView(VK_NULL_HANDLE),
+		m_cacheSampler(VK_NULL_HANDLE),
+		m_pageTableSampler(VK_NULL_HANDLE),
+		m_descriptorSetLayout(VK_NULL_HANDLE),
+		m_descriptorPool(VK_NULL_HANDLE),
+		m_stagingBuffer(VK_NULL_HANDLE),
+		m_stagingMemory(VK_NULL_HANDLE),
+		m_pStagingData(nullptr),
+		m_cacheSlotsPerSide(0),
+		m_frameNumber(0),
+		m_pageTableDirty(false),
+		m_quit(false)
+	{}
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, const std::string& filename);
+	void Destroy();
+
+	/*
+		Call once per frame, after waiting on the fence of the frame slot about to be reused.
+		Reads that slot's feedback, queues missing pages, and uploads whatever the loader has finished.
+		Rethrows anything that stopped the loader thread.
+	*/
+	void BeginFrame(uint32_t frameSlot);
+
+	// Record at the end of a frame that sampled the virtual texture so its feedback can be read on the host.
+	void RecordFeedbackBarrier(VkCommandBuffer commandBuffer) const;
+
+	// Bindings 0 to 3 of virtual_texture.glsl, for fragment shaders. Each frame slot has its own feedback and params.
+	void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, uint32_t frameSlot) const;
+	_NODISCARD VkDescriptorSetLayout SetLayout() const { return m_descriptorSetLayout; }
+
+	_NODISCARD VkImageView GetCacheView() const { return m_cacheView; }
+	_NODISCARD VkImageView GetPageTableView() const { return m_pageTableView; }
+	_NODISCARD VkSampler GetCacheSampler() const { return m_cacheSampler; }
+	_NODISCARD VkSampler GetPageTableSampler() const { return m_pageTableSampler; }
+	_NODISCARD VkBuffer GetParamsBuffer(uint32_t frameSlot) const { return m_vFrames[frameSlot].paramsBuffer; }
+	_NODISCARD VkBuffer GetFeedbackBuffer(uint32_t frameSlot) const { return m_vFrames[frameSlot].feedbackBuffer; }
+
+private:
+
+	// CPU copy of a page table texel, matches the R8G8B8A8_UINT page table image.
+	struct PageTableEntry
+	{
+		uint8_t cacheX;
+		uint8_t cacheY;
+		uint8_t mip;		// Mip of the page actually mapped, coarser than requested until the real page arrives.
+		uint8_t valid;
+	};
+
+	struct CacheSlot
+	{
+		uint32_t pageId = UINT32_MAX;
+		uint64_t lastUsedFrame = 0;
+		bool pinned = false;
+		std::list<uint32_t>::iterator lruPosition;
+	};
+
+	struct LoadedPage
+	{
+		uint32_t pageId;
+		std::vector<uint8_t> data;
+	};
+
+	struct FrameResources
+	{
+		VkBuffer feedbackBuffer = VK_NULL_HANDLE;		// One bit per virtual page, host visible.
+		VkDeviceMemory feedbackMemory = VK_NULL_HANDLE;
+		uint32_t* pFeedback = nullptr;
+		VkBuffer paramsBuffer = VK_NULL_HANDLE;			// Shader parameters, per frame because the feedback pattern rotates.
+		VkDeviceMemory paramsMemory = VK_NULL_HANDLE;
+		void* pParams = nullptr;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		bool submitted = false;
+	};
+
+	void CreateImages();
+	void CreateFrameResources();
+	void CreateDescriptors();
+	void LoadPinnedPage();
+
+	void WriteParams(FrameResources& frame);
+	void ProcessFeedback(FrameResources& frame);
+	void RequestPage(uint32_t pageId);
+	bool AllocateSlot(uint32_t& slotIndex);
+	void MapPage(uint32_t pageId, uint32_t slotIndex);
+	void UnmapPage(uint32_t pageId);
+	void RecordUploads(VkCommandBuffer commandBuffer, VkDeviceSize stagingBase, const std::vector<LoadedPage>& pages);
+
+	void LoaderThread();
+
+	VkPhysicalDevice m_physicalDevice;
+	VkDevice m_device;
+	VkQueue m_queue;
+	VkCommandPool m_commandPool;
+
+	PageFile m_pageFile;
+
+	// GPU side: the physical page cache and the page table, with one mip per virtual mip.
+	VkImage m_cacheImage;
+	VkDeviceMemory m_cacheMemory;
+	VkImageView m_cacheView;
+	VkImage m_pageTableImage;
+	VkDeviceMemory m_pageTableMemory;
+	VkImageView m_pageTableView;
+	VkSampler m_cacheSampler;
+	VkSampler m_pageTableSampler;
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkDescriptorPool m_descriptorPool;
+
+	VkBuffer m_stagingBuffer;
+	VkDeviceMemory m_stagingMemory;
+	uint8_t* m_pStagingData;
+	std::vector<FrameResources> m_vFrames;
+
+	// CPU side residency.
+	uint32_t m_cacheSlotsPerSide;
+	std::vector<CacheSlot> m_vSlots;
+	std::list<uint32_t> m_lru;						// Front is most recently used. Pinned slots are never in here.
+	std::vector<int32_t> m_vPageToSlot;				// -1 when not resident.
+	std::vector<uint8_t> m_vRequested;				// Queued for or being loaded by the loader thread.
+	std::vector<PageTableEntry> m_vPageTable;		// All mips, laid out like the page ids.
+	uint64_t m_frameNumber;
+	bool m_pageTableDirty;
+
+	// Loader thread. Requests are served coarsest mip first so the fallback sharpens step by step.
+	std::thread m_loader;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<uint32_t> m_requests;
+	std::vector<LoadedPage> m_vLoaded;
+	std::exception_ptr m_loaderError;				// Whatever stopped the loader, rethrown by BeginFrame.
+	bool m_quit;
+};
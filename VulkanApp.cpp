@@ -8,6 +8,7 @@
 #include "VulkanApp.h"
 #include "VulkanUtils.h"
 #include "Constants.h"
+#include "LodSelection.h"
 
 #include <iostream>		// Capture error reporting
 #include <cassert>		//
@@ -15,6 +16,12 @@
 #include <set>
 #include <algorithm>	// Necessary for std::clamp
 #include <optional>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <cstring>
+#include <random>
+#include <iterator>
 
 // Error reporting
 #define ASSERT(condition, message)	DMC::UTILS::ReportError(condition, message)
@@ -25,9 +32,75 @@
 #define MAX_FRAMES_IN_FLIGHT		Render_constants::g_maxFramesInFlight
 #define V_LAYERS					Validation_constants::g_vLayers
 #define V_EXTENS					Extension_constants::g_vDeviceExtensions
+#define DEVICE_CACHE				Startup_constants::g_deviceCacheFile
+#define PREFER_DYNAMIC_RENDERING	Render_constants::g_preferDynamicRendering
+#define PREFER_MESH_SHADERS			Render_constants::g_preferMeshShaders
+#define PREFER_DEFERRED_SHADING		Render_constants::g_preferDeferredShading
+#define LOG_FILE					Logging_constants::g_logFile
+#define PERF_BASELINE				Logging_constants::g_perfWarningBaselineFile
+#define WINDOW_EVENT_CAPACITY		Render_constants::g_windowEventCapacity
+#define MINIMIZED_SLEEP_MS			Render_constants::g_minimizedSleepMilliseconds
+#define JOB_WORKERS					Job_constants::g_workerThreads
+#define MAX_INSTANCES				Scene_constants::g_maxInstances
+#define SCENE_FILE					Scene_constants::g_sceneFile
+#define BACKDROP_PAGE_FILE			VirtualTexture_constants::g_backdropPageFile
+#define BACKDROP_TEXTURE			Texture_constants::g_backdropTexture
+#define LOD_ERROR_PIXELS			Scene_constants::g_lodErrorPixels
+#define LOD_HYSTERESIS				Scene_constants::g_lodHysteresis
+#define MAX_LIGHTS					Lighting_constants::g_maxLights
+#define TEST_LIGHT_COUNT			Lighting_constants::g_testLightCount
+#define SUN_DIRECTION				Lighting_constants::g_sunDirection
+#define SUN_COLOR					Lighting_constants::g_sunColor
+#define CASCADE_COUNT				Shadow_constants::g_cascadeCount
+#define SHADOW_MAP_SIZE				Shadow_constants::g_shadowMapSize
+#define CASCADE_ENDS				Shadow_constants::g_cascadeEnds
+#define CASCADE_REFRESH_INTERVALS	Shadow_constants::g_cascadeRefreshIntervals
+#define CASTER_REACH				Shadow_constants::g_casterReach
+#define DYNAMIC_RESOLUTION			Resolution_constants::g_dynamicResolution
+#define TARGET_GPU_MS				Resolution_constants::g_targetGpuMilliseconds
+#define TARGET_TOLERANCE			Resolution_constants::g_targetTolerance
+#define MIN_RENDER_SCALE			Resolution_constants::g_minRenderScale
+#define MAX_RENDER_SCALE			Resolution_constants::g_maxRenderScale
+#define POST_PROCESS				Post_constants::g_postProcess
+#define FUSED_POST_PROCESS			Post_constants::g_fusedPostProcess
+#define EXPOSURE					Post_constants::g_exposure
+#define CONTRAST					Post_constants::g_contrast
+#define SATURATION					Post_constants::g_saturation
+#define TINT						Post_constants::g_tint
+#define VIGNETTE					Post_constants::g_vignette
+#define FILM_GRAIN					Post_constants::g_filmGrain
+#define SHARPEN						Post_constants::g_sharpen
+
+namespace
+{
+	// VulkanApp::m_windowState, packed so the main thread can replace the whole of it in one store.
+	// Width in the low 32 bits, height in the 30 above it.
+	constexpr uint64_t WINDOW_STATE_PENDING = 1ull << 63;	// Set on every post, the render thread swaps in zero as it reads.
+	constexpr uint64_t WINDOW_STATE_ICONIFIED = 1ull << 62;
+	constexpr uint64_t WINDOW_STATE_HEIGHT_MASK = (1ull << 30) - 1;
+
+	// What's timed on the GPU every frame.
+	enum GpuScope : uint32_t
+	{
+		GPU_SCOPE_FRAME = 0,		// The whole command buffer, what dynamic resolution steers by.
+		GPU_SCOPE_POST,				// Post-processing, fused or not.
+		GPU_SCOPE_COUNT
+	};
+
+	// HDR, so lighting can go past 1 and leave it to the tonemapper. Blendable, sampleable and attachable everywhere.
+	constexpr VkFormat SCENE_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+}
 
 void VulkanApp::Run()
 {
+	m_startupProfiler.Begin();
+
+	// Always running, the render thread's status lines go through it even without the layers.
+	m_logger.Init(LOG_FILE);
+
+	// Workers start before anything else, so start up work can use them too.
+	m_jobs.Init(JOB_WORKERS);
+
 	InitWindow();
 	InitVulkan();
 	MainLoop();
@@ -49,64 +122,303 @@ void VulkanApp::InitWindow()
 	// Assign a function for resize callback.
 	glfwSetWindowUserPointer(m_window, this);
 	glfwSetFramebufferSizeCallback(m_window, FrameBufferResizeCallBack);
+
+	// Any input is timed for the present latency stats, and P cycles the present policy.
+	glfwSetKeyCallback(m_window, KeyCallBack);
+	glfwSetMouseButtonCallback(m_window, MouseButtonCallBack);
+	glfwSetCursorPosCallback(m_window, CursorPosCallBack);
+	glfwSetWindowIconifyCallback(m_window, IconifyCallBack);
+
+	// Main thread jobs, GLFW calls for instance, are run between events, so queuing one has to wake the event loop.
+	m_jobs.SetMainThreadWake([] { glfwPostEmptyEvent(); });
+
+	// Key commands are passed to the render thread through here. Size, minimising and input timing skip the queue, see PostWindowState.
+	m_windowEvents = std::make_unique<RingBuffer<WindowEvent>>(WINDOW_EVENT_CAPACITY);
+
+	// After this only the render thread reads the size, from whatever PostWindowState last published.
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(m_window, &width, &height);
+	m_framebufferWidth = static_cast<uint32_t>(width);
+	m_framebufferHeight = static_cast<uint32_t>(height);
 }
 
 void VulkanApp::InitVulkan()
 {
-	CreateInstance();
-	SetupDebugMessenger();
-	CreateSurface();
-	PickPhysicalDevice();
-	CreateLogicalDevice();
-	CreateSwapChain();
-	CreateImageViews();
-	CreateRenderPass();
-	CreateGraphicsPipeline(); // Possible to avoid when using dynamic state for viewports and scissor rects.
-	CreateFramebuffers();
-	CreateCommandPool();
-	CreateCommandBuffers();
-	CreateSyncObjects();
+	// Each step is timed so time to first frame can be broken down, see StartupProfiler.
+	m_startupProfiler.Step("CreateInstance", [this] { CreateInstance(); });
+	m_startupProfiler.Step("SetupDebugMessenger", [this] { SetupDebugMessenger(); });
+	m_startupProfiler.Step("CreateSurface", [this] { CreateSurface(); });
+	m_startupProfiler.Step("PickPhysicalDevice", [this] { PickPhysicalDevice(); });
+	m_startupProfiler.Step("CreateLogicalDevice", [this] { CreateLogicalDevice(); });
+	m_startupProfiler.Step("CreateSwapChain", [this] { CreateSwapChain(); });
+	m_startupProfiler.Step("CreateImageViews", [this] { CreateImageViews(); });
+	m_startupProfiler.Step("CreateClusteredLights", [this] { CreateClusteredLights(); });
+	m_startupProfiler.Step("CreateShadowCascades", [this] { CreateShadowCascades(); });
+	m_startupProfiler.Step("CreateDeferredLighting", [this] { CreateDeferredLighting(); });
+	m_startupProfiler.Step("CreateMeshletCuller", [this] { CreateMeshletCuller(); });
+	m_startupProfiler.Step("CreateDynamicResolution", [this] { CreateDynamicResolution(); });
+	m_startupProfiler.Step("CreatePostProcess", [this] { CreatePostProcess(); });
+	m_startupProfiler.Step("CreateVirtualTexture", [this] { CreateVirtualTexture(); });
+	m_startupProfiler.Step("CreateTextureStreamer", [this] { CreateTextureStreamer(); });
+	m_startupProfiler.Step("CreateDepthResources", [this] { CreateDepthResources(); });
+	m_startupProfiler.Step("CreateRenderPass", [this] { CreateRenderPass(); });
+	m_startupProfiler.Step("CreateGraphicsPipeline", [this] { CreateGraphicsPipeline(); }); // Possible to avoid when using dynamic state for viewports and scissor rects.
+	m_startupProfiler.Step("CreateFramebuffers", [this] { CreateFramebuffers(); });
+	m_startupProfiler.Step("CreateCommandPool", [this] { CreateCommandPool(); });
+	m_startupProfiler.Step("CreateScene", [this] { CreateScene(); });
+	m_startupProfiler.Step("CreateCommandBuffers", [this] { CreateCommandBuffers(); });
+	m_startupProfiler.Step("CreateSyncObjects", [this] { CreateSyncObjects(); });
+	m_startupProfiler.Step("CreateInstanceBuffers", [this] { CreateInstanceBuffers(); });
+
+	NameObjects();
 }
 
 void VulkanApp::MainLoop()
 {
-	while (!glfwWindowShouldClose(m_window))
+	/*
+		GLFW has to stay on the main thread, so rendering moves off it. The main thread sleeps in glfwWaitEvents
+		and forwards what the callbacks see, the render thread never calls into GLFW or waits on the main thread.
+	*/
+	m_rendering = true;
+	m_renderThread = std::thread(&VulkanApp::RenderLoop, this);
+
+	while (!glfwWindowShouldClose(m_window) && !m_renderFailed.load(std::memory_order_acquire))
+	{
+		glfwWaitEvents();
+		m_jobs.RunMainThreadJobs();
+	}
+
+	m_rendering = false;
+	m_renderThread.join();
+
+	// Anything the render thread threw is rethrown here, after it has stopped touching the device.
+	if (m_renderError)
+	{
+		std::rethrow_exception(m_renderError);
+	}
+
+	vkDeviceWaitIdle(m_device);
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(PresentPolicy::Count); i++)
+	{
+		if (m_presentStats[i].Frames() > 0)
+		{
+			m_presentStats[i].Report(std::cout, PresentPolicyName(static_cast<PresentPolicy>(i)));
+		}
+	}
+
+	const char* const POST_VARIANTS[] = { "post-processing unfused", "post-processing fused" };
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		if (m_postStats[i].Samples() > 0)
+		{
+			m_postStats[i].Report(std::cout, POST_VARIANTS[i]);
+		}
+	}
+}
+
+void VulkanApp::RenderLoop()
+{
+	try
+	{
+		while (m_rendering.load(std::memory_order_acquire))
+		{
+			ProcessWindowEvents();
+
+			// Nothing can be presented while minimised. Sleep rather than spin, the restore arrives as a message.
+			if (m_minimized)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(MINIMIZED_SLEEP_MS));
+				continue;
+			}
+
+			// Driver host allocations between these are flagged, steady state frames should make none.
+			GetHostAllocator().BeginFrame();
+			DrawFrame();
+			GetHostAllocator().EndFrame();
+
+			m_perfWarnings.NextFrame();
+
+			if (m_requestedPresentPolicy != m_presentPolicy)
+			{
+				ApplyPresentPolicy(m_requestedPresentPolicy);
+			}
+		}
+	}
+	catch (...)
+	{
+		m_renderError = std::current_exception();
+		m_renderFailed.store(true, std::memory_order_release);
+		glfwPostEmptyEvent(); // Safe from any thread, wakes the main thread so it can stop.
+	}
+}
+
+void VulkanApp::ProcessWindowEvents()
+{
+	// However many resizes arrived since the last frame, only the latest size matters.
+	const uint64_t STATE = m_windowState.exchange(0, std::memory_order_acquire);
+	if (STATE & WINDOW_STATE_PENDING)
+	{
+		m_framebufferWidth = static_cast<uint32_t>(STATE);
+		m_framebufferHeight = static_cast<uint32_t>((STATE >> 32) & WINDOW_STATE_HEIGHT_MASK);
+		m_minimized = (STATE & WINDOW_STATE_ICONIFIED) != 0 || m_framebufferWidth == 0 || m_framebufferHeight == 0;
+		m_framebufferResized = true;
+	}
+
+	// Only the oldest input since the last frame counts, that's the one which waited longest.
+	const PresentStats::Clock::rep INPUT_TICKS = m_inputTicks.exchange(0, std::memory_order_relaxed);
+	if (INPUT_TICKS != 0 && !m_hasPendingInput)
+	{
+		m_pendingInputTime = PresentStats::Clock::time_point(PresentStats::Clock::duration(INPUT_TICKS));
+		m_hasPendingInput = true;
+	}
+
+	WindowEvent event;
+	while (m_windowEvents->TryPop(event))
+	{
+		switch (event.type)
+		{
+		case WindowEvent::Type::CyclePresentPolicy:
+		{
+			const uint32_t NEXT = (static_cast<uint32_t>(m_presentPolicy) + 1) % static_cast<uint32_t>(PresentPolicy::Count);
+			m_requestedPresentPolicy = static_cast<PresentPolicy>(NEXT);
+			break;
+		}
+
+		case WindowEvent::Type::TogglePostFusion:
+			// Both variants are always built, so this takes effect on the next frame recorded.
+			m_fusedPostProcess = !m_fusedPostProcess;
+			m_logger.Status(m_fusedPostProcess ? "Post-processing: fused" : "Post-processing: unfused");
+			break;
+		}
+	}
+}
+
+void VulkanApp::PostWindowEvent(WindowEvent::Type type)
+{
+	// Only key presses come through here. A full ring means the render thread is stuck, so drop the press rather than wait.
+	const WindowEvent EVENT = { type };
+	static_cast<void>(m_windowEvents->TryPush(EVENT));
+}
+
+void VulkanApp::PostWindowState()
+{
+	// Asked for rather than taken from the callback, so a resize and an iconify can't overwrite each other's half.
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(m_window, &width, &height);
+
+	uint64_t state = WINDOW_STATE_PENDING | static_cast<uint32_t>(width) | ((static_cast<uint64_t>(height) & WINDOW_STATE_HEIGHT_MASK) << 32);
+	if (glfwGetWindowAttrib(m_window, GLFW_ICONIFIED) == GLFW_TRUE)
 	{
-		glfwPollEvents();
-		DrawFrame();
+		state |= WINDOW_STATE_ICONIFIED;
 	}
 
+	// Replaces anything the render thread hasn't read yet, so this never waits however far behind it is.
+	m_windowState.store(state, std::memory_order_release);
+}
+
+void VulkanApp::PostInput()
+{
+	// Keeps the oldest unread input, a flood of cursor moves costs one failed compare exchange each.
+	PresentStats::Clock::rep none = 0;
+	m_inputTicks.compare_exchange_strong(none, PresentStats::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void VulkanApp::SetPresentPolicy(PresentPolicy policy)
+{
+	m_presentPolicy = policy;
+	m_requestedPresentPolicy = policy;
+	m_framesInFlight = GetPresentSettings(policy).framesInFlight;
+}
+
+void VulkanApp::ApplyPresentPolicy(PresentPolicy policy)
+{
+	// Present mode and image count are baked into the swap chain, so it has to be rebuilt.
 	vkDeviceWaitIdle(m_device);
+
+	SetPresentPolicy(policy);
+	m_currentFrame = 0;
+	m_presentStats[static_cast<size_t>(policy)].Restart();
+
+	RecreateSwapChain();
+
+	const std::string MESSAGE = std::string("Present policy: ") + PresentPolicyName(policy);
+	m_logger.Status(MESSAGE.c_str());
 }
 
 void VulkanApp::CleanUp()
 {
+	// Nothing should be queued by now, and no job may touch the device after this.
+	m_jobs.Shutdown();
+
 	CleanupSwapChain();
 
 	// Destroy sync objects.
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		vkDestroySemaphore(m_device, m_vImageAvailableSemaphores[i], nullptr);
-		vkDestroySemaphore(m_device, m_vRenderFinishedSemaphores[i], nullptr);
-		vkDestroyFence(m_device, m_vFences[i], nullptr);
+		vkDestroySemaphore(m_device, m_vImageAvailableSemaphores[i], GetAllocationCallbacks());
+		vkDestroySemaphore(m_device, m_vRenderFinishedSemaphores[i], GetAllocationCallbacks());
+		vkDestroyFence(m_device, m_vFences[i], GetAllocationCallbacks());
+	}
+
+	// Destroy textures and their upload resources. The virtual texture stops its loader thread first.
+	vkDestroyDescriptorPool(m_device, m_backdropDescriptorPool, GetAllocationCallbacks());
+	vkDestroyDescriptorSetLayout(m_device, m_backdropSetLayout, GetAllocationCallbacks());
+	m_textureStreamer.Destroy();
+	m_virtualTexture.Destroy();
+
+	// Destroy instance buffers, unmapping happens implicitly when the memory is freed.
+	for (size_t i = 0; i < m_vInstanceBuffers.size(); i++)
+	{
+		vkDestroyBuffer(m_device, m_vInstanceBuffers[i], GetAllocationCallbacks());
+		vkFreeMemory(m_device, m_vInstanceMemory[i], GetAllocationCallbacks());
 	}
 
+	// Destroy meshlet culling, before the geometry its descriptors point at. The pyramid's image went with the swap chain.
+	m_depthPyramid.Destroy();
+	m_meshletCuller.Destroy();
+	m_deferred.Destroy();
+	m_postProcess.Destroy();
+	m_resolution.Destroy();
+	m_gpuTimer.Destroy();
+	m_shadows.Destroy();
+	m_lights.Destroy();
+
+	// Destroy scene geometry.
+	vkDestroyBuffer(m_device, m_sceneVertexBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_sceneVertexMemory, GetAllocationCallbacks());
+	vkDestroyBuffer(m_device, m_sceneIndexBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_sceneIndexMemory, GetAllocationCallbacks());
+
 	// Destroy command pool.
-	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	vkDestroyCommandPool(m_device, m_commandPool, GetAllocationCallbacks());
 
 	// Destroy virtual device
-	vkDestroyDevice(m_device, nullptr);
+	vkDestroyDevice(m_device, GetAllocationCallbacks());
 
 	// Does nothing in release mode.
 	if (g_enableValidationLayers)
 	{
-		DestroyDebugUtilsMessengerExt(m_vulkanInstance, m_debugMessenger, nullptr);
+		DestroyDebugUtilsMessengerExt(m_vulkanInstance, m_debugMessenger, GetAllocationCallbacks());
 	}
 
-	vkDestroySurfaceKHR(m_vulkanInstance, m_surface, nullptr);
-	vkDestroyInstance(m_vulkanInstance, nullptr);
+	vkDestroySurfaceKHR(m_vulkanInstance, m_surface, GetAllocationCallbacks());
+	vkDestroyInstance(m_vulkanInstance, GetAllocationCallbacks());
+	m_logger.Shutdown(); // After the instance, which can still report on the way out.
+
+	if (g_enableValidationLayers)
+	{
+		m_perfWarnings.CompareWithBaseline(PERF_BASELINE);
+		m_perfWarnings.Summary(std::cout);
+	}
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
+
+	// Anything still live at this point was leaked by us or the driver.
+	if (GetAllocationCallbacks() != nullptr)
+	{
+		GetHostAllocator().Report(std::cout);
+	}
 }
 
 // =================================================================================================================================================================
@@ -127,7 +439,7 @@ void VulkanApp::CreateInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = m_instanceApiVersion = GetInstanceApiVersion();
 
 	VkInstanceCreateInfo createInfo{}; // Select global extensions and validation layers.
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -138,6 +450,13 @@ void VulkanApp::CreateInstance()
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
 	createInfo.ppEnabledExtensionNames = extensions.data();
 
+	// Best practices checks are what raise most performance warnings, they're off unless asked for.
+	const VkValidationFeatureEnableEXT ENABLED_FEATURES[] = { VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT };
+	VkValidationFeaturesEXT validationFeatures{};
+	validationFeatures.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+	validationFeatures.enabledValidationFeatureCount = 1;
+	validationFeatures.pEnabledValidationFeatures = ENABLED_FEATURES;
+
 	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
 	if (g_enableValidationLayers)
 	{
@@ -146,6 +465,11 @@ void VulkanApp::CreateInstance()
 
 		PopulateDebugInfo(debugCreateInfo);
 		createInfo.pNext = static_cast<VkDebugUtilsMessengerCreateInfoEXT*>(&debugCreateInfo);
+
+		if (ValidationFeaturesSupported())
+		{
+			debugCreateInfo.pNext = &validationFeatures;
+		}
 	}
 	else
 	{
@@ -154,10 +478,25 @@ void VulkanApp::CreateInstance()
 	}
 
 	// 2nd parameter of vkCreateInstance is used with custom allocator callbacks.
-	retcode = vkCreateInstance(&createInfo, nullptr, &m_vulkanInstance);
+	retcode = vkCreateInstance(&createInfo, GetAllocationCallbacks(), &m_vulkanInstance);
 	ASSERT(retcode == VK_SUCCESS, "Failed to create instance!");
 }
 
+uint32_t VulkanApp::GetInstanceApiVersion()
+{
+	// vkEnumerateInstanceVersion is missing from a 1.0 loader, and asking a 1.0 loader for anything newer fails instance creation.
+	auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	if (enumerateInstanceVersion != nullptr)
+	{
+		enumerateInstanceVersion(&loaderVersion);
+	}
+
+	// 1.3 is the newest we know how to use. Devices report their own version, features are negotiated per device.
+	return std::min(loaderVersion, static_cast<uint32_t>(VK_MAKE_API_VERSION(0, 1, 3, 0)));
+}
+
 void VulkanApp::SetupDebugMessenger()
 {
 	uint32_t retcode = VK_SUCCESS;
@@ -172,7 +511,7 @@ void VulkanApp::SetupDebugMessenger()
 	PopulateDebugInfo(createInfo);
 
 	// Debug messenger is specific to the instance, so it must be specified in the first parameter.
-	retcode = CreateDebugUtilsMessengerExt(m_vulkanInstance, &createInfo, nullptr, &m_debugMessenger);
+	retcode = CreateDebugUtilsMessengerExt(m_vulkanInstance, &createInfo, GetAllocationCallbacks(), &m_debugMessenger);
 	ASSERT(retcode == VK_SUCCESS, "Failed to set up debug messenger!");
 }
 
@@ -180,7 +519,7 @@ void VulkanApp::CreateSurface()
 {
 	uint32_t retcode = VK_SUCCESS;
 
-	retcode = glfwCreateWindowSurface(m_vulkanInstance, m_window, nullptr, &m_surface);
+	retcode = glfwCreateWindowSurface(m_vulkanInstance, m_window, GetAllocationCallbacks(), &m_surface);
 	ASSERT(retcode == VK_SUCCESS, "Failed to create window surface!");
 }
 
@@ -201,24 +540,59 @@ void VulkanApp::PickPhysicalDevice()
 	retCode = vkEnumeratePhysicalDevices(m_vulkanInstance, &deviceCount, devices.data());
 	ASSERT(retCode == VK_SUCCESS, "No physical devices available!");
 
-	std::multimap<uint32_t, VkPhysicalDevice> candidates;
+	// Every query a device needs is made here, once, and kept for the one we pick.
+	std::multimap<uint32_t, DeviceCapabilities> candidates;
 	for (const auto& device : devices)
 	{
-		uint32_t score = RateDevice(device);
-		candidates.insert(std::make_pair(score, device));
+		DeviceCapabilities capabilities = QueryDeviceCapabilities(device, m_surface, m_instanceApiVersion, DEVICE_CACHE);
+		uint32_t score = RateDevice(capabilities);
+		candidates.insert(std::make_pair(score, std::move(capabilities)));
 	}
 
 	// It's possible for the highest scoring GPU to score 0 because it's not suitable.
 	ASSERT(candidates.rbegin()->first > 0, "Failed to find suitable GPU!");
 
-	m_physicalDevice = candidates.rbegin()->second;
+	m_deviceCapabilities = candidates.rbegin()->second;
+	m_physicalDevice = m_deviceCapabilities.physicalDevice;
+	m_useDeferredShading = PREFER_DEFERRED_SHADING;
+	m_useDynamicRendering = PREFER_DYNAMIC_RENDERING && m_deviceCapabilities.dynamicRendering && !m_useDeferredShading;
+
+	// Each meshlet's indirect draw finds itself through its first instance.
+	m_useMeshletCulling = m_deviceCapabilities.features.drawIndirectFirstInstance == VK_TRUE;
+	m_useMeshShaders = PREFER_MESH_SHADERS && m_useMeshletCulling && m_deviceCapabilities.meshShader;
+
+	// The backdrop's fragment shader reports the pages it wants with atomics.
+	m_useVirtualTexture = m_deviceCapabilities.features.fragmentStoresAndAtomics == VK_TRUE && std::filesystem::exists(BACKDROP_PAGE_FILE);
+	m_useStreamedBackdrop = !m_useVirtualTexture && std::filesystem::exists(BACKDROP_TEXTURE);
+
+	m_depthFormat = FindDepthFormat();
+}
+
+VkFormat VulkanApp::FindDepthFormat()
+{
+	// No stencil is used. The depth pyramid samples depth, so it has to be readable as well as attachable.
+	const VkFormat CANDIDATES[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM };
+	const VkFormatFeatureFlags FEATURES = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+	for (VkFormat format : CANDIDATES)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+
+		if ((properties.optimalTilingFeatures & FEATURES) == FEATURES)
+		{
+			return format;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a supported depth format!");
 }
 
 void VulkanApp::CreateLogicalDevice()
 {
 	uint32_t retcode = VK_SUCCESS;
 
-	QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
+	const QueueFamilyIndices& indices = m_deviceCapabilities.queueFamilies;
 
 	// Must create a queue from all unique families.
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -237,16 +611,50 @@ void VulkanApp::CreateLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	// Defined for future use in more complex apps.
+	// Only what's used. Without multi draw, meshlets are drawn with one indirect call each.
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.drawIndirectFirstInstance = m_useMeshletCulling ? VK_TRUE : VK_FALSE;
+	deviceFeatures.multiDrawIndirect = m_useMeshletCulling ? m_deviceCapabilities.features.multiDrawIndirect : VK_FALSE;
+	deviceFeatures.fragmentStoresAndAtomics = m_useVirtualTexture ? VK_TRUE : VK_FALSE;
+
+	std::vector<const char*> extensions(V_EXTENS.begin(), V_EXTENS.end());
+
+	// Same struct for the extension and core 1.3, only the extension needs enabling by name.
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+	dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+	dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+	if (m_useDynamicRendering && !m_deviceCapabilities.dynamicRenderingIsCore)
+	{
+		extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		extensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+		extensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+	}
+
+	void* pFeatureChain = m_useDynamicRendering ? &dynamicRenderingFeatures : nullptr;
+
+#ifdef VK_EXT_mesh_shader
+	// Task shaders aren't used, culling happens before the draw in its own pass.
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+	meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+	meshShaderFeatures.meshShader = VK_TRUE;
+
+	if (m_useMeshShaders)
+	{
+		extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+		meshShaderFeatures.pNext = pFeatureChain;
+		pFeatureChain = &meshShaderFeatures;
+	}
+#endif
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = pFeatureChain;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(V_EXTENS.size());
-	createInfo.ppEnabledExtensionNames = V_EXTENS.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	// Set validation layers to support older Vulkan implementations.
 	// Modern implementations ignore these values as no distinction is made between instance and device validation layers.
@@ -260,25 +668,37 @@ void VulkanApp::CreateLogicalDevice()
 		createInfo.enabledLayerCount = 0;
 	}
 
-	retcode = vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device);
+	retcode = vkCreateDevice(m_physicalDevice, &createInfo, GetAllocationCallbacks(), &m_device);
 	ASSERT(retcode == VK_SUCCESS, "Failed to create logical device!");
 
 	vkGetDeviceQueue(m_device, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_device, indices.presentFamily.value(), 0, &m_presentQueue);
+
+	if (m_useDynamicRendering)
+	{
+		// Core and extension entry points have different names but the same signature.
+		const char* BEGIN_NAME = m_deviceCapabilities.dynamicRenderingIsCore ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR";
+		const char* END_NAME = m_deviceCapabilities.dynamicRenderingIsCore ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR";
+
+		m_pfnCmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(m_device, BEGIN_NAME));
+		m_pfnCmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(m_device, END_NAME));
+
+		ASSERT(m_pfnCmdBeginRendering != nullptr && m_pfnCmdEndRendering != nullptr, "Failed to load dynamic rendering functions!");
+	}
 }
 
 void VulkanApp::CreateSwapChain()
 {
 	uint32_t retcode = VK_SUCCESS;
 
-	const SwapChainSupportDetails SWAP_CHAIN_SUPPORT = QuerySwapChainSupport(m_physicalDevice);
+	const SwapChainSupportDetails& SWAP_CHAIN_SUPPORT = m_deviceCapabilities.swapChainSupport;
 
 	VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(SWAP_CHAIN_SUPPORT.formats);
 	VkPresentModeKHR presentMode = ChooseSwapPresentMode(SWAP_CHAIN_SUPPORT.presentModes);
 	VkExtent2D extent = ChooseSwapExtent(SWAP_CHAIN_SUPPORT.capabilities);
 
-	// Requesting just the minimum could cause us to have to wait for the driver to complete internal operations.
-	uint32_t imageCount = SWAP_CHAIN_SUPPORT.capabilities.minImageCount + 1;
+	// Requesting just the minimum could cause us to have to wait for the driver to complete internal operations, how much more depends on the policy.
+	uint32_t imageCount = SWAP_CHAIN_SUPPORT.capabilities.minImageCount + GetPresentSettings(m_presentPolicy).extraImages;
 
 	// Ensure we don't go over the max image count. A max of zero would indicate that there is no max.
 	if (SWAP_CHAIN_SUPPORT.capabilities.maxImageCount > 0 && imageCount > SWAP_CHAIN_SUPPORT.capabilities.maxImageCount)
@@ -296,7 +716,7 @@ void VulkanApp::CreateSwapChain()
 	createInfo.imageArrayLayers = 1; // Number of layers of which, each image consists. Always 1 unless developing stereoscopic 3D.
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-	QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
+	const QueueFamilyIndices& indices = m_deviceCapabilities.queueFamilies;
 	uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
 	// It's likely these families are the same, but we should cover the possibility they're not.
@@ -319,7 +739,7 @@ void VulkanApp::CreateSwapChain()
 	createInfo.clipped = VK_TRUE;
 	createInfo.oldSwapchain = m_oldSwapChain; // Swap chains may become invalid in certain circumstances. Reference the old swap chain here if that happens.
 
-	retcode = vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_currentSwapChain);
+	retcode = vkCreateSwapchainKHR(m_device, &createInfo, GetAllocationCallbacks(), &m_currentSwapChain);
 	ASSERT(retcode == VK_SUCCESS, "Failed to create swap chain!");
 
 	// Resize the images container to the actual number becuase only a minimum number was set earlier.
@@ -329,6 +749,9 @@ void VulkanApp::CreateSwapChain()
 
 	m_swapChainImageFormat = surfaceFormat.format;
 	m_swapChainExtent = extent;
+
+	// The image count can change with the policy, and nothing is in flight while the swap chain is rebuilt.
+	m_vImagesInFlight.assign(m_vSwapChainImages.size(), VK_NULL_HANDLE);
 }
 
 void VulkanApp::CreateImageViews()
@@ -352,62 +775,247 @@ void VulkanApp::CreateImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;							//
 		createInfo.subresourceRange.layerCount = 1;							//
 
-		if (vkCreateImageView(m_device, &createInfo, nullptr, &m_vSwapChainImageViews[i]) != VK_SUCCESS)
+		if (vkCreateImageView(m_device, &createInfo, GetAllocationCallbacks(), &m_vSwapChainImageViews[i]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create image views!");
 		}
 	}
 }
 
+void VulkanApp::CreateDepthResources()
+{
+	// The scene's targets are sized for the largest render scale, every frame draws into their top left corner.
+	m_resolution.CreateTargets(m_swapChainExtent, SCENE_COLOR_FORMAT);
+	const VkExtent2D TARGET_EXTENT = m_resolution.TargetExtent();
+
+	if (POST_PROCESS)
+	{
+		m_postProcess.CreateTargets(TARGET_EXTENT, m_resolution.ColorView());
+		m_resolution.SetSource(m_postProcess.OutputView());
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = m_depthFormat;
+	imageInfo.extent = { TARGET_EXTENT.width, TARGET_EXTENT.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (m_useMeshletCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0)
+		| (m_useDeferredShading ? VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT : 0);
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	CreateImage(m_physicalDevice, m_device, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage, m_depthMemory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_depthImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = m_depthFormat;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+
+	if (vkCreateImageView(m_device, &viewInfo, GetAllocationCallbacks(), &m_depthImageView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth image view!");
+	}
+
+	// The pyramid follows the depth buffer's size, and the culler's descriptors follow the pyramid.
+	if (m_useMeshletCulling)
+	{
+		m_depthPyramid.Create(TARGET_EXTENT, m_depthImageView);
+		m_meshletCuller.BindDepthPyramid(m_depthPyramid.View(), m_depthPyramid.Sampler());
+	}
+
+	// The G-buffer shares depth's size, and lighting reads depth back beside it.
+	if (m_useDeferredShading)
+	{
+		m_deferred.CreateTargets(TARGET_EXTENT, m_depthImageView);
+	}
+}
+
 void VulkanApp::CreateRenderPass()
 {
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_swapChainImageFormat;
+	// Dynamic rendering describes its attachments when recording, so there's nothing to build.
+	if (m_useDynamicRendering)
+	{
+		return;
+	}
+
+	// The whole frame in one pass. Occlusion culling splits it around the depth pyramid build, the passes only differ in load and store so share framebuffers and pipelines.
+	m_renderPass = CreateMainRenderPass(true, true);
+
+	if (m_useMeshletCulling)
+	{
+		m_earlyRenderPass = CreateMainRenderPass(true, false);
+		m_lateRenderPass = CreateMainRenderPass(false, true);
+	}
+}
+
+VkRenderPass VulkanApp::CreateMainRenderPass(bool firstPass, bool lastPass)
+{
+	VkAttachmentDescription attachments[4]{};
+
+	// The scene's colour target, upscaled to the swap chain image once the last pass is done with it.
+	VkAttachmentDescription& colorAttachment = attachments[0];
+	colorAttachment.format = m_resolution.ColorFormat();
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;			// No multisampling so set to 1.
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;		// Clear frame buffer to black before drawing new frame.
+	colorAttachment.loadOp = firstPass ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;	// Clear frame buffer before drawing new frame, later passes add to it.
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;		// We want to see the triangle so store the attachment data.
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;	// There is no stenciling, so what happens to stenciling data is irrelevant.
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;	//
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;		// Previous image layout is irrelevent. CAUTION: Contents of the image are not guaranteed to be preserved.
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;	// Image will be presented using the swap chain.
+	colorAttachment.initialLayout = firstPass ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;	// Previous image layout is irrelevent. CAUTION: Contents of the image are not guaranteed to be preserved.
+	colorAttachment.finalLayout = lastPass ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;	// Image will be sampled by the upscale.
+
+	// Only kept when the pyramid is built from it.
+	VkAttachmentDescription& depthAttachment = attachments[1];
+	depthAttachment.format = m_depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = firstPass ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = lastPass ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = firstPass ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthAttachment.finalLayout = lastPass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	// The G-buffer. Cleared every pass, so lighting can tell what this pass drew, and never stored.
+	const VkFormat GBUFFER_FORMATS[] = { DeferredLighting::ALBEDO_FORMAT, DeferredLighting::NORMAL_FORMAT };
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		VkAttachmentDescription& gbufferAttachment = attachments[2 + i];
+		gbufferAttachment.format = GBUFFER_FORMATS[i];
+		gbufferAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		gbufferAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		gbufferAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		gbufferAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		gbufferAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		gbufferAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		gbufferAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
 
-	// Using a single subpass.
+	// Using a single subpass, or two when deferred.
 	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;										// Only one reference so its index is 0.
+	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // Best performance for intended use as colour buffer.
 
-	VkSubpassDescription subpass{};
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpasses[2]{};
+	VkSubpassDescription& subpass = subpasses[0];
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// Deferred, the geometry writes the G-buffer and the second subpass reads it at the same pixel to write the frame.
+	const VkAttachmentReference GBUFFER_REFS[] =
+	{
+		{ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+		{ 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }
+	};
+	const VkAttachmentReference LIGHTING_INPUT_REFS[] =
+	{
+		{ 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL }
+	};
+
+	if (m_useDeferredShading)
+	{
+		subpass.colorAttachmentCount = 2;
+		subpass.pColorAttachments = GBUFFER_REFS;
+
+		VkSubpassDescription& lightingSubpass = subpasses[1];
+		lightingSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		lightingSubpass.inputAttachmentCount = 3;
+		lightingSubpass.pInputAttachments = LIGHTING_INPUT_REFS;
+		lightingSubpass.colorAttachmentCount = 1;
+		lightingSubpass.pColorAttachments = &colorAttachmentRef;
+	}
+
+	// Waits for the last pass or frame to finish with the attachments, the last upscale to read colour, and the pyramid build to finish reading depth.
+	VkSubpassDependency dependencies[4]{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+		| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	uint32_t dependencyCount = 1;
+
+	if (m_useDeferredShading)
+	{
+		// Lighting reads what the geometry wrote at its own pixel only, so tiles never have to wait on each other.
+		VkSubpassDependency& gbufferDependency = dependencies[dependencyCount++];
+		gbufferDependency.srcSubpass = 0;
+		gbufferDependency.dstSubpass = 1;
+		gbufferDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		gbufferDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		gbufferDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		gbufferDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		gbufferDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// The frame is first touched by lighting, which has to wait for any earlier pass and upscale too.
+		VkSubpassDependency& frameDependency = dependencies[dependencyCount++];
+		frameDependency = dependencies[0];
+		frameDependency.dstSubpass = 1;
+		frameDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		frameDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	}
+
+	// Post-processing or the upscale samples colour straight after. Colour is only written by the last subpass.
+	if (lastPass)
+	{
+		VkSubpassDependency& upscaleDependency = dependencies[dependencyCount++];
+		upscaleDependency.srcSubpass = m_useDeferredShading ? 1 : 0;
+		upscaleDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		upscaleDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		upscaleDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		upscaleDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		upscaleDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	// The pyramid is built from depth straight after. Depth is only written by the first subpass.
+	if (!lastPass)
+	{
+		VkSubpassDependency& pyramidDependency = dependencies[dependencyCount++];
+		pyramidDependency.srcSubpass = 0;
+		pyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		pyramidDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		pyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		pyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		pyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
 
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-
-	if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS)
+	renderPassInfo.attachmentCount = m_useDeferredShading ? 4 : 2;
+	renderPassInfo.pAttachments = attachments;
+	renderPassInfo.subpassCount = m_useDeferredShading ? 2 : 1;
+	renderPassInfo.pSubpasses = subpasses;
+	renderPassInfo.dependencyCount = dependencyCount;
+	renderPassInfo.pDependencies = dependencies;
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(m_device, &renderPassInfo, GetAllocationCallbacks(), &renderPass) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create render pass!");
 	}
 
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	return renderPass;
 }
 
 void VulkanApp::CreateGraphicsPipeline()
 {
 	std::vector<char> vertShaderCode = ReadFile("shaders/vert.spv");
-	std::vector<char> fragShaderCode = ReadFile("shaders/frag.spv");
+	std::vector<char> fragShaderCode = ReadFile(m_useDeferredShading ? "shaders/gbuffer_unlit_frag.spv" : "shaders/frag.spv");
 
 	// Only required until GFX pipeline is set up so can be destroyed at the end, rather than become class members.
 	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
@@ -443,25 +1051,17 @@ void VulkanApp::CreateGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE; // When true it's possible to break up the primitive types.
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(m_swapChainExtent.width);	// Use swap chain size as it may differ from window.
-	viewport.height = static_cast<float>(m_swapChainExtent.height);	//
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	// Scissor rects can be used to define in which regions pizels are drawn, here we just draw the whole frame buffer.
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapChainExtent;
-
+	// The viewport and scissor follow the render resolution, which changes from frame to frame, so they're set when recording.
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+
+	const VkDynamicState DYNAMIC_STATES[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(DYNAMIC_STATES));
+	dynamicState.pDynamicStates = DYNAMIC_STATES;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -514,6 +1114,29 @@ void VulkanApp::CreateGraphicsPipeline()
 	colorBlending.blendConstants[2] = 0.0f;
 	colorBlending.blendConstants[3] = 0.0f;
 
+	// The G-buffer is overwritten, blending albedo and normals together means nothing.
+	VkPipelineColorBlendAttachmentState gbufferBlendAttachments[2]{};
+	if (m_useDeferredShading)
+	{
+		for (VkPipelineColorBlendAttachmentState& gbufferBlendAttachment : gbufferBlendAttachments)
+		{
+			gbufferBlendAttachment.colorWriteMask = colorBlendAttachment.colorWriteMask;
+			gbufferBlendAttachment.blendEnable = VK_FALSE;
+		}
+
+		colorBlending.attachmentCount = 2;
+		colorBlending.pAttachments = gbufferBlendAttachments;
+	}
+
+	// Nearest wins, and what's written is what the depth pyramid is built from.
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
 	// Must provide a pipeline even though it's not used yet.
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -522,7 +1145,7 @@ void VulkanApp::CreateGraphicsPipeline()
 	pipelineLayoutInfo.pushConstantRangeCount = 0;
 	pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_pipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create pipeline layout!");
 	}
@@ -537,117 +1160,594 @@ void VulkanApp::CreateGraphicsPipeline()
 	pipelineInfo.pViewportState = &viewportState;
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr;
+	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = m_pipelineLayout;
 	pipelineInfo.renderPass = m_renderPass;
 	pipelineInfo.subpass = 0;
+
+	// Without a render pass, the pipeline is told the attachment formats directly.
+	VkPipelineRenderingCreateInfoKHR renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	renderingInfo.colorAttachmentCount = 1;
+	const VkFormat COLOR_FORMAT = m_resolution.ColorFormat();
+	renderingInfo.pColorAttachmentFormats = &COLOR_FORMAT;
+	renderingInfo.depthAttachmentFormat = m_depthFormat;
+
+	if (m_useDynamicRendering)
+	{
+		pipelineInfo.pNext = &renderingInfo;
+		pipelineInfo.renderPass = VK_NULL_HANDLE;
+	}
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;	// Used to create new pipeline by inheriting from an old pipeline for improved performance.
 	pipelineInfo.basePipelineIndex = -1;				//
 
 	// The second parameter refers to a pipeline cache that can be used to significantly speed up pipeline creation, even across apps when stored to a file.
-	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_graphicsPipeline) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create graphics pipeline!");
 	}
 
-	vkDestroyShaderModule(m_device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(m_device, vertShaderModule, nullptr);
-}
-
-void VulkanApp::CreateFramebuffers()
-{
-	m_vSwapChainFramebuffers.resize(m_vSwapChainImageViews.size());
-
-	// Iterate through the image views and create fram buffers from them.
-	for (uint32_t i = 0; i < m_vSwapChainImageViews.size(); i++)
+	// The backdrop has no vertex input either, only its texture's set. Deferred, it's written unlit like the triangle.
+	if (m_useVirtualTexture || m_useStreamedBackdrop)
 	{
-		VkImageView attachments[] =
+		const char* fragShaderFile;
+		if (m_useVirtualTexture)
 		{
-			m_vSwapChainImageViews[i]
-		};
+			fragShaderFile = m_useDeferredShading ? "shaders/backdrop_gbuffer_frag.spv" : "shaders/backdrop_frag.spv";
+		}
+		else
+		{
+			fragShaderFile = m_useDeferredShading ? "shaders/backdrop_streamed_gbuffer_frag.spv" : "shaders/backdrop_streamed_frag.spv";
+		}
 
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = m_renderPass;
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
-		framebufferInfo.width = m_swapChainExtent.width;
-		framebufferInfo.height = m_swapChainExtent.height;
-		framebufferInfo.layers = 1;
+		VkShaderModule backdropVertShaderModule = CreateShaderModule(ReadFile("shaders/backdrop_vert.spv"));
+		VkShaderModule backdropFragShaderModule = CreateShaderModule(ReadFile(fragShaderFile));
+		shaderStages[0].module = backdropVertShaderModule;
+		shaderStages[1].module = backdropFragShaderModule;
 
-		if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_vSwapChainFramebuffers[i]) != VK_SUCCESS)
+		const VkDescriptorSetLayout BACKDROP_SET_LAYOUT = m_useVirtualTexture ? m_virtualTexture.SetLayout() : m_backdropSetLayout;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &BACKDROP_SET_LAYOUT;
+
+		if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_backdropPipelineLayout) != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to create framebuffer!");
+			throw std::runtime_error("Failed to create backdrop pipeline layout!");
 		}
-	}
-}
 
-void VulkanApp::CreateCommandPool()
-{
-	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevice);
+		pipelineInfo.layout = m_backdropPipelineLayout;
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(); // Submitting commands for drawing requires the graphics family.
-	poolInfo.flags = 0;
+		if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_backdropPipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create backdrop pipeline!");
+		}
 
-	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create command pool!");
+		vkDestroyShaderModule(m_device, backdropVertShaderModule, GetAllocationCallbacks());
+		vkDestroyShaderModule(m_device, backdropFragShaderModule, GetAllocationCallbacks());
 	}
-}
 
-void VulkanApp::CreateCommandBuffers()
-{
-	m_vCommandBuffers.resize(m_vSwapChainFramebuffers.size());
+	// Scene meshes share the rest, and are lit from the clustered light lists. Deferred, they're lit later and only write the G-buffer.
+	VkShaderModule meshVertShaderModule = CreateShaderModule(ReadFile("shaders/mesh_vert.spv"));
+	VkShaderModule litFragShaderModule = CreateShaderModule(ReadFile(m_useDeferredShading ? "shaders/gbuffer_frag.spv" : "shaders/lit_frag.spv"));
+	shaderStages[0].module = meshVertShaderModule;
+	shaderStages[1].module = litFragShaderModule;
+
+	// Bindings and attributes straight from the layout declaration, the shader's inputs have to match it.
+	const VkVertexInputBindingDescription MESH_BINDING = QuantizedVertexBinding(0);
+	const std::vector<VkVertexInputAttributeDescription> MESH_ATTRIBUTES = QuantizedVertexAttributes(0);
+	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.pVertexBindingDescriptions = &MESH_BINDING;
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(MESH_ATTRIBUTES.size());
+	vertexInputInfo.pVertexAttributeDescriptions = MESH_ATTRIBUTES.data();
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(MeshPushConstants);
+
+	const VkDescriptorSetLayout LIGHT_SET_LAYOUT = m_lights.SetLayout();
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &LIGHT_SET_LAYOUT;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, GetAllocationCallbacks(), &m_meshPipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create mesh pipeline layout!");
+	}
 
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = static_cast<uint32_t>(m_vCommandBuffers.size());
+	pipelineInfo.layout = m_meshPipelineLayout;
 
-	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_vCommandBuffers.data()) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_meshPipeline) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to allocate command buffers!");
+		throw std::runtime_error("Failed to create mesh pipeline!");
 	}
 
-	for (size_t i = 0; i < m_vCommandBuffers.size(); i++)
+	vkDestroyShaderModule(m_device, meshVertShaderModule, GetAllocationCallbacks());
+	vkDestroyShaderModule(m_device, litFragShaderModule, GetAllocationCallbacks());
+
+	// Meshlets read their instance and dequantisation from the culler's buffers, the layout is the culler's. Lights are its set 1.
+	VkShaderModule litMeshletFragShaderModule = VK_NULL_HANDLE;
+	if (m_useMeshletCulling)
 	{
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0;
-		beginInfo.pInheritanceInfo = nullptr; // Only relevant for secondary command buffers.
+		VkShaderModule meshletVertShaderModule = CreateShaderModule(ReadFile("shaders/meshlet_vert.spv"));
+		litMeshletFragShaderModule = CreateShaderModule(ReadFile(m_useDeferredShading ? "shaders/gbuffer_frag.spv" : "shaders/lit_meshlet_frag.spv"));
+		shaderStages[0].module = meshletVertShaderModule;
+		shaderStages[1].module = litMeshletFragShaderModule;
+		pipelineInfo.layout = m_meshletCuller.DrawPipelineLayout();
 
-		if (vkBeginCommandBuffer(m_vCommandBuffers[i], &beginInfo) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_meshletPipeline) != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to begin recording command buffer!");
+			throw std::runtime_error("Failed to create meshlet pipeline!");
 		}
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = m_renderPass;
-		renderPassInfo.framebuffer = m_vSwapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };	// Defines the render area, should match attachments for best performance.
-		renderPassInfo.renderArea.extent = m_swapChainExtent;//
-
-		VkClearValue clearColor = { {{0.52f, 0.63f, 0.95f, 1.0f}} }; // Clear to pastel blue.
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
+		vkDestroyShaderModule(m_device, meshletVertShaderModule, GetAllocationCallbacks());
+	}
 
-		vkCmdBeginRenderPass(m_vCommandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+#ifdef VK_EXT_mesh_shader
+	// The mesh shader replaces vertex input and assembly altogether.
+	if (m_useMeshletCulling && m_meshletCuller.HasMeshShaders())
+	{
+		VkShaderModule meshShaderModule = CreateShaderModule(ReadFile("shaders/meshlet_mesh.spv"));
+		shaderStages[0].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+		shaderStages[0].module = meshShaderModule;
+		pipelineInfo.pVertexInputState = nullptr;
+		pipelineInfo.pInputAssemblyState = nullptr;
 
-		vkCmdBindPipeline(m_vCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-		vkCmdDraw(m_vCommandBuffers[i], 3, 1, 0, 0); // Draw the blooming triangle! (And it's about time too!)
-		vkCmdEndRenderPass(m_vCommandBuffers[i]); // End the render pass.
+		if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, GetAllocationCallbacks(), &m_meshletMeshPipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create meshlet mesh shader pipeline!");
+		}
+
+		vkDestroyShaderModule(m_device, meshShaderModule, GetAllocationCallbacks());
+	}
+#endif
+
+	vkDestroyShaderModule(m_device, litMeshletFragShaderModule, GetAllocationCallbacks());
+	vkDestroyShaderModule(m_device, fragShaderModule, GetAllocationCallbacks());
+	vkDestroyShaderModule(m_device, vertShaderModule, GetAllocationCallbacks());
+
+	if (m_useDeferredShading)
+	{
+		m_deferred.CreatePipeline(m_renderPass);
+	}
+}
+
+void VulkanApp::CreateFramebuffers()
+{
+	// The upscale writes the swap chain images whichever way the scene is drawn.
+	m_resolution.CreateOutput(m_swapChainImageFormat, m_vSwapChainImageViews);
+
+	// Dynamic rendering draws straight to the scene's image views.
+	if (m_useDynamicRendering)
+	{
+		return;
+	}
+
+	// The G-buffer is only used when deferred.
+	VkImageView attachments[] =
+	{
+		m_resolution.ColorView(),
+		m_depthImageView,
+		m_deferred.AlbedoView(),
+		m_deferred.NormalView()
+	};
+
+	// Compatible with the early and late passes too. Frames draw into as much of it as their render resolution needs.
+	const VkExtent2D TARGET_EXTENT = m_resolution.TargetExtent();
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = m_renderPass;
+	framebufferInfo.attachmentCount = m_useDeferredShading ? 4 : 2;
+	framebufferInfo.pAttachments = attachments;
+	framebufferInfo.width = TARGET_EXTENT.width;
+	framebufferInfo.height = TARGET_EXTENT.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(m_device, &framebufferInfo, GetAllocationCallbacks(), &m_sceneFramebuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create framebuffer!");
+	}
+}
+
+void VulkanApp::CreateCommandPool()
+{
+	const QueueFamilyIndices& queueFamilyIndices = m_deviceCapabilities.queueFamilies;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(); // Submitting commands for drawing requires the graphics family.
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Recorded every frame, culling reads that frame's instance buffer.
+
+	if (vkCreateCommandPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create command pool!");
+	}
+}
+
+void VulkanApp::CreateCommandBuffers()
+{
+	m_vCommandBuffers.resize(m_vSwapChainImages.size()); // One per image, there are no framebuffers with dynamic rendering.
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = static_cast<uint32_t>(m_vCommandBuffers.size());
+
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_vCommandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate command buffers!");
+	}
+}
+
+void VulkanApp::RecordCommandBuffer(uint32_t imageIndex)
+{
+	VkCommandBuffer commandBuffer = m_vCommandBuffers[imageIndex];
+
+	// Beginning implicitly resets it, the image's last use has been waited on.
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr; // Only relevant for secondary command buffers.
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to begin recording command buffer!");
+	}
+
+	/*
+		There's no camera, clip space is the view and everything is seen along +z. Front faces are clockwise, which
+		with y pointing down means their normals point away from the viewer, where the cones expect them towards it.
+		Testing the cones against the mirrored direction culls what the rasteriser would.
+	*/
+	const Float3 VIEW_DIRECTION = { 0.0f, 0.0f, -1.0f };
+
+	/*
+		With meshlets, the first pass draws everything else and the meshlets that were visible last frame. Its depth
+		builds the pyramid, and the second pass draws the meshlets that were hidden last frame but aren't any more.
+	*/
+	const bool OCCLUSION_CULLING = m_meshletCuller.Ready();
+
+	m_gpuTimer.Reset(commandBuffer, m_currentFrame);
+	m_gpuTimer.Begin(commandBuffer, m_currentFrame, GPU_SCOPE_FRAME);
+
+	m_lights.Record(commandBuffer, m_currentFrame);
+
+	// Only the cascades due a refresh, and only their dynamic casters unless the cache moved.
+	m_shadows.Record(commandBuffer, [this](VkCommandBuffer cmd, const Float4x4& lightViewProjection, bool staticCasters)
+	{
+		RecordShadowCasters(cmd, lightViewProjection, staticCasters);
+	});
+
+	if (OCCLUSION_CULLING)
+	{
+		// The pyramid covers the whole depth target, only the corner drawn at this resolution is meaningful.
+		const VkExtent2D RENDER_EXTENT = m_resolution.RenderExtent();
+		const VkExtent2D TARGET_EXTENT = m_resolution.TargetExtent();
+		m_meshletCuller.SetDepthRegion(static_cast<float>(RENDER_EXTENT.width) / TARGET_EXTENT.width,
+			static_cast<float>(RENDER_EXTENT.height) / TARGET_EXTENT.height);
+		m_meshletCuller.RecordCull(commandBuffer, m_currentFrame, m_viewProjection, VIEW_DIRECTION, false, CullPhase::Early);
+	}
+
+	BeginMainPass(commandBuffer, imageIndex, true, !OCCLUSION_CULLING);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	RecordDraws(commandBuffer); // Draw the blooming triangle! (And it's about time too!)
+
+	// After the scene, so early depth testing skips the backdrop wherever something already covers it.
+	if (m_useVirtualTexture)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_backdropPipeline);
+		m_virtualTexture.Bind(commandBuffer, m_backdropPipelineLayout, 0, m_currentFrame);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+	else if (m_useStreamedBackdrop && m_textureStreamer.GetImageView(m_backdropTexture) != VK_NULL_HANDLE)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_backdropPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_backdropPipelineLayout, 0, 1, &m_vBackdropSets[m_currentFrame], 0, nullptr);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+	EndMainPass(commandBuffer, imageIndex, !OCCLUSION_CULLING);
+
+	if (OCCLUSION_CULLING)
+	{
+		m_depthPyramid.Record(commandBuffer);
+		m_meshletCuller.RecordCull(commandBuffer, m_currentFrame, m_viewProjection, VIEW_DIRECTION, false, CullPhase::Late);
+
+		BeginMainPass(commandBuffer, imageIndex, false, true);
+		RecordMeshletDraws(commandBuffer);
+		EndMainPass(commandBuffer, imageIndex, true);
+	}
+
+	if (POST_PROCESS)
+	{
+		const VkExtent2D RENDER_EXTENT = m_resolution.RenderExtent();
+		m_vPostFrames[m_currentFrame] = { m_fusedPostProcess, static_cast<uint64_t>(RENDER_EXTENT.width) * RENDER_EXTENT.height };
+
+		m_gpuTimer.Begin(commandBuffer, m_currentFrame, GPU_SCOPE_POST);
+		m_postProcess.Record(commandBuffer, RENDER_EXTENT, m_fusedPostProcess);
+		m_gpuTimer.End(commandBuffer, m_currentFrame, GPU_SCOPE_POST);
+	}
+
+	m_resolution.Record(commandBuffer, imageIndex);
+	m_gpuTimer.End(commandBuffer, m_currentFrame, GPU_SCOPE_FRAME);
+
+	// The backdrop's page requests are read on the host once this frame slot comes round again.
+	if (m_useVirtualTexture)
+	{
+		m_virtualTexture.RecordFeedbackBarrier(commandBuffer);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+void VulkanApp::RecordDraws(VkCommandBuffer commandBuffer)
+{
+	// The triangle's vertices come from the shader, the pipeline bound by the caller has no vertex input.
+	bool hasMeshes = false;
+	for (const DrawItem& ITEM : m_vDrawList)
+	{
+		if (ITEM.mesh == TRIANGLE_MESH)
+		{
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		}
+		hasMeshes = hasMeshes || ITEM.mesh != TRIANGLE_MESH;
+	}
+
+	if (!hasMeshes || m_sceneVertexBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Every mesh is in the same two buffers, bound once. Each draw picks its range with the vertex offset and first index.
+	const VkDeviceSize VERTEX_BUFFER_OFFSET = 0;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshPipeline);
+	m_lights.Bind(commandBuffer, m_meshPipelineLayout, 0, m_currentFrame);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_sceneVertexBuffer, &VERTEX_BUFFER_OFFSET);
+	vkCmdBindIndexBuffer(commandBuffer, m_sceneIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	for (const DrawItem& ITEM : m_vDrawList)
+	{
+		if (ITEM.mesh == TRIANGLE_MESH)
+		{
+			continue;
+		}
+
+		// Only quantised meshes match the pipeline's vertex input, raw ones are for tools. Meshlets are drawn below.
+		const SceneMesh& SCENE_MESH = m_vSceneMeshes[ITEM.mesh - TRIANGLE_MESH - 1];
+		if (SCENE_MESH.vertexFormat != static_cast<uint32_t>(SceneVertexFormat::Quantized) || SCENE_MESH.lodCount == 0
+			|| (m_meshletCuller.Ready() && DrawsAsMeshlets(ITEM)))
+		{
+			continue;
+		}
+
+		const SceneLod& LOD = m_vSceneLods[SCENE_MESH.firstLod + ITEM.lod];
+		const Float4x4 DEQUANTIZE = Float4x4::Translation(SCENE_MESH.positionOffset[0], SCENE_MESH.positionOffset[1], SCENE_MESH.positionOffset[2]);
+
+		MeshPushConstants constants;
+		constants.world = m_transforms.GetWorld(ITEM.instance);
+		Multiply(m_viewProjection, constants.world, constants.clipFromVertex);
+		Multiply(constants.clipFromVertex, DEQUANTIZE, constants.clipFromVertex);
+		Multiply(constants.clipFromVertex, Float4x4::Scale(SCENE_MESH.positionScale[0], SCENE_MESH.positionScale[1], SCENE_MESH.positionScale[2]), constants.clipFromVertex);
+
+		vkCmdPushConstants(commandBuffer, m_meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+		vkCmdDrawIndexed(commandBuffer, LOD.indexCount, 1, static_cast<uint32_t>(LOD.indexOffset / sizeof(uint32_t)),
+			static_cast<int32_t>(SCENE_MESH.vertexOffset / SCENE_MESH.vertexStride), 0);
+	}
+
+	RecordMeshletDraws(commandBuffer);
+}
+
+void VulkanApp::RecordShadowCasters(VkCommandBuffer commandBuffer, const Float4x4& lightViewProjection, bool staticCasters)
+{
+	if (m_sceneVertexBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Whatever the cascade's box touches, on screen or not. The pipeline is bound by the caller.
+	m_vShadowCasters.clear();
+	m_sceneBvh.QueryFrustum(Frustum::FromViewProjection(lightViewProjection), m_vShadowCasters);
+
+	const VkDeviceSize VERTEX_BUFFER_OFFSET = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_sceneVertexBuffer, &VERTEX_BUFFER_OFFSET);
+	vkCmdBindIndexBuffer(commandBuffer, m_sceneIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	for (uint32_t drawable : m_vShadowCasters)
+	{
+		// The triangle has no vertex buffer to read positions from, it casts nothing.
+		const DrawItem& ITEM = m_vDrawables[drawable];
+		const ShadowCaster* pCaster = ITEM.mesh == TRIANGLE_MESH ? nullptr : m_scene.Get<ShadowCaster>(ITEM.entity);
+		if (pCaster == nullptr || pCaster->isStatic != staticCasters)
+		{
+			continue;
+		}
+
+		const SceneMesh& SCENE_MESH = m_vSceneMeshes[ITEM.mesh - TRIANGLE_MESH - 1];
+		if (SCENE_MESH.vertexFormat != static_cast<uint32_t>(SceneVertexFormat::Quantized) || SCENE_MESH.lodCount == 0)
+		{
+			continue;
+		}
+
+		// The level the view last chose, shadows rarely need more detail than what casts them.
+		const LodState* pLodState = m_scene.Get<LodState>(ITEM.entity);
+		const SceneLod& LOD = m_vSceneLods[SCENE_MESH.firstLod + (pLodState ? pLodState->lod : 0)];
 
-		if (vkEndCommandBuffer(m_vCommandBuffers[i]) != VK_SUCCESS)
+		Float4x4 clipFromVertex;
+		Multiply(lightViewProjection, m_transforms.GetWorld(ITEM.instance), clipFromVertex);
+		Multiply(clipFromVertex, Float4x4::Translation(SCENE_MESH.positionOffset[0], SCENE_MESH.positionOffset[1], SCENE_MESH.positionOffset[2]), clipFromVertex);
+		Multiply(clipFromVertex, Float4x4::Scale(SCENE_MESH.positionScale[0], SCENE_MESH.positionScale[1], SCENE_MESH.positionScale[2]), clipFromVertex);
+
+		vkCmdPushConstants(commandBuffer, m_shadows.PipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(clipFromVertex), &clipFromVertex);
+		vkCmdDrawIndexed(commandBuffer, LOD.indexCount, 1, static_cast<uint32_t>(LOD.indexOffset / sizeof(uint32_t)),
+			static_cast<int32_t>(SCENE_MESH.vertexOffset / SCENE_MESH.vertexStride), 0);
+	}
+}
+
+void VulkanApp::RecordMeshletDraws(VkCommandBuffer commandBuffer)
+{
+	if (!m_meshletCuller.Ready())
+	{
+		return;
+	}
+
+	// Whatever survived the last cull. The vertex path reads the scene buffers, the mesh shader reads its own.
+	const VkDeviceSize VERTEX_BUFFER_OFFSET = 0;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshletCuller.UsesMeshShaders() ? m_meshletMeshPipeline : m_meshletPipeline);
+	m_lights.Bind(commandBuffer, m_meshletCuller.DrawPipelineLayout(), 1, m_currentFrame);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_sceneVertexBuffer, &VERTEX_BUFFER_OFFSET);
+	vkCmdBindIndexBuffer(commandBuffer, m_sceneIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	m_meshletCuller.RecordDraws(commandBuffer, m_currentFrame, m_viewProjection);
+}
+
+void VulkanApp::BeginMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool firstPass, bool lastPass)
+{
+	VkClearValue clearValues[4]{};
+	clearValues[0].color = { {0.52f, 0.63f, 0.95f, 1.0f} }; // Clear to pastel blue.
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	// The G-buffer clears to zero, an albedo alpha of zero marks pixels lighting leaves alone.
+
+	// Only the corner of the targets at this frame's render resolution is drawn, cleared or stored.
+	const VkExtent2D RENDER_EXTENT = m_resolution.RenderExtent();
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(RENDER_EXTENT.width);
+	viewport.height = static_cast<float>(RENDER_EXTENT.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	const VkRect2D SCISSOR = { { 0, 0 }, RENDER_EXTENT };
+
+	if (!m_useDynamicRendering)
+	{
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = firstPass ? (lastPass ? m_renderPass : m_earlyRenderPass) : m_lateRenderPass;
+		renderPassInfo.framebuffer = m_sceneFramebuffer;
+		renderPassInfo.renderArea = SCISSOR;
+		renderPassInfo.clearValueCount = m_useDeferredShading ? 4 : 2;
+		renderPassInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &SCISSOR);
+		return;
+	}
+
+	// The render pass used to handle the layout transitions, here they're explicit.
+	VkImageMemoryBarrier barriers[2]{};
+	for (VkImageMemoryBarrier& barrier : barriers)
+	{
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	}
+
+	VkImageMemoryBarrier& colorBarrier = barriers[0];
+	colorBarrier.oldLayout = firstPass ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;	// Contents are cleared anyway.
+	colorBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorBarrier.image = m_resolution.ColorImage();
+	colorBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	colorBarrier.srcAccessMask = firstPass ? 0 : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	colorBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	// Shared by every frame, so the last frame's drawing or the pyramid build may still be using it.
+	VkImageMemoryBarrier& depthBarrier = barriers[1];
+	depthBarrier.oldLayout = firstPass ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.image = m_depthImage;
+	depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	depthBarrier.srcAccessMask = firstPass ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	// The fragment shader stage waits out the last frame's upscale reading colour before it's overwritten.
+	const VkPipelineStageFlags SRC_STAGES = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+		| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	const VkPipelineStageFlags DST_STAGES = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	vkCmdPipelineBarrier(commandBuffer, SRC_STAGES, DST_STAGES, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	VkRenderingAttachmentInfoKHR colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	colorAttachment.imageView = m_resolution.ColorView();
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp = firstPass ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue = clearValues[0];
+
+	VkRenderingAttachmentInfoKHR depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	depthAttachment.imageView = m_depthImageView;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = firstPass ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = lastPass ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.clearValue = clearValues[1];
+
+	VkRenderingInfoKHR renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	renderingInfo.renderArea = SCISSOR;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+
+	m_pfnCmdBeginRendering(commandBuffer, &renderingInfo);
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &SCISSOR);
+}
+
+void VulkanApp::EndMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool lastPass)
+{
+	if (!m_useDynamicRendering)
+	{
+		// Shade whatever this pass drew into the G-buffer.
+		if (m_useDeferredShading)
 		{
-			throw std::runtime_error("Failed to record command buffer!");
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+			m_lights.Bind(commandBuffer, m_deferred.PipelineLayout(), 1, m_currentFrame);
+			m_deferred.Record(commandBuffer);
 		}
+
+		vkCmdEndRenderPass(commandBuffer); // The passes' final layouts and dependencies cover what comes next.
+		return;
+	}
+
+	m_pfnCmdEndRendering(commandBuffer);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	if (lastPass)
+	{
+		// Post-processing or the upscale samples colour straight after.
+		barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.image = m_resolution.ColorImage();
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+		return;
 	}
+
+	// The pyramid is built from depth straight after.
+	barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barrier.image = m_depthImage;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
 void VulkanApp::CreateSyncObjects()
@@ -655,7 +1755,6 @@ void VulkanApp::CreateSyncObjects()
 	m_vImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	m_vRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	m_vFences.resize(MAX_FRAMES_IN_FLIGHT);
-	m_vImagesInFlight.resize(m_vSwapChainImageViews.size(), VK_NULL_HANDLE);
 
 	// Current API requires this struct, but it only defines what type of info struct it is.
 	VkSemaphoreCreateInfo semaphoreInfo{};
@@ -668,9 +1767,9 @@ void VulkanApp::CreateSyncObjects()
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_vImageAvailableSemaphores[i]) != VK_SUCCESS
-			|| vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_vRenderFinishedSemaphores[i]) != VK_SUCCESS
-			|| vkCreateFence(m_device, &fenceInfo, nullptr, &m_vFences[i]) != VK_SUCCESS)
+		if (vkCreateSemaphore(m_device, &semaphoreInfo, GetAllocationCallbacks(), &m_vImageAvailableSemaphores[i]) != VK_SUCCESS
+			|| vkCreateSemaphore(m_device, &semaphoreInfo, GetAllocationCallbacks(), &m_vRenderFinishedSemaphores[i]) != VK_SUCCESS
+			|| vkCreateFence(m_device, &fenceInfo, GetAllocationCallbacks(), &m_vFences[i]) != VK_SUCCESS)
 		{
 
 			throw std::runtime_error("Failed to create semaphores for a frame!");
@@ -678,11 +1777,546 @@ void VulkanApp::CreateSyncObjects()
 	}
 }
 
+void VulkanApp::CreateScene()
+{
+	// The transform's node doubles as its instance index, there's one instance per node that's drawn.
+	const uint32_t NODE = m_transforms.Add(TransformHierarchy::NO_PARENT, Float4x4::Identity(), m_transforms.Count());
+	m_scene.Create(MeshInstance{ TRIANGLE_MESH, 0 }, Transform{ NODE });
+
+	if (std::filesystem::exists(SCENE_FILE))
+	{
+		SceneFile file;
+		file.Open(SCENE_FILE);
+		LoadScene(file);
+	}
+
+	BuildSceneBvh();
+	AddTestLights();
+
+	// Whatever the caches held was drawn before the scene's static casters existed.
+	m_shadows.InvalidateStatic();
+}
+
+void VulkanApp::LoadScene(const SceneFile& file)
+{
+	// A drawn node's instance is its transform node, and instances past the buffers' end would never be written.
+	if (static_cast<uint64_t>(m_transforms.Count()) + file.NodeCount() > MAX_INSTANCES)
+	{
+		throw std::runtime_error("Scene file has more nodes than the instance buffers hold!");
+	}
+
+	// Node indices in the file become transform nodes. Parents always come first, so each parent is already mapped.
+	const SceneNode* pNodes = file.Nodes();
+	std::vector<uint32_t> vNodeIds(file.NodeCount());
+	for (uint32_t i = 0; i < file.NodeCount(); i++)
+	{
+		const SceneNode& NODE = pNodes[i];
+		const uint32_t PARENT = NODE.parent == SCENE_NO_INDEX ? TransformHierarchy::NO_PARENT : vNodeIds[NODE.parent];
+		const uint32_t INSTANCE = NODE.mesh == SCENE_NO_INDEX ? TransformHierarchy::NO_INSTANCE : m_transforms.Count();
+
+		vNodeIds[i] = m_transforms.Add(PARENT, NODE.local, INSTANCE);
+		if (NODE.mesh != SCENE_NO_INDEX)
+		{
+			m_scene.Create(MeshInstance{ TRIANGLE_MESH + 1 + NODE.mesh, NODE.material }, Transform{ vNodeIds[i] }, LodState{ 0 }, ShadowCaster{ true });
+		}
+	}
+
+	m_vSceneMeshes.assign(file.Meshes(), file.Meshes() + file.MeshCount());
+	m_vSceneLods.assign(file.Lods(), file.Lods() + file.LodCount());
+
+	const VkDeviceSize VERTEX_BYTES = file.VertexDataSize();
+	const VkDeviceSize INDEX_BYTES = static_cast<VkDeviceSize>(file.IndexCount()) * sizeof(uint32_t);
+	if (VERTEX_BYTES == 0 || INDEX_BYTES == 0)
+	{
+		return;
+	}
+
+	CreateBuffer(m_physicalDevice, m_device, VERTEX_BYTES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_sceneVertexBuffer, m_sceneVertexMemory);
+	CreateBuffer(m_physicalDevice, m_device, INDEX_BYTES, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_sceneIndexBuffer, m_sceneIndexMemory);
+
+	// The file already holds the data exactly as the buffers want it, so it's one copy from the mapping into staging memory.
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingMemory;
+	CreateBuffer(m_physicalDevice, m_device, VERTEX_BYTES + INDEX_BYTES, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+	file.PrefetchGeometry();
+
+	void* pData = nullptr;
+	vkMapMemory(m_device, stagingMemory, 0, VERTEX_BYTES + INDEX_BYTES, 0, &pData);
+	std::memcpy(pData, file.VertexData(), VERTEX_BYTES);
+	std::memcpy(static_cast<uint8_t*>(pData) + VERTEX_BYTES, file.Indices(), INDEX_BYTES);
+	vkUnmapMemory(m_device, stagingMemory);
+
+	SubmitImmediate(m_device, m_commandPool, m_graphicsQueue, [&](VkCommandBuffer commandBuffer)
+	{
+		const VkBufferCopy VERTEX_COPY{ 0, 0, VERTEX_BYTES };
+		const VkBufferCopy INDEX_COPY{ VERTEX_BYTES, 0, INDEX_BYTES };
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, m_sceneVertexBuffer, 1, &VERTEX_COPY);
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, m_sceneIndexBuffer, 1, &INDEX_COPY);
+	});
+
+	vkDestroyBuffer(m_device, stagingBuffer, GetAllocationCallbacks());
+	vkFreeMemory(m_device, stagingMemory, GetAllocationCallbacks());
+
+	if (m_useMeshletCulling)
+	{
+		m_meshletCuller.Upload(file, m_commandPool, m_graphicsQueue);
+	}
+}
+
+void VulkanApp::CreateInstanceBuffers()
+{
+	const VkDeviceSize SIZE = sizeof(Float4x4) * MAX_INSTANCES;
+
+	m_vInstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	m_vInstanceMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	std::vector<Float4x4*> vMapped(MAX_FRAMES_IN_FLIGHT);
+
+	// One per frame in flight, so the transforms can write a frame's matrices while the GPU reads another's. Mapped for good.
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		CreateBuffer(m_physicalDevice, m_device, SIZE, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_vInstanceBuffers[i], m_vInstanceMemory[i]);
+
+		void* pData = nullptr;
+		vkMapMemory(m_device, m_vInstanceMemory[i], 0, SIZE, 0, &pData);
+		vMapped[i] = static_cast<Float4x4*>(pData);
+	}
+
+	m_transforms.SetInstanceTargets(vMapped, MAX_INSTANCES);
+
+	if (m_useMeshletCulling)
+	{
+		m_meshletCuller.BindFrames(m_vInstanceBuffers, m_sceneVertexBuffer);
+	}
+}
+
+void VulkanApp::CreateMeshletCuller()
+{
+	if (!m_useMeshletCulling)
+	{
+		return;
+	}
+
+	// Frames in flight are the most the policy can ask for, the same as the instance buffers the culler reads.
+	m_meshletCuller.Init(m_physicalDevice, m_device, MAX_FRAMES_IN_FLIGHT, m_deviceCapabilities.features.multiDrawIndirect == VK_TRUE, m_useMeshShaders, m_lights.SetLayout());
+	m_depthPyramid.Init(m_physicalDevice, m_device);
+}
+
+void VulkanApp::CreateClusteredLights()
+{
+	// Needed by every lit pipeline's layout, so before any of them.
+	m_lights.Init(m_physicalDevice, m_device, MAX_FRAMES_IN_FLIGHT, MAX_LIGHTS);
+}
+
+void VulkanApp::CreateShadowCascades()
+{
+	ShadowCascadeSettings settings{};
+	settings.cascadeCount = CASCADE_COUNT;
+	settings.mapSize = SHADOW_MAP_SIZE;
+	settings.casterReach = CASTER_REACH;
+	std::copy(std::begin(CASCADE_ENDS), std::end(CASCADE_ENDS), settings.cascadeEnds);
+	std::copy(std::begin(CASCADE_REFRESH_INTERVALS), std::end(CASCADE_REFRESH_INTERVALS), settings.refreshIntervals);
+
+	// The depth buffer's format is already known to be attachable and sampleable. Lit pipelines read the map through the light set.
+	m_shadows.Init(m_physicalDevice, m_device, m_depthFormat, settings);
+	m_lights.BindShadowMap(m_shadows.View(), m_shadows.Sampler());
+}
+
+void VulkanApp::CreateDynamicResolution()
+{
+	// Timestamps come from the graphics queue, the one every frame is submitted to.
+	const uint32_t GRAPHICS_FAMILY = m_deviceCapabilities.queueFamilies.graphicsFamily.value();
+	m_gpuTimer.Init(m_device, MAX_FRAMES_IN_FLIGHT, GPU_SCOPE_COUNT, m_deviceCapabilities.properties.limits.timestampPeriod,
+		m_deviceCapabilities.vQueueFamilies[GRAPHICS_FAMILY].timestampValidBits);
+
+	// Without timestamps there's nothing to steer by, so the scale stays put.
+	DynamicResolutionSettings settings{};
+	settings.enabled = DYNAMIC_RESOLUTION && m_gpuTimer.Supported();
+	settings.targetMilliseconds = TARGET_GPU_MS;
+	settings.tolerance = TARGET_TOLERANCE;
+	settings.minScale = MIN_RENDER_SCALE;
+	settings.maxScale = MAX_RENDER_SCALE;
+	m_resolution.Init(m_physicalDevice, m_device, MAX_FRAMES_IN_FLIGHT, settings);
+}
+
+void VulkanApp::CreatePostProcess()
+{
+	m_fusedPostProcess = FUSED_POST_PROCESS;
+	m_vPostFrames.assign(MAX_FRAMES_IN_FLIGHT, { m_fusedPostProcess, 0 });
+
+	if (!POST_PROCESS)
+	{
+		return;
+	}
+
+	PostProcessSettings settings{};
+	settings.exposure = EXPOSURE;
+	settings.contrast = CONTRAST;
+	settings.saturation = SATURATION;
+	std::copy(std::begin(TINT), std::end(TINT), settings.tint);
+	settings.vignette = VIGNETTE;
+	settings.grain = FILM_GRAIN;
+	settings.sharpen = SHARPEN;
+	m_postProcess.Init(m_physicalDevice, m_device, settings);
+}
+
+void VulkanApp::CreateVirtualTexture()
+{
+	if (!m_useVirtualTexture)
+	{
+		return;
+	}
+
+	// Uploads go through the graphics queue, like the texture streamer's.
+	m_virtualTexture.Init(m_physicalDevice, m_device, m_graphicsQueue, m_deviceCapabilities.queueFamilies.graphicsFamily.value(), BACKDROP_PAGE_FILE);
+}
+
+void VulkanApp::CreateDeferredLighting()
+{
+	if (!m_useDeferredShading)
+	{
+		return;
+	}
+
+	// Lighting reads the same clustered lists forward shading does.
+	m_deferred.Init(m_physicalDevice, m_device, m_lights.SetLayout());
+}
+
+void VulkanApp::AddTestLights()
+{
+	if (TEST_LIGHT_COUNT == 0 || m_vSceneMeshes.empty())
+	{
+		return;
+	}
+
+	Aabb bounds = Aabb::Empty();
+	for (const Aabb& BOUNDS : m_vDrawableBounds)
+	{
+		bounds.min = Min(bounds.min, BOUNDS.min);
+		bounds.max = Max(bounds.max, BOUNDS.max);
+	}
+
+	// Sized to the scene, so each light covers a handful of clusters however big it is.
+	const Float3 SIZE = bounds.max - bounds.min;
+	const float RANGE = std::sqrt(Dot(SIZE, SIZE)) * 0.08f;
+
+	// Fixed seed, the same lights every run. Spots face along +z, the way everything is seen, so they light what faces the viewer.
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < TEST_LIGHT_COUNT; i++)
+	{
+		const Float3 POSITION = { bounds.min.x + SIZE.x * unit(random), bounds.min.y + SIZE.y * unit(random), bounds.min.z + SIZE.z * unit(random) };
+		const uint32_t NODE = m_transforms.Add(TransformHierarchy::NO_PARENT, Float4x4::Translation(POSITION.x, POSITION.y, POSITION.z));
+
+		Light light{};
+		light.type = i % 4 == 0 ? LightType::Spot : LightType::Point;
+		light.color[0] = 0.5f + unit(random);
+		light.color[1] = 0.5f + unit(random);
+		light.color[2] = 0.5f + unit(random);
+		light.range = RANGE * (0.5f + unit(random));
+		light.spotCosOuter = 0.80f;
+		light.spotCosInner = 0.95f;
+
+		m_scene.Create(light, Transform{ NODE });
+	}
+}
+
+void VulkanApp::UpdateLights()
+{
+	// World matrices are current, the transforms were just updated for this frame.
+	m_vFrameLights.clear();
+	m_scene.ForEach<const Light, const Transform>([this](uint32_t count, const Entity*, const Light* pLights, const Transform* pTransforms)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Light& LIGHT = pLights[i];
+			const Float4x4& WORLD = m_transforms.GetWorld(pTransforms[i].node);
+			const float Z_LENGTH = std::sqrt(WORLD.m[8] * WORLD.m[8] + WORLD.m[9] * WORLD.m[9] + WORLD.m[10] * WORLD.m[10]);
+			const float INV_Z_LENGTH = Z_LENGTH > 0.0f ? 1.0f / Z_LENGTH : 0.0f;
+
+			GpuLight light{};
+			light.position[0] = WORLD.m[12];
+			light.position[1] = WORLD.m[13];
+			light.position[2] = WORLD.m[14];
+			light.range = LIGHT.range;
+			std::copy(std::begin(LIGHT.color), std::end(LIGHT.color), light.color);
+			light.type = static_cast<uint32_t>(LIGHT.type);
+			light.direction[0] = WORLD.m[8] * INV_Z_LENGTH;
+			light.direction[1] = WORLD.m[9] * INV_Z_LENGTH;
+			light.direction[2] = WORLD.m[10] * INV_Z_LENGTH;
+			light.spotCosOuter = LIGHT.spotCosOuter;
+			light.spotCosInner = LIGHT.spotCosInner;
+			m_vFrameLights.push_back(light);
+		}
+	});
+
+	// The cascades were just fitted for this frame, the matrices are the ones their layers will hold when it's shaded.
+	GpuSun sun{};
+	m_shadows.FillSun(sun);
+	const float SUN_LENGTH = std::sqrt(SUN_DIRECTION[0] * SUN_DIRECTION[0] + SUN_DIRECTION[1] * SUN_DIRECTION[1] + SUN_DIRECTION[2] * SUN_DIRECTION[2]);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		sun.direction[i] = SUN_DIRECTION[i] / SUN_LENGTH;
+		sun.color[i] = SUN_COLOR[i];
+	}
+
+	m_lights.Update(m_currentFrame, m_vFrameLights, sun, m_viewProjection, m_resolution.RenderExtent());
+}
+
+void VulkanApp::BuildSceneBvh()
+{
+	// Bounds need world matrices. This runs before the instance buffers exist, so the update only computes them.
+	m_transforms.Update(m_jobs, m_currentFrame);
+
+	m_vDrawables.clear();
+	m_vDrawableBounds.clear();
+	m_vDrawables.reserve(m_scene.Count());
+	m_vDrawableBounds.reserve(m_scene.Count());
+
+	m_scene.ForEach<const MeshInstance, const Transform>([this](uint32_t count, const Entity* pEntities, const MeshInstance* pMeshes, const Transform* pTransforms)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			m_vDrawables.push_back({ pEntities[i], pMeshes[i].mesh, pMeshes[i].material, pTransforms[i].node, 0 });
+			m_vDrawableBounds.push_back(GetWorldBounds(pMeshes[i].mesh, pTransforms[i].node));
+		}
+	});
+
+	m_sceneBvh.Build(m_vDrawableBounds.data(), static_cast<uint32_t>(m_vDrawableBounds.size()));
+}
+
+void VulkanApp::UpdateDrawList()
+{
+	// The tree is only built once. When anything moves its boxes are refit, which keeps them correct if less tight.
+	if (m_transforms.Moved())
+	{
+		for (uint32_t i = 0; i < m_vDrawables.size(); i++)
+		{
+			m_vDrawableBounds[i] = GetWorldBounds(m_vDrawables[i].mesh, m_vDrawables[i].instance);
+		}
+		m_sceneBvh.Refit(m_vDrawableBounds.data());
+	}
+
+	m_vVisibleDrawables.clear();
+	m_sceneBvh.QueryFrustum(Frustum::FromViewProjection(m_viewProjection), m_vVisibleDrawables);
+
+	// Back in registry order, so the draw order doesn't depend on the tree's layout.
+	std::sort(m_vVisibleDrawables.begin(), m_vVisibleDrawables.end());
+
+	// The level each was last drawn at carries over in its LodState, SelectLods picks up from there.
+	m_vDrawList.clear();
+	for (uint32_t drawable : m_vVisibleDrawables)
+	{
+		DrawItem item = m_vDrawables[drawable];
+		if (const LodState* pLodState = m_scene.Get<LodState>(item.entity))
+		{
+			item.lod = pLodState->lod;
+		}
+		m_vDrawList.push_back(item);
+	}
+}
+
+void VulkanApp::SelectLods()
+{
+	// Clip space is an orthographic view, a unit covers half the rendered height wherever the object is. That height
+	// follows the dynamic resolution, so the levels are picked again every frame, held steady by the hysteresis.
+	const float PIXELS_PER_UNIT = m_resolution.RenderExtent().height * 0.5f;
+
+	for (DrawItem& item : m_vDrawList)
+	{
+		if (LodState* pLodState = m_scene.Get<LodState>(item.entity))
+		{
+			const SceneMesh& SCENE_MESH = m_vSceneMeshes[item.mesh - TRIANGLE_MESH - 1];
+			const float SCALE = m_transforms.GetWorld(item.instance).MaxScale();
+			pLodState->lod = SelectLod(m_vSceneLods.data() + SCENE_MESH.firstLod, SCENE_MESH.lodCount, PIXELS_PER_UNIT * SCALE, LOD_ERROR_PIXELS, LOD_HYSTERESIS, pLodState->lod);
+			item.lod = pLodState->lod;
+		}
+	}
+}
+
+void VulkanApp::UpdateMeshletDraws()
+{
+	if (!m_useMeshletCulling)
+	{
+		return;
+	}
+
+	// Every meshlet of every full detail mesh in the draw list, the GPU decides which of them are drawn.
+	m_vMeshletDraws.clear();
+	for (const DrawItem& ITEM : m_vDrawList)
+	{
+		if (!DrawsAsMeshlets(ITEM))
+		{
+			continue;
+		}
+
+		const uint32_t MESH = ITEM.mesh - TRIANGLE_MESH - 1;
+		const SceneMesh& SCENE_MESH = m_vSceneMeshes[MESH];
+		for (uint32_t i = 0; i < SCENE_MESH.meshletCount; i++)
+		{
+			m_vMeshletDraws.push_back({ SCENE_MESH.firstMeshlet + i, ITEM.instance, MESH, 0 });
+		}
+	}
+
+	// The list changes whenever anything enters or leaves the frustum, so it's rewritten into this slot's buffers
+	// every frame. Only this slot's last frame read them, and its fence was waited on at the top of DrawFrame.
+	m_meshletCuller.SetDraws(m_currentFrame, m_vMeshletDraws);
+}
+
+bool VulkanApp::DrawsAsMeshlets(const DrawItem& item) const
+{
+	// Meshlets only cover the full mesh. Coarser levels are cheap enough to draw whole, and have fewer triangles to cull.
+	if (!m_useMeshletCulling || item.mesh == TRIANGLE_MESH || item.lod != 0)
+	{
+		return false;
+	}
+
+	const SceneMesh& SCENE_MESH = m_vSceneMeshes[item.mesh - TRIANGLE_MESH - 1];
+	return SCENE_MESH.meshletCount > 0 && SCENE_MESH.vertexFormat == static_cast<uint32_t>(SceneVertexFormat::Quantized);
+}
+
+Aabb VulkanApp::GetWorldBounds(uint32_t mesh, uint32_t node) const
+{
+	const Float4x4& WORLD = m_transforms.GetWorld(node);
+
+	// The triangle is flat, its corners straight from shader.vert.
+	if (mesh == TRIANGLE_MESH)
+	{
+		Aabb bounds = Aabb::Empty();
+		bounds.Grow(WORLD.TransformPoint({ 0.0f, -0.5f, 0.0f }));
+		bounds.Grow(WORLD.TransformPoint({ 0.5f, 0.5f, 0.0f }));
+		bounds.Grow(WORLD.TransformPoint({ -0.5f, 0.5f, 0.0f }));
+		return bounds;
+	}
+
+	const SceneMesh& SCENE_MESH = m_vSceneMeshes[mesh - TRIANGLE_MESH - 1];
+	const Float3 CENTER = { SCENE_MESH.boundsCenter[0], SCENE_MESH.boundsCenter[1], SCENE_MESH.boundsCenter[2] };
+	return Aabb::FromSphere(WORLD.TransformPoint(CENTER), SCENE_MESH.boundsRadius * WORLD.MaxScale());
+}
+
+void VulkanApp::CreateTextureStreamer()
+{
+	const QueueFamilyIndices& queueFamilyIndices = m_deviceCapabilities.queueFamilies;
+
+	// Uploads go through the graphics queue, so no queue family ownership transfers are needed.
+	m_textureStreamer.Init(m_physicalDevice, m_device, m_graphicsQueue, queueFamilyIndices.graphicsFamily.value());
+
+	if (!m_useStreamedBackdrop)
+	{
+		return;
+	}
+
+	// Drawn from whichever mips have arrived, so it starts blurry and sharpens as the rest stream in.
+	m_backdropTexture = m_textureStreamer.Load(BACKDROP_TEXTURE);
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, GetAllocationCallbacks(), &m_backdropSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create backdrop descriptor set layout!");
+	}
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, GetAllocationCallbacks(), &m_backdropDescriptorPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create backdrop descriptor pool!");
+	}
+
+	const std::vector<VkDescriptorSetLayout> LAYOUTS(MAX_FRAMES_IN_FLIGHT, m_backdropSetLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_backdropDescriptorPool;
+	allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+	allocInfo.pSetLayouts = LAYOUTS.data();
+
+	m_vBackdropSets.resize(MAX_FRAMES_IN_FLIGHT);
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_vBackdropSets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate backdrop descriptor sets!");
+	}
+}
+
 void VulkanApp::DrawFrame()
 {
+	// Claim any input this frame can react to, the latency is measured when it's presented.
+	const bool HAS_INPUT = m_hasPendingInput;
+	const PresentStats::Clock::time_point INPUT_TIME = m_pendingInputTime;
+	m_hasPendingInput = false;
+
 	// Wait for frame
 	vkWaitForFences(m_device, 1, &m_vFences[m_currentFrame], VK_TRUE, UINT64_MAX); // Will wait for all fences, with no timeout.
 
+	// The slot's last frame is done, its GPU time picks the resolution everything below is drawn at.
+	double gpuMilliseconds = -1.0;
+	m_gpuTimer.Read(m_currentFrame, GPU_SCOPE_FRAME, gpuMilliseconds);
+	m_resolution.Update(m_currentFrame, gpuMilliseconds);
+
+	double postMilliseconds;
+	if (m_gpuTimer.Read(m_currentFrame, GPU_SCOPE_POST, postMilliseconds))
+	{
+		const PostFrame& POST_FRAME = m_vPostFrames[m_currentFrame];
+		m_postStats[POST_FRAME.fused ? 1 : 0].Add(postMilliseconds, POST_FRAME.pixels);
+	}
+
+	// Push the next slice of any texture mips still streaming in.
+	m_textureStreamer.Update();
+
+	// The backdrop's view changes as its mips arrive. This slot's set is free to rewrite now its fence has signalled.
+	const VkImageView BACKDROP_VIEW = m_useStreamedBackdrop ? m_textureStreamer.GetImageView(m_backdropTexture) : VK_NULL_HANDLE;
+	if (BACKDROP_VIEW != VK_NULL_HANDLE)
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = m_textureStreamer.GetSampler();
+		imageInfo.imageView = BACKDROP_VIEW;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_vBackdropSets[m_currentFrame];
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+
+	// This slot's feedback is complete now its fence has signalled. Pages the loader has finished go up with it.
+	if (m_useVirtualTexture)
+	{
+		m_virtualTexture.BeginFrame(m_currentFrame);
+	}
+
+	// Only what moved since this frame slot was last used is recomputed or rewritten. The slot's fence was just waited on.
+	m_transforms.Update(m_jobs, m_currentFrame);
+	UpdateDrawList();
+	SelectLods();
+	UpdateMeshletDraws();
+	m_shadows.Update(m_viewProjection, { SUN_DIRECTION[0], SUN_DIRECTION[1], SUN_DIRECTION[2] });
+	UpdateLights();
+
 	// Get an image from the swap chain.
 	uint32_t imageIndex;
 
@@ -711,6 +2345,9 @@ void VulkanApp::DrawFrame()
 	// Mark the image as in use by this frame.
 	m_vImagesInFlight[imageIndex] = m_vFences[m_currentFrame];
 
+	// Its command buffer is free again now, and this frame's instance buffer is the one to cull against.
+	RecordCommandBuffer(imageIndex);
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -746,14 +2383,17 @@ void VulkanApp::DrawFrame()
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
-	// Check if a previous frame is using this image.
-	if (m_vImagesInFlight[imageIndex] != VK_NULL_HANDLE)
+	// Check presentation return codes.
+	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+
+	PresentStats& stats = m_presentStats[static_cast<size_t>(m_presentPolicy)];
+	const PresentStats::Clock::time_point PRESENT_TIME = PresentStats::Clock::now();
+	stats.Presented(PRESENT_TIME);
+	if (HAS_INPUT)
 	{
-		vkWaitForFences(m_device, 1, &m_vImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		stats.AddLatency(PRESENT_TIME - INPUT_TIME);
 	}
 
-	// Check presentation return codes.
-	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_framebufferResized)
 	{
 		// Reset local resize flag.
@@ -765,22 +2405,39 @@ void VulkanApp::DrawFrame()
 		throw std::runtime_error("Failed to present swap chain image!");
 	}
 
-	vkQueueWaitIdle(m_presentQueue);
+	if (!m_startupProfiler.FirstFrameDone())
+	{
+		m_startupProfiler.MarkFirstFrame();
+
+		// A line per status message, the whole report is more than one log record holds.
+		std::stringstream report;
+		m_startupProfiler.Report(report);
+
+		std::string line;
+		while (std::getline(report, line))
+		{
+			m_logger.Status(line.c_str());
+		}
+	}
 
-	m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	// The fences are what limit how far ahead of the GPU we get, so frames in flight is down to the policy.
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
 }
 
 // =================================================================================================================================================================
 // Needed when swap chain becomes incompatible, during window resize for example.
 void VulkanApp::RecreateSwapChain()
 {
-	// Handle minimisation as a special case of resizing.
-	int width = 0, height = 0;
-	glfwGetFramebufferSize(m_window, &width, &height);
-	while (width == 0 || height == 0)
+	// The new extent comes from the surface capabilities, the rest of the device's capabilities are unchanged.
+	RefreshSurfaceCapabilities(m_deviceCapabilities, m_surface);
+
+	/*	A zero extent means we were minimised before the message arrived. Keep the old swap chain,
+		the render loop stops drawing once the message is processed and the restore brings us back here.
+	*/
+	const VkExtent2D& CURRENT_EXTENT = m_deviceCapabilities.swapChainSupport.capabilities.currentExtent;
+	if (CURRENT_EXTENT.width == 0 || CURRENT_EXTENT.height == 0 || m_framebufferWidth == 0 || m_framebufferHeight == 0)
 	{
-		glfwGetFramebufferSize(m_window, &width, &height);
-		glfwWaitEvents();
+		return;
 	}
 
 	/*	We need to clean up the old swap chain, but we don't want
@@ -791,44 +2448,164 @@ void VulkanApp::RecreateSwapChain()
 
 	CreateSwapChain();
 	CreateImageViews();
+	CreateDepthResources();
 	CreateRenderPass();
 	CreateGraphicsPipeline();
 	CreateFramebuffers();
 	CreateCommandBuffers();
+
+	NameObjects();
 }
 
 void VulkanApp::CleanupSwapChain()
 {
-	// Destroy framebuffers.
-	for (auto framebuffer : m_vSwapChainFramebuffers)
-	{
-		vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-	}
+	// Destroy framebuffers, and the upscale's into the swap chain images.
+	vkDestroyFramebuffer(m_device, m_sceneFramebuffer, GetAllocationCallbacks());
+	m_sceneFramebuffer = VK_NULL_HANDLE;
+	m_resolution.ReleaseOutput();
 
 	// Clean up existing command buffers, keeping the pool intact for future use.
 	vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_vCommandBuffers.size()), m_vCommandBuffers.data());
 
 	// Destroy Pipeline.
-	vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-
-	// Destroy Render Pass.
-	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+	vkDestroyPipeline(m_device, m_graphicsPipeline, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_backdropPipeline, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_backdropPipelineLayout, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_meshPipeline, GetAllocationCallbacks());
+	vkDestroyPipelineLayout(m_device, m_meshPipelineLayout, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_meshletPipeline, GetAllocationCallbacks());
+	vkDestroyPipeline(m_device, m_meshletMeshPipeline, GetAllocationCallbacks());
+	m_meshletPipeline = VK_NULL_HANDLE;
+	m_meshletMeshPipeline = VK_NULL_HANDLE;
+	m_deferred.ReleasePipeline();
+
+	// Destroy Render Passes.
+	vkDestroyRenderPass(m_device, m_renderPass, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_earlyRenderPass, GetAllocationCallbacks());
+	vkDestroyRenderPass(m_device, m_lateRenderPass, GetAllocationCallbacks());
+	m_earlyRenderPass = VK_NULL_HANDLE;
+	m_lateRenderPass = VK_NULL_HANDLE;
+
+	// Destroy depth, and the pyramid, G-buffer, scene colour and post-processing images sized with it.
+	m_depthPyramid.Release();
+	m_deferred.ReleaseTargets();
+	m_postProcess.ReleaseTargets();
+	m_resolution.ReleaseTargets();
+	vkDestroyImageView(m_device, m_depthImageView, GetAllocationCallbacks());
+	vkDestroyImage(m_device, m_depthImage, GetAllocationCallbacks());
+	vkFreeMemory(m_device, m_depthMemory, GetAllocationCallbacks());
 
 	// Destroy image views.
 	for (auto view : m_vSwapChainImageViews)
 	{
-		vkDestroyImageView(m_device, view, nullptr);
+		vkDestroyImageView(m_device, view, GetAllocationCallbacks());
+	}
+
+	vkDestroySwapchainKHR(m_device, m_oldSwapChain, GetAllocationCallbacks());
+	vkDestroySwapchainKHR(m_device, m_currentSwapChain, GetAllocationCallbacks());
+}
+
+void VulkanApp::NameObjects()
+{
+	if (!g_enableValidationLayers)
+	{
+		return;
+	}
+
+	// Debug utils takes every handle as a uint64, most of ours are pointers on 64 bit builds so need the cast.
+	auto name = [this](VkObjectType type, uint64_t handle, const std::string& objectName)
+	{
+		if (handle != 0)
+		{
+			SetDebugObjectName(m_vulkanInstance, m_device, type, handle, objectName.c_str());
+		}
+	};
+
+	name(VK_OBJECT_TYPE_DEVICE, reinterpret_cast<uint64_t>(m_device), "Main device");
+	name(VK_OBJECT_TYPE_QUEUE, reinterpret_cast<uint64_t>(m_graphicsQueue), "Graphics queue");
+	if (m_presentQueue != m_graphicsQueue)
+	{
+		name(VK_OBJECT_TYPE_QUEUE, reinterpret_cast<uint64_t>(m_presentQueue), "Present queue");
+	}
+	name(VK_OBJECT_TYPE_SWAPCHAIN_KHR, reinterpret_cast<uint64_t>(m_currentSwapChain), "Swap chain");
+	name(VK_OBJECT_TYPE_RENDER_PASS, reinterpret_cast<uint64_t>(m_renderPass), "Main render pass");
+	name(VK_OBJECT_TYPE_RENDER_PASS, reinterpret_cast<uint64_t>(m_earlyRenderPass), "Early render pass");
+	name(VK_OBJECT_TYPE_RENDER_PASS, reinterpret_cast<uint64_t>(m_lateRenderPass), "Late render pass");
+	name(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(m_depthImage), "Depth buffer");
+	name(VK_OBJECT_TYPE_IMAGE_VIEW, reinterpret_cast<uint64_t>(m_depthImageView), "Depth buffer view");
+	name(VK_OBJECT_TYPE_PIPELINE_LAYOUT, reinterpret_cast<uint64_t>(m_pipelineLayout), "Triangle pipeline layout");
+	name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(m_graphicsPipeline), "Triangle pipeline");
+	name(VK_OBJECT_TYPE_PIPELINE_LAYOUT, reinterpret_cast<uint64_t>(m_meshPipelineLayout), "Mesh pipeline layout");
+	name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(m_meshPipeline), "Mesh pipeline");
+	name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(m_meshletPipeline), "Meshlet pipeline");
+	name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(m_meshletMeshPipeline), "Meshlet mesh shader pipeline");
+	name(VK_OBJECT_TYPE_PIPELINE_LAYOUT, reinterpret_cast<uint64_t>(m_backdropPipelineLayout), "Backdrop pipeline layout");
+	name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(m_backdropPipeline), "Backdrop pipeline");
+	name(VK_OBJECT_TYPE_COMMAND_POOL, reinterpret_cast<uint64_t>(m_commandPool), "Main command pool");
+	name(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(m_resolution.ColorImage()), "Scene colour");
+	name(VK_OBJECT_TYPE_IMAGE_VIEW, reinterpret_cast<uint64_t>(m_resolution.ColorView()), "Scene colour view");
+
+	if (!m_useDynamicRendering)
+	{
+		name(VK_OBJECT_TYPE_FRAMEBUFFER, reinterpret_cast<uint64_t>(m_sceneFramebuffer), "Scene framebuffer");
 	}
 
-	vkDestroySwapchainKHR(m_device, m_oldSwapChain, nullptr);
-	vkDestroySwapchainKHR(m_device, m_currentSwapChain, nullptr);
+	for (size_t i = 0; i < m_vSwapChainImages.size(); i++)
+	{
+		const std::string INDEX = std::to_string(i);
+		name(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(m_vSwapChainImages[i]), "Swap chain image " + INDEX);
+		name(VK_OBJECT_TYPE_IMAGE_VIEW, reinterpret_cast<uint64_t>(m_vSwapChainImageViews[i]), "Swap chain view " + INDEX);
+		name(VK_OBJECT_TYPE_COMMAND_BUFFER, reinterpret_cast<uint64_t>(m_vCommandBuffers[i]), "Frame commands " + INDEX);
+	}
+
+	for (size_t i = 0; i < m_vFences.size(); i++)
+	{
+		const std::string INDEX = std::to_string(i);
+		name(VK_OBJECT_TYPE_FENCE, reinterpret_cast<uint64_t>(m_vFences[i]), "Frame fence " + INDEX);
+		name(VK_OBJECT_TYPE_SEMAPHORE, reinterpret_cast<uint64_t>(m_vImageAvailableSemaphores[i]), "Image available " + INDEX);
+		name(VK_OBJECT_TYPE_SEMAPHORE, reinterpret_cast<uint64_t>(m_vRenderFinishedSemaphores[i]), "Render finished " + INDEX);
+	}
 }
 
+// The callbacks all run on the main thread, inside glfwWaitEvents. They only post messages and state.
+
 void VulkanApp::FrameBufferResizeCallBack(GLFWwindow* window, int width, int height)
 {
 	VulkanApp* app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
-	app->m_framebufferResized = true;
+	app->PostWindowState();
+}
+
+void VulkanApp::IconifyCallBack(GLFWwindow* window, int iconified)
+{
+	VulkanApp* app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+	app->PostWindowState();
+}
+
+void VulkanApp::KeyCallBack(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	VulkanApp* app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+	app->PostInput();
+
+	// Applied between frames by the render thread.
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	{
+		app->PostWindowEvent(WindowEvent::Type::CyclePresentPolicy);
+	}
+	else if (key == GLFW_KEY_F && action == GLFW_PRESS)
+	{
+		app->PostWindowEvent(WindowEvent::Type::TogglePostFusion);
+	}
+}
+
+void VulkanApp::MouseButtonCallBack(GLFWwindow* window, int button, int action, int mods)
+{
+	reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window))->PostInput();
+}
+
+void VulkanApp::CursorPosCallBack(GLFWwindow* window, double x, double y)
+{
+	reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window))->PostInput();
 }
 
 
@@ -875,11 +2652,39 @@ std::vector<const char*> VulkanApp::GetRequiredExtensions()
 	if (g_enableValidationLayers)
 	{
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
+		if (ValidationFeaturesSupported())
+		{
+			extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+		}
 	}
 
 	return extensions;
 }
 
+bool VulkanApp::ValidationFeaturesSupported()
+{
+	// Provided by the validation layer itself rather than the driver, so ask the layer.
+	for (const char* layerName : V_LAYERS)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(layerName, &extensionCount, extensions.data());
+
+		for (const auto& EXTENSION : extensions)
+		{
+			if (strcmp(EXTENSION.extensionName, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME) == 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 // =================================================================================================================================================================
 // Debug message handler
 
@@ -891,7 +2696,15 @@ VKAPI_ATTR VkBool32 VKAPI_CALL VulkanApp::DebugCallBack
 	void* pUserData
 )
 {
-	std::cerr << "Validation Layer: " << pCallBackData->pMessage << std::endl;
+	VulkanApp* pApp = static_cast<VulkanApp*>(pUserData);
+
+	if (PerfWarningReport::IsPerformanceWarning(messageType, pCallBackData))
+	{
+		pApp->m_perfWarnings.Record(pCallBackData);
+	}
+
+	// Runs on whatever thread the driver called from, so all I/O is left to the logger's writer thread.
+	pApp->m_logger.Push(messageSeverity, messageType, pCallBackData->messageIdNumber, pCallBackData->pMessageIdName, pCallBackData->pMessage);
 
 	return VK_FALSE;
 }
@@ -910,153 +2723,37 @@ void VulkanApp::PopulateDebugInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo
 		VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
 
 	createInfo.pfnUserCallback = DebugCallBack;
-	createInfo.pUserData = nullptr;
+	createInfo.pUserData = this;
 }
 
 // =================================================================================================================================================================
 // Device selection
 
-uint32_t VulkanApp::RateDevice(VkPhysicalDevice device)
+uint32_t VulkanApp::RateDevice(const DeviceCapabilities& capabilities)
 {
 	uint32_t score = 0;
 
-	// Support for basic properties like name, type and Vulkan version.
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-	// Support for optional features, such as, texture comnpression, 64-bit floats, and multi-viewport rendering.
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
 	// No geometry shader would make the device totally unsuitable, as would lack of required queue families.
-	if (!deviceFeatures.geometryShader || !DeviceSuitable(device))
+	if (!capabilities.features.geometryShader || !capabilities.Suitable())
 	{
 		return 0;
 	}
 
 	// Discrete GPU's are preferable.
-	if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+	if (capabilities.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
 	{
 		score += 1000;
 	}
 
 	// As are GPU's that can output the highest gfx quality.
-	score += deviceProperties.limits.maxImageDimension2D;
+	score += capabilities.properties.limits.maxImageDimension2D;
 
 	return score;
 }
 
-bool VulkanApp::DeviceSuitable(VkPhysicalDevice device)
-{
-	const QueueFamilyIndices INDICES = FindQueueFamilies(device);
-	const bool EXTENSIONS_SUPPORTED = DeviceExtensionSupport(device);
-	bool swapChainSupportAdequate = false;
-
-	if (EXTENSIONS_SUPPORTED)
-	{
-		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
-		swapChainSupportAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-	}
-
-	// Going mad or is EXTENSIONS_SUPPORTED unecessary at this point?
-	return INDICES.IsComplete() && EXTENSIONS_SUPPORTED && swapChainSupportAdequate;
-}
-
-bool VulkanApp::DeviceExtensionSupport(VkPhysicalDevice device)
-{
-	// Get extension count.
-	uint32_t extensionCount;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-	// Get extension names.
-	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-	// Tick off avilable extensions against those that are required.
-	std::set<std::string> requiredExtensions(V_EXTENS.begin(), V_EXTENS.end());
-	for (const auto& extension : availableExtensions)
-	{
-		requiredExtensions.erase(extension.extensionName);
-	}
-
-	return requiredExtensions.empty();
-}
-
 // =================================================================================================================================================================
 // Swap chain creation.
 
-// Find the GFX queue family.
-QueueFamilyIndices VulkanApp::FindQueueFamilies(VkPhysicalDevice device)
-{
-	QueueFamilyIndices indices{};
-
-	// Types of operations supported and number of queues that can be created based on that queue family.
-	uint32_t queueFamilyCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-
-	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
-	uint32_t i = 0;
-	for (const auto& queueFamily : queueFamilies)
-	{
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
-
-		if (presentSupport)
-		{
-			indices.presentFamily = i;
-		}
-
-		// Require at least one queue family that supports GFX bit.
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-		{
-			indices.graphicsFamily = i;
-		}
-
-		// Break if we have at least one of each required family.
-		if (indices.IsComplete())
-		{
-			break;
-		}
-
-		i++;
-	}
-
-	return indices;
-}
-
-SwapChainSupportDetails VulkanApp::QuerySwapChainSupport(VkPhysicalDevice device)
-{
-	SwapChainSupportDetails details;
-
-	// The physical device and the surface are included in all swap chain queries as they are core components of the swap chain.
-	// Surface capabilities.
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, m_surface, &details.capabilities);
-
-	// Face formats.
-	uint32_t formatCount;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_surface, &formatCount, nullptr);
-
-	if (formatCount != 0)
-	{
-		details.formats.resize(formatCount);
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_surface, &formatCount, details.formats.data());
-	}
-
-	// Presentation modes.
-	uint32_t presentModeCount;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_surface, &presentModeCount, nullptr);
-
-	if (presentModeCount != 0)
-	{
-		details.presentModes.resize(presentModeCount);
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, m_surface, &presentModeCount, details.presentModes.data());
-	}
-
-	return details;
-}
-
 VkSurfaceFormatKHR VulkanApp::ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
 	// Set the prefered format here.
@@ -1095,12 +2792,12 @@ VkPresentModeKHR VulkanApp::ChooseSwapPresentMode(const std::vector <VkPresentMo
 																==>	ONLY VK_PRESENT_MODE_FIFO_KHR is guranteed to be avilable.	<==
 	 */
 
-	 // Check for the prefered present mode.
-	for (const auto& MODE : availableModes)
+	 // The policy lists modes in order of preference.
+	for (const auto& PREFERRED : GetPresentSettings(m_presentPolicy).vPresentModes)
 	{
-		if (MODE == VK_PRESENT_MODE_MAILBOX_KHR) // VK_PRESENT_MODE_MAILBOX_KHR is quite power hungy, consier VK_PRESENT_MODE_FIFO_KHR for mobile devices.
+		if (std::find(availableModes.begin(), availableModes.end(), PREFERRED) != availableModes.end())
 		{
-			return MODE;
+			return PREFERRED;
 		}
 	}
 
@@ -1117,13 +2814,11 @@ VkExtent2D VulkanApp::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
 	}
 	else
 	{
-		int width, height;
-		glfwGetFramebufferSize(m_window, &width, &height);
-
+		// From the last resize message, GLFW can't be asked from the render thread.
 		VkExtent2D actualExtent =
 		{
-			static_cast<uint32_t>(width),
-			static_cast<uint32_t>(height)
+			m_framebufferWidth,
+			m_framebufferHeight
 		};
 
 		// Fix values between min and max supported extents.
@@ -1142,7 +2837,7 @@ VkShaderModule VulkanApp::CreateShaderModule(const std::vector<char>& code)
 	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); // Must satisfy Uint32_t alignment, which the default allocator of std::vector does.
 
 	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	if (vkCreateShaderModule(m_device, &createInfo, GetAllocationCallbacks(), &shaderModule) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create shader module!");
 	}
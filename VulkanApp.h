@@ -6,11 +6,37 @@
 
 #pragma once
 #include "VulkanUtils.h"
+#include "TextureStreamer.h"
+#include "VirtualTexture.h"
+#include "DeviceCapabilities.h"
+#include "StartupProfiler.h"
+#include "Logger.h"
+#include "PerfWarningReport.h"
+#include "PresentPolicy.h"
+#include "WindowEvent.h"
+#include "RingBuffer.h"
+#include "JobSystem.h"
+#include "EntityRegistry.h"
+#include "SceneComponents.h"
+#include "SceneFile.h"
+#include "Bvh.h"
+#include "MeshletCuller.h"
+#include "DepthPyramid.h"
+#include "ClusteredLights.h"
+#include "DeferredLighting.h"
+#include "ShadowCascades.h"
+#include "GpuTimer.h"
+#include "DynamicResolution.h"
+#include "PostProcess.h"
 
 #define GLFW_INCLUDE_VULKAN	// Loads GLFW funtionality and vulkan.h
 #include <GLFW/glfw3.h>		//
 
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <exception>
 
 #ifdef NDEBUG
 constexpr bool g_enableValidationLayers = false;
@@ -35,16 +61,65 @@ public:
 		m_oldSwapChain(nullptr),
 		m_swapChainImageFormat(VK_FORMAT_UNDEFINED),
 		m_swapChainExtent({ 0, 0 }),
+		m_depthFormat(VK_FORMAT_UNDEFINED),
+		m_depthImage(VK_NULL_HANDLE),
+		m_depthMemory(VK_NULL_HANDLE),
+		m_depthImageView(VK_NULL_HANDLE),
 		m_renderPass(nullptr),
+		m_earlyRenderPass(nullptr),
+		m_lateRenderPass(nullptr),
 		m_pipelineLayout(nullptr),
 		m_graphicsPipeline(nullptr),
+		m_meshPipelineLayout(nullptr),
+		m_meshPipeline(nullptr),
+		m_meshletPipeline(nullptr),
+		m_meshletMeshPipeline(nullptr),
+		m_backdropPipelineLayout(nullptr),
+		m_backdropPipeline(nullptr),
+		m_sceneFramebuffer(VK_NULL_HANDLE),
 		m_commandPool(nullptr),
+		m_instanceApiVersion(VK_API_VERSION_1_0),
+		m_useDynamicRendering(false),
+		m_pfnCmdBeginRendering(nullptr),
+		m_pfnCmdEndRendering(nullptr),
+		m_useMeshletCulling(false),
+		m_useMeshShaders(false),
+		m_useDeferredShading(false),
+		m_useVirtualTexture(false),
+		m_useStreamedBackdrop(false),
 		m_currentFrame(0),
+		m_presentPolicy(PresentPolicy::LowLatency),
+		m_requestedPresentPolicy(PresentPolicy::LowLatency),
+		m_framesInFlight(GetPresentSettings(PresentPolicy::LowLatency).framesInFlight),
+		m_pendingInputTime(),
+		m_hasPendingInput(false),
+		m_rendering(false),
+		m_renderFailed(false),
+		m_windowState(0),
+		m_inputTicks(0),
+		m_framebufferWidth(0),
+		m_framebufferHeight(0),
+		m_minimized(false),
+		m_fusedPostProcess(false),
+		m_backdropTexture(0),
+		m_backdropSetLayout(VK_NULL_HANDLE),
+		m_backdropDescriptorPool(VK_NULL_HANDLE),
+		m_sceneVertexBuffer(VK_NULL_HANDLE),
+		m_sceneVertexMemory(VK_NULL_HANDLE),
+		m_sceneIndexBuffer(VK_NULL_HANDLE),
+		m_sceneIndexMemory(VK_NULL_HANDLE),
+		m_viewProjection(Float4x4::Identity()),
 		m_framebufferResized(false)
 	{}
 
 	void Run();
 
+	// Call before Run to pick the starting policy, P cycles through them while running.
+	void SetPresentPolicy(PresentPolicy policy);
+
+	// True when validation raised performance warnings that aren't in the baseline, see PerfWarningReport.
+	_NODISCARD bool PerfRegressed() const { return m_perfWarnings.HasRegressions(); }
+
 private:
 
 	//=======================================================================================================================
@@ -61,29 +136,74 @@ private:
 	// Initialisation.
 
 	void CreateInstance();
+	uint32_t GetInstanceApiVersion();
 	void SetupDebugMessenger();
 	void CreateSurface();
 	void PickPhysicalDevice();
 	void CreateLogicalDevice();
 	void CreateSwapChain();
 	void CreateImageViews();
+	void CreateDepthResources();
+	VkFormat FindDepthFormat();
 	void CreateRenderPass();
+	VkRenderPass CreateMainRenderPass(bool firstPass, bool lastPass);
 	void CreateGraphicsPipeline();
 	void CreateFramebuffers();
 	void CreateCommandPool();
 	void CreateCommandBuffers();
+	void RecordCommandBuffer(uint32_t imageIndex);
+	void RecordDraws(VkCommandBuffer commandBuffer);
+	void RecordMeshletDraws(VkCommandBuffer commandBuffer);
+	void BeginMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool firstPass, bool lastPass);
+	void EndMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool lastPass);
 	void CreateSyncObjects();
+	void CreateTextureStreamer();
+	void CreateScene();
+	void LoadScene(const SceneFile& file);
+	void CreateInstanceBuffers();
+	void CreateMeshletCuller();
+	void CreateClusteredLights();
+	void CreateDeferredLighting();
+	void CreateShadowCascades();
+	void CreateDynamicResolution();
+	void CreatePostProcess();
+	void CreateVirtualTexture();
+	void RecordShadowCasters(VkCommandBuffer commandBuffer, const Float4x4& lightViewProjection, bool staticCasters);
+	void AddTestLights();
+	void UpdateLights();
+	void BuildSceneBvh();
+	void UpdateDrawList();
+	void SelectLods();
+	void UpdateMeshletDraws();
+	bool DrawsAsMeshlets(const DrawItem& item) const;
+	Aabb GetWorldBounds(uint32_t mesh, uint32_t node) const;
 
 	void DrawFrame();
 
 	// Needed when swap chain becomes incompatible, during window resize for example.
 	void RecreateSwapChain();
 	void CleanupSwapChain();
+	void NameObjects();
+	void ApplyPresentPolicy(PresentPolicy policy);
+
+	// Render thread, and the messages it gets from the main thread.
+	void RenderLoop();
+	void ProcessWindowEvents();
+	void PostWindowEvent(WindowEvent::Type type);
+	void PostWindowState();
+	void PostInput();
+
+	// GLFW callbacks, on the main thread.
 	static void FrameBufferResizeCallBack(GLFWwindow* window, int width, int height);
+	static void IconifyCallBack(GLFWwindow* window, int iconified);
+	static void KeyCallBack(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void MouseButtonCallBack(GLFWwindow* window, int button, int action, int mods);
+	static void CursorPosCallBack(GLFWwindow* window, double x, double y);
 
 	// Checks used during instance creation.
 	bool CheckValidationLayerSupport();
 	std::vector<const char*> GetRequiredExtensions();
+	bool ValidationFeaturesSupported();
 
 	// Debug message handler
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallBack
@@ -96,13 +216,9 @@ private:
 	void PopulateDebugInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 
 	// Device selection
-	uint32_t RateDevice(VkPhysicalDevice device);
-	bool DeviceSuitable(VkPhysicalDevice device);
-	bool DeviceExtensionSupport(VkPhysicalDevice device);
+	uint32_t RateDevice(const DeviceCapabilities& capabilities);
 
 	// Swap chain creation
-	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
-	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR ChooseSwapPresentMode(const std::vector <VkPresentModeKHR>& availableModes);
 	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
@@ -115,8 +231,11 @@ private:
 	GLFWwindow* m_window;
 	VkInstance	m_vulkanInstance;				// This is actually a wrapped up pointer!
 	VkDebugUtilsMessengerEXT m_debugMessenger;	// And this is too!
+	Logger m_logger;							// Where the debug messenger's output goes.
+	PerfWarningReport m_perfWarnings;
 	VkSurfaceKHR m_surface;
 	VkPhysicalDevice m_physicalDevice;			// Destroyed implicitly when Vulkan instance is destroyed.
+	DeviceCapabilities m_deviceCapabilities;	// Queried once when picking the device, only surface capabilities are refreshed after that.
 	VkDevice m_device;							// Here be pointers.
 	VkQueue m_graphicsQueue;					// Implictly destroyed when logical device is destroyed.
 	VkQueue m_presentQueue;
@@ -129,13 +248,36 @@ private:
 	VkExtent2D m_swapChainExtent;
 	std::vector<VkImageView> m_vSwapChainImageViews;
 
+	// One depth buffer for every swap chain image, frames are ordered around it by the passes' dependencies.
+	VkFormat m_depthFormat;
+	VkImage m_depthImage;
+	VkDeviceMemory m_depthMemory;
+	VkImageView m_depthImageView;
+
 	// Rendering and pipeline.
+	uint32_t m_instanceApiVersion;
+	bool m_useDynamicRendering;								// When set there is no render pass and no framebuffers.
+	PFN_vkCmdBeginRenderingKHR m_pfnCmdBeginRendering;
+	PFN_vkCmdEndRenderingKHR m_pfnCmdEndRendering;
+	bool m_useMeshletCulling;								// Needs drawIndirectFirstInstance, otherwise meshes are drawn whole.
+	bool m_useMeshShaders;
+	bool m_useDeferredShading;								// The main passes light a G-buffer in a second subpass. Needs the render pass path.
+	bool m_useVirtualTexture;								// There's a backdrop page file, and fragment shaders can write its feedback.
+	bool m_useStreamedBackdrop;								// Otherwise the backdrop is a KTX2 texture, if there's one of those.
 	VkRenderPass m_renderPass;
+	VkRenderPass m_earlyRenderPass;							// The frame split around the depth pyramid, compatible with m_renderPass.
+	VkRenderPass m_lateRenderPass;
 	VkPipelineLayout m_pipelineLayout;
 	VkPipeline m_graphicsPipeline;
+	VkPipelineLayout m_meshPipelineLayout;		// Scene meshes, quantised vertices in, see mesh.vert.
+	VkPipeline m_meshPipeline;
+	VkPipeline m_meshletPipeline;				// Culled meshlets through the vertex pipeline, see meshlet.vert.
+	VkPipeline m_meshletMeshPipeline;			// Or through mesh shaders, see meshlet.mesh.
+	VkPipelineLayout m_backdropPipelineLayout;	// Behind everything, from the virtual texture or a streamed texture, see backdrop.frag.
+	VkPipeline m_backdropPipeline;
 
-	// Frame buffers
-	std::vector<VkFramebuffer> m_vSwapChainFramebuffers;
+	// Frame buffers. The scene's targets are shared by every swap chain image, like depth.
+	VkFramebuffer m_sceneFramebuffer;
 
 	// Command pool
 	VkCommandPool m_commandPool;
@@ -148,6 +290,108 @@ private:
 	std::vector<VkFence> m_vImagesInFlight;
 	uint32_t m_currentFrame;
 
+	// Present policy. Sync objects exist for the maximum frames in flight, the policy decides how many are used.
+	PresentPolicy m_presentPolicy;
+	PresentPolicy m_requestedPresentPolicy;
+	uint32_t m_framesInFlight;
+	PresentStats m_presentStats[static_cast<size_t>(PresentPolicy::Count)];
+	PresentStats::Clock::time_point m_pendingInputTime;
+	bool m_hasPendingInput;
+
+	// Render thread. Everything below the atomics is only touched by it once it has started.
+	std::thread m_renderThread;
+	std::atomic<bool> m_rendering;
+	std::atomic<bool> m_renderFailed;
+	std::atomic<uint64_t> m_windowState;				// Latest framebuffer size and minimised flag, zero once the render thread has it.
+	std::atomic<PresentStats::Clock::rep> m_inputTicks;	// Oldest input the render thread hasn't seen, zero for none.
+	std::exception_ptr m_renderError;
+	std::unique_ptr<RingBuffer<WindowEvent>> m_windowEvents;
+	uint32_t m_framebufferWidth;
+	uint32_t m_framebufferHeight;
+	bool m_minimized;
+
+	// Textures
+	TextureStreamer m_textureStreamer;
+	VirtualTexture m_virtualTexture;
+	TextureHandle m_backdropTexture;
+	VkDescriptorSetLayout m_backdropSetLayout;
+	VkDescriptorPool m_backdropDescriptorPool;
+	std::vector<VkDescriptorSet> m_vBackdropSets;			// One per frame in flight, pointed at the texture's current view as its mips arrive.
+
+	// Shared by anything that can be split up: culling, recording, decoding, simulation.
+	JobSystem m_jobs;
+
+	// Scene, and what the renderer pulled out of it to draw.
+	EntityRegistry m_scene;
+	TransformHierarchy m_transforms;
+	std::vector<DrawItem> m_vDrawList;
+
+	// Everything drawable and its world bounds, indexed the same as the BVH's objects. Culling and picking go through the BVH.
+	std::vector<DrawItem> m_vDrawables;
+	std::vector<Aabb> m_vDrawableBounds;
+	std::vector<uint32_t> m_vVisibleDrawables;	// Scratch, this frame's frustum query.
+	Bvh m_sceneBvh;
+
+	// Full detail meshes are culled a meshlet at a time on the GPU, after the BVH has dropped whole objects.
+	MeshletCuller m_meshletCuller;
+	std::vector<MeshletDraw> m_vMeshletDraws;		// Scratch, this frame's, kept to save reallocating.
+
+	// Built from the early pass's depth every frame, the late meshlet pass is culled against it.
+	DepthPyramid m_depthPyramid;
+
+	// Every Light in the scene, gathered each frame and binned on the GPU for the lit pipelines.
+	ClusteredLights m_lights;
+	std::vector<GpuLight> m_vFrameLights;
+
+	// The G-buffer and lighting subpass when shading is deferred.
+	DeferredLighting m_deferred;
+
+	// The scene is drawn at a scale of the window's resolution that holds the GPU frame time, then upscaled to it.
+	DynamicResolution m_resolution;
+	GpuTimer m_gpuTimer;
+
+	// Turns the HDR scene into what's upscaled, fused into one dispatch or not. Each way's GPU time is kept apart.
+	PostProcess m_postProcess;
+	bool m_fusedPostProcess;
+	GpuScopeStats m_postStats[2];				// Unfused, then fused.
+
+	// How each frame slot last recorded it, so its time is credited to the right variant at the right size.
+	struct PostFrame
+	{
+		bool fused;
+		uint64_t pixels;
+	};
+	std::vector<PostFrame> m_vPostFrames;
+
+	// The sun's shadows, sampled through the light set.
+	ShadowCascades m_shadows;
+	std::vector<uint32_t> m_vShadowCasters;		// Scratch for each cascade's query of the scene BVH.
+
+	// Geometry from the scene file, every mesh in one vertex and one index buffer.
+	std::vector<SceneMesh> m_vSceneMeshes;
+	std::vector<SceneLod> m_vSceneLods;
+	VkBuffer m_sceneVertexBuffer;
+	VkDeviceMemory m_sceneVertexMemory;
+	VkBuffer m_sceneIndexBuffer;
+	VkDeviceMemory m_sceneIndexMemory;
+
+	// What mesh.vert is pushed per draw. 128 bytes, the most every device is guaranteed to take.
+	struct MeshPushConstants
+	{
+		Float4x4 clipFromVertex;	// View projection * world * the mesh's dequantisation.
+		Float4x4 world;
+	};
+
+	// There's no camera yet, so this stays the identity and world space is clip space. Culling uses it too.
+	Float4x4 m_viewProjection;
+
+	// World matrices for the GPU, one buffer per frame in flight, persistently mapped.
+	std::vector<VkBuffer> m_vInstanceBuffers;
+	std::vector<VkDeviceMemory> m_vInstanceMemory;
+
+	// Start up timing, reported once the first frame has been presented.
+	StartupProfiler m_startupProfiler;
+
 	// Explicit resize variable required because VK_ERROR_OUT_OF_DATE_KHR is not guaranteed to be triggered on all systems.
 	bool m_framebufferResized;
 };
@@ -9,8 +9,11 @@
 #include <vector>
 #include <optional>
 #include <fstream>
+#include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
+#include "HostAllocator.h"
+
 inline std::vector<char> ReadFile(const std::string& filename)
 {
 	// Start reading from the back, treat as binary file.
@@ -72,6 +75,168 @@ inline void DestroyDebugUtilsMessengerExt
 	}
 }
 
+// Names show up in validation messages, which makes them a lot easier to trace back. Does nothing without debug utils.
+inline void SetDebugObjectName(VkInstance instance, VkDevice device, VkObjectType type, uint64_t handle, const char* pName)
+{
+	const auto FUNC = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+
+	if (FUNC != nullptr)
+	{
+		VkDebugUtilsObjectNameInfoEXT nameInfo{};
+		nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+		nameInfo.objectType = type;
+		nameInfo.objectHandle = handle;
+		nameInfo.pObjectName = pName;
+
+		FUNC(device, &nameInfo);
+	}
+}
+
+// Find a memory type that satisfies both the resource's requirements and the properties we ask for.
+inline uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+// Create a buffer and bind freshly allocated memory to it. One allocation per buffer, fine for a handful of long lived buffers.
+inline void CreateBuffer
+(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags properties,
+	VkBuffer& buffer,
+	VkDeviceMemory& bufferMemory
+)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, GetAllocationCallbacks(), &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+
+	if (vkAllocateMemory(device, &allocInfo, GetAllocationCallbacks(), &bufferMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate buffer memory!");
+	}
+
+	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+}
+
+// Create an image and bind freshly allocated memory to it.
+inline void CreateImage
+(
+	VkPhysicalDevice physicalDevice,
+	VkDevice device,
+	const VkImageCreateInfo& imageInfo,
+	VkMemoryPropertyFlags properties,
+	VkImage& image,
+	VkDeviceMemory& imageMemory
+)
+{
+	if (vkCreateImage(device, &imageInfo, GetAllocationCallbacks(), &image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+
+	if (vkAllocateMemory(device, &allocInfo, GetAllocationCallbacks(), &imageMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate image memory!");
+	}
+
+	vkBindImageMemory(device, image, imageMemory, 0);
+}
+
+// Load a SPIR-V file straight into a shader module.
+inline VkShaderModule LoadShaderModule(VkDevice device, const std::string& filename)
+{
+	const std::vector<char> CODE = ReadFile(filename);
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = CODE.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(CODE.data()); // Default allocator satisfies uint32_t alignment.
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(device, &createInfo, GetAllocationCallbacks(), &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+// Record and submit a short lived command buffer, then wait for it. Only for load time work, never inside the frame loop.
+template <typename RecordFunc>
+inline void SubmitImmediate(VkDevice device, VkCommandPool pool, VkQueue queue, RecordFunc&& record)
+{
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = pool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	record(commandBuffer);
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit immediate command buffer!");
+	}
+
+	vkQueueWaitIdle(queue);
+	vkFreeCommandBuffers(device, pool, 1, &commandBuffer);
+}
+
 struct QueueFamilyIndices
 {
 	std::optional<uint32_t> graphicsFamily;
@@ -0,0 +1,22 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Messages from the GLFW thread to the render thread.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <cstdint>
+
+// Plain data, these are copied through a RingBuffer. Only key commands come this way,
+// the window's size and input timing just need their latest value, see VulkanApp::PostWindowState and PostInput.
+struct WindowEvent
+{
+	enum class Type : uint32_t
+	{
+		CyclePresentPolicy,
+		TogglePostFusion
+	};
+
+	Type type;
+};
@@ -0,0 +1,114 @@
+//==============================================================================================================//
+//	Project:		Vulkan Renderer
+//	Description:	Fixed size Chase-Lev work stealing deque.
+//	Author:			Dom McCollum
+//==============================================================================================================//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+/*
+	The owning thread pushes and pops at the bottom, like a stack, so it works on whatever is hottest in its cache.
+	Any other thread may steal from the top. Only the last element is contended, a compare exchange on top decides it.
+	Memory orders follow Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models".
+
+	Unlike the paper the buffer never grows, a full deque refuses the push and the caller runs the work itself.
+*/
+template<typename T>
+class WorkStealingDeque
+{
+public:
+
+	explicit WorkStealingDeque(size_t capacity) :
+		m_mask(static_cast<int64_t>(capacity) - 1),
+		m_buffer(new std::atomic<T>[capacity]),
+		m_top(0),
+		m_bottom(0)
+	{
+		if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		{
+			throw std::runtime_error("Work stealing deque capacity must be a power of two!");
+		}
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	// Owner only.
+	_NODISCARD bool Push(T value)
+	{
+		const int64_t BOTTOM = m_bottom.load(std::memory_order_relaxed);
+		const int64_t TOP = m_top.load(std::memory_order_acquire);
+
+		if (BOTTOM - TOP > m_mask)
+		{
+			return false; // Full.
+		}
+
+		m_buffer[BOTTOM & m_mask].store(value, std::memory_order_relaxed);
+		m_bottom.store(BOTTOM + 1, std::memory_order_release); // The paper's release fence, as a store so thread sanitizer can follow it.
+		return true;
+	}
+
+	// Owner only.
+	_NODISCARD bool Pop(T& value)
+	{
+		const int64_t BOTTOM = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(BOTTOM, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > BOTTOM)
+		{
+			m_bottom.store(BOTTOM + 1, std::memory_order_relaxed); // Empty.
+			return false;
+		}
+
+		value = m_buffer[BOTTOM & m_mask].load(std::memory_order_relaxed);
+		if (top != BOTTOM)
+		{
+			return true; // More than one left, no thief can reach this one.
+		}
+
+		// Last element, race the thieves for it.
+		const bool WON = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		m_bottom.store(BOTTOM + 1, std::memory_order_relaxed);
+		return WON;
+	}
+
+	// Any thread.
+	_NODISCARD bool Steal(T& value)
+	{
+		int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t BOTTOM = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= BOTTOM)
+		{
+			return false; // Empty.
+		}
+
+		value = m_buffer[top & m_mask].load(std::memory_order_relaxed);
+		return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	// A snapshot, only good as a hint.
+	_NODISCARD bool Empty() const
+	{
+		return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	const int64_t m_mask;
+	std::unique_ptr<std::atomic<T>[]> m_buffer;
+
+	// Thieves hammer top, the owner hammers bottom.
+	alignas(64) std::atomic<int64_t> m_top;
+	alignas(64) std::atomic<int64_t> m_bottom;
+};